@@ -0,0 +1,94 @@
+// Thread scaling of FleetSimulator::apply_parallel.
+//
+//   g++ -O2 -std=c++14 -pthread Benchmark/FleetScalingBenchmark.cpp -o scaling
+//   ./scaling [max_threads] [steps]
+//
+// Every thread count is checked bit for bit against the single-threaded run.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "../Intermediate/ProjectFiles/FleetSimulator.hpp"
+
+static void populate(FleetSimulator& fleet, size_t count) {
+    Vector3f wheel_relative_location[4] = {
+        Vector3f(100.f, 100.f, -50.f), Vector3f(100.f, -100.f, -50.f),
+        Vector3f(-100.f, 100.f, -50.f), Vector3f(-100.f, -100.f, -50.f)};
+    for (size_t v = 0; v < count; v++) {
+        Vector3f location(500.f * (v % 1000), 500.f * (v / 1000), 70.f);
+        Vector3f velocity(0.5f * (v % 7), -0.5f * (v % 5), 0.f);
+        int handle = fleet.add_vehicle(
+            100.f, 20.f, location, Quaternionf::Identity(),
+            Vector3f(150.f, 150.f, 50.f), 20.f, velocity, Vector3f::Zero(),
+            Vector3f::Zero(), wheel_relative_location);
+        for (int i = 0; i < 4; i++) {
+            Vector3f hit_point = fleet.get_wheel_location(handle, i);
+            hit_point(2) = 0.f;
+            fleet.set_hit_point(handle, i, &hit_point);
+        }
+    }
+}
+
+static bool same_state(FleetSimulator& a, FleetSimulator& b) {
+    for (size_t v = 0; v < a.size(); v++) {
+        int handle = (int)v;
+        if (a.get_body_location(handle) != b.get_body_location(handle))
+            return false;
+        for (int i = 0; i < 4; i++) {
+            if (a.get_wheel_location(handle, i) !=
+                    b.get_wheel_location(handle, i) ||
+                a.get_wheel_linear_velocity(handle, i) !=
+                    b.get_wheel_linear_velocity(handle, i))
+                return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (argc > 1)
+        max_threads = (size_t)atoi(argv[1]);
+    if (max_threads < 1)
+        max_threads = 1;
+    int steps = argc > 2 ? atoi(argv[2]) : 100;
+    const size_t sizes[] = {100, 1000, 10000, 100000};
+    const float delta_time = 0.016f;
+
+    printf("%10s %8s %14s %18s %8s %s\n", "vehicles", "threads", "steps/s",
+           "vehicle-steps/s", "speedup", "identical");
+    for (size_t count : sizes) {
+        int count_steps = (int)(steps * (100000 / count));
+        if (count_steps > 100000)
+            count_steps = 100000;
+
+        FleetSimulator reference;
+        populate(reference, count);
+        for (int s = 0; s < count_steps; s++)
+            reference.apply(delta_time);
+
+        double base_rate = 0.0;
+        for (size_t threads = 1; threads <= max_threads; threads++) {
+            FleetThreadPool pool(threads);
+            FleetSimulator fleet;
+            populate(fleet, count);
+
+            auto start = std::chrono::steady_clock::now();
+            for (int s = 0; s < count_steps; s++)
+                fleet.apply_parallel(pool, delta_time);
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+
+            double rate = count_steps / elapsed.count();
+            if (threads == 1)
+                base_rate = rate;
+            printf("%10zu %8zu %14.1f %18.4g %7.2fx %s\n", count, threads,
+                   rate, rate * count, rate / base_rate,
+                   same_state(reference, fleet) ? "yes" : "NO");
+        }
+    }
+    return 0;
+}
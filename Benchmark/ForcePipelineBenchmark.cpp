@@ -0,0 +1,149 @@
+// ForcePipeline vs ParticleForceRegistry on the Vehicle4WSimulator force set,
+// one registry/pipeline per vehicle as in Vehicle4WSimulator.
+//
+//   g++ -O2 -std=c++14 Benchmark/ForcePipelineBenchmark.cpp -o force_pipeline
+//   ./force_pipeline [vehicles] [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../Intermediate/ProjectFiles/ForcePipeline.hpp"
+#include "../Intermediate/ProjectFiles/ParticleForceRegistry.hpp"
+
+typedef ForcePipeline<Gravity, Spring, Contact, Friction, FrameConstraint>
+    BenchPipeline;
+
+// five particles wired like one Vehicle4WSimulator
+struct BenchVehicle {
+    Particle* body;
+    Particle* wheel[4];
+    float normal_length_body[4];
+    float normal_length_wheel[4];
+};
+
+static Vector3f ground(0.f, 0.f, 0.f);
+
+static void build(std::vector<BenchVehicle>& vehicles, int count) {
+    vehicles.resize(count);
+    for (int v = 0; v < count; v++) {
+        BenchVehicle& bv = vehicles[v];
+        Vector3f velocity(0.1f * (v % 7), -0.1f * (v % 5), 0.f);
+        bv.body = new Particle(100.f, Vector3f(0.f, 0.f, 0.f),
+                               Quaternionf::Identity(), velocity,
+                               Vector3f::Zero());
+        for (int i = 0; i < 4; i++) {
+            bv.wheel[i] = new Particle(
+                20.f, Vector3f(i < 2 ? 100.f : -100.f, i % 2 ? 100.f : -100.f,
+                               -50.f),
+                Quaternionf::Identity(), velocity, Vector3f::Zero());
+            bv.wheel[i]->update_hit_point(&ground);
+            bv.normal_length_body[i] = 50.f + 2.5f;
+            bv.normal_length_wheel[i] = -bv.normal_length_body[i];
+        }
+    }
+}
+
+template <typename Registry>
+static void add_all(Registry& registry, BenchVehicle& bv) {
+    Vector3f gravity(0.f, 0.f, -10.f);
+    registry.add(bv.body, new Gravity(gravity));
+    for (int i = 0; i < 4; i++)
+        registry.add(bv.wheel[i], new Gravity(gravity));
+    registry.add(bv.body,
+                 new Spring(bv.wheel, 4, 100.f, bv.normal_length_body));
+    for (int i = 0; i < 4; i++)
+        registry.add(bv.wheel[i], new Spring(&bv.body, 1, 100.f,
+                                             bv.normal_length_wheel + i));
+    for (int i = 0; i < 4; i++)
+        registry.add(bv.wheel[i], new Contact(300.f, 0.2f));
+    for (int i = 0; i < 4; i++)
+        registry.add(bv.wheel[i], new Friction(1.f, 10.f));
+    registry.add(bv.body, new FrameConstraint(bv.wheel, 4));
+}
+
+// ForcePipeline stores generators by value
+struct PipelineAdapter {
+    BenchPipeline* pipeline;
+
+    template <typename G>
+    void add(Particle* particle, G* fg) {
+        pipeline->add(particle, *fg);
+        delete fg;
+    }
+};
+
+static void reset(std::vector<BenchVehicle>& vehicles) {
+    for (BenchVehicle& bv : vehicles) {
+        bv.body->apply_force(0.f);
+        for (int i = 0; i < 4; i++)
+            bv.wheel[i]->apply_force(0.f);
+    }
+}
+
+// registries == nullptr times the reset alone
+template <typename Registry>
+static double run(std::vector<Registry>* registries,
+                  std::vector<BenchVehicle>& vehicles,
+                  int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        if (registries) {
+            for (Registry& registry : *registries)
+                registry.update_forces(0.016f);
+        }
+        reset(vehicles);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    int vehicle_count = argc > 1 ? atoi(argv[1]) : 1000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 1000;
+    // registrations per vehicle: 5 gravity, 5 spring, 4 contact, 4 friction,
+    // 1 frame constraint
+    double registrations = 19.0 * vehicle_count * iterations;
+
+    std::vector<BenchVehicle> registry_vehicles, pipeline_vehicles;
+    build(registry_vehicles, vehicle_count);
+    build(pipeline_vehicles, vehicle_count);
+
+    std::vector<ParticleForceRegistry> registries(vehicle_count);
+    std::vector<BenchPipeline> pipelines(vehicle_count);
+    for (int v = 0; v < vehicle_count; v++) {
+        add_all(registries[v], registry_vehicles[v]);
+        PipelineAdapter adapter = {&pipelines[v]};
+        add_all(adapter, pipeline_vehicles[v]);
+    }
+
+    // same inputs must produce the same state
+    for (int v = 0; v < vehicle_count; v++) {
+        registries[v].update_forces(0.016f);
+        pipelines[v].update_forces(0.016f);
+        registry_vehicles[v].body->apply_force(0.016f);
+        pipeline_vehicles[v].body->apply_force(0.016f);
+        if (registry_vehicles[v].body->get_location() !=
+            pipeline_vehicles[v].body->get_location()) {
+            printf("mismatch at vehicle %d\n", v);
+            return 1;
+        }
+    }
+
+    double reset_time = run<BenchPipeline>(nullptr, pipeline_vehicles,
+                                           iterations);
+    double registry_time =
+        run(&registries, registry_vehicles, iterations) - reset_time;
+    double pipeline_time =
+        run(&pipelines, pipeline_vehicles, iterations) - reset_time;
+
+    printf("vehicles %d, iterations %d\n", vehicle_count, iterations);
+    printf("ParticleForceRegistry %8.2f ns/registration\n",
+           registry_time * 1e9 / registrations);
+    printf("ForcePipeline         %8.2f ns/registration\n",
+           pipeline_time * 1e9 / registrations);
+    printf("speedup               %8.2fx\n", registry_time / pipeline_time);
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Accuracy vs cost of the Vehicle4WSimulator integrators.
+//
+//   cmake --build build --target integrator_benchmark
+//   ./build/integrator_benchmark
+//
+// suspension: the vehicle falls freely with its body pushed 10 units off
+// the spring rest length, for 4 s. Error is the largest body or wheel z
+// deviation from an RK4 run at dt = 1e-4.
+// landing: dropped from 100 units onto flat ground and run for 5 s; stable
+// means the state stayed finite and the body came to rest above ground.
+// Cost is wall time per simulated second.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "../Intermediate/ProjectFiles/GroundQuery.hpp"
+#include "../Intermediate/ProjectFiles/Vehicle4WSimulator.hpp"
+
+static Vector3f wheel_relative_location[4] = {
+    Vector3f(100.f, 100.f, -50.f), Vector3f(100.f, -100.f, -50.f),
+    Vector3f(-100.f, 100.f, -50.f), Vector3f(-100.f, -100.f, -50.f)};
+
+static std::unique_ptr<Vehicle4WSimulator> make_vehicle(
+    Integrator integrator,
+    float height,
+    float body_offset) {
+    std::unique_ptr<Vehicle4WSimulator> vehicle(new Vehicle4WSimulator(
+        100.f, 20.f, Vector3f(0.f, 0.f, height), Quaternionf::Identity(),
+        Vector3f(150.f, 150.f, 50.f), 20.f, Vector3f::Zero(),
+        Vector3f::Zero(), Vector3f(0.f, 0.f, body_offset),
+        wheel_relative_location));
+    vehicle->set_integrator(integrator);
+    return vehicle;
+}
+
+struct Sample {
+    float body_z;
+    float wheel_z[4];
+};
+
+static Sample run_suspension(Integrator integrator,
+                             float delta_time,
+                             float seconds) {
+    std::unique_ptr<Vehicle4WSimulator> vehicle =
+        make_vehicle(integrator, 1000.f, 10.f);
+    Vector3f* airborne[4] = {nullptr, nullptr, nullptr, nullptr};
+    int steps = (int)lround(seconds / delta_time);
+    for (int s = 0; s < steps; s++)
+        vehicle->apply(airborne, delta_time);
+
+    Sample sample;
+    sample.body_z = vehicle->get_body_relative_location()(2);
+    for (int i = 0; i < 4; i++)
+        sample.wheel_z[i] = vehicle->get_wheel_relative_location(i)(2);
+    return sample;
+}
+
+static float max_error(const Sample& a, const Sample& b) {
+    float error = fabs(a.body_z - b.body_z);
+    for (int i = 0; i < 4; i++)
+        error = fmax(error, fabs(a.wheel_z[i] - b.wheel_z[i]));
+    return error;
+}
+
+static bool run_landing(Integrator integrator,
+                        float delta_time,
+                        const GroundQuery& ground,
+                        float* rest_z) {
+    std::unique_ptr<Vehicle4WSimulator> vehicle =
+        make_vehicle(integrator, 170.f, 0.f);
+    int steps = (int)lround(5.f / delta_time);
+    for (int s = 0; s < steps; s++)
+        vehicle->apply(ground, delta_time);
+    *rest_z = vehicle->get_body_location()(2);
+    return std::isfinite(*rest_z) && *rest_z > 0.f && *rest_z < 200.f;
+}
+
+int main() {
+    const float seconds = 4.f;
+    const float delta_times[] = {0.005f, 0.01f, 0.02f, 0.04f, 0.08f, 0.16f};
+    const int evaluations[INTEGRATOR_COUNT] = {1, 2, 4, 1};
+
+    std::vector<float> heights(4, 0.f);
+    HeightfieldGround ground(Vector2f(-5000.f, -5000.f), 10000.f, 2, 2,
+                             heights);
+    Sample reference = run_suspension(INTEGRATOR_RK4, 1e-4f, seconds);
+
+    printf("%-17s %6s %6s %12s %14s %8s %8s\n", "integrator", "dt",
+           "evals", "error", "ns/sim-second", "landing", "rest z");
+    for (int k = 0; k < INTEGRATOR_COUNT; k++) {
+        Integrator integrator = (Integrator)k;
+        for (float delta_time : delta_times) {
+            // repeat until the timing is long enough to trust
+            Sample sample;
+            int runs = 0;
+            auto start = std::chrono::steady_clock::now();
+            double elapsed = 0.0;
+            while (elapsed < 0.05) {
+                sample = run_suspension(integrator, delta_time, seconds);
+                runs++;
+                elapsed = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+            }
+            float rest_z;
+            bool stable = run_landing(integrator, delta_time, ground, &rest_z);
+            printf("%-17s %6.3f %6d %12.4g %14.0f %8s %8.2f\n",
+                   integrator_name(integrator), delta_time, evaluations[k],
+                   max_error(sample, reference),
+                   elapsed * 1e9 / (runs * seconds),
+                   stable ? "stable" : "UNSTABLE", rest_z);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,555 @@
+// Per-stage benchmarks of the simulator core (Google Benchmark).
+//
+//   cmake -S Headless -B build && cmake --build build
+//   ./build/simulator_benchmark --benchmark_out=current.json
+//                               --benchmark_out_format=json
+//   python3 Benchmark/compare_benchmarks.py baseline.json current.json
+//
+// Every case runs on a vehicle resting on flat ground, so the state stays
+// bounded however many iterations the library picks. Generator cases only
+// accumulate force (nothing is integrated), which is all they time.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "../Intermediate/ProjectFiles/FleetLod.hpp"
+#include "../Intermediate/ProjectFiles/FleetSimulator.hpp"
+#include "../Intermediate/ProjectFiles/GroundQuery.hpp"
+#include "../Intermediate/ProjectFiles/ParticleForceRegistry.hpp"
+#include "../Intermediate/ProjectFiles/PhysicsThread.hpp"
+#include "../Intermediate/ProjectFiles/Trajectory.hpp"
+#include "../Intermediate/ProjectFiles/Vehicle4WSimulator.hpp"
+
+#define BENCH_DELTA_TIME 0.016f
+
+static Vector3f wheel_relative_location[4] = {
+    Vector3f(100.f, 100.f, -50.f), Vector3f(100.f, -100.f, -50.f),
+    Vector3f(-100.f, 100.f, -50.f), Vector3f(-100.f, -100.f, -50.f)};
+
+// five particles wired like one Vehicle4WSimulator, wheels on z = -70
+struct StageVehicle {
+    Particle body;
+    Particle wheel0, wheel1, wheel2, wheel3;
+    Particle* wheel[4];
+    Particle* body_ptr;
+    float normal_length_body[4];
+    float normal_length_wheel[4];
+    Vector3f hit_point[4];
+
+    StageVehicle()
+        : body(100.f, Vector3f::Zero(), Quaternionf::Identity(),
+               Vector3f(0.5f, -0.5f, 0.f), Vector3f::Zero()),
+          wheel0(particle_at(0)),
+          wheel1(particle_at(1)),
+          wheel2(particle_at(2)),
+          wheel3(particle_at(3)),
+          body_ptr(&body) {
+        wheel[0] = &wheel0, wheel[1] = &wheel1;
+        wheel[2] = &wheel2, wheel[3] = &wheel3;
+        for (int i = 0; i < 4; i++) {
+            normal_length_body[i] = 50.f + 2.5f;
+            normal_length_wheel[i] = -normal_length_body[i];
+            hit_point[i] = wheel_relative_location[i] - Vector3f(0, 0, 20.f);
+            wheel[i]->update_hit_point(&hit_point[i]);
+        }
+    }
+
+    static Particle particle_at(int i) {
+        return Particle(20.f, wheel_relative_location[i],
+                        Quaternionf::Identity(), Vector3f(0.5f, -0.5f, 0.f),
+                        Vector3f::Zero());
+    }
+
+    // the Vehicle4WSimulator registration set, in its order
+    void register_all(ParticleForceRegistry& registry,
+                      vector<unique_ptr<ForceGenerator>>& owned) {
+        Vector3f gravity(0.f, 0.f, -10.f);
+        auto add = [&](Particle* particle, ForceGenerator* fg) {
+            owned.emplace_back(fg);
+            registry.add(particle, fg);
+        };
+        add(&body, new Gravity(gravity));
+        for (int i = 0; i < 4; i++)
+            add(wheel[i], new Gravity(gravity));
+        add(&body, new Spring(wheel, 4, 100.f, normal_length_body));
+        for (int i = 0; i < 4; i++)
+            add(wheel[i],
+                new Spring(&body_ptr, 1, 100.f, normal_length_wheel + i));
+        for (int i = 0; i < 4; i++)
+            add(wheel[i], new Contact(300.f, 0.2f));
+        for (int i = 0; i < 4; i++)
+            add(wheel[i], new Friction(1.f, 10.f));
+        add(&body, new FrameConstraint(wheel, 4));
+    }
+};
+
+static void BM_ParticleApplyForce(benchmark::State& state) {
+    Particle particle(20.f, Vector3f::Zero(), Quaternionf::Identity(),
+                      Vector3f::Zero(), Vector3f::Zero());
+    for (auto _ : state) {
+        particle.update_force(Vector3f(0.f, 0.f, 1.f));
+        particle.apply_force(BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    benchmark::DoNotOptimize(particle.get_location());
+}
+BENCHMARK(BM_ParticleApplyForce);
+
+// one virtual update_force call, as the registry makes it
+static void run_generator(benchmark::State& state,
+                          Particle* particle,
+                          ForceGenerator* fg) {
+    for (auto _ : state) {
+        fg->update_force(particle, BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    benchmark::DoNotOptimize(particle->get_location());
+}
+
+static void BM_Gravity(benchmark::State& state) {
+    StageVehicle vehicle;
+    Gravity fg(Vector3f(0.f, 0.f, -10.f));
+    run_generator(state, &vehicle.body, &fg);
+}
+BENCHMARK(BM_Gravity);
+
+static void BM_SpringBody(benchmark::State& state) {
+    StageVehicle vehicle;
+    Spring fg(vehicle.wheel, 4, 100.f, vehicle.normal_length_body);
+    run_generator(state, &vehicle.body, &fg);
+}
+BENCHMARK(BM_SpringBody);
+
+static void BM_SpringWheel(benchmark::State& state) {
+    StageVehicle vehicle;
+    Spring fg(&vehicle.body_ptr, 1, 100.f, vehicle.normal_length_wheel);
+    run_generator(state, vehicle.wheel[0], &fg);
+}
+BENCHMARK(BM_SpringWheel);
+
+static void BM_Contact(benchmark::State& state) {
+    StageVehicle vehicle;
+    Contact fg(300.f, 0.2f);
+    run_generator(state, vehicle.wheel[0], &fg);
+}
+BENCHMARK(BM_Contact);
+
+static void BM_Friction(benchmark::State& state) {
+    StageVehicle vehicle;
+    Friction fg(1.f, 10.f);
+    run_generator(state, vehicle.wheel[0], &fg);
+}
+BENCHMARK(BM_Friction);
+
+static void BM_FrameConstraint(benchmark::State& state) {
+    StageVehicle vehicle;
+    FrameConstraint fg(vehicle.wheel, 4);
+    run_generator(state, &vehicle.body, &fg);
+}
+BENCHMARK(BM_FrameConstraint);
+
+// the 19 registrations of one vehicle
+static void BM_RegistryUpdateForces(benchmark::State& state) {
+    StageVehicle vehicle;
+    ParticleForceRegistry registry;
+    vector<unique_ptr<ForceGenerator>> owned;
+    vehicle.register_all(registry, owned);
+    for (auto _ : state) {
+        registry.update_forces(BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    state.counters["registrations"] = (double)owned.size();
+}
+BENCHMARK(BM_RegistryUpdateForces);
+
+static Vehicle4WSimulator* make_vehicle(Vector3f location) {
+    return new Vehicle4WSimulator(
+        100.f, 20.f, location, Quaternionf::Identity(),
+        Vector3f(150.f, 150.f, 50.f), 20.f, Vector3f::Zero(),
+        Vector3f::Zero(), Vector3f::Zero(), wheel_relative_location);
+}
+
+static Vector3f fleet_location(int v) {
+    return Vector3f(500.f * (v % 100), 500.f * (v / 100), 70.f);
+}
+
+static void BM_Vehicle4WSimulatorApply(benchmark::State& state) {
+    unique_ptr<Vehicle4WSimulator> vehicle(make_vehicle(fleet_location(0)));
+    Vector3f hit_point[4];
+    Vector3f* hit_point_arr[4];
+    for (int i = 0; i < 4; i++) {
+        hit_point[i] = vehicle->get_wheel_location(i);
+        hit_point[i](2) = 0.f;
+        hit_point_arr[i] = &hit_point[i];
+    }
+    for (auto _ : state) {
+        vehicle->apply(hit_point_arr, BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Vehicle4WSimulatorApply);
+
+// an AI driver steering every step
+static void BM_Vehicle4WSimulatorTurnApply(benchmark::State& state) {
+    unique_ptr<Vehicle4WSimulator> vehicle(make_vehicle(fleet_location(0)));
+    Vector3f hit_point[4];
+    Vector3f* hit_point_arr[4];
+    for (int i = 0; i < 4; i++) {
+        hit_point[i] = vehicle->get_wheel_location(i);
+        hit_point[i](2) = 0.f;
+        hit_point_arr[i] = &hit_point[i];
+    }
+    for (auto _ : state) {
+        vehicle->turn(true);
+        vehicle->apply(hit_point_arr, BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Vehicle4WSimulatorTurnApply);
+
+static unique_ptr<GroundQuery> flat_ground() {
+    vector<float> heights(4, 0.f);
+    return unique_ptr<GroundQuery>(new HeightfieldGround(
+        Vector2f(-5000.f, -5000.f), 60000.f, 2, 2, heights));
+}
+
+// Vehicle4WSimulator::apply including its wheel sweeps
+static void BM_Vehicle4WSimulatorApplyGround(benchmark::State& state) {
+    unique_ptr<GroundQuery> ground = flat_ground();
+    unique_ptr<Vehicle4WSimulator> vehicle(make_vehicle(fleet_location(0)));
+    for (auto _ : state) {
+        vehicle->apply(*ground, BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Vehicle4WSimulatorApplyGround);
+
+// the same with the contact cache, which sweeps a resting vehicle's wheels
+// once every max_age seconds
+static void BM_Vehicle4WSimulatorApplyGroundCached(benchmark::State& state) {
+    unique_ptr<GroundQuery> ground = flat_ground();
+    unique_ptr<Vehicle4WSimulator> vehicle(make_vehicle(fleet_location(0)));
+    vehicle->set_contact_cache(20.f, 0.25f);
+    for (auto _ : state) {
+        vehicle->apply(*ground, BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Vehicle4WSimulatorApplyGroundCached);
+
+// axles axles of two wheels, 150 apart along x
+static shared_ptr<const VehicleArchetype> axle_archetype(int axles) {
+    VehicleArchetypeDesc desc;
+    Vector3f axle[VEHICLE_MAX_WHEELS / 2];
+    for (int k = 0; k < axles; k++) {
+        axle[k] = Vector3f(75.f * (axles - 1) - 150.f * k, 100.f, -50.f);
+    }
+    desc.set_axles(axle, axles);
+    return make_vehicle_archetype(desc);
+}
+
+// apply with sweeps on range(0) axles; the fixed wheel counts against the
+// runtime-sized simulator on the same vehicle
+template <typename Simulator>
+static void BM_AxlesApplyGround(benchmark::State& state) {
+    unique_ptr<GroundQuery> ground = flat_ground();
+    unique_ptr<Simulator> vehicle(
+        new Simulator(axle_archetype((int)state.range(0)), fleet_location(0),
+                      Quaternionf::Identity(), Vector3f::Zero(),
+                      Vector3f::Zero()));
+    for (auto _ : state) {
+        vehicle->apply(*ground, BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    state.counters["wheels"] = (double)vehicle->get_wheel_count();
+}
+BENCHMARK_TEMPLATE(BM_AxlesApplyGround, Vehicle4WSimulator)->Arg(2);
+BENCHMARK_TEMPLATE(BM_AxlesApplyGround, Vehicle6WSimulator)->Arg(3);
+BENCHMARK_TEMPLATE(BM_AxlesApplyGround, VehicleNWSimulator)
+    ->Arg(2)
+    ->Arg(3)
+    ->Arg(9);
+
+// apply on the tire model with the brakes held and the wheels steered, per
+// kernel level; compare with BM_AxlesApplyGround/2
+static void BM_TireModelApplyGround(benchmark::State& state) {
+    FleetKernelLevel level = (FleetKernelLevel)state.range(0);
+    if (level > detect_fleet_kernel_level()) {
+        state.SkipWithError("kernel level not supported on this CPU");
+        return;
+    }
+    VehicleArchetypeDesc desc;
+    Vector3f axle[2] = {Vector3f(75.f, 100.f, -50.f),
+                        Vector3f(-75.f, 100.f, -50.f)};
+    desc.set_axles(axle, 2);
+    desc.tire_model = true;
+    desc.suspension_damping = 40.f;
+    unique_ptr<GroundQuery> ground = flat_ground();
+    unique_ptr<Vehicle4WSimulator> vehicle(new Vehicle4WSimulator(
+        make_vehicle_archetype(desc), fleet_location(0),
+        Quaternionf::Identity(), Vector3f::Zero(), Vector3f::Zero()));
+    vehicle->set_kernel_level(level);
+    VehicleCommand command = {0.0, 0.f, 1.f, 0.5f};
+    vehicle->submit(command);
+    for (auto _ : state) {
+        vehicle->apply(*ground, BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_TireModelApplyGround)
+    ->Arg(FLEET_KERNEL_SCALAR)
+    ->Arg(FLEET_KERNEL_SSE2)
+    ->Arg(FLEET_KERNEL_AVX2);
+
+// what the game thread is left with when a PhysicsThread steps the vehicle
+// at 1 kHz: take the latest state, sweep from it, hand the hits back and
+// blend; compare with BM_Vehicle4WSimulatorApplyGround
+static void BM_PhysicsThreadFrame(benchmark::State& state) {
+    unique_ptr<GroundQuery> ground = flat_ground();
+    unique_ptr<Vehicle4WSimulator> vehicle(make_vehicle(fleet_location(0)));
+    PhysicsThread physics(vehicle.get(), 0.001f);
+    physics.start();
+    Vector3f centers[4];
+    float radii[4];
+    GroundHit hits[4];
+    WheelGroundHits ground_hits;
+    for (auto _ : state) {
+        const VehiclePublication& p = physics.acquire();
+        for (int i = 0; i < 4; i++) {
+            centers[i] = p.wheel_location[i];
+            radii[i] = p.wheel_radius;
+        }
+        ground->sweep_spheres(centers, radii, 4, GROUND_SWEEP_DISTANCE, hits,
+                              ground_hits.hit);
+        for (int i = 0; i < 4; i++) {
+            ground_hits.point[i] = hits[i].point;
+            ground_hits.normal[i] = hits[i].normal;
+        }
+        physics.submit_ground(ground_hits);
+        VehicleRenderState blended =
+            interpolate(p.previous, p.current, physics.get_alpha(p));
+        benchmark::DoNotOptimize(blended);
+    }
+    physics.stop();
+}
+BENCHMARK(BM_PhysicsThreadFrame);
+
+static void BM_SnapshotSave(benchmark::State& state) {
+    unique_ptr<Vehicle4WSimulator> vehicle(make_vehicle(fleet_location(0)));
+    VehicleSnapshot snapshot;
+    for (auto _ : state) {
+        vehicle->save_snapshot(&snapshot);
+        benchmark::DoNotOptimize(&snapshot);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            Vehicle4WSimulator::snapshot_size());
+}
+BENCHMARK(BM_SnapshotSave);
+
+static void BM_SnapshotRestore(benchmark::State& state) {
+    unique_ptr<Vehicle4WSimulator> vehicle(make_vehicle(fleet_location(0)));
+    VehicleSnapshot snapshot;
+    vehicle->save_snapshot(&snapshot);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vehicle->restore_snapshot(&snapshot));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            Vehicle4WSimulator::snapshot_size());
+}
+BENCHMARK(BM_SnapshotRestore);
+
+// rolls back Arg frames and re-simulates them, saving each one again, as a
+// rollback netcode tick would
+static void BM_Rollback(benchmark::State& state) {
+    int frames = (int)state.range(0);
+    unique_ptr<GroundQuery> ground = flat_ground();
+    unique_ptr<Vehicle4WSimulator> vehicle(make_vehicle(fleet_location(0)));
+    SnapshotRing ring(Vehicle4WSimulator::snapshot_size(), frames + 1);
+    for (int f = 0; f <= frames; f++) {
+        vehicle->save_snapshot(ring.push(f));
+        vehicle->apply(*ground, BENCH_DELTA_TIME);
+    }
+    Vector3f expected = vehicle->get_body_location();
+
+    for (auto _ : state) {
+        vehicle->restore_snapshot(ring.find(0));
+        ring.truncate(0);
+        for (int f = 1; f <= frames; f++) {
+            vehicle->apply(*ground, BENCH_DELTA_TIME);
+            vehicle->save_snapshot(ring.push(f));
+        }
+        vehicle->apply(*ground, BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    if (vehicle->get_body_location() != expected)
+        state.SkipWithError("re-simulation diverged from the first run");
+    state.counters["frames"] = benchmark::Counter(
+        (double)state.iterations() * frames, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Rollback)->Arg(8)->Arg(32);
+
+static void populate(FleetSimulator& fleet, int count) {
+    for (int v = 0; v < count; v++) {
+        int handle = fleet.add_vehicle(
+            100.f, 20.f, fleet_location(v), Quaternionf::Identity(),
+            Vector3f(150.f, 150.f, 50.f), 20.f, Vector3f::Zero(),
+            Vector3f::Zero(), Vector3f::Zero(), wheel_relative_location);
+        for (int i = 0; i < 4; i++) {
+            Vector3f hit_point = fleet.get_wheel_location(handle, i);
+            hit_point(2) = 0.f;
+            fleet.set_hit_point(handle, i, &hit_point);
+        }
+    }
+}
+
+static void set_vehicle_rate(benchmark::State& state) {
+    state.counters["vehicle_steps"] = benchmark::Counter(
+        (double)state.iterations() * state.range(0),
+        benchmark::Counter::kIsRate);
+}
+
+// one step of state.range(0) vehicles: Vehicle4WSimulator each
+static void BM_VehicleLoopStep(benchmark::State& state) {
+    vector<unique_ptr<Vehicle4WSimulator>> vehicles;
+    vector<Vector3f> hit_points;
+    for (int v = 0; v < state.range(0); v++) {
+        vehicles.emplace_back(make_vehicle(fleet_location(v)));
+        for (int i = 0; i < 4; i++) {
+            hit_points.push_back(vehicles.back()->get_wheel_location(i));
+            hit_points.back()(2) = 0.f;
+        }
+    }
+    for (auto _ : state) {
+        for (size_t v = 0; v < vehicles.size(); v++) {
+            Vector3f* hit_point_arr[4];
+            for (int i = 0; i < 4; i++)
+                hit_point_arr[i] = &hit_points[v * 4 + i];
+            vehicles[v]->apply(hit_point_arr, BENCH_DELTA_TIME);
+        }
+        benchmark::ClobberMemory();
+    }
+    set_vehicle_rate(state);
+}
+BENCHMARK(BM_VehicleLoopStep)->Arg(1)->Arg(100)->Arg(10000);
+
+// ... and FleetSimulator
+static void BM_FleetStep(benchmark::State& state) {
+    FleetSimulator fleet;
+    populate(fleet, (int)state.range(0));
+    for (auto _ : state) {
+        fleet.apply(BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    set_vehicle_rate(state);
+}
+BENCHMARK(BM_FleetStep)->Arg(1)->Arg(100)->Arg(10000);
+
+// FleetSimulator with the ground query in the step
+static void BM_FleetStepGround(benchmark::State& state) {
+    unique_ptr<GroundQuery> ground = flat_ground();
+    FleetSimulator fleet;
+    populate(fleet, (int)state.range(0));
+    for (auto _ : state) {
+        fleet.query_ground(*ground);
+        fleet.apply(BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    set_vehicle_rate(state);
+}
+BENCHMARK(BM_FleetStepGround)->Arg(1)->Arg(100)->Arg(10000);
+
+// as BM_FleetStepGround, re-tiered every step for a viewer in one corner of
+// the grid; vehicle_steps still counts every vehicle
+static void BM_FleetStepLod(benchmark::State& state) {
+    unique_ptr<GroundQuery> ground = flat_ground();
+    FleetSimulator fleet;
+    populate(fleet, (int)state.range(0));
+    FleetLod lod;
+    Vector3f viewer(0.f, 0.f, 500.f);
+    for (auto _ : state) {
+        lod.update(fleet, &viewer, 1);
+        fleet.query_ground(*ground);
+        fleet.apply(BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    set_vehicle_rate(state);
+}
+BENCHMARK(BM_FleetStepLod)->Arg(1)->Arg(100)->Arg(10000);
+
+// as BM_FleetStepGround with every 16th vehicle driving and the rest
+// settled and asleep; vehicle_steps still counts every vehicle
+static void BM_FleetStepParked(benchmark::State& state) {
+    unique_ptr<GroundQuery> ground = flat_ground();
+    FleetSimulator fleet;
+    populate(fleet, (int)state.range(0));
+    fleet.set_sleep(FLEET_SLEEP_STEPS);
+    VehicleCommandBuffer batch;
+    for (int v = 0; v < (int)fleet.size(); v += 16)
+        batch.push(v, 0., 0.5f, 0.f, 0.f);
+    fleet.submit(batch);
+    for (int step = 0; step < 2 * FLEET_SLEEP_STEPS; step++) {
+        fleet.query_ground(*ground);
+        fleet.apply(BENCH_DELTA_TIME);
+    }
+    for (auto _ : state) {
+        fleet.query_ground(*ground);
+        fleet.apply(BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    set_vehicle_rate(state);
+}
+BENCHMARK(BM_FleetStepParked)->Arg(1)->Arg(100)->Arg(10000);
+
+// a new command for every vehicle each step, submitted as one batch, as AI
+// drivers would; compare with BM_FleetStep
+static void BM_FleetStepCommands(benchmark::State& state) {
+    FleetSimulator fleet;
+    populate(fleet, (int)state.range(0));
+    VehicleCommandBuffer batch;
+    batch.reserve(fleet.size());
+    int step = 0;
+    for (auto _ : state) {
+        float steer = (step++ & 1) ? 0.25f : -0.25f;
+        for (int v = 0; v < (int)fleet.size(); v++)
+            batch.push(v, fleet.get_time(), 0.5f, 0.f, steer);
+        fleet.submit(batch);
+        fleet.apply(BENCH_DELTA_TIME);
+        benchmark::ClobberMemory();
+    }
+    set_vehicle_rate(state);
+}
+BENCHMARK(BM_FleetStepCommands)->Arg(1)->Arg(100)->Arg(10000);
+
+// one recorded frame of an Arg-vehicle fleet, every column, segment
+// remapping included; compare with BM_FleetStepGround
+static void BM_TrajectoryRecordFleet(benchmark::State& state) {
+    const char* path = "simulator_benchmark.traj";
+    FleetSimulator fleet;
+    populate(fleet, (int)state.range(0));
+    // the file grows with every frame, so start over every ~300 MB
+    TrajectoryRecorder recorder;
+    for (auto _ : state) {
+        if (!recorder.is_open() ||
+            recorder.get_frame_count() * fleet.size() >= (1 << 20)) {
+            state.PauseTiming();
+            if (!recorder.open(path, (uint32_t)fleet.size(),
+                               BENCH_DELTA_TIME))
+                state.SkipWithError("cannot create the trajectory file");
+            state.ResumeTiming();
+        }
+        recorder.begin_frame();
+        recorder.record(fleet);
+        recorder.end_frame();
+    }
+    recorder.close();
+    remove(path);
+    set_vehicle_rate(state);
+}
+BENCHMARK(BM_TrajectoryRecordFleet)->Arg(1)->Arg(100)->Arg(10000);
+
+BENCHMARK_MAIN();
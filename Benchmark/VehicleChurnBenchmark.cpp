@@ -0,0 +1,174 @@
+// Spawn/despawn churn: every round a quarter of the live vehicles is torn
+// down and replaced, then the set is stepped once. Prints heap allocations
+// per round, allocations still live and resident set size, for
+// Vehicle4WSimulator and for FleetSimulator.
+//
+//   cmake --build build --target vehicle_churn_benchmark
+//   ./build/vehicle_churn_benchmark [vehicles] [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "../Intermediate/ProjectFiles/FleetSimulator.hpp"
+#include "../Intermediate/ProjectFiles/Vehicle4WSimulator.hpp"
+
+static size_t allocation_count = 0;
+static size_t free_count = 0;
+
+void* operator new(size_t size) {
+    allocation_count++;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// GCC pairs the inlined free() with the operator new above and takes the
+// replacements for a mismatch
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept {
+    if (p)
+        free_count++;
+    free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+static long rss_kb() {
+#ifdef __linux__
+    FILE* statm = fopen("/proc/self/statm", "r");
+    long pages = 0, resident = 0;
+    if (statm) {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+    return resident * 4;
+#else
+    return -1;
+#endif
+}
+
+static Vector3f wheel_relative_location[4] = {
+    Vector3f(100.f, 100.f, -50.f), Vector3f(100.f, -100.f, -50.f),
+    Vector3f(-100.f, 100.f, -50.f), Vector3f(-100.f, -100.f, -50.f)};
+
+static Vector3f spawn_location(int slot) {
+    return Vector3f(500.f * (slot % 100), 500.f * (slot / 100), 70.f);
+}
+
+struct RoundStats {
+    size_t allocations;
+    size_t frees;
+};
+
+static void print_header(const char* name) {
+    printf("%s\n%6s %12s %12s %12s %10s\n", name, "round", "allocs/round",
+           "frees/round", "live allocs", "rss KB");
+}
+
+static void print_round(int round, const RoundStats& start) {
+    printf("%6d %12zu %12zu %12zu %10ld\n", round,
+           allocation_count - start.allocations, free_count - start.frees,
+           allocation_count - free_count, rss_kb());
+}
+
+static void churn_vehicles(int count, int rounds) {
+    std::mt19937 random(1);
+    std::vector<std::unique_ptr<Vehicle4WSimulator>> vehicles(count);
+    // every vehicle shares the block, as spawners are expected to
+    std::shared_ptr<const VehicleArchetype> archetype =
+        make_vehicle_archetype(vehicle_archetype_desc(
+            100.f, 20.f, Vector3f(150.f, 150.f, 50.f), 20.f,
+            Vector3f::Zero(), wheel_relative_location));
+    auto spawn = [&](int slot) {
+        vehicles[slot].reset(new Vehicle4WSimulator(
+            archetype, spawn_location(slot), Quaternionf::Identity(),
+            Vector3f::Zero(), Vector3f::Zero()));
+    };
+
+    print_header("Vehicle4WSimulator");
+    RoundStats start = {allocation_count, free_count};
+    for (int slot = 0; slot < count; slot++)
+        spawn(slot);
+    print_round(0, start);
+
+    size_t overflow = 0;
+    double seconds = 0.0;
+    for (int round = 1; round <= rounds; round++) {
+        start = {allocation_count, free_count};
+        auto begin = std::chrono::steady_clock::now();
+        for (int k = 0; k < count / 4; k++) {
+            int slot = (int)(random() % count);
+            vehicles[slot].reset();
+            spawn(slot);
+        }
+        seconds += std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - begin)
+                       .count();
+        for (int slot = 0; slot < count; slot++) {
+            Vector3f* hit_point_arr[4] = {nullptr, nullptr, nullptr, nullptr};
+            vehicles[slot]->apply(hit_point_arr, 0.016f);
+            overflow += vehicles[slot]->get_arena_overflow_count();
+        }
+        print_round(round, start);
+    }
+    printf("respawn %.1f ns/vehicle, arena overflows %zu\n\n",
+           seconds * 1e9 / (rounds * (count / 4)), overflow);
+}
+
+static void churn_fleet(int count, int rounds) {
+    std::mt19937 random(1);
+    FleetSimulator fleet;
+    std::vector<int> handles(count);
+    auto spawn = [&](int slot) {
+        handles[slot] = fleet.add_vehicle(
+            100.f, 20.f, spawn_location(slot), Quaternionf::Identity(),
+            Vector3f(150.f, 150.f, 50.f), 20.f, Vector3f::Zero(),
+            Vector3f::Zero(), Vector3f::Zero(), wheel_relative_location);
+    };
+
+    print_header("FleetSimulator");
+    RoundStats start = {allocation_count, free_count};
+    for (int slot = 0; slot < count; slot++)
+        spawn(slot);
+    print_round(0, start);
+
+    double seconds = 0.0;
+    for (int round = 1; round <= rounds; round++) {
+        start = {allocation_count, free_count};
+        auto begin = std::chrono::steady_clock::now();
+        for (int k = 0; k < count / 4; k++) {
+            int slot = (int)(random() % count);
+            fleet.remove_vehicle(handles[slot]);
+            spawn(slot);
+        }
+        seconds += std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - begin)
+                       .count();
+        fleet.apply(0.016f);
+        print_round(round, start);
+    }
+    printf("respawn %.1f ns/vehicle\n",
+           seconds * 1e9 / (rounds * (count / 4)));
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 10;
+    if (count < 4)
+        count = 4;
+    churn_vehicles(count, rounds);
+    churn_fleet(count, rounds);
+    return 0;
+}
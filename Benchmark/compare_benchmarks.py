@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""Compare two Google Benchmark JSON reports and flag regressions.
+
+    python3 Benchmark/compare_benchmarks.py baseline.json current.json \
+        [--threshold 0.05] [--metric cpu_time|real_time]
+
+Prints one line per benchmark present in both reports and exits with 1 when
+any of them got slower by more than the threshold (relative), 0 otherwise.
+With --benchmark_repetitions the median aggregate is compared.
+"""
+
+import argparse
+import json
+import sys
+
+NS_PER_UNIT = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path, metric):
+    with open(path) as f:
+        report = json.load(f)
+    times = {}
+    medians = {}
+    for bench in report.get("benchmarks", []):
+        if bench.get("error_occurred"):
+            continue
+        name = bench.get("run_name", bench["name"])
+        ns = bench[metric] * NS_PER_UNIT[bench.get("time_unit", "ns")]
+        if bench.get("run_type") == "aggregate":
+            if bench.get("aggregate_name") == "median":
+                medians[name] = ns
+        elif name not in times:
+            times[name] = ns
+    times.update(medians)
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="allowed relative slowdown (default 0.05)")
+    parser.add_argument("--metric", default="cpu_time",
+                        choices=["cpu_time", "real_time"])
+    args = parser.parse_args()
+
+    baseline = load(args.baseline, args.metric)
+    current = load(args.current, args.metric)
+
+    regressions = 0
+    width = max([len(name) for name in baseline] + [9])
+    print("%-*s %14s %14s %9s" % (width, "benchmark", "baseline ns",
+                                  "current ns", "change"))
+    for name in baseline:
+        if name not in current:
+            print("%-*s %14s" % (width, name, "missing"))
+            continue
+        old, new = baseline[name], current[name]
+        change = (new - old) / old if old > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  improved"
+        print("%-*s %14.1f %14.1f %+8.1f%%%s" % (width, name, old, new,
+                                                 change * 100, flag))
+    for name in current:
+        if name not in baseline:
+            print("%-*s %14s" % (width, name, "new"))
+
+    if regressions:
+        print("%d regression(s) beyond %.1f%%" % (regressions,
+                                                  args.threshold * 100))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,216 @@
+#ifndef _RUNNER_HPP_
+#define _RUNNER_HPP_
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "FleetLod.hpp"
+#include "FleetSimulator.hpp"
+#include "FleetThreadPool.hpp"
+#include "Scenario.hpp"
+#include "Trajectory.hpp"
+#include "Vehicle4WSimulator.hpp"
+#include "VehicleHitch.hpp"
+
+// Steps a parsed scenario for its frames, the way vehicle4w_headless and
+// the regression tests run it. Both modes return vehicle 0's body location
+// and record every frame to recorder while it is open.
+
+// applies the inputs of frame, starting at *next
+template <typename Move, typename Turn>
+inline void dispatch_inputs(const Scenario& scenario,
+                            int frame,
+                            size_t* next,
+                            Move move,
+                            Turn turn) {
+    const vector<ScenarioInput>& inputs = scenario.inputs;
+    for (; *next < inputs.size() && inputs[*next].frame <= frame; (*next)++) {
+        const ScenarioInput& input = inputs[*next];
+        if (input.vehicle >= scenario.vehicles)
+            continue;
+        int begin = input.vehicle < 0 ? 0 : input.vehicle;
+        int end = input.vehicle < 0 ? scenario.vehicles : input.vehicle + 1;
+        for (int v = begin; v < end; v++) {
+            switch (input.command) {
+                case SCENARIO_FORWARD:
+                    move(v, true);
+                    break;
+                case SCENARIO_BACKWARD:
+                    move(v, false);
+                    break;
+                case SCENARIO_LEFT:
+                    turn(v, true);
+                    break;
+                case SCENARIO_RIGHT:
+                    turn(v, false);
+                    break;
+            }
+        }
+    }
+}
+
+// calls submit(v, command) for every drive command of the scenario
+template <typename Submit>
+inline void submit_drives(const Scenario& scenario, Submit submit) {
+    for (const ScenarioDrive& drive : scenario.drives) {
+        if (drive.vehicle >= scenario.vehicles)
+            continue;
+        int begin = drive.vehicle < 0 ? 0 : drive.vehicle;
+        int end = drive.vehicle < 0 ? scenario.vehicles : drive.vehicle + 1;
+        for (int v = begin; v < end; v++)
+            submit(v, drive.command);
+    }
+}
+
+// lod_sizes receives the awake vehicles per tier after the last frame,
+// *asleep the sleeping ones
+inline Vector3f run_fleet(const Scenario& scenario,
+                          const GroundQuery& ground,
+                          size_t threads,
+                          size_t chunk,
+                          TrajectoryRecorder* recorder,
+                          size_t* lod_sizes,
+                          size_t* asleep) {
+    FleetSimulator fleet;
+    VehicleArchetype archetype(scenario.vehicle);
+    for (int v = 0; v < scenario.vehicles; v++) {
+        fleet.add_vehicle(archetype, scenario.vehicle_location(v),
+                          Quaternionf::Identity(), scenario.linear_velocity,
+                          Vector3f::Zero());
+    }
+
+    // the whole script in one batch; handles are the vehicle indices
+    VehicleCommandBuffer batch;
+    submit_drives(scenario, [&](int v, const VehicleCommand& command) {
+        batch.push(v, command);
+    });
+    fleet.submit(batch);
+
+    FleetLod lod(scenario.lod_full_distance, scenario.lod_rigid_distance);
+    fleet.set_far_interval(scenario.far_interval);
+    fleet.set_sleep(scenario.sleep_steps, scenario.sleep_velocity);
+
+    FleetThreadPool pool(threads);
+    size_t next = 0;
+    for (int frame = 0; frame < scenario.frames; frame++) {
+        dispatch_inputs(
+            scenario, frame, &next,
+            [&](int v, bool forward) { fleet.move(v, forward); },
+            [&](int v, bool left) { fleet.turn(v, left); });
+        if (scenario.lod)
+            lod.update(fleet, scenario.viewers.data(),
+                       scenario.viewers.size());
+        pool.parallel_for(fleet.chunk_count(chunk), [&](size_t c) {
+            size_t begin = c * chunk;
+            size_t end = min(begin + chunk, fleet.size());
+            fleet.query_ground(ground, begin, end);
+            fleet.apply_range(begin, end, scenario.delta_time);
+        });
+        fleet.advance_time(scenario.delta_time);
+        if (recorder->begin_frame()) {
+            recorder->record(fleet);
+            recorder->end_frame();
+        }
+    }
+    for (int t = 0; t < VEHICLE_LOD_COUNT; t++)
+        lod_sizes[t] = fleet.lod_size((VehicleLod)t);
+    *asleep = fleet.asleep_size();
+    return fleet.get_body_location(0);
+}
+
+// trajectory files hold four-wheel vehicles; main() refuses to record others
+inline void record_vehicle(TrajectoryRecorder* recorder,
+                           int v,
+                           Vehicle4WSimulator& vehicle) {
+    recorder->record(v, vehicle);
+}
+
+template <typename Simulator>
+inline void record_vehicle(TrajectoryRecorder*, int, Simulator&) {}
+
+// *trailer receives the body location of vehicle 0's trailer, if any
+template <typename Simulator>
+inline Vector3f run_vehicles(const Scenario& scenario,
+                             const GroundQuery& ground,
+                             TrajectoryRecorder* recorder,
+                             Vector3f* trailer) {
+    typedef VehicleHitch<Simulator, VehicleNWSimulator> Hitch;
+    vector<unique_ptr<Simulator>> vehicles;
+    vector<unique_ptr<VehicleNWSimulator>> trailers;
+    vector<unique_ptr<Hitch>> hitches;
+    // one constant block for the whole run
+    shared_ptr<const VehicleArchetype> archetype =
+        make_vehicle_archetype(scenario.vehicle);
+    shared_ptr<const VehicleArchetype> trailer_archetype =
+        make_vehicle_archetype(scenario.trailer_vehicle);
+    for (int v = 0; v < scenario.vehicles; v++) {
+        vehicles.emplace_back(new Simulator(
+            archetype, scenario.vehicle_location(v), Quaternionf::Identity(),
+            scenario.linear_velocity, Vector3f::Zero()));
+        vehicles.back()->set_integrator(scenario.integrator);
+        vehicles.back()->set_contact_cache(scenario.contact_tolerance,
+                                           scenario.contact_max_age);
+        if (!scenario.trailer)
+            continue;
+        trailers.emplace_back(new VehicleNWSimulator(
+            trailer_archetype, scenario.trailer_location(v),
+            Quaternionf::Identity(), scenario.linear_velocity,
+            Vector3f::Zero()));
+        trailers.back()->set_integrator(scenario.integrator);
+        trailers.back()->set_contact_cache(scenario.contact_tolerance,
+                                           scenario.contact_max_age);
+        hitches.emplace_back(new Hitch(
+            vehicles.back().get(), scenario.tow_offset, trailers.back().get(),
+            scenario.hitch_offset, scenario.hitch_stiffness,
+            scenario.hitch_damping));
+    }
+    submit_drives(scenario, [&](int v, const VehicleCommand& command) {
+        vehicles[v]->submit(command);
+    });
+
+    size_t next = 0;
+    for (int frame = 0; frame < scenario.frames; frame++) {
+        dispatch_inputs(
+            scenario, frame, &next,
+            [&](int v, bool forward) { vehicles[v]->move(forward); },
+            [&](int v, bool left) { vehicles[v]->turn(left); });
+        for (auto& hitch : hitches)
+            hitch->update();
+        for (auto& vehicle : vehicles)
+            vehicle->apply(ground, scenario.delta_time);
+        for (auto& unit : trailers)
+            unit->apply(ground, scenario.delta_time);
+        if (recorder->begin_frame()) {
+            for (int v = 0; v < scenario.vehicles; v++)
+                record_vehicle(recorder, v, *vehicles[v]);
+            recorder->end_frame();
+        }
+    }
+    if (!trailers.empty())
+        *trailer = trailers[0]->get_body_location();
+    // the hitches point into the units
+    hitches.clear();
+    return vehicles[0]->get_body_location();
+}
+
+// the unrolled simulators for the common wheel counts, the runtime-sized
+// one for the rest
+inline Vector3f run_vehicles(const Scenario& scenario,
+                             const GroundQuery& ground,
+                             TrajectoryRecorder* recorder,
+                             Vector3f* trailer) {
+    switch (scenario.vehicle.wheel_count) {
+        case 4:
+            return run_vehicles<Vehicle4WSimulator>(scenario, ground,
+                                                    recorder, trailer);
+        case 6:
+            return run_vehicles<Vehicle6WSimulator>(scenario, ground,
+                                                    recorder, trailer);
+        default:
+            return run_vehicles<VehicleNWSimulator>(scenario, ground,
+                                                    recorder, trailer);
+    }
+}
+
+#endif
@@ -0,0 +1,501 @@
+#ifndef _SCENARIO_HPP_
+#define _SCENARIO_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Eigen/Eigen/Dense"
+#include "GroundQuery.hpp"
+#include "Integrator.hpp"
+#include "VehicleArchetype.hpp"
+#include "VehicleCommand.hpp"
+using namespace std;
+using namespace Eigen;
+
+// Line-based scenario description for the headless runner. '#' starts a
+// comment; every other line is a key followed by its values:
+//
+//   dt 0.016
+//   frames 1000
+//   vehicles 100                      (laid out on a square grid)
+//   spacing 500
+//   spawn_height 70
+//   archetype <file>                  (VehicleArchetype.hpp JSON; the
+//                                     vehicle keys below override it)
+//   body_mass 100
+//   wheel_mass 20
+//   wheel_radius 20
+//   body_extent 150 150 50
+//   body_location 0 0 0               (relative to the vehicle origin)
+//   wheels 4                          (2..18)
+//   wheel_location <i> 100 100 -50    (i < wheels, relative to the origin)
+//   linear_velocity 0 0 0
+//   integrator symplectic_euler       (verlet, rk4, implicit_spring)
+//   terrain flat <z>
+//   terrain waves <amplitude> <wavelength> <cell>
+//   terrain heightfield <file> <cell> (file: size_x size_y, then heights)
+//   terrain obj <file> <cell>         (v / f records, faces fan-triangulated)
+//   input <frame> <vehicle|all> forward|backward|left|right
+//   drive <time> <vehicle|all> <throttle> <brake> <steer>
+//                                     (analog axes held from time on)
+//   lod <full> <rigid> <far_interval> (fleet mode: simulation detail by
+//                                     distance to the nearest viewer)
+//   viewer <x> <y> <z>                (one line per viewer)
+//   sleep <steps> <velocity>          (fleet mode: vehicles resting for
+//                                     steps steps fall asleep)
+//   trailer <file> <tow x y z> <hitch x y z> <stiffness> <damping>
+//                                     (vehicle mode: every vehicle tows a
+//                                     trailer of archetype file, hitch on
+//                                     its body linked to tow on the
+//                                     vehicle's; see VehicleHitch.hpp)
+//   contact_cache <tolerance> <max_age>
+//                                     (vehicle mode: wheels reuse their
+//                                     last ground contact until they moved
+//                                     tolerance or max_age seconds passed)
+//
+// Relative file names resolve against the scenario's directory.
+
+enum ScenarioCommand {
+    SCENARIO_FORWARD,
+    SCENARIO_BACKWARD,
+    SCENARIO_LEFT,
+    SCENARIO_RIGHT
+};
+
+struct ScenarioInput {
+    int frame;
+    // -1 addresses every vehicle
+    int vehicle;
+    ScenarioCommand command;
+};
+
+struct ScenarioDrive {
+    // -1 addresses every vehicle
+    int vehicle;
+    VehicleCommand command;
+};
+
+struct Scenario {
+    float delta_time;
+    int frames;
+    int vehicles;
+    float spacing;
+    float spawn_height;
+
+    // every vehicle is of this archetype
+    VehicleArchetypeDesc vehicle;
+    Vector3f linear_velocity;
+    Integrator integrator;
+
+    string terrain;
+    vector<float> terrain_args;
+    string terrain_file;
+
+    // sorted by frame
+    vector<ScenarioInput> inputs;
+    // in file order
+    vector<ScenarioDrive> drives;
+
+    // FleetLod distances and FleetSimulator::set_far_interval; lod is set
+    // when the scenario has a lod line
+    bool lod;
+    float lod_full_distance;
+    float lod_rigid_distance;
+    int far_interval;
+    vector<Vector3f> viewers;
+
+    // FleetSimulator::set_sleep; 0 steps keeps every vehicle awake
+    int sleep_steps;
+    float sleep_velocity;
+
+    // VehicleHitch parameters; trailer is set when the scenario has a
+    // trailer line
+    bool trailer;
+    VehicleArchetypeDesc trailer_vehicle;
+    Vector3f tow_offset;
+    Vector3f hitch_offset;
+    float hitch_stiffness;
+    float hitch_damping;
+
+    // VehicleSimulator::set_contact_cache; 0 sweeps every step
+    float contact_tolerance;
+    float contact_max_age;
+
+    Scenario()
+        : delta_time(0.016f),
+          frames(1000),
+          vehicles(1),
+          spacing(500.f),
+          spawn_height(70.f),
+          linear_velocity(Vector3f::Zero()),
+          integrator(INTEGRATOR_SYMPLECTIC_EULER),
+          terrain("flat"),
+          terrain_args(1, 0.f),
+          lod(false),
+          lod_full_distance(0.f),
+          lod_rigid_distance(0.f),
+          far_interval(0),
+          sleep_steps(0),
+          sleep_velocity(0.f),
+          trailer(false),
+          tow_offset(Vector3f::Zero()),
+          hitch_offset(Vector3f::Zero()),
+          hitch_stiffness(0.f),
+          hitch_damping(0.f),
+          contact_tolerance(0.f),
+          contact_max_age(0.f) {}
+
+    int grid_columns() const {
+        return max((int)ceil(sqrt((float)vehicles)), 1);
+    }
+
+    Vector3f vehicle_location(int v) const {
+        int columns = grid_columns();
+        return Vector3f(spacing * (v % columns), spacing * (v / columns),
+                        spawn_height);
+    }
+
+    // places vehicle v's trailer so the hitch points meet
+    Vector3f trailer_location(int v) const {
+        return vehicle_location(v) + vehicle.body_relative_location +
+               tow_offset - trailer_vehicle.body_relative_location -
+               hitch_offset;
+    }
+
+    // XY bounds of the spawn grid, grown by margin
+    void bounds(float margin, Vector2f* lo, Vector2f* hi) const {
+        int columns = grid_columns();
+        int rows = (vehicles + columns - 1) / columns;
+        *lo = Vector2f(-margin, -margin);
+        *hi = Vector2f(spacing * (columns - 1) + margin,
+                       spacing * max(rows - 1, 0) + margin);
+    }
+};
+
+class ScenarioParser {
+    string path;
+    int line_number;
+
+    [[noreturn]] void fail(const string& message) const {
+        ostringstream out;
+        out << path << ":" << line_number << ": " << message;
+        throw runtime_error(out.str());
+    }
+
+    template <typename T>
+    T read(istringstream& in, const char* what) {
+        T value;
+        if (!(in >> value))
+            fail(string("expected ") + what);
+        return value;
+    }
+
+    Vector3f read_vector(istringstream& in) {
+        float x = read<float>(in, "x");
+        float y = read<float>(in, "y");
+        float z = read<float>(in, "z");
+        return Vector3f(x, y, z);
+    }
+
+    string resolve(const string& file) const {
+        if (file.empty() || file[0] == '/')
+            return file;
+        size_t slash = path.find_last_of("/\\");
+        return slash == string::npos ? file : path.substr(0, slash + 1) + file;
+    }
+
+    void parse_terrain(istringstream& in, Scenario* scenario) {
+        string kind = read<string>(in, "terrain kind");
+        scenario->terrain_args.clear();
+        scenario->terrain_file.clear();
+        int count;
+        if (kind == "flat") {
+            count = 1;
+        } else if (kind == "waves") {
+            count = 3;
+        } else if (kind == "heightfield" || kind == "obj") {
+            scenario->terrain_file = resolve(read<string>(in, "file name"));
+            count = 1;
+        } else {
+            fail("unknown terrain '" + kind + "'");
+        }
+        for (int k = 0; k < count; k++)
+            scenario->terrain_args.push_back(read<float>(in, "number"));
+        // wavelength and cell sizes
+        int first = kind == "flat" ? count : kind == "waves" ? 1 : 0;
+        for (int k = first; k < count; k++) {
+            if (scenario->terrain_args[k] <= 0.f)
+                fail("sizes must be positive");
+        }
+        scenario->terrain = kind;
+    }
+
+    int read_vehicle(istringstream& in) {
+        string target = read<string>(in, "vehicle");
+        if (target == "all")
+            return -1;
+        istringstream number(target);
+        int vehicle;
+        if (!(number >> vehicle) || vehicle < 0)
+            fail("expected vehicle index or 'all'");
+        return vehicle;
+    }
+
+    void parse_input(istringstream& in, Scenario* scenario) {
+        ScenarioInput input;
+        input.frame = read<int>(in, "frame");
+        input.vehicle = read_vehicle(in);
+        string command = read<string>(in, "command");
+        if (command == "forward") {
+            input.command = SCENARIO_FORWARD;
+        } else if (command == "backward") {
+            input.command = SCENARIO_BACKWARD;
+        } else if (command == "left") {
+            input.command = SCENARIO_LEFT;
+        } else if (command == "right") {
+            input.command = SCENARIO_RIGHT;
+        } else {
+            fail("unknown command '" + command + "'");
+        }
+        scenario->inputs.push_back(input);
+    }
+
+    void parse_drive(istringstream& in, Scenario* scenario) {
+        ScenarioDrive drive;
+        drive.command.time = read<double>(in, "time");
+        drive.vehicle = read_vehicle(in);
+        drive.command.throttle = read<float>(in, "throttle");
+        drive.command.brake = read<float>(in, "brake");
+        drive.command.steer = read<float>(in, "steer");
+        scenario->drives.push_back(drive);
+    }
+
+    void parse_trailer(istringstream& in, Scenario* scenario) {
+        string file = resolve(read<string>(in, "file name"));
+        string error;
+        if (!load_vehicle_archetype(file, &scenario->trailer_vehicle, &error))
+            fail(error);
+        scenario->tow_offset = read_vector(in);
+        scenario->hitch_offset = read_vector(in);
+        scenario->hitch_stiffness = read<float>(in, "stiffness");
+        scenario->hitch_damping = read<float>(in, "damping");
+        if (scenario->hitch_stiffness < 0.f || scenario->hitch_damping < 0.f)
+            fail("expected non-negative stiffness and damping");
+        scenario->trailer = true;
+    }
+
+    void parse_line(const string& line, Scenario* scenario) {
+        istringstream in(line.substr(0, line.find('#')));
+        string key;
+        if (!(in >> key))
+            return;
+
+        if (key == "dt") {
+            scenario->delta_time = read<float>(in, "time step");
+        } else if (key == "frames") {
+            scenario->frames = read<int>(in, "frame count");
+        } else if (key == "vehicles") {
+            scenario->vehicles = read<int>(in, "vehicle count");
+        } else if (key == "spacing") {
+            scenario->spacing = read<float>(in, "spacing");
+        } else if (key == "spawn_height") {
+            scenario->spawn_height = read<float>(in, "height");
+        } else if (key == "archetype") {
+            string file = resolve(read<string>(in, "file name"));
+            string error;
+            if (!load_vehicle_archetype(file, &scenario->vehicle, &error))
+                fail(error);
+        } else if (key == "body_mass") {
+            scenario->vehicle.body_mass = read<float>(in, "mass");
+        } else if (key == "wheel_mass") {
+            scenario->vehicle.wheel_mass = read<float>(in, "mass");
+        } else if (key == "wheel_radius") {
+            scenario->vehicle.wheel_radius = read<float>(in, "radius");
+        } else if (key == "body_extent") {
+            scenario->vehicle.body_box_extent = read_vector(in);
+        } else if (key == "body_location") {
+            scenario->vehicle.body_relative_location = read_vector(in);
+        } else if (key == "wheels") {
+            int count = read<int>(in, "wheel count");
+            if (count < VEHICLE_MIN_WHEELS || count > VEHICLE_MAX_WHEELS)
+                fail("wheel count must be 2..18");
+            scenario->vehicle.wheel_count = count;
+        } else if (key == "wheel_location") {
+            int i = read<int>(in, "wheel index");
+            if (i < 0 || i >= VEHICLE_MAX_WHEELS)
+                fail("wheel index must be 0..17");
+            scenario->vehicle.wheel_relative_location[i] = read_vector(in);
+        } else if (key == "linear_velocity") {
+            scenario->linear_velocity = read_vector(in);
+        } else if (key == "integrator") {
+            string name = read<string>(in, "integrator");
+            scenario->integrator = integrator_from_name(name.c_str());
+            if (scenario->integrator == INTEGRATOR_COUNT)
+                fail("unknown integrator '" + name + "'");
+        } else if (key == "terrain") {
+            parse_terrain(in, scenario);
+        } else if (key == "input") {
+            parse_input(in, scenario);
+        } else if (key == "drive") {
+            parse_drive(in, scenario);
+        } else if (key == "lod") {
+            scenario->lod = true;
+            scenario->lod_full_distance = read<float>(in, "full distance");
+            scenario->lod_rigid_distance = read<float>(in, "rigid distance");
+            scenario->far_interval = read<int>(in, "far interval");
+            if (scenario->lod_full_distance < 0.f ||
+                scenario->lod_rigid_distance < scenario->lod_full_distance)
+                fail("expected 0 <= full <= rigid distance");
+        } else if (key == "viewer") {
+            scenario->viewers.push_back(read_vector(in));
+        } else if (key == "sleep") {
+            scenario->sleep_steps = read<int>(in, "sleep steps");
+            scenario->sleep_velocity = read<float>(in, "sleep velocity");
+            if (scenario->sleep_steps < 0 || scenario->sleep_velocity < 0.f)
+                fail("expected non-negative sleep steps and velocity");
+        } else if (key == "trailer") {
+            parse_trailer(in, scenario);
+        } else if (key == "contact_cache") {
+            scenario->contact_tolerance = read<float>(in, "tolerance");
+            scenario->contact_max_age = read<float>(in, "max age");
+            if (scenario->contact_tolerance < 0.f ||
+                scenario->contact_max_age <= 0.f)
+                fail("expected tolerance >= 0 and max age > 0");
+        } else {
+            fail("unknown key '" + key + "'");
+        }
+
+        string rest;
+        if (in >> rest)
+            fail("unexpected '" + rest + "'");
+    }
+
+   public:
+    Scenario parse(const string& path_) {
+        path = path_;
+        line_number = 0;
+        ifstream file(path.c_str());
+        if (!file)
+            throw runtime_error("cannot open " + path);
+
+        Scenario scenario;
+        string line;
+        while (getline(file, line)) {
+            line_number++;
+            parse_line(line, &scenario);
+        }
+        if (scenario.delta_time <= 0.f)
+            fail("dt must be positive");
+        if (scenario.vehicles < 1)
+            fail("vehicles must be at least 1");
+        if (scenario.lod && scenario.viewers.empty())
+            fail("lod needs at least one viewer");
+        stable_sort(scenario.inputs.begin(), scenario.inputs.end(),
+                    [](const ScenarioInput& a, const ScenarioInput& b) {
+                        return a.frame < b.frame;
+                    });
+        return scenario;
+    }
+};
+
+// Builds the GroundQuery described by scenario. Procedural terrains cover
+// the spawn grid plus a margin of GROUND_MARGIN units.
+#define GROUND_MARGIN 5000.f
+
+static unique_ptr<GroundQuery> load_heightfield(const Scenario& scenario) {
+    ifstream file(scenario.terrain_file.c_str());
+    if (!file)
+        throw runtime_error("cannot open " + scenario.terrain_file);
+    int size_x, size_y;
+    if (!(file >> size_x >> size_y) || size_x < 2 || size_y < 2)
+        throw runtime_error(scenario.terrain_file + ": bad grid size");
+    vector<float> heights((size_t)size_x * size_y);
+    for (float& h : heights) {
+        if (!(file >> h))
+            throw runtime_error(scenario.terrain_file + ": too few heights");
+    }
+    return unique_ptr<GroundQuery>(new HeightfieldGround(
+        Vector2f::Zero(), scenario.terrain_args[0], size_x, size_y, heights));
+}
+
+static unique_ptr<GroundQuery> load_obj(const Scenario& scenario) {
+    ifstream file(scenario.terrain_file.c_str());
+    if (!file)
+        throw runtime_error("cannot open " + scenario.terrain_file);
+    vector<Vector3f> vertices;
+    vector<int> indices;
+    string line;
+    while (getline(file, line)) {
+        istringstream in(line);
+        string tag;
+        in >> tag;
+        if (tag == "v") {
+            Vector3f p;
+            in >> p(0) >> p(1) >> p(2);
+            vertices.push_back(p);
+        } else if (tag == "f") {
+            // "i", "i/t" or "i/t/n", 1-based or negative
+            vector<int> face;
+            string token;
+            while (in >> token) {
+                int index = atoi(token.c_str());
+                face.push_back(index < 0 ? (int)vertices.size() + index
+                                         : index - 1);
+            }
+            for (size_t k = 1; k + 1 < face.size(); k++) {
+                indices.push_back(face[0]);
+                indices.push_back(face[k]);
+                indices.push_back(face[k + 1]);
+            }
+        }
+    }
+    for (int index : indices) {
+        if (index < 0 || index >= (int)vertices.size())
+            throw runtime_error(scenario.terrain_file + ": bad face index");
+    }
+    return unique_ptr<GroundQuery>(
+        new TriangleMeshGround(vertices, indices, scenario.terrain_args[0]));
+}
+
+static unique_ptr<GroundQuery> make_ground(const Scenario& scenario) {
+    if (scenario.terrain == "heightfield")
+        return load_heightfield(scenario);
+    if (scenario.terrain == "obj")
+        return load_obj(scenario);
+
+    Vector2f lo, hi;
+    scenario.bounds(GROUND_MARGIN, &lo, &hi);
+    if (scenario.terrain == "flat") {
+        // one cell over the whole area
+        Vector2f size = hi - lo;
+        float cell = max(size(0), size(1));
+        vector<float> heights(4, scenario.terrain_args[0]);
+        return unique_ptr<GroundQuery>(
+            new HeightfieldGround(lo, cell, 2, 2, heights));
+    }
+
+    // waves: amplitude * sin(kx) * cos(ky)
+    float amplitude = scenario.terrain_args[0];
+    float k = 2.f * (float)M_PI / scenario.terrain_args[1];
+    float cell = scenario.terrain_args[2];
+    int size_x = (int)ceil((hi(0) - lo(0)) / cell) + 1;
+    int size_y = (int)ceil((hi(1) - lo(1)) / cell) + 1;
+    vector<float> heights((size_t)size_x * size_y);
+    for (int j = 0; j < size_y; j++) {
+        for (int i = 0; i < size_x; i++) {
+            float x = lo(0) + i * cell, y = lo(1) + j * cell;
+            heights[(size_t)j * size_x + i] =
+                amplitude * sin(k * x) * cos(k * y);
+        }
+    }
+    return unique_ptr<GroundQuery>(
+        new HeightfieldGround(lo, cell, size_x, size_y, heights));
+}
+
+#endif
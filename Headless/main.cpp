@@ -0,0 +1,200 @@
+// Headless driver for the simulator core: loads a scenario, steps it at a
+// fixed dt and reports throughput.
+//
+//   vehicle4w_headless <scenario> [--mode fleet|vehicle] [--frames N]
+//                      [--vehicles N] [--threads N] [--chunk N]
+//                      [--integrator NAME] [--record FILE]
+//
+// fleet mode runs FleetSimulator (parallel when --threads > 1), vehicle mode
+// one VehicleSimulator per vehicle; only vehicle mode has integrators
+// other than symplectic_euler, wheel counts other than four, trailers,
+// the tire model and the contact cache.
+// Both sweep the wheels against the scenario terrain every frame, unless a
+// contact_cache line lets wheels reuse their last contact, and the time
+// spent doing so is included.
+// --record writes every frame of four-wheel vehicles to a trajectory file
+// (see Trajectory.hpp); vehicle mode does not see the sweep results and
+// records no hit points.
+// A scenario lod line re-tiers the fleet every frame (see FleetLod.hpp), a
+// sleep line lets resting vehicles sleep; both are fleet mode only.
+// Configured with -DVEHICLE4W_INSTRUMENTATION=1 (or 2 for per-generator
+// timers), the run ends with the per-stage latency table.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Runner.hpp"
+
+struct Options {
+    string scenario;
+    string mode;
+    string integrator;
+    string record;
+    int frames;
+    int vehicles;
+    int threads;
+    int chunk;
+
+    Options()
+        : mode("fleet"),
+          frames(-1),
+          vehicles(-1),
+          threads(1),
+          chunk(FLEET_DEFAULT_CHUNK) {}
+};
+
+static void usage() {
+    fprintf(stderr,
+            "usage: vehicle4w_headless <scenario> [--mode fleet|vehicle] "
+            "[--frames N]\n"
+            "                          [--vehicles N] [--threads N] "
+            "[--chunk N]\n"
+            "                          [--integrator NAME] [--record FILE]\n");
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    for (int k = 1; k < argc; k++) {
+        const char* arg = argv[k];
+        if (arg[0] != '-') {
+            if (!options->scenario.empty())
+                return false;
+            options->scenario = arg;
+            continue;
+        }
+        if (k + 1 >= argc)
+            return false;
+        const char* value = argv[++k];
+        if (!strcmp(arg, "--mode")) {
+            options->mode = value;
+            if (options->mode != "fleet" && options->mode != "vehicle")
+                return false;
+        } else if (!strcmp(arg, "--frames")) {
+            options->frames = atoi(value);
+        } else if (!strcmp(arg, "--vehicles")) {
+            options->vehicles = atoi(value);
+        } else if (!strcmp(arg, "--threads")) {
+            options->threads = atoi(value);
+        } else if (!strcmp(arg, "--chunk")) {
+            options->chunk = atoi(value);
+        } else if (!strcmp(arg, "--integrator")) {
+            options->integrator = value;
+        } else if (!strcmp(arg, "--record")) {
+            options->record = value;
+        } else {
+            return false;
+        }
+    }
+    return !options->scenario.empty() && options->threads >= 1 &&
+           options->chunk >= 1;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 1;
+    }
+
+    Scenario scenario;
+    unique_ptr<GroundQuery> ground;
+    TrajectoryRecorder recorder;
+    try {
+        scenario = ScenarioParser().parse(options.scenario);
+        if (options.frames >= 0)
+            scenario.frames = options.frames;
+        if (options.vehicles >= 1)
+            scenario.vehicles = options.vehicles;
+        if (!options.integrator.empty()) {
+            scenario.integrator =
+                integrator_from_name(options.integrator.c_str());
+            if (scenario.integrator == INTEGRATOR_COUNT)
+                throw runtime_error("unknown integrator " +
+                                    options.integrator);
+        }
+        if (options.mode == "fleet" &&
+            scenario.integrator != INTEGRATOR_SYMPLECTIC_EULER)
+            throw runtime_error("fleet mode only integrates with "
+                                "symplectic_euler, use --mode vehicle");
+        if (options.mode == "vehicle" && scenario.lod)
+            throw runtime_error("lod needs fleet mode");
+        if (options.mode == "vehicle" && scenario.sleep_steps)
+            throw runtime_error("sleep needs fleet mode");
+        if (options.mode == "fleet" &&
+            scenario.vehicle.wheel_count != FLEET_WHEEL_COUNT)
+            throw runtime_error("fleet mode only simulates four-wheel "
+                                "vehicles, use --mode vehicle");
+        if (options.mode == "fleet" && scenario.trailer)
+            throw runtime_error("trailers need vehicle mode");
+        if (options.mode == "fleet" && scenario.vehicle.tire_model)
+            throw runtime_error("the tire model needs vehicle mode");
+        if (options.mode == "fleet" && scenario.contact_tolerance > 0.f)
+            throw runtime_error("the contact cache needs vehicle mode");
+        if (!options.record.empty() &&
+            (scenario.vehicle.wheel_count != 4 || scenario.trailer))
+            throw runtime_error("only four-wheel vehicles without trailers "
+                                "can be recorded");
+        ground = make_ground(scenario);
+        if (!options.record.empty() &&
+            !recorder.open(options.record.c_str(), scenario.vehicles,
+                           scenario.delta_time))
+            throw runtime_error("cannot create " + options.record);
+    } catch (const exception& e) {
+        fprintf(stderr, "vehicle4w_headless: %s\n", e.what());
+        return 1;
+    }
+
+    size_t lod_sizes[VEHICLE_LOD_COUNT] = {};
+    size_t asleep = 0;
+    Vector3f trailer = Vector3f::Zero();
+    auto start = chrono::steady_clock::now();
+    Vector3f location =
+        options.mode == "fleet"
+            ? run_fleet(scenario, *ground, (size_t)options.threads,
+                        (size_t)options.chunk, &recorder, lod_sizes, &asleep)
+            : run_vehicles(scenario, *ground, &recorder, &trailer);
+    double seconds =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double steps = scenario.frames / seconds;
+    printf("scenario         %s\n", options.scenario.c_str());
+    printf("mode             %s (%d thread%s)\n", options.mode.c_str(),
+           options.threads, options.threads == 1 ? "" : "s");
+    printf("integrator       %s\n", integrator_name(scenario.integrator));
+    printf("vehicles         %d\n", scenario.vehicles);
+    printf("frames           %d x %g s\n", scenario.frames,
+           scenario.delta_time);
+    printf("wall time        %.3f s\n", seconds);
+    printf("steps/s          %.1f\n", steps);
+    printf("vehicle-steps/s  %.1f\n", steps * scenario.vehicles);
+    printf("vehicle 0 body   %.3f %.3f %.3f\n", location(0), location(1),
+           location(2));
+    if (scenario.trailer) {
+        printf("trailer 0 body   %.3f %.3f %.3f\n", trailer(0), trailer(1),
+               trailer(2));
+    }
+    if (scenario.lod) {
+        printf("lod              %zu full, %zu rigid, %zu far\n",
+               lod_sizes[VEHICLE_LOD_FULL], lod_sizes[VEHICLE_LOD_RIGID],
+               lod_sizes[VEHICLE_LOD_FAR]);
+    }
+    if (scenario.sleep_steps) {
+        printf("sleep            %zu asleep, %zu awake\n", asleep,
+               scenario.vehicles - asleep);
+    }
+    if (recorder.is_open()) {
+        printf("recorded         %llu frames to %s%s\n",
+               (unsigned long long)recorder.get_frame_count(),
+               options.record.c_str(),
+               recorder.has_failed() ? " (incomplete)" : "");
+    }
+#if VEHICLE4W_INSTRUMENTATION && !defined(VEHICLE4W_INSTRUMENTATION_BACKEND)
+    printf("\n");
+    InstrumentRegistry::get().report(stdout);
+#endif
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Prints a trajectory file written by vehicle4w_headless --record or the
+// actors' recorders.
+//
+//   vehicle4w_trajectory <file>                   header and columns
+//   vehicle4w_trajectory <file> --vehicle V       one row per frame
+//       [--from N] [--to N] [--every N]
+//
+// Rows hold the frame, time, world-space body location, body velocity and
+// the wheel hit points (relative to the vehicle origin, nan when airborne).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Trajectory.hpp"
+
+static const char* column_names[TRAJECTORY_COLUMN_COUNT] = {
+    "origin_x", "origin_y", "origin_z", "body_x",    "body_y",    "body_z",
+    "body_vx",  "body_vy",  "body_vz",  "body_fx",   "body_fy",   "body_fz",
+    "body_qw",  "body_qx",  "body_qy",  "body_qz",   "wheel_x",   "wheel_y",
+    "wheel_z",  "wheel_vx", "wheel_vy", "wheel_vz",  "wheel_fx",  "wheel_fy",
+    "wheel_fz", "wheel_qw", "wheel_qx", "wheel_qy",  "wheel_qz",  "hit_x",
+    "hit_y",    "hit_z"};
+
+static void usage() {
+    fprintf(stderr,
+            "usage: vehicle4w_trajectory <file> [--vehicle V] [--from N] "
+            "[--to N] [--every N]\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argv[1][0] == '-') {
+        usage();
+        return 1;
+    }
+    long vehicle = -1, from = 0, to = -1, every = 1;
+    for (int k = 2; k < argc; k++) {
+        if (k + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        const char* arg = argv[k];
+        long value = atol(argv[++k]);
+        if (!strcmp(arg, "--vehicle")) {
+            vehicle = value;
+        } else if (!strcmp(arg, "--from")) {
+            from = value;
+        } else if (!strcmp(arg, "--to")) {
+            to = value;
+        } else if (!strcmp(arg, "--every")) {
+            every = value < 1 ? 1 : value;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    TrajectoryReader reader;
+    if (!reader.open(argv[1])) {
+        fprintf(stderr, "vehicle4w_trajectory: %s is not a readable "
+                        "trajectory\n", argv[1]);
+        return 1;
+    }
+    long frames = (long)reader.get_frame_count();
+    if (vehicle < 0) {
+        printf("frames    %ld x %g s\n", frames, reader.get_delta_time());
+        printf("vehicles  %u\n", reader.get_vehicle_count());
+        printf("columns  ");
+        for (int c = 0; c < TRAJECTORY_COLUMN_COUNT; c++) {
+            if (reader.has_column((TrajectoryColumn)c))
+                printf(" %s", column_names[c]);
+        }
+        printf("\n");
+        return 0;
+    }
+    if (vehicle >= (long)reader.get_vehicle_count()) {
+        fprintf(stderr, "vehicle4w_trajectory: no vehicle %ld\n", vehicle);
+        return 1;
+    }
+
+    if (to < 0 || to > frames)
+        to = frames;
+    printf("%8s %9s %10s %10s %10s %9s %9s %9s  hits\n", "frame", "time",
+           "body_x", "body_y", "body_z", "vel_x", "vel_y", "vel_z");
+    for (long f = from; f < to; f += every) {
+        Vector3f body =
+            reader.get_vector(TRAJECTORY_ORIGIN_X, f, vehicle) +
+            reader.get_vector(TRAJECTORY_BODY_X, f, vehicle);
+        Vector3f vel = reader.get_vector(TRAJECTORY_BODY_VX, f, vehicle);
+        printf("%8ld %9.3f %10.3f %10.3f %10.3f %9.3f %9.3f %9.3f ", f,
+               (f + 1) * reader.get_delta_time(), body(0), body(1), body(2),
+               vel(0), vel(1), vel(2));
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            Vector3f hit = reader.get_vector(TRAJECTORY_WHEEL_HIT_X, f,
+                                             vehicle * FLEET_WHEEL_COUNT + i);
+            printf(" %.1f", hit(2));
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#ifndef _ARENA_HPP_
+#define _ARENA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#define ARENA_OVERFLOW_CHUNK 1024
+
+// Bump allocator over a caller-provided block. Nothing is freed one by one
+// and no destructors run: the whole arena goes away with its block, so it
+// only holds trivially destructible state (particles, force generators and
+// their registrations). Requests past the end of the block spill into heap
+// chunks, which makes an undersized block slower but never wrong.
+class Arena {
+    struct Chunk {
+        Chunk* next;
+    };
+
+    char* cursor;
+    char* end;
+    Chunk* overflow;
+    size_t overflow_count;
+
+    void grow(size_t bytes) {
+        size_t size = sizeof(Chunk) + bytes;
+        if (size < ARENA_OVERFLOW_CHUNK)
+            size = ARENA_OVERFLOW_CHUNK;
+        Chunk* chunk = (Chunk*)malloc(size);
+        if (!chunk)
+            throw std::bad_alloc();
+        chunk->next = overflow;
+        overflow = chunk;
+        overflow_count++;
+        cursor = (char*)(chunk + 1);
+        end = (char*)chunk + size;
+    }
+
+    static char* align_up(char* p, size_t align) {
+        uintptr_t value = ((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1);
+        return (char*)value;
+    }
+
+   public:
+    Arena(void* block_, size_t bytes_)
+        : cursor((char*)block_),
+          end((char*)block_ + bytes_),
+          overflow(nullptr),
+          overflow_count(0) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        while (overflow) {
+            Chunk* next = overflow->next;
+            free(overflow);
+            overflow = next;
+        }
+    }
+
+    void* allocate(size_t bytes, size_t align) {
+        char* p = align_up(cursor, align);
+        if (!cursor || p + bytes > end) {
+            grow(bytes + align);
+            p = align_up(cursor, align);
+        }
+        cursor = p + bytes;
+        return p;
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+    }
+
+    // heap chunks taken because the block ran out; 0 when sized right
+    size_t get_overflow_count() const { return overflow_count; }
+};
+
+// std allocator drawing from an Arena; deallocate is a no-op
+template <typename T>
+class ArenaAllocator {
+   public:
+    typedef T value_type;
+
+    Arena* arena;
+
+    explicit ArenaAllocator(Arena* arena_) : arena(arena_) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        return (T*)arena->allocate(n * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
+    }
+};
+
+#endif
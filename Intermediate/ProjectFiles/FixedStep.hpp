@@ -0,0 +1,87 @@
+#ifndef _FIXEDSTEP_HPP_
+#define _FIXEDSTEP_HPP_
+
+#include <cmath>
+
+#include "Eigen/Eigen/Dense"
+using namespace Eigen;
+
+#define FIXED_STEP_DELTA_TIME 0.02f
+#define FIXED_STEP_MAX_STEPS 5
+
+// Turns variable frame times into a whole number of fixed steps. Leftover
+// time carries over to the next frame; time beyond max_steps steps in one
+// frame is dropped, so a hitch slows the simulation down instead of making
+// the next frames even more expensive.
+class FixedStepper {
+    float step;
+    int max_steps;
+    float accumulator;
+    int dropped_steps;
+
+   public:
+    FixedStepper(float step_ = FIXED_STEP_DELTA_TIME,
+                 int max_steps_ = FIXED_STEP_MAX_STEPS)
+        : step(step_),
+          max_steps(max_steps_ < 1 ? 1 : max_steps_),
+          accumulator(0.f),
+          dropped_steps(0) {}
+
+    // adds frame_time and returns the number of steps to run now
+    int advance(float frame_time) {
+        accumulator += frame_time;
+        int steps = 0;
+        while (accumulator >= step && steps < max_steps) {
+            accumulator -= step;
+            steps++;
+        }
+        if (accumulator >= step) {
+            float behind = floor(accumulator / step);
+            dropped_steps += (int)behind;
+            accumulator -= behind * step;
+        }
+        return steps;
+    }
+
+    // fraction of a step not simulated yet, for blending the last two states
+    float get_alpha() const { return accumulator / step; }
+
+    float get_step() const { return step; }
+
+    int get_max_steps() const { return max_steps; }
+
+    // steps discarded by the cap since construction
+    int get_dropped_steps() const { return dropped_steps; }
+
+    void reset() { accumulator = 0.f; }
+};
+
+// what a vehicle's components show: relative locations and the rotation,
+// for up to Wheels wheels
+template <int Wheels>
+struct BasicVehicleRenderState {
+    Vector3f body_location;
+    Vector3f wheel_location[Wheels];
+    Quaternionf quat;
+};
+
+typedef BasicVehicleRenderState<4> VehicleRenderState;
+
+template <int Wheels>
+inline BasicVehicleRenderState<Wheels> interpolate(
+    const BasicVehicleRenderState<Wheels>& from,
+    const BasicVehicleRenderState<Wheels>& to,
+    float alpha) {
+    BasicVehicleRenderState<Wheels> state;
+    state.body_location =
+        from.body_location + alpha * (to.body_location - from.body_location);
+    for (int i = 0; i < Wheels; i++) {
+        state.wheel_location[i] =
+            from.wheel_location[i] +
+            alpha * (to.wheel_location[i] - from.wheel_location[i]);
+    }
+    state.quat = from.quat.slerp(alpha, to.quat);
+    return state;
+}
+
+#endif
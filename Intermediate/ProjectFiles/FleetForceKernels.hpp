@@ -0,0 +1,452 @@
+#ifndef _FLEETFORCEKERNELS_HPP_
+#define _FLEETFORCEKERNELS_HPP_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "ParticleForce.hpp"
+using namespace std;
+
+// Batched versions of the Gravity/Spring/Contact/Friction generators and of
+// Particle::apply_force, evaluated over FleetSimulator columns.
+//
+// Every variant performs the same IEEE operations in the same order per lane
+// (no reciprocal approximations, no FMA), so SSE2/AVX2 results are expected to
+// be bit-identical to the scalar path. Compilers that contract the scalar path
+// into FMAs may differ in the last bits; FLEET_KERNEL_TOLERANCE is the relative
+// error accepted when comparing paths, as Tests/KernelParityTest.cpp does.
+#define FLEET_KERNEL_TOLERANCE 1e-5f
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define FLEET_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define FLEET_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FLEET_TARGET_AVX2
+#endif
+#else
+#define FLEET_KERNELS_X86 0
+#endif
+
+enum FleetKernelLevel {
+    FLEET_KERNEL_SCALAR = 0,
+    FLEET_KERNEL_SSE2 = 1,
+    FLEET_KERNEL_AVX2 = 2,
+};
+
+// Wheel columns read and written by the wheel force kernel. Per-vehicle
+// columns are indexed by vehicle, per-wheel columns by vehicle * 4 + i.
+struct WheelKernelArgs {
+    // per wheel
+    const float* mass;
+    const float* z;
+    float* vx;
+    float* vy;
+    const float* vz;
+    float* fx;
+    float* fy;
+    float* fz;
+    const float* normal_length;
+    const uint8_t* grounded;
+
+    // per vehicle
+    const float* body_z;
+    const float* gravity_acc;
+    const float* spring_constant;
+    const float* balance;
+    const float* loss_coeff;
+    const float* damping;
+};
+
+struct ParticleKernelArgs {
+    const float* mass;
+    float* x;
+    float* y;
+    float* z;
+    float* vx;
+    float* vy;
+    float* vz;
+    float* fx;
+    float* fy;
+    float* fz;
+};
+
+inline FleetKernelLevel detect_fleet_kernel_level() {
+#if FLEET_KERNELS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+                  ((_xgetbv(0) & 6) == 6);
+    if (max_leaf >= 7 && os_avx) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5))
+            return FLEET_KERNEL_AVX2;
+    }
+    return sse2 ? FLEET_KERNEL_SSE2 : FLEET_KERNEL_SCALAR;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return FLEET_KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return FLEET_KERNEL_SSE2;
+    return FLEET_KERNEL_SCALAR;
+#endif
+#else
+    return FLEET_KERNEL_SCALAR;
+#endif
+}
+
+// gravity, spring, contact and friction for the wheels of [begin, end)
+inline void fleet_wheel_forces_scalar(const WheelKernelArgs& a,
+                                      size_t begin,
+                                      size_t end,
+                                      float delta_time) {
+    for (size_t v = begin; v < end; v++) {
+        float g = a.gravity_acc[v];
+        float k = a.spring_constant[v];
+        float balance = a.balance[v];
+        float loss_coeff = a.loss_coeff[v];
+        float damping = a.damping[v];
+        float body_z = a.body_z[v];
+
+        for (size_t w = v * 4; w < v * 4 + 4; w++) {
+            float mass = a.mass[w];
+
+            // gravity
+            a.fz[w] += mass * -g;
+
+            // spring
+            float val = (a.z[w] - body_z) + a.normal_length[w];
+            a.fz[w] += -(val * k);
+
+            if (!a.grounded[w])
+                continue;
+
+            // contact
+            float vel_z = a.vz[w];
+            float force = balance;
+            if (!(abs(vel_z) < MAX_DEVIATION))
+                force =
+                    (1 + loss_coeff) * (-vel_z) * mass / delta_time + balance;
+            a.fz[w] += force;
+
+            // friction; the sign flip deliberately carries over from X to Y
+            // exactly as in Friction::update_force
+            float friction = damping * mass * g;
+            if (abs(a.vx[w]) < (friction / mass) * delta_time) {
+                a.vx[w] = 0.f;
+            } else {
+                friction *= (a.vx[w] > 0 ? -1 : 1);
+                a.fx[w] += friction;
+            }
+            if (abs(a.vy[w]) < (friction / mass) * delta_time) {
+                a.vy[w] = 0.f;
+            } else {
+                friction *= (a.vy[w] > 0 ? -1 : 1);
+                a.fy[w] += friction;
+            }
+        }
+    }
+}
+
+// linear part of Particle::apply_force for particles [begin, end); the
+// forces are left in place, FleetSimulator clears them when a step starts
+inline void fleet_apply_force_scalar(const ParticleKernelArgs& a,
+                                     size_t begin,
+                                     size_t end,
+                                     float delta_time) {
+    for (size_t i = begin; i < end; i++) {
+        a.vx[i] += delta_time * a.fx[i] / a.mass[i];
+        a.vy[i] += delta_time * a.fy[i] / a.mass[i];
+        a.vz[i] += delta_time * a.fz[i] / a.mass[i];
+        a.x[i] += delta_time * a.vx[i];
+        a.y[i] += delta_time * a.vy[i];
+        a.z[i] += delta_time * a.vz[i];
+    }
+}
+
+#if FLEET_KERNELS_X86
+
+// four wheels (one vehicle) per instruction
+inline void fleet_wheel_forces_sse2(const WheelKernelArgs& a,
+                                    size_t begin,
+                                    size_t end,
+                                    float delta_time) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 minus_one = _mm_set1_ps(-1.f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    const __m128 max_deviation = _mm_set1_ps(MAX_DEVIATION);
+    const __m128 dt = _mm_set1_ps(delta_time);
+    const __m128i zero_i = _mm_setzero_si128();
+
+    for (size_t v = begin; v < end; v++) {
+        size_t w = v * 4;
+        __m128 g = _mm_set1_ps(a.gravity_acc[v]);
+        __m128 k = _mm_set1_ps(a.spring_constant[v]);
+        __m128 balance = _mm_set1_ps(a.balance[v]);
+        __m128 loss_coeff = _mm_set1_ps(a.loss_coeff[v]);
+        __m128 damping = _mm_set1_ps(a.damping[v]);
+        __m128 body_z = _mm_set1_ps(a.body_z[v]);
+
+        __m128 mass = _mm_loadu_ps(a.mass + w);
+        __m128 z = _mm_loadu_ps(a.z + w);
+        __m128 vx = _mm_loadu_ps(a.vx + w);
+        __m128 vy = _mm_loadu_ps(a.vy + w);
+        __m128 vz = _mm_loadu_ps(a.vz + w);
+        __m128 fx = _mm_loadu_ps(a.fx + w);
+        __m128 fy = _mm_loadu_ps(a.fy + w);
+        __m128 fz = _mm_loadu_ps(a.fz + w);
+
+        int flags;
+        memcpy(&flags, a.grounded + w, sizeof(flags));
+        __m128i flags_i = _mm_cvtsi32_si128(flags);
+        flags_i = _mm_unpacklo_epi8(flags_i, zero_i);
+        flags_i = _mm_unpacklo_epi16(flags_i, zero_i);
+        __m128 grounded = _mm_castsi128_ps(_mm_cmpgt_epi32(flags_i, zero_i));
+
+        // gravity
+        fz = _mm_add_ps(fz, _mm_mul_ps(mass, _mm_xor_ps(g, sign_mask)));
+
+        // spring
+        __m128 val = _mm_add_ps(_mm_sub_ps(z, body_z),
+                                _mm_loadu_ps(a.normal_length + w));
+        fz = _mm_add_ps(fz, _mm_xor_ps(_mm_mul_ps(val, k), sign_mask));
+
+        // contact
+        __m128 at_rest = _mm_cmplt_ps(_mm_and_ps(vz, abs_mask), max_deviation);
+        __m128 impulse = _mm_mul_ps(_mm_add_ps(one, loss_coeff),
+                                    _mm_xor_ps(vz, sign_mask));
+        impulse = _mm_add_ps(_mm_div_ps(_mm_mul_ps(impulse, mass), dt),
+                             balance);
+        __m128 contact = _mm_or_ps(_mm_and_ps(at_rest, balance),
+                                   _mm_andnot_ps(at_rest, impulse));
+        fz = _mm_add_ps(fz, _mm_and_ps(grounded, contact));
+
+        // friction
+        __m128 friction = _mm_mul_ps(_mm_mul_ps(damping, mass), g);
+
+        __m128 stop = _mm_cmplt_ps(
+            _mm_and_ps(vx, abs_mask),
+            _mm_mul_ps(_mm_div_ps(friction, mass), dt));
+        __m128 sign = _mm_or_ps(
+            _mm_and_ps(_mm_cmpgt_ps(vx, zero), minus_one),
+            _mm_andnot_ps(_mm_cmpgt_ps(vx, zero), one));
+        __m128 flipped = _mm_mul_ps(friction, sign);
+        __m128 oppose = _mm_andnot_ps(stop, grounded);
+        vx = _mm_andnot_ps(_mm_and_ps(stop, grounded), vx);
+        fx = _mm_add_ps(fx, _mm_and_ps(oppose, flipped));
+        friction = _mm_or_ps(_mm_and_ps(oppose, flipped),
+                             _mm_andnot_ps(oppose, friction));
+
+        stop = _mm_cmplt_ps(_mm_and_ps(vy, abs_mask),
+                            _mm_mul_ps(_mm_div_ps(friction, mass), dt));
+        sign = _mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(vy, zero), minus_one),
+                         _mm_andnot_ps(_mm_cmpgt_ps(vy, zero), one));
+        flipped = _mm_mul_ps(friction, sign);
+        oppose = _mm_andnot_ps(stop, grounded);
+        vy = _mm_andnot_ps(_mm_and_ps(stop, grounded), vy);
+        fy = _mm_add_ps(fy, _mm_and_ps(oppose, flipped));
+
+        _mm_storeu_ps(a.vx + w, vx);
+        _mm_storeu_ps(a.vy + w, vy);
+        _mm_storeu_ps(a.fx + w, fx);
+        _mm_storeu_ps(a.fy + w, fy);
+        _mm_storeu_ps(a.fz + w, fz);
+    }
+}
+
+inline void fleet_apply_force_sse2(const ParticleKernelArgs& a,
+                                   size_t begin,
+                                   size_t end,
+                                   float delta_time) {
+    const __m128 dt = _mm_set1_ps(delta_time);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 mass = _mm_loadu_ps(a.mass + i);
+        float* velocity[3] = {a.vx, a.vy, a.vz};
+        float* location[3] = {a.x, a.y, a.z};
+        float* force[3] = {a.fx, a.fy, a.fz};
+        for (int axis = 0; axis < 3; axis++) {
+            __m128 f = _mm_loadu_ps(force[axis] + i);
+            __m128 vel = _mm_loadu_ps(velocity[axis] + i);
+            vel = _mm_add_ps(vel, _mm_div_ps(_mm_mul_ps(dt, f), mass));
+            __m128 loc = _mm_loadu_ps(location[axis] + i);
+            loc = _mm_add_ps(loc, _mm_mul_ps(dt, vel));
+            _mm_storeu_ps(velocity[axis] + i, vel);
+            _mm_storeu_ps(location[axis] + i, loc);
+        }
+    }
+    fleet_apply_force_scalar(a, i, end, delta_time);
+}
+
+// per-vehicle constant of v in the low lane half and of v + 1 in the high one
+FLEET_TARGET_AVX2 inline __m256 fleet_broadcast_pair(const float* column,
+                                                     size_t v) {
+    return _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm_set1_ps(column[v])),
+        _mm_set1_ps(column[v + 1]), 1);
+}
+
+// eight wheels (two vehicles) per instruction
+FLEET_TARGET_AVX2
+inline void fleet_wheel_forces_avx2(const WheelKernelArgs& a,
+                                    size_t begin,
+                                    size_t end,
+                                    float delta_time) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 minus_one = _mm256_set1_ps(-1.f);
+    const __m256 abs_mask =
+        _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 sign_mask =
+        _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+    const __m256 max_deviation = _mm256_set1_ps(MAX_DEVIATION);
+    const __m256 dt = _mm256_set1_ps(delta_time);
+
+    size_t v = begin;
+    for (; v + 2 <= end; v += 2) {
+        size_t w = v * 4;
+        __m256 g = fleet_broadcast_pair(a.gravity_acc, v);
+        __m256 k = fleet_broadcast_pair(a.spring_constant, v);
+        __m256 balance = fleet_broadcast_pair(a.balance, v);
+        __m256 loss_coeff = fleet_broadcast_pair(a.loss_coeff, v);
+        __m256 damping = fleet_broadcast_pair(a.damping, v);
+        __m256 body_z = fleet_broadcast_pair(a.body_z, v);
+
+        __m256 mass = _mm256_loadu_ps(a.mass + w);
+        __m256 z = _mm256_loadu_ps(a.z + w);
+        __m256 vx = _mm256_loadu_ps(a.vx + w);
+        __m256 vy = _mm256_loadu_ps(a.vy + w);
+        __m256 vz = _mm256_loadu_ps(a.vz + w);
+        __m256 fx = _mm256_loadu_ps(a.fx + w);
+        __m256 fy = _mm256_loadu_ps(a.fy + w);
+        __m256 fz = _mm256_loadu_ps(a.fz + w);
+
+        __m256i flags_i = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i*)(a.grounded + w)));
+        __m256 grounded = _mm256_castsi256_ps(
+            _mm256_cmpgt_epi32(flags_i, _mm256_setzero_si256()));
+
+        // gravity
+        fz = _mm256_add_ps(fz,
+                           _mm256_mul_ps(mass, _mm256_xor_ps(g, sign_mask)));
+
+        // spring
+        __m256 val = _mm256_add_ps(_mm256_sub_ps(z, body_z),
+                                   _mm256_loadu_ps(a.normal_length + w));
+        fz = _mm256_add_ps(fz,
+                           _mm256_xor_ps(_mm256_mul_ps(val, k), sign_mask));
+
+        // contact
+        __m256 at_rest = _mm256_cmp_ps(_mm256_and_ps(vz, abs_mask),
+                                       max_deviation, _CMP_LT_OQ);
+        __m256 impulse = _mm256_mul_ps(_mm256_add_ps(one, loss_coeff),
+                                       _mm256_xor_ps(vz, sign_mask));
+        impulse = _mm256_add_ps(
+            _mm256_div_ps(_mm256_mul_ps(impulse, mass), dt), balance);
+        __m256 contact = _mm256_blendv_ps(impulse, balance, at_rest);
+        fz = _mm256_add_ps(fz, _mm256_and_ps(grounded, contact));
+
+        // friction
+        __m256 friction = _mm256_mul_ps(_mm256_mul_ps(damping, mass), g);
+
+        __m256 stop = _mm256_cmp_ps(
+            _mm256_and_ps(vx, abs_mask),
+            _mm256_mul_ps(_mm256_div_ps(friction, mass), dt), _CMP_LT_OQ);
+        __m256 sign = _mm256_blendv_ps(
+            one, minus_one, _mm256_cmp_ps(vx, zero, _CMP_GT_OQ));
+        __m256 flipped = _mm256_mul_ps(friction, sign);
+        __m256 oppose = _mm256_andnot_ps(stop, grounded);
+        vx = _mm256_andnot_ps(_mm256_and_ps(stop, grounded), vx);
+        fx = _mm256_add_ps(fx, _mm256_and_ps(oppose, flipped));
+        friction = _mm256_blendv_ps(friction, flipped, oppose);
+
+        stop = _mm256_cmp_ps(
+            _mm256_and_ps(vy, abs_mask),
+            _mm256_mul_ps(_mm256_div_ps(friction, mass), dt), _CMP_LT_OQ);
+        sign = _mm256_blendv_ps(one, minus_one,
+                                _mm256_cmp_ps(vy, zero, _CMP_GT_OQ));
+        flipped = _mm256_mul_ps(friction, sign);
+        oppose = _mm256_andnot_ps(stop, grounded);
+        vy = _mm256_andnot_ps(_mm256_and_ps(stop, grounded), vy);
+        fy = _mm256_add_ps(fy, _mm256_and_ps(oppose, flipped));
+
+        _mm256_storeu_ps(a.vx + w, vx);
+        _mm256_storeu_ps(a.vy + w, vy);
+        _mm256_storeu_ps(a.fx + w, fx);
+        _mm256_storeu_ps(a.fy + w, fy);
+        _mm256_storeu_ps(a.fz + w, fz);
+    }
+    fleet_wheel_forces_scalar(a, v, end, delta_time);
+}
+
+FLEET_TARGET_AVX2
+inline void fleet_apply_force_avx2(const ParticleKernelArgs& a,
+                                   size_t begin,
+                                   size_t end,
+                                   float delta_time) {
+    const __m256 dt = _mm256_set1_ps(delta_time);
+    float* velocity[3] = {a.vx, a.vy, a.vz};
+    float* location[3] = {a.x, a.y, a.z};
+    float* force[3] = {a.fx, a.fy, a.fz};
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 mass = _mm256_loadu_ps(a.mass + i);
+        for (int axis = 0; axis < 3; axis++) {
+            __m256 f = _mm256_loadu_ps(force[axis] + i);
+            __m256 vel = _mm256_loadu_ps(velocity[axis] + i);
+            vel = _mm256_add_ps(vel,
+                                _mm256_div_ps(_mm256_mul_ps(dt, f), mass));
+            __m256 loc = _mm256_loadu_ps(location[axis] + i);
+            loc = _mm256_add_ps(loc, _mm256_mul_ps(dt, vel));
+            _mm256_storeu_ps(velocity[axis] + i, vel);
+            _mm256_storeu_ps(location[axis] + i, loc);
+        }
+    }
+    fleet_apply_force_scalar(a, i, end, delta_time);
+}
+
+#endif
+
+inline void fleet_wheel_forces(FleetKernelLevel level,
+                               const WheelKernelArgs& a,
+                               size_t begin,
+                               size_t end,
+                               float delta_time) {
+#if FLEET_KERNELS_X86
+    if (level == FLEET_KERNEL_AVX2)
+        return fleet_wheel_forces_avx2(a, begin, end, delta_time);
+    if (level == FLEET_KERNEL_SSE2)
+        return fleet_wheel_forces_sse2(a, begin, end, delta_time);
+#endif
+    fleet_wheel_forces_scalar(a, begin, end, delta_time);
+}
+
+inline void fleet_apply_force(FleetKernelLevel level,
+                              const ParticleKernelArgs& a,
+                              size_t begin,
+                              size_t end,
+                              float delta_time) {
+#if FLEET_KERNELS_X86
+    if (level == FLEET_KERNEL_AVX2)
+        return fleet_apply_force_avx2(a, begin, end, delta_time);
+    if (level == FLEET_KERNEL_SSE2)
+        return fleet_apply_force_sse2(a, begin, end, delta_time);
+#endif
+    fleet_apply_force_scalar(a, begin, end, delta_time);
+}
+
+#endif
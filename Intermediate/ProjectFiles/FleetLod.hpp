@@ -0,0 +1,200 @@
+#ifndef _FLEET_LOD_HPP_
+#define _FLEET_LOD_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Eigen/Eigen/Dense"
+#include "FleetSimulator.hpp"
+using namespace std;
+using namespace Eigen;
+
+// horizontal distance from the nearest viewer up to which a vehicle runs at
+// full detail, and up to which it runs the rigid model
+#define FLEET_LOD_FULL_DISTANCE 5000.f
+#define FLEET_LOD_RIGID_DISTANCE 20000.f
+// a vehicle only drops a tier this fraction past the distance it rose at,
+// so one driving along a boundary does not swap tiers every frame
+#define FLEET_LOD_HYSTERESIS 0.1f
+
+// Uniform grid over the fleet's body positions in x and y. Cells are hashed
+// into a table of twice the fleet's size and filled by counting sort, so a
+// rebuild is two passes and allocates nothing once the fleet stops growing.
+class VehicleGrid {
+    float cell_size;
+    size_t mask;
+    size_t count;
+    // table slot s holds entries [cell_start[s], cell_start[s + 1])
+    vector<uint32_t> cell_start;
+    vector<uint32_t> entries;
+    // by dense index
+    vector<uint32_t> slot;
+    vector<int32_t> cell_x, cell_y;
+    vector<float> x, y;
+
+    static uint32_t hash(int32_t cx, int32_t cy) {
+        return ((uint32_t)cx * 73856093u) ^ ((uint32_t)cy * 19349663u);
+    }
+
+    int32_t cell(float c) const { return (int32_t)floor(c / cell_size); }
+
+   public:
+    explicit VehicleGrid(float cell_size_ = FLEET_LOD_RIGID_DISTANCE / 4)
+        : cell_size(cell_size_), mask(0), count(0) {}
+
+    void build(FleetSimulator& fleet) {
+        count = fleet.size();
+        size_t table = 16;
+        while (table < 2 * count)
+            table *= 2;
+        mask = table - 1;
+        cell_start.assign(table + 1, 0);
+        entries.resize(count);
+        slot.resize(count);
+        cell_x.resize(count);
+        cell_y.resize(count);
+        x.resize(count);
+        y.resize(count);
+
+        ParticleColumns& bodies = fleet.get_bodies();
+        VehicleColumns& vehicles = fleet.get_vehicles();
+        for (size_t v = 0; v < count; v++) {
+            x[v] = vehicles.origin_x[v] + bodies.x[v];
+            y[v] = vehicles.origin_y[v] + bodies.y[v];
+            cell_x[v] = cell(x[v]);
+            cell_y[v] = cell(y[v]);
+            slot[v] = hash(cell_x[v], cell_y[v]) & mask;
+            cell_start[slot[v] + 1]++;
+        }
+        for (size_t s = 0; s < table; s++) {
+            cell_start[s + 1] += cell_start[s];
+        }
+        // fill every slot back to front through its end offset, which then
+        // holds its start: the offsets end up shifted by one slot
+        for (size_t v = count; v-- > 0;) {
+            entries[--cell_start[slot[v] + 1]] = (uint32_t)v;
+        }
+        for (size_t s = 0; s < table; s++) {
+            cell_start[s] = cell_start[s + 1];
+        }
+        cell_start[table] = (uint32_t)count;
+    }
+
+    // f(index, squared distance) for every vehicle within radius of (x, y)
+    // at the last build
+    template <typename F>
+    void query(float qx, float qy, float radius, F f) const {
+        if (!count)
+            return;
+        float radius_sq = radius * radius;
+        for (int32_t cy = cell(qy - radius); cy <= cell(qy + radius); cy++) {
+            for (int32_t cx = cell(qx - radius); cx <= cell(qx + radius);
+                 cx++) {
+                size_t s = hash(cx, cy) & mask;
+                for (uint32_t k = cell_start[s]; k < cell_start[s + 1]; k++) {
+                    uint32_t v = entries[k];
+                    if (cell_x[v] != cx || cell_y[v] != cy)
+                        continue;
+                    float dx = x[v] - qx, dy = y[v] - qy;
+                    float distance_sq = dx * dx + dy * dy;
+                    if (distance_sq <= radius_sq)
+                        f((size_t)v, distance_sq);
+                }
+            }
+        }
+    }
+
+    size_t size() const { return count; }
+};
+
+// Picks every vehicle's VehicleLod from its horizontal distance to the
+// nearest viewer: full up close, rigid further out, far beyond that or when
+// the vehicle is hidden from every viewer. Only vehicles within reach of a
+// viewer are visited through the grid; the rest are far by default.
+class FleetLod {
+    struct Change {
+        int handle;
+        VehicleLod lod;
+    };
+
+    float full_distance;
+    float rigid_distance;
+    VehicleGrid grid;
+    // squared distance to the nearest viewer, by dense index
+    vector<float> nearest;
+    // by handle
+    vector<uint8_t> hidden;
+    vector<Change> changes;
+
+    VehicleLod classify(VehicleLod current, float distance_sq, bool hide)
+        const {
+        float stretch = 1.f + FLEET_LOD_HYSTERESIS;
+        float full = current == VEHICLE_LOD_FULL ? full_distance * stretch
+                                                 : full_distance;
+        float rigid = current != VEHICLE_LOD_FAR ? rigid_distance * stretch
+                                                 : rigid_distance;
+        if (distance_sq <= full * full)
+            return VEHICLE_LOD_FULL;
+        if (distance_sq <= rigid * rigid && !hide)
+            return VEHICLE_LOD_RIGID;
+        return VEHICLE_LOD_FAR;
+    }
+
+   public:
+    FleetLod(float full_distance_ = FLEET_LOD_FULL_DISTANCE,
+             float rigid_distance_ = FLEET_LOD_RIGID_DISTANCE)
+        : full_distance(full_distance_),
+          rigid_distance(max(rigid_distance_, full_distance_)),
+          grid(rigid_distance / 4) {}
+
+    float get_full_distance() const { return full_distance; }
+
+    float get_rigid_distance() const { return rigid_distance; }
+
+    // Hidden vehicles beyond the full distance go far instead of rigid;
+    // close ones keep full detail, the player may still run into them.
+    void set_hidden(int handle, bool hide) {
+        if ((size_t)handle >= hidden.size())
+            hidden.resize(handle + 1, 0);
+        hidden[handle] = hide;
+    }
+
+    // Re-tiers the fleet for this frame's viewers; call between steps.
+    void update(FleetSimulator& fleet,
+                const Vector3f* viewers,
+                size_t viewer_count) {
+        grid.build(fleet);
+        size_t n = fleet.size();
+        nearest.assign(n, numeric_limits<float>::infinity());
+        float reach = rigid_distance * (1.f + FLEET_LOD_HYSTERESIS);
+        for (size_t k = 0; k < viewer_count; k++) {
+            grid.query(viewers[k](0), viewers[k](1), reach,
+                       [this](size_t v, float distance_sq) {
+                           if (distance_sq < nearest[v])
+                               nearest[v] = distance_sq;
+                       });
+        }
+
+        // set_lod reorders the fleet, so collect the changes by handle first
+        changes.clear();
+        for (size_t v = 0; v < n; v++) {
+            int handle = fleet.handle_of(v);
+            VehicleLod current = fleet.get_lod(handle);
+            bool hide = (size_t)handle < hidden.size() && hidden[handle];
+            VehicleLod lod = classify(current, nearest[v], hide);
+            if (lod != current) {
+                Change change = {handle, lod};
+                changes.push_back(change);
+            }
+        }
+        for (const Change& change : changes) {
+            fleet.set_lod(change.handle, change.lod);
+        }
+    }
+
+    const VehicleGrid& get_grid() const { return grid; }
+};
+
+#endif
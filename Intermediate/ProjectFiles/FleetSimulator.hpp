@@ -0,0 +1,1319 @@
+#ifndef _FLEETSIMULATOR_HPP_
+#define _FLEETSIMULATOR_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "Eigen/Eigen/Dense"
+#include "FixedStep.hpp"
+#include "FleetForceKernels.hpp"
+#include "FleetThreadPool.hpp"
+#include "GroundQuery.hpp"
+#include "Instrumentation.hpp"
+#include "Integrator.hpp"
+#include "Particle.hpp"
+#include "ParticleForce.hpp"
+#include "VehicleArchetype.hpp"
+#include "VehicleCommand.hpp"
+using namespace std;
+using namespace Eigen;
+
+#define FLEET_WHEEL_COUNT 4
+#define FLEET_ALIGNMENT 64
+// vehicles per parallel chunk; a multiple of 16 keeps chunk boundaries of the
+// per-vehicle columns on separate cache lines
+#define FLEET_DEFAULT_CHUNK 256
+// steps between two steps of a far vehicle
+#define FLEET_FAR_INTERVAL 8
+// steps a vehicle must rest for before it falls asleep, and the speed of
+// its body and wheels below which it counts as resting
+#define FLEET_SLEEP_STEPS 30
+#define FLEET_SLEEP_VELOCITY 2.f
+
+// How much of the model a vehicle runs. Full is Vehicle4WSimulator's five
+// particles; rigid moves the body and wheels as one particle with a single
+// ground sweep, the suspension frozen as it was; far runs the rigid model
+// every few steps over the time it missed, or not at all.
+enum VehicleLod {
+    VEHICLE_LOD_FULL,
+    VEHICLE_LOD_RIGID,
+    VEHICLE_LOD_FAR,
+    VEHICLE_LOD_COUNT
+};
+
+// Cache-line aligned allocator so every SoA column starts on its own line and
+// can be streamed with aligned vector loads.
+template <typename T>
+class AlignedAllocator {
+   public:
+    typedef T value_type;
+
+    AlignedAllocator() {}
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* raw = malloc(n * sizeof(T) + FLEET_ALIGNMENT + sizeof(void*));
+        if (!raw)
+            throw bad_alloc();
+        uintptr_t addr = (uintptr_t)raw + sizeof(void*);
+        addr = (addr + FLEET_ALIGNMENT - 1) & ~(uintptr_t)(FLEET_ALIGNMENT - 1);
+        ((void**)addr)[-1] = raw;
+        return (T*)addr;
+    }
+
+    void deallocate(T* ptr, size_t) {
+        if (ptr)
+            free(((void**)ptr)[-1]);
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const {
+        return false;
+    }
+};
+
+typedef vector<float, AlignedAllocator<float>> FloatColumn;
+typedef vector<uint8_t, AlignedAllocator<uint8_t>> FlagColumn;
+
+// Structure-of-arrays mirror of Particle: one column per scalar component.
+struct ParticleColumns {
+    FloatColumn mass;
+    FloatColumn x, y, z;
+    FloatColumn vx, vy, vz;
+    FloatColumn fx, fy, fz;
+    FloatColumn wx, wy, wz;
+    FloatColumn qw, qx, qy, qz;
+
+    template <typename F>
+    void for_each_column(F f) {
+        FloatColumn* columns[] = {&mass, &x,  &y,  &z,  &vx, &vy,
+                                  &vz,   &fx, &fy, &fz, &wx, &wy,
+                                  &wz,   &qw, &qx, &qy, &qz};
+        for (FloatColumn* column : columns)
+            f(*column);
+    }
+
+    void resize(size_t n) {
+        for_each_column([n](FloatColumn& c) { c.resize(n, 0.f); });
+    }
+
+    void move(size_t from, size_t to) {
+        for_each_column([from, to](FloatColumn& c) { c[to] = c[from]; });
+    }
+
+    void swap(size_t a, size_t b) {
+        for_each_column([a, b](FloatColumn& c) { std::swap(c[a], c[b]); });
+    }
+
+    void set(size_t i,
+             float mass_,
+             const Vector3f& location_,
+             const Quaternionf& quat_,
+             const Vector3f& linear_velocity_,
+             const Vector3f& angular_velocity_) {
+        mass[i] = mass_;
+        x[i] = location_(0), y[i] = location_(1), z[i] = location_(2);
+        vx[i] = linear_velocity_(0), vy[i] = linear_velocity_(1),
+        vz[i] = linear_velocity_(2);
+        fx[i] = fy[i] = fz[i] = 0.f;
+        wx[i] = angular_velocity_(0), wy[i] = angular_velocity_(1),
+        wz[i] = angular_velocity_(2);
+        qw[i] = quat_.w(), qx[i] = quat_.x(), qy[i] = quat_.y(),
+        qz[i] = quat_.z();
+    }
+
+    Vector3f location(size_t i) const { return Vector3f(x[i], y[i], z[i]); }
+
+    Vector3f force(size_t i) const { return Vector3f(fx[i], fy[i], fz[i]); }
+
+    Vector3f linear_velocity(size_t i) const {
+        return Vector3f(vx[i], vy[i], vz[i]);
+    }
+
+    Quaternionf quat(size_t i) const {
+        return Quaternionf(qw[i], qx[i], qy[i], qz[i]);
+    }
+
+    ParticleKernelArgs kernel_args() {
+        ParticleKernelArgs a = {mass.data(), x.data(),  y.data(),  z.data(),
+                                vx.data(),   vy.data(), vz.data(), fx.data(),
+                                fy.data(),   fz.data()};
+        return a;
+    }
+};
+
+// Per-vehicle constants and frame state that the force kernels read.
+struct VehicleColumns {
+    FloatColumn origin_x, origin_y, origin_z;
+    FloatColumn extent_x, extent_y, extent_z;
+    FloatColumn wheel_radius;
+    FloatColumn gravity_acc;
+    FloatColumn spring_constant;
+    FloatColumn balance;
+    FloatColumn loss_coeff;
+    FloatColumn damping;
+
+    template <typename F>
+    void for_each_column(F f) {
+        FloatColumn* columns[] = {
+            &origin_x,     &origin_y,    &origin_z,        &extent_x,
+            &extent_y,     &extent_z,    &wheel_radius,    &gravity_acc,
+            &spring_constant, &balance,  &loss_coeff,      &damping};
+        for (FloatColumn* column : columns)
+            f(*column);
+    }
+
+    void resize(size_t n) {
+        for_each_column([n](FloatColumn& c) { c.resize(n, 0.f); });
+    }
+
+    void move(size_t from, size_t to) {
+        for_each_column([from, to](FloatColumn& c) { c[to] = c[from]; });
+    }
+
+    void swap(size_t a, size_t b) {
+        for_each_column([a, b](FloatColumn& c) { std::swap(c[a], c[b]); });
+    }
+};
+
+// Per-wheel state that is not part of the particle itself.
+struct WheelColumns {
+    // rest length of the body<->wheel spring seen from the body; the wheel
+    // side uses the negated value, as in Vehicle4WSimulator
+    FloatColumn normal_length;
+    // hit point relative to the vehicle origin, valid when grounded is set
+    FloatColumn hit_x, hit_y, hit_z;
+    FlagColumn grounded;
+
+    void resize(size_t n) {
+        normal_length.resize(n, 0.f);
+        hit_x.resize(n, 0.f);
+        hit_y.resize(n, 0.f);
+        hit_z.resize(n, 0.f);
+        grounded.resize(n, 0);
+    }
+
+    void move(size_t from, size_t to) {
+        normal_length[to] = normal_length[from];
+        hit_x[to] = hit_x[from];
+        hit_y[to] = hit_y[from];
+        hit_z[to] = hit_z[from];
+        grounded[to] = grounded[from];
+    }
+
+    void swap(size_t a, size_t b) {
+        std::swap(normal_length[a], normal_length[b]);
+        std::swap(hit_x[a], hit_x[b]);
+        std::swap(hit_y[a], hit_y[b]);
+        std::swap(hit_z[a], hit_z[b]);
+        std::swap(grounded[a], grounded[b]);
+    }
+};
+
+// Per-vehicle input: the held axes, the axes averaged over the running step,
+// and the vehicle's slice [command_begin, command_end) of the fleet's queue.
+struct InputColumns {
+    FloatColumn throttle, brake, steer;
+    FloatColumn step_throttle, step_brake, step_steer;
+    vector<size_t> command_begin, command_end;
+
+    void resize(size_t n) {
+        FloatColumn* columns[] = {&throttle,      &brake,      &steer,
+                                  &step_throttle, &step_brake, &step_steer};
+        for (FloatColumn* column : columns)
+            column->resize(n, 0.f);
+        command_begin.resize(n, 0);
+        command_end.resize(n, 0);
+    }
+
+    void move(size_t from, size_t to) {
+        throttle[to] = throttle[from];
+        brake[to] = brake[from];
+        steer[to] = steer[from];
+        command_begin[to] = command_begin[from];
+        command_end[to] = command_end[from];
+    }
+
+    void swap(size_t a, size_t b) {
+        std::swap(throttle[a], throttle[b]);
+        std::swap(brake[a], brake[b]);
+        std::swap(steer[a], steer[b]);
+        std::swap(command_begin[a], command_begin[b]);
+        std::swap(command_end[a], command_end[b]);
+    }
+
+    VehicleInput held(size_t v) const {
+        VehicleInput held_input = {throttle[v], brake[v], steer[v]};
+        return held_input;
+    }
+
+    VehicleInput step(size_t v) const {
+        VehicleInput step_input = {step_throttle[v], step_brake[v],
+                                   step_steer[v]};
+        return step_input;
+    }
+};
+
+// Steps many Vehicle4WSimulator-equivalent vehicles at once. Every vehicle's
+// body and wheels live in contiguous columns (wheel j of vehicle v is at
+// v * FLEET_WHEEL_COUNT + j), and apply() runs each force type as one pass
+// over the whole fleet instead of one virtual call per particle.
+//
+// Vehicles are addressed by a stable handle; removal swaps the last vehicle
+// into the freed slot so the columns stay dense. The dense order is also
+// partitioned by VehicleLod, full vehicles first, so every tier is one
+// contiguous range for the kernels. Sleeping vehicles come last, whatever
+// their tier, and are neither stepped nor swept until they wake.
+class FleetSimulator {
+    ParticleColumns bodies;
+    ParticleColumns wheels;
+    VehicleColumns vehicles;
+    WheelColumns wheel_state;
+    InputColumns input;
+    size_t vehicle_count;
+    FleetKernelLevel kernel_level;
+
+    // commands of every vehicle, grouped by vehicle index in time order;
+    // time is the start of the next step
+    vector<VehicleCommand> commands;
+    vector<VehicleCommand> command_scratch;
+    vector<size_t> command_offsets;
+    double time;
+    bool input_active;
+
+    // the partition after the last tier, holding the sleeping vehicles
+    static const int ASLEEP = VEHICLE_LOD_COUNT;
+
+    // tier t holds the indices [lod_begin(t), lod_end[t])
+    size_t lod_end[VEHICLE_LOD_COUNT + 1];
+    // time a far vehicle has been stepped up to
+    vector<double> advanced_time;
+    int far_interval;
+    uint64_t step_count;
+
+    // by dense index: the tier a sleeping vehicle wakes into, and the steps
+    // an awake one has been resting for
+    vector<uint8_t> sleep_lod;
+    vector<uint32_t> rest_steps;
+    int sleep_steps;
+    float sleep_velocity;
+
+    vector<int> handle_to_index;
+    vector<int> index_to_handle;
+    vector<int> free_handles;
+
+    static void clear_forces(ParticleColumns& columns,
+                             size_t begin,
+                             size_t end) {
+        fill(columns.fx.begin() + begin, columns.fx.begin() + end, 0.f);
+        fill(columns.fy.begin() + begin, columns.fy.begin() + end, 0.f);
+        fill(columns.fz.begin() + begin, columns.fz.begin() + end, 0.f);
+    }
+
+    // gravity, springs, contact, friction and the frame constraint of
+    // vehicles [begin, end), accumulated from zero
+    void apply_forces(size_t begin, size_t end, float delta_time) {
+        INSTRUMENT_SCOPE(INSTRUMENT_FORCES);
+        clear_forces(bodies, begin, end);
+        clear_forces(wheels, begin * FLEET_WHEEL_COUNT,
+                     end * FLEET_WHEEL_COUNT);
+
+        // wheels: gravity, spring, contact, friction
+        WheelKernelArgs wheel_args = {
+            wheels.mass.data(),
+            wheels.z.data(),
+            wheels.vx.data(),
+            wheels.vy.data(),
+            wheels.vz.data(),
+            wheels.fx.data(),
+            wheels.fy.data(),
+            wheels.fz.data(),
+            wheel_state.normal_length.data(),
+            wheel_state.grounded.data(),
+            bodies.z.data(),
+            vehicles.gravity_acc.data(),
+            vehicles.spring_constant.data(),
+            vehicles.balance.data(),
+            vehicles.loss_coeff.data(),
+            vehicles.damping.data(),
+        };
+        fleet_wheel_forces(kernel_level, wheel_args, begin, end, delta_time);
+
+        // body: gravity, spring, frame constraint
+        for (size_t v = begin; v < end; v++) {
+            float k = vehicles.spring_constant[v];
+            bodies.fz[v] += bodies.mass[v] * -vehicles.gravity_acc[v];
+
+            float force_sum = 0.f;
+            float vel_x = 0.f, vel_y = 0.f;
+            for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+                size_t w = v * FLEET_WHEEL_COUNT + i;
+                float val = (bodies.z[v] - wheels.z[w]) -
+                            wheel_state.normal_length[w];
+                force_sum += -(val * k);
+                vel_x += wheels.vx[w];
+                vel_y += wheels.vy[w];
+            }
+            bodies.fz[v] += force_sum;
+            bodies.vx[v] = vel_x / FLEET_WHEEL_COUNT;
+            bodies.vy[v] = vel_y / FLEET_WHEEL_COUNT;
+        }
+
+        // throttle and brake
+        for (size_t v = begin; input_active && v < end; v++) {
+            VehicleInput step = input.step(v);
+            if (step.throttle == 0.f && step.brake == 0.f)
+                continue;
+            update_input_forces(bodies, step, v, delta_time);
+            for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+                update_input_forces(wheels, step, v * FLEET_WHEEL_COUNT + i,
+                                    delta_time);
+            }
+        }
+    }
+
+    size_t lod_begin(int lod) const { return lod ? lod_end[lod - 1] : 0; }
+
+    // tier of v, or ASLEEP
+    int partition_of(size_t v) const {
+        int t = 0;
+        while (v >= lod_end[t])
+            t++;
+        return t;
+    }
+
+    VehicleLod lod_of(size_t v) const {
+        int t = partition_of(v);
+        return t == ASLEEP ? (VehicleLod)sleep_lod[v] : (VehicleLod)t;
+    }
+
+    bool far_due(size_t v) const {
+        return far_interval > 0 && (step_count + v) % far_interval == 0;
+    }
+
+    // the archetype's constants into vehicle v's columns
+    void write_archetype(size_t v, const VehicleArchetype& archetype) {
+        const VehicleArchetypeDesc& desc = archetype.desc;
+        vehicles.extent_x[v] = desc.body_box_extent(0);
+        vehicles.extent_y[v] = desc.body_box_extent(1);
+        vehicles.extent_z[v] = desc.body_box_extent(2);
+        vehicles.wheel_radius[v] = desc.wheel_radius;
+        vehicles.gravity_acc[v] = desc.gravity_acc;
+        vehicles.spring_constant[v] = desc.spring_constant;
+        vehicles.balance[v] = archetype.balance;
+        vehicles.loss_coeff[v] = desc.loss_coeff;
+        vehicles.damping[v] = desc.damping;
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            wheel_state.normal_length[v * FLEET_WHEEL_COUNT + i] =
+                archetype.normal_length_body[i];
+        }
+    }
+
+    void swap_vehicles(size_t a, size_t b) {
+        if (a == b)
+            return;
+        bodies.swap(a, b);
+        vehicles.swap(a, b);
+        input.swap(a, b);
+        std::swap(advanced_time[a], advanced_time[b]);
+        std::swap(sleep_lod[a], sleep_lod[b]);
+        std::swap(rest_steps[a], rest_steps[b]);
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            wheels.swap(a * FLEET_WHEEL_COUNT + i, b * FLEET_WHEEL_COUNT + i);
+            wheel_state.swap(a * FLEET_WHEEL_COUNT + i,
+                             b * FLEET_WHEEL_COUNT + i);
+        }
+        std::swap(index_to_handle[a], index_to_handle[b]);
+        handle_to_index[index_to_handle[a]] = (int)a;
+        handle_to_index[index_to_handle[b]] = (int)b;
+    }
+
+    // Moves vehicle v from tier from to tier to across the partitions in
+    // between, one swap with a boundary vehicle each; returns its new index.
+    size_t move_tier(size_t v, int from, int to) {
+        for (int t = from; t > to; t--) {
+            size_t first = lod_begin(t);
+            swap_vehicles(v, first);
+            v = first;
+            lod_end[t - 1]++;
+        }
+        for (int t = from; t < to; t++) {
+            size_t last = lod_end[t] - 1;
+            swap_vehicles(v, last);
+            v = last;
+            lod_end[t]--;
+        }
+        return v;
+    }
+
+    // Leaving the full model: the body and wheels go on with their summed
+    // momentum, so the rigid model starts where the springs left off.
+    void make_rigid(size_t v) {
+        float mass = bodies.mass[v];
+        Vector3f momentum = mass * bodies.linear_velocity(v);
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = v * FLEET_WHEEL_COUNT + i;
+            mass += wheels.mass[w];
+            momentum += wheels.mass[w] * wheels.linear_velocity(w);
+        }
+        Vector3f velocity = momentum / mass;
+        bodies.vx[v] = velocity(0), bodies.vy[v] = velocity(1),
+        bodies.vz[v] = velocity(2);
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = v * FLEET_WHEEL_COUNT + i;
+            wheels.vx[w] = velocity(0), wheels.vy[w] = velocity(1),
+            wheels.vz[w] = velocity(2);
+        }
+    }
+
+    // Counts the steps v has been resting for: on the ground, no throttle or
+    // steer held or queued, and the wheels and the body's horizontal motion
+    // slower than sleep_velocity. The body may still bounce on the springs,
+    // and a resting wheel may flicker in and out of its sweep's reach.
+    void update_rest(size_t v) {
+        float limit = sleep_velocity * sleep_velocity;
+        bool resting = input.throttle[v] == 0.f && input.steer[v] == 0.f &&
+                       input.command_begin[v] == input.command_end[v] &&
+                       bodies.vx[v] * bodies.vx[v] +
+                               bodies.vy[v] * bodies.vy[v] <
+                           limit;
+        bool grounded = false;
+        for (int i = 0; resting && i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = v * FLEET_WHEEL_COUNT + i;
+            grounded = grounded || wheel_state.grounded[w];
+            resting = wheels.linear_velocity(w).squaredNorm() < limit;
+        }
+        rest_steps[v] = resting && grounded ? rest_steps[v] + 1 : 0;
+    }
+
+    // Stops v where it stands, with the body at the height its springs hold
+    // it at rather than wherever its bounce froze, and moves it past the
+    // last tier.
+    void fall_asleep(size_t v) {
+        int lod = partition_of(v);
+        sleep_lod[v] = (uint8_t)lod;
+        float z = -bodies.mass[v] * vehicles.gravity_acc[v] /
+                  vehicles.spring_constant[v];
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = v * FLEET_WHEEL_COUNT + i;
+            z += wheels.z[w] + wheel_state.normal_length[w];
+        }
+        bodies.z[v] = z / FLEET_WHEEL_COUNT;
+        bodies.vx[v] = bodies.vy[v] = bodies.vz[v] = 0.f;
+        bodies.fx[v] = bodies.fy[v] = bodies.fz[v] = 0.f;
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = v * FLEET_WHEEL_COUNT + i;
+            wheels.vx[w] = wheels.vy[w] = wheels.vz[w] = 0.f;
+            wheels.fx[w] = wheels.fy[w] = wheels.fz[w] = 0.f;
+        }
+        move_tier(v, lod, ASLEEP);
+    }
+
+    // Moves the sleeping v back into its tier; returns its new index.
+    size_t wake_index(size_t v) {
+        int lod = sleep_lod[v];
+        rest_steps[v] = 0;
+        v = move_tier(v, ASLEEP, lod);
+        if (lod == VEHICLE_LOD_FAR)
+            advanced_time[v] = time;
+        return v;
+    }
+
+    // Puts every vehicle that rested for sleep_steps to sleep. Going down
+    // the awake range, a vehicle swapped into v has already been looked at.
+    void sleep_rested() {
+        for (size_t v = lod_end[VEHICLE_LOD_FAR]; v-- > 0;) {
+            if (rest_steps[v] >= (uint32_t)sleep_steps)
+                fall_asleep(v);
+        }
+    }
+
+    // The rigid model over [t0, t0 + delta_time): gravity, contact and
+    // friction as the wheel kernel computes them, on the summed mass, then
+    // one displacement for the body and every wheel.
+    void apply_rigid(size_t v, double t0, float delta_time) {
+        VehicleInput step = {0.f, 0.f, 0.f};
+        if (input_active) {
+            VehicleInput held = input.held(v);
+            step = consume_commands(commands.data(), &input.command_begin[v],
+                                    input.command_end[v], t0,
+                                    t0 + delta_time, &held);
+            input.throttle[v] = held.throttle;
+            input.brake[v] = held.brake;
+            input.steer[v] = held.steer;
+            input.step_throttle[v] = step.throttle;
+            input.step_brake[v] = step.brake;
+            input.step_steer[v] = step.steer;
+        }
+
+        float mass = bodies.mass[v];
+        bool grounded = false;
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = v * FLEET_WHEEL_COUNT + i;
+            mass += wheels.mass[w];
+            grounded = grounded || wheel_state.grounded[w];
+        }
+        float g = vehicles.gravity_acc[v];
+        float vx = bodies.vx[v], vy = bodies.vy[v], vz = bodies.vz[v];
+        float fx = 0.f, fy = 0.f, fz = mass * -g;
+        if (grounded) {
+            float balance = FLEET_WHEEL_COUNT * vehicles.balance[v];
+            float force = balance;
+            if (!(abs(vz) < MAX_DEVIATION))
+                force = (1 + vehicles.loss_coeff[v]) * (-vz) * mass /
+                            delta_time +
+                        balance;
+            fz += force;
+
+            // with the wheel kernel's sign carry-over from X to Y
+            float friction = vehicles.damping[v] * mass * g;
+            if (abs(vx) < (friction / mass) * delta_time) {
+                vx = 0.f;
+            } else {
+                friction *= (vx > 0 ? -1 : 1);
+                fx += friction;
+            }
+            if (abs(vy) < (friction / mass) * delta_time) {
+                vy = 0.f;
+            } else {
+                friction *= (vy > 0 ? -1 : 1);
+                fy += friction;
+            }
+        }
+        if (step.throttle != 0.f || step.brake != 0.f) {
+            fx += mass * input_acceleration(step, vx, delta_time);
+            fy += mass * input_acceleration(step, vy, delta_time);
+        }
+
+        vx += delta_time * fx / mass;
+        vy += delta_time * fy / mass;
+        vz += delta_time * fz / mass;
+        float dx = delta_time * vx, dy = delta_time * vy, dz = delta_time * vz;
+        bodies.x[v] += dx, bodies.y[v] += dy, bodies.z[v] += dz;
+        bodies.vx[v] = vx, bodies.vy[v] = vy, bodies.vz[v] = vz;
+        bodies.fx[v] = fx, bodies.fy[v] = fy, bodies.fz[v] = fz;
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = v * FLEET_WHEEL_COUNT + i;
+            wheels.x[w] += dx, wheels.y[w] += dy, wheels.z[w] += dz;
+            wheels.vx[w] = vx, wheels.vy[w] = vy, wheels.vz[w] = vz;
+            wheels.fx[w] = wheels.fy[w] = wheels.fz[w] = 0.f;
+        }
+
+        if (step.steer != 0.f)
+            turn_wheels(v, step.steer * VEHICLE_STEER_TORQUE, delta_time);
+    }
+
+    // Vehicle4WSimulator::apply for the full vehicles [begin, end)
+    void apply_full(size_t begin, size_t end, float delta_time) {
+        INSTRUMENT_COUNT(INSTRUMENT_VEHICLE_STEPS, end - begin);
+        if (input_active)
+            begin_input(begin, end, delta_time);
+        apply_forces(begin, end, delta_time);
+
+        // apply
+        INSTRUMENT_SCOPE(INSTRUMENT_INTEGRATE);
+        fleet_apply_force(kernel_level, bodies.kernel_args(), begin, end,
+                          delta_time);
+        fleet_apply_force(kernel_level, wheels.kernel_args(),
+                          begin * FLEET_WHEEL_COUNT, end * FLEET_WHEEL_COUNT,
+                          delta_time);
+
+        // steering
+        for (size_t v = begin; input_active && v < end; v++) {
+            if (input.step_steer[v] != 0.f)
+                turn_wheels(v, input.step_steer[v] * VEHICLE_STEER_TORQUE,
+                            delta_time);
+        }
+    }
+
+    // world-space centre of the wheels, where a rigid vehicle sweeps
+    Vector3f ground_probe(size_t v) const {
+        Vector3f center = Vector3f::Zero();
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            center += wheels.location(v * FLEET_WHEEL_COUNT + i);
+        }
+        return Vector3f(vehicles.origin_x[v], vehicles.origin_y[v],
+                        vehicles.origin_z[v]) +
+               center / FLEET_WHEEL_COUNT;
+    }
+
+    // sweeps of the full vehicles [begin, end), one per wheel
+    void query_wheels(const GroundQuery& ground, size_t begin, size_t end) {
+        Vector3f centers[GROUND_QUERY_BLOCK];
+        float radii[GROUND_QUERY_BLOCK];
+        GroundHit hits[GROUND_QUERY_BLOCK];
+        uint8_t hit_flags[GROUND_QUERY_BLOCK];
+
+        size_t first = begin * FLEET_WHEEL_COUNT;
+        size_t last = end * FLEET_WHEEL_COUNT;
+        INSTRUMENT_COUNT(INSTRUMENT_WHEEL_SWEEPS, last - first);
+        for (size_t block = first; block < last; block += GROUND_QUERY_BLOCK) {
+            size_t count = min((size_t)GROUND_QUERY_BLOCK, last - block);
+            for (size_t k = 0; k < count; k++) {
+                size_t w = block + k;
+                size_t v = w / FLEET_WHEEL_COUNT;
+                centers[k] = Vector3f(vehicles.origin_x[v] + wheels.x[w],
+                                      vehicles.origin_y[v] + wheels.y[w],
+                                      vehicles.origin_z[v] + wheels.z[w]);
+                radii[k] = vehicles.wheel_radius[v];
+            }
+            ground.sweep_spheres(centers, radii, count, GROUND_SWEEP_DISTANCE,
+                                 hits, hit_flags);
+            INSTRUMENT_COUNT(INSTRUMENT_WHEEL_HITS,
+                             std::count(hit_flags, hit_flags + count, 1));
+            for (size_t k = 0; k < count; k++) {
+                size_t w = block + k;
+                size_t v = w / FLEET_WHEEL_COUNT;
+                wheel_state.grounded[w] = hit_flags[k];
+                if (hit_flags[k]) {
+                    const Vector3f& point = hits[k].point;
+                    wheel_state.hit_x[w] = point(0) - vehicles.origin_x[v];
+                    wheel_state.hit_y[w] = point(1) - vehicles.origin_y[v];
+                    wheel_state.hit_z[w] = point(2) - vehicles.origin_z[v];
+                }
+            }
+        }
+    }
+
+    // one sweep per vehicle probed[k] from centers[k], for all its wheels
+    void sweep_probes(const GroundQuery& ground,
+                      const Vector3f* centers,
+                      const float* radii,
+                      const size_t* probed,
+                      size_t count) {
+        GroundHit hits[GROUND_QUERY_BLOCK];
+        uint8_t hit_flags[GROUND_QUERY_BLOCK];
+        ground.sweep_spheres(centers, radii, count, GROUND_SWEEP_DISTANCE, hits,
+                             hit_flags);
+        INSTRUMENT_COUNT(INSTRUMENT_WHEEL_SWEEPS, count);
+        INSTRUMENT_COUNT(INSTRUMENT_WHEEL_HITS,
+                         std::count(hit_flags, hit_flags + count, 1));
+        for (size_t k = 0; k < count; k++) {
+            size_t v = probed[k];
+            for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+                size_t w = v * FLEET_WHEEL_COUNT + i;
+                wheel_state.grounded[w] = hit_flags[k];
+                if (hit_flags[k]) {
+                    const Vector3f& point = hits[k].point;
+                    wheel_state.hit_x[w] = point(0) - vehicles.origin_x[v];
+                    wheel_state.hit_y[w] = point(1) - vehicles.origin_y[v];
+                    wheel_state.hit_z[w] = point(2) - vehicles.origin_z[v];
+                }
+            }
+        }
+    }
+
+    float sphere_inertia(float mass, float radius) {
+        return 2.f / 5 * mass * radius * radius;
+    }
+
+    void reserve_index(size_t n) {
+        if (bodies.mass.size() >= n)
+            return;
+        size_t capacity = bodies.mass.size() ? bodies.mass.size() * 2 : 16;
+        while (capacity < n)
+            capacity *= 2;
+        bodies.resize(capacity);
+        wheels.resize(capacity * FLEET_WHEEL_COUNT);
+        vehicles.resize(capacity);
+        wheel_state.resize(capacity * FLEET_WHEEL_COUNT);
+        input.resize(capacity);
+        advanced_time.resize(capacity, 0.);
+        sleep_lod.resize(capacity, 0);
+        rest_steps.resize(capacity, 0);
+    }
+
+    // -1 for handles that are out of range or free
+    int handle_index(int handle) const {
+        if (handle < 0 || handle >= (int)handle_to_index.size())
+            return -1;
+        return handle_to_index[handle];
+    }
+
+    // as Particle::apply_torque with a torque about z on the wheels of v
+    void turn_wheels(size_t v, float torque, float delta_time) {
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = v * FLEET_WHEEL_COUNT + i;
+            float inverse_inertia =
+                1.f / sphere_inertia(wheels.mass[w], vehicles.wheel_radius[v]);
+            wheels.wz[w] += delta_time * (inverse_inertia * torque);
+
+            Vector3f angular_velocity(wheels.wx[w], wheels.wy[w],
+                                      wheels.wz[w]);
+            Quaternionf quat =
+                rotate_quat(wheels.quat(w), angular_velocity, delta_time);
+            wheels.qw[w] = quat.w(), wheels.qx[w] = quat.x();
+            wheels.qy[w] = quat.y(), wheels.qz[w] = quat.z();
+        }
+    }
+
+    // Vehicle4WSimulator::begin_input for vehicles [begin, end); each
+    // vehicle only touches its own slice of the queue
+    void begin_input(size_t begin, size_t end, float delta_time) {
+        for (size_t v = begin; v < end; v++) {
+            VehicleInput held = input.held(v);
+            VehicleInput step = consume_commands(
+                commands.data(), &input.command_begin[v], input.command_end[v],
+                time, time + delta_time, &held);
+            input.throttle[v] = held.throttle;
+            input.brake[v] = held.brake;
+            input.steer[v] = held.steer;
+            input.step_throttle[v] = step.throttle;
+            input.step_brake[v] = step.brake;
+            input.step_steer[v] = step.steer;
+        }
+    }
+
+    void update_input_forces(ParticleColumns& columns,
+                             const VehicleInput& step,
+                             size_t i,
+                             float delta_time) {
+        columns.fx[i] += columns.mass[i] *
+                         input_acceleration(step, columns.vx[i], delta_time);
+        columns.fy[i] += columns.mass[i] *
+                         input_acceleration(step, columns.vy[i], delta_time);
+    }
+
+   public:
+    FleetSimulator()
+        : vehicle_count(0),
+          kernel_level(detect_fleet_kernel_level()),
+          time(0.),
+          input_active(false),
+          far_interval(FLEET_FAR_INTERVAL),
+          step_count(0),
+          sleep_steps(0),
+          sleep_velocity(FLEET_SLEEP_VELOCITY) {
+        fill(lod_end, lod_end + ASLEEP + 1, (size_t)0);
+    }
+
+    // defaults to the widest instruction set the CPU supports
+    void set_kernel_level(FleetKernelLevel level) { kernel_level = level; }
+
+    FleetKernelLevel get_kernel_level() { return kernel_level; }
+
+    // The kernels stream per-vehicle columns, so the archetype's constants
+    // are copied in rather than referenced; the block need not outlive the
+    // call. Its locations are relative to location_. The columns hold four
+    // wheels a vehicle and the kernels are the spring model's: -1, adding
+    // nothing, for archetypes with another wheel count or the tire model.
+    int add_vehicle(const VehicleArchetype& archetype,
+                    Vector3f location_,
+                    Quaternionf quat_,
+                    Vector3f linear_velocity_,
+                    Vector3f angular_velocity_) {
+        if (archetype.desc.wheel_count != FLEET_WHEEL_COUNT ||
+            archetype.desc.tire_model)
+            return -1;
+        size_t v = vehicle_count++;
+        reserve_index(vehicle_count);
+
+        int handle;
+        if (!free_handles.empty()) {
+            handle = free_handles.back();
+            free_handles.pop_back();
+        } else {
+            handle = (int)handle_to_index.size();
+            handle_to_index.push_back(-1);
+        }
+        handle_to_index[handle] = (int)v;
+        index_to_handle.push_back(handle);
+
+        const VehicleArchetypeDesc& desc = archetype.desc;
+        bodies.set(v, desc.body_mass, desc.body_relative_location, quat_,
+                   linear_velocity_, angular_velocity_);
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            wheels.set(v * FLEET_WHEEL_COUNT + i, desc.wheel_mass,
+                       desc.wheel_relative_location[i], quat_,
+                       linear_velocity_, angular_velocity_);
+        }
+
+        vehicles.origin_x[v] = location_(0);
+        vehicles.origin_y[v] = location_(1);
+        vehicles.origin_z[v] = location_(2);
+        write_archetype(v, archetype);
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            wheel_state.grounded[v * FLEET_WHEEL_COUNT + i] = 0;
+        }
+
+        input.throttle[v] = input.brake[v] = input.steer[v] = 0.f;
+        input.command_begin[v] = input.command_end[v] = 0;
+
+        // appended to the sleeping vehicles, then promoted
+        lod_end[ASLEEP] = vehicle_count;
+        advanced_time[v] = time;
+        rest_steps[v] = 0;
+        move_tier(v, ASLEEP, VEHICLE_LOD_FULL);
+        return handle;
+    }
+
+    // a private archetype with the default force constants
+    int add_vehicle(float body_mass_,
+                    float wheel_mass_,
+                    Vector3f location_,
+                    Quaternionf quat_,
+                    Vector3f body_box_extent_,
+                    float wheel_radius_,
+                    Vector3f linear_velocity_,
+                    Vector3f angular_velocity_,
+                    Vector3f body_relative_location_,
+                    Vector3f* wheel_relative_location_arr_) {
+        VehicleArchetype archetype(vehicle_archetype_desc(
+            body_mass_, wheel_mass_, body_box_extent_, wheel_radius_,
+            body_relative_location_, wheel_relative_location_arr_));
+        return add_vehicle(archetype, location_, quat_, linear_velocity_,
+                           angular_velocity_);
+    }
+
+    // Rebinds a vehicle to another archetype, e.g. a reloaded one: masses,
+    // shape and force constants follow it, positions and velocities stay.
+    // A sleeping vehicle wakes to settle on its new springs. Archetypes
+    // add_vehicle() refuses are ignored.
+    void set_archetype(int handle, const VehicleArchetype& archetype) {
+        if (archetype.desc.wheel_count != FLEET_WHEEL_COUNT ||
+            archetype.desc.tire_model)
+            return;
+        wake(handle);
+        size_t v = (size_t)handle_to_index[handle];
+        bodies.mass[v] = archetype.desc.body_mass;
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            wheels.mass[v * FLEET_WHEEL_COUNT + i] = archetype.desc.wheel_mass;
+        }
+        write_archetype(v, archetype);
+    }
+
+    void remove_vehicle(int handle) {
+        size_t v = (size_t)handle_to_index[handle];
+        v = move_tier(v, partition_of(v), ASLEEP);
+        size_t last = --vehicle_count;
+        lod_end[ASLEEP] = vehicle_count;
+        if (v != last) {
+            bodies.move(last, v);
+            vehicles.move(last, v);
+            input.move(last, v);
+            advanced_time[v] = advanced_time[last];
+            sleep_lod[v] = sleep_lod[last];
+            rest_steps[v] = rest_steps[last];
+            for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+                wheels.move(last * FLEET_WHEEL_COUNT + i,
+                            v * FLEET_WHEEL_COUNT + i);
+                wheel_state.move(last * FLEET_WHEEL_COUNT + i,
+                                 v * FLEET_WHEEL_COUNT + i);
+            }
+            int moved = index_to_handle[last];
+            index_to_handle[v] = moved;
+            handle_to_index[moved] = (int)v;
+        }
+        index_to_handle.pop_back();
+        handle_to_index[handle] = -1;
+        free_handles.push_back(handle);
+    }
+
+    size_t size() const { return vehicle_count; }
+
+    int index_of(int handle) const { return handle_to_index[handle]; }
+
+    int handle_of(size_t index) const { return index_to_handle[index]; }
+
+    // Moves a vehicle to another tier between steps. Like remove_vehicle,
+    // this changes the dense index of the vehicle and of the ones it swaps
+    // with. A sleeping vehicle stays asleep and wakes into lod.
+    void set_lod(int handle, VehicleLod lod) {
+        size_t v = (size_t)handle_to_index[handle];
+        int from = partition_of(v);
+        if (from == ASLEEP) {
+            sleep_lod[v] = (uint8_t)lod;
+            return;
+        }
+        if (from == lod)
+            return;
+        if (from == VEHICLE_LOD_FULL)
+            make_rigid(v);
+        v = move_tier(v, from, lod);
+        if (lod == VEHICLE_LOD_FAR)
+            advanced_time[v] = time;
+    }
+
+    VehicleLod get_lod(int handle) const {
+        return lod_of((size_t)handle_to_index[handle]);
+    }
+
+    // awake vehicles at lod
+    size_t lod_size(VehicleLod lod) const {
+        return lod_end[lod] - lod_begin(lod);
+    }
+
+    // Steps between two steps of a far vehicle, each covering the time since
+    // its last; 0 leaves far vehicles dormant.
+    void set_far_interval(int steps) { far_interval = steps < 0 ? 0 : steps; }
+
+    int get_far_interval() const { return far_interval; }
+
+    // sweeps the vehicle needs before the next step: one per wheel at full
+    // detail, one from get_ground_probe() for the same hit on every wheel
+    // otherwise, none for a far vehicle that skips the step or a sleeping
+    // one
+    int ground_queries(int handle) const {
+        size_t v = (size_t)handle_to_index[handle];
+        int t = partition_of(v);
+        return t == VEHICLE_LOD_FULL    ? FLEET_WHEEL_COUNT
+               : t == VEHICLE_LOD_RIGID ? 1
+               : t == VEHICLE_LOD_FAR   ? far_due(v)
+                                        : 0;
+    }
+
+    // A vehicle resting for steps steps in a row falls asleep: on the
+    // ground, every wheel below velocity, as is the body horizontally, with
+    // no throttle or steer held and no commands queued. It then keeps its
+    // state until submit(), move(), turn(), wake() or wake_near(). 0 keeps
+    // every vehicle awake, and wakes the sleeping ones.
+    void set_sleep(int steps, float velocity = FLEET_SLEEP_VELOCITY) {
+        sleep_steps = steps < 0 ? 0 : steps;
+        sleep_velocity = velocity;
+        if (!sleep_steps) {
+            while (lod_end[VEHICLE_LOD_FAR] < vehicle_count)
+                wake_index(lod_end[VEHICLE_LOD_FAR]);
+        }
+    }
+
+    int get_sleep_steps() const { return sleep_steps; }
+
+    float get_sleep_velocity() const { return sleep_velocity; }
+
+    bool is_asleep(int handle) const {
+        return (size_t)handle_to_index[handle] >= lod_end[VEHICLE_LOD_FAR];
+    }
+
+    // e.g. after an impulse from outside the simulation; changes dense
+    // indices as set_lod does
+    void wake(int handle) {
+        size_t v = (size_t)handle_to_index[handle];
+        if (v >= lod_end[VEHICLE_LOD_FAR])
+            wake_index(v);
+    }
+
+    // Wakes the sleeping vehicles whose body is within radius of center,
+    // in world space; call when the ground there changes.
+    void wake_near(const Vector3f& center, float radius) {
+        // going up, the vehicle a wake swaps into v is one already seen
+        for (size_t v = lod_end[VEHICLE_LOD_FAR]; v < vehicle_count; v++) {
+            Vector3f body(vehicles.origin_x[v] + bodies.x[v],
+                          vehicles.origin_y[v] + bodies.y[v],
+                          vehicles.origin_z[v] + bodies.z[v]);
+            if ((body - center).squaredNorm() <= radius * radius)
+                wake_index(v);
+        }
+    }
+
+    size_t asleep_size() const {
+        return vehicle_count - lod_end[VEHICLE_LOD_FAR];
+    }
+
+    size_t awake_size() const { return lod_end[VEHICLE_LOD_FAR]; }
+
+    Vector3f get_ground_probe(int handle) const {
+        return ground_probe((size_t)handle_to_index[handle]);
+    }
+
+    // world-space hit point of a wheel sweep, nullptr when airborne
+    void set_hit_point(int handle, int i, const Vector3f* hit_point) {
+        size_t v = (size_t)handle_to_index[handle];
+        size_t w = v * FLEET_WHEEL_COUNT + i;
+        if (!hit_point) {
+            wheel_state.grounded[w] = 0;
+            return;
+        }
+        wheel_state.grounded[w] = 1;
+        wheel_state.hit_x[w] = (*hit_point)(0) - vehicles.origin_x[v];
+        wheel_state.hit_y[w] = (*hit_point)(1) - vehicles.origin_y[v];
+        wheel_state.hit_z[w] = (*hit_point)(2) - vehicles.origin_z[v];
+    }
+
+    // sweeps the wheels of vehicles [begin, end) against ground, in blocks of
+    // GROUND_QUERY_BLOCK sweeps; safe to run per chunk in parallel. Rigid
+    // vehicles and far ones due in the next step sweep once, from the
+    // centre of their wheels; sleeping ones not at all.
+    void query_ground(const GroundQuery& ground, size_t begin, size_t end) {
+        INSTRUMENT_SCOPE(INSTRUMENT_SWEEP);
+        end = min(end, lod_end[VEHICLE_LOD_FAR]);
+        size_t full_end = min(end, lod_end[VEHICLE_LOD_FULL]);
+        if (begin < full_end)
+            query_wheels(ground, begin, full_end);
+
+        Vector3f centers[GROUND_QUERY_BLOCK];
+        float radii[GROUND_QUERY_BLOCK];
+        size_t probed[GROUND_QUERY_BLOCK];
+        size_t count = 0;
+        for (size_t v = max(begin, full_end); v < end; v++) {
+            if (v >= lod_end[VEHICLE_LOD_RIGID] && !far_due(v))
+                continue;
+            centers[count] = ground_probe(v);
+            radii[count] = vehicles.wheel_radius[v];
+            probed[count++] = v;
+            if (count == GROUND_QUERY_BLOCK) {
+                sweep_probes(ground, centers, radii, probed, count);
+                count = 0;
+            }
+        }
+        if (count)
+            sweep_probes(ground, centers, radii, probed, count);
+    }
+
+    void query_ground(const GroundQuery& ground) {
+        query_ground(ground, 0, vehicle_count);
+    }
+
+    // Vehicle4WSimulator::apply for vehicles [begin, end), or the rigid model
+    // for those not at VEHICLE_LOD_FULL; sleeping vehicles are skipped.
+    // Forces are cleared when the step starts, so afterwards fx, fy, fz hold
+    // what it applied.
+    void apply_range(size_t begin, size_t end, float delta_time) {
+        INSTRUMENT_SCOPE(INSTRUMENT_STEP);
+        end = min(end, lod_end[VEHICLE_LOD_FAR]);
+        size_t full_end = min(end, lod_end[VEHICLE_LOD_FULL]);
+        if (begin < full_end)
+            apply_full(begin, full_end, delta_time);
+        for (size_t v = begin; sleep_steps && v < full_end; v++) {
+            update_rest(v);
+        }
+
+        size_t rigid_end = min(end, lod_end[VEHICLE_LOD_RIGID]);
+        for (size_t v = max(begin, full_end); v < rigid_end; v++) {
+            apply_rigid(v, time, delta_time);
+            if (sleep_steps)
+                update_rest(v);
+        }
+        INSTRUMENT_COUNT(INSTRUMENT_VEHICLE_STEPS,
+                         rigid_end > full_end ? rigid_end - full_end : 0);
+
+        // far vehicles catch up on the steps they skipped
+        double step_end = time + delta_time;
+        for (size_t v = max(begin, rigid_end); v < end; v++) {
+            if (!far_due(v))
+                continue;
+            INSTRUMENT_COUNT(INSTRUMENT_VEHICLE_STEPS, 1);
+            apply_rigid(v, advanced_time[v],
+                        (float)(step_end - advanced_time[v]));
+            advanced_time[v] = step_end;
+            if (sleep_steps)
+                update_rest(v);
+        }
+    }
+
+    void apply(float delta_time) {
+        apply_range(0, vehicle_count, delta_time);
+        advance_time(delta_time);
+    }
+
+    // Vehicles are independent within a step, so chunks can run on any
+    // thread in any order and the result is bit-identical to apply(). After
+    // the last chunk of a step, advance_time() moves the clock past it and
+    // puts rested vehicles to sleep. Chunks only cover the awake vehicles.
+    size_t chunk_count(size_t chunk_size) const {
+        return (lod_end[VEHICLE_LOD_FAR] + chunk_size - 1) / chunk_size;
+    }
+
+    void apply_chunk(size_t chunk, size_t chunk_size, float delta_time) {
+        size_t begin = chunk * chunk_size;
+        size_t end = begin + chunk_size;
+        apply_range(begin, end < vehicle_count ? end : vehicle_count,
+                    delta_time);
+    }
+
+    void apply_parallel(FleetThreadPool& pool,
+                        float delta_time,
+                        size_t chunk_size = FLEET_DEFAULT_CHUNK) {
+        pool.parallel_for(chunk_count(chunk_size), [&](size_t chunk) {
+            apply_chunk(chunk, chunk_size, delta_time);
+        });
+        advance_time(delta_time);
+    }
+
+    void advance_time(float delta_time) {
+        time += delta_time;
+        step_count++;
+        if (sleep_steps)
+            sleep_rested();
+        INSTRUMENT_COUNT(INSTRUMENT_ASLEEP_VEHICLES, asleep_size());
+        INSTRUMENT_COUNT(INSTRUMENT_AWAKE_VEHICLES, awake_size());
+    }
+
+    // start of the next step on the clock command times refer to
+    double get_time() { return time; }
+
+    void set_time(double time_) { time = time_; }
+
+    // Hands over a batch of commands, addressed by vehicle handle, and
+    // clears it. Call between steps; the steps then consume each vehicle's
+    // commands from its own slice without locking. Commands for unknown
+    // handles are dropped.
+    void submit(VehicleCommandBuffer& batch) {
+        if (batch.empty())
+            return;
+
+        // counting sort by vehicle index, queued commands ahead of the batch
+        command_offsets.assign(vehicle_count + 1, 0);
+        for (size_t v = 0; v < vehicle_count; v++) {
+            command_offsets[v + 1] =
+                input.command_end[v] - input.command_begin[v];
+        }
+        for (size_t k = 0; k < batch.size(); k++) {
+            int index = handle_index(batch[k].vehicle);
+            if (index >= 0)
+                command_offsets[index + 1]++;
+        }
+        for (size_t v = 0; v < vehicle_count; v++) {
+            command_offsets[v + 1] += command_offsets[v];
+        }
+
+        command_scratch.resize(command_offsets[vehicle_count]);
+        for (size_t v = 0; v < vehicle_count; v++) {
+            size_t first = command_offsets[v];
+            copy(commands.begin() + input.command_begin[v],
+                 commands.begin() + input.command_end[v],
+                 command_scratch.begin() + first);
+            input.command_end[v] =
+                first + input.command_end[v] - input.command_begin[v];
+            input.command_begin[v] = first;
+        }
+        for (size_t k = 0; k < batch.size(); k++) {
+            int index = handle_index(batch[k].vehicle);
+            if (index >= 0)
+                command_scratch[input.command_end[index]++] = batch[k].command;
+        }
+        batch.clear();
+
+        // a batch may hold commands older than queued ones
+        for (size_t v = 0; v < vehicle_count; v++) {
+            vector<VehicleCommand>::iterator first =
+                command_scratch.begin() + input.command_begin[v];
+            vector<VehicleCommand>::iterator last =
+                command_scratch.begin() + input.command_end[v];
+            auto earlier = [](const VehicleCommand& a,
+                              const VehicleCommand& b) {
+                return a.time < b.time;
+            };
+            if (!is_sorted(first, last, earlier))
+                stable_sort(first, last, earlier);
+        }
+        commands.swap(command_scratch);
+        input_active = true;
+
+        // going up, the vehicle a wake swaps into v is one already seen
+        for (size_t v = lod_end[VEHICLE_LOD_FAR]; v < vehicle_count; v++) {
+            if (input.command_begin[v] != input.command_end[v])
+                wake_index(v);
+        }
+    }
+
+    // input held after the last step
+    VehicleInput get_input(int handle) {
+        return input.held((size_t)handle_to_index[handle]);
+    }
+
+    void move(int handle, bool forward) {
+        static char flag[2] = {-1, 1};
+        wake(handle);
+        size_t v = (size_t)handle_to_index[handle];
+        bodies.vx[v] += flag[forward] * 20.f;
+        bodies.vy[v] += flag[forward] * 20.f;
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = v * FLEET_WHEEL_COUNT + i;
+            wheels.vx[w] += flag[forward] * 20.f;
+            wheels.vy[w] += flag[forward] * 20.f;
+        }
+    }
+
+    void turn(int handle, bool left, float delta_time = FIXED_STEP_DELTA_TIME) {
+        float turn_radius = 10.f;
+        float force = 1000.f;
+        wake(handle);
+        turn_wheels((size_t)handle_to_index[handle], force * turn_radius,
+                    delta_time);
+    }
+
+    Vector3f get_location(int handle) {
+        size_t v = (size_t)handle_to_index[handle];
+        return Vector3f(vehicles.origin_x[v], vehicles.origin_y[v],
+                        vehicles.origin_z[v]);
+    }
+
+    Vector3f get_body_relative_location(int handle) {
+        return bodies.location((size_t)handle_to_index[handle]);
+    }
+
+    Vector3f get_body_location(int handle) {
+        return get_location(handle) + get_body_relative_location(handle);
+    }
+
+    Quaternionf get_body_relative_quat(int handle) {
+        return bodies.quat((size_t)handle_to_index[handle]);
+    }
+
+    Vector3f get_body_linear_velocity(int handle) {
+        return bodies.linear_velocity((size_t)handle_to_index[handle]);
+    }
+
+    // force integrated by the last step
+    Vector3f get_body_applied_force(int handle) {
+        return bodies.force((size_t)handle_to_index[handle]);
+    }
+
+    Vector3f get_wheel_relative_location(int handle, int i) {
+        return wheels.location(handle_to_index[handle] * FLEET_WHEEL_COUNT +
+                               i);
+    }
+
+    Vector3f get_wheel_location(int handle, int i) {
+        return get_location(handle) + get_wheel_relative_location(handle, i);
+    }
+
+    Quaternionf get_wheel_relative_quat(int handle, int i) {
+        return wheels.quat(handle_to_index[handle] * FLEET_WHEEL_COUNT + i);
+    }
+
+    Vector3f get_wheel_linear_velocity(int handle, int i) {
+        return wheels.linear_velocity(handle_to_index[handle] *
+                                          FLEET_WHEEL_COUNT +
+                                      i);
+    }
+
+    Vector3f get_wheel_applied_force(int handle, int i) {
+        return wheels.force(handle_to_index[handle] * FLEET_WHEEL_COUNT + i);
+    }
+
+    float get_wheel_radius(int handle) {
+        return vehicles.wheel_radius[(size_t)handle_to_index[handle]];
+    }
+
+    VehicleRenderState get_render_state(int handle) {
+        VehicleRenderState state;
+        state.body_location = get_body_relative_location(handle);
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            state.wheel_location[i] = get_wheel_relative_location(handle, i);
+        }
+        state.quat = get_wheel_relative_quat(handle, 0);
+        return state;
+    }
+
+    ParticleColumns& get_bodies() { return bodies; }
+
+    ParticleColumns& get_wheels() { return wheels; }
+
+    VehicleColumns& get_vehicles() { return vehicles; }
+
+    WheelColumns& get_wheel_state() { return wheel_state; }
+};
+
+#endif
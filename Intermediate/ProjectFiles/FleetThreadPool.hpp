@@ -0,0 +1,146 @@
+#ifndef _FLEETTHREADPOOL_HPP_
+#define _FLEETTHREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small work-stealing pool for headless fleet stepping (in-engine the fleet
+// manager uses ParallelFor instead). parallel_for hands every worker a
+// contiguous block of indices; a worker pops from the back of its own deque
+// and, once empty, steals from the front of the others. The calling thread
+// works as slot 0, so a pool of size 1 runs everything inline.
+class FleetThreadPool {
+    typedef std::function<void(size_t)> Job;
+
+    struct Task {
+        const Job* job;
+        size_t index;
+    };
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex state_lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    size_t generation;
+    bool stopping;
+    std::atomic<size_t> remaining;
+
+    bool pop(size_t self, Task& task) {
+        {
+            Queue& own = *queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); k++) {
+            Queue& victim = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void drain(size_t self) {
+        Task task;
+        while (pop(self, task)) {
+            (*task.job)(task.index);
+            if (remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> guard(state_lock);
+                done.notify_all();
+            }
+        }
+    }
+
+    void worker(size_t self) {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(state_lock);
+                wake.wait(guard,
+                          [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            drain(self);
+        }
+    }
+
+   public:
+    // thread_count includes the calling thread
+    explicit FleetThreadPool(size_t thread_count)
+        : generation(0), stopping(false), remaining(0) {
+        if (thread_count < 1)
+            thread_count = 1;
+        for (size_t i = 0; i < thread_count; i++)
+            queues.emplace_back(new Queue());
+        for (size_t i = 1; i < thread_count; i++)
+            threads.emplace_back(&FleetThreadPool::worker, this, i);
+    }
+
+    ~FleetThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    size_t size() const { return queues.size(); }
+
+    // runs job(0) .. job(count - 1) and returns once all of them finished
+    void parallel_for(size_t count, const Job& job) {
+        if (count == 0)
+            return;
+        if (queues.size() == 1) {
+            for (size_t i = 0; i < count; i++)
+                job(i);
+            return;
+        }
+
+        remaining = count;
+        size_t n = queues.size();
+        for (size_t q = 0; q < n; q++) {
+            Queue& queue = *queues[q];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            for (size_t i = q * count / n; i < (q + 1) * count / n; i++) {
+                Task task = {&job, i};
+                queue.tasks.push_back(task);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            generation++;
+        }
+        wake.notify_all();
+
+        drain(0);
+
+        std::unique_lock<std::mutex> guard(state_lock);
+        done.wait(guard, [&] { return remaining == 0; });
+    }
+};
+
+#endif
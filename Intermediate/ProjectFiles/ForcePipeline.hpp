@@ -0,0 +1,126 @@
+#ifndef _FORCEPIPELINE_HPP_
+#define _FORCEPIPELINE_HPP_
+
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Instrumentation.hpp"
+#include "Particle.hpp"
+#include "ParticleForce.hpp"
+
+// position of T in Ts...
+template <typename T, typename... Ts>
+struct PipelineIndex;
+
+template <typename T, typename... Ts>
+struct PipelineIndex<T, T, Ts...> : std::integral_constant<size_t, 0> {};
+
+template <typename T, typename U, typename... Ts>
+struct PipelineIndex<T, U, Ts...>
+    : std::integral_constant<size_t, 1 + PipelineIndex<T, Ts...>::value> {};
+
+// Compile-time replacement for ParticleForceRegistry. The generator set is
+// fixed by the template arguments; registrations are grouped by generator
+// type and the generators are stored by value next to their particle, so
+// each group runs as one loop of direct, inlinable calls.
+//
+// Groups run in template-argument order and keep insertion order inside a
+// group, so listing the types in the order a registry would have seen them
+// reproduces its results exactly. Generators outside the set (scripted or
+// temporary forces) still belong in a ParticleForceRegistry.
+//
+// Allocator is the allocator template for the group storage; ForcePipeline
+// below is the std::allocator version.
+template <template <typename> class Allocator, typename... Generators>
+class BasicForcePipeline {
+    template <typename G>
+    struct Registration {
+        Particle* particle;
+        G fg;
+
+        Registration(Particle* particle_, const G& fg_)
+            : particle(particle_), fg(fg_) {}
+    };
+
+    template <typename G>
+    using Group = std::vector<Registration<G>, Allocator<Registration<G>>>;
+
+    std::tuple<Group<Generators>...> groups;
+
+    template <typename G>
+    Group<G>& group() {
+        return std::get<PipelineIndex<G, Generators...>::value>(groups);
+    }
+
+    template <typename G>
+    void update_group(float delta_time) {
+        INSTRUMENT_SCOPE_DETAIL(InstrumentGenerator<G>::stage);
+        for (Registration<G>& registration : group<G>()) {
+            // qualified call: no virtual dispatch
+            registration.fg.G::update_force(registration.particle, delta_time);
+        }
+    }
+
+   public:
+    BasicForcePipeline() {}
+
+    explicit BasicForcePipeline(const Allocator<char>& allocator)
+        : groups(Group<Generators>(
+              Allocator<Registration<Generators>>(allocator))...) {}
+
+    // storage reserve<G>(n) asks the allocator for, per registration
+    template <typename G>
+    static constexpr size_t registration_size() {
+        return sizeof(Registration<G>);
+    }
+
+    template <typename G>
+    static constexpr size_t registration_align() {
+        return alignof(Registration<G>);
+    }
+
+    template <typename G>
+    void add(Particle* particle, const G& fg) {
+        group<G>().push_back(Registration<G>(particle, fg));
+    }
+
+    template <typename G, typename... Args>
+    void emplace(Particle* particle, Args&&... args) {
+        group<G>().push_back(
+            Registration<G>(particle, G(std::forward<Args>(args)...)));
+    }
+
+    template <typename G>
+    void reserve(size_t n) {
+        group<G>().reserve(n);
+    }
+
+    size_t size() {
+        size_t sizes[] = {0, group<Generators>().size()...};
+        size_t total = 0;
+        for (size_t n : sizes)
+            total += n;
+        return total;
+    }
+
+    // drops every registration but keeps the storage
+    void clear() {
+        int expand[] = {0, (group<Generators>().clear(), 0)...};
+        (void)expand;
+    }
+
+    void update_forces(float delta_time) {
+        INSTRUMENT_COUNT(INSTRUMENT_GENERATOR_CALLS, size());
+        // expand over the pack in order
+        int expand[] = {0, (update_group<Generators>(delta_time), 0)...};
+        (void)expand;
+    }
+};
+
+template <typename... Generators>
+using ForcePipeline = BasicForcePipeline<std::allocator, Generators...>;
+
+#endif
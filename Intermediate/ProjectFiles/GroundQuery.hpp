@@ -0,0 +1,579 @@
+#ifndef _GROUNDQUERY_HPP_
+#define _GROUNDQUERY_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Eigen/Eigen/Dense"
+#include "Snapshot.hpp"
+using namespace std;
+using namespace Eigen;
+
+// reach of the wheel sweep below the wheel center, as in AVehicle4WActor
+#define GROUND_SWEEP_DISTANCE 1.0f
+// wheels per block in batched fleet queries
+#define GROUND_QUERY_BLOCK 64
+
+struct GroundHit {
+    Vector3f point;
+    Vector3f normal;
+    int surface;
+};
+
+// Engine-independent replacement for the UE wheel sweep: a sphere moved
+// straight down (-Z) by distance. A sphere that already touches the ground
+// reports a hit at distance 0, like an initially penetrating UE sweep.
+class GroundQuery {
+   public:
+    virtual ~GroundQuery() {}
+
+    virtual bool sweep_sphere(const Vector3f& center,
+                              float radius,
+                              float distance,
+                              GroundHit* hit) const = 0;
+
+    // count sweeps at once; hit_flags[i] is set when hits[i] is valid
+    virtual void sweep_spheres(const Vector3f* centers,
+                               const float* radii,
+                               size_t count,
+                               float distance,
+                               GroundHit* hits,
+                               uint8_t* hit_flags) const {
+        for (size_t i = 0; i < count; i++)
+            hit_flags[i] = sweep_sphere(centers[i], radii[i], distance,
+                                        hits + i);
+    }
+};
+
+// Ground contacts of up to Capacity wheels, kept by value between steps so
+// most steps need no sweep. A wheel grounded at its last sweep reuses the
+// plane through that hit, which predicts the sweep exactly while the wheel
+// stays over the same face: until its center has moved tolerance from
+// where it was swept, in x and y, or the contact is max_age seconds old.
+// A wheel in the air, or one the plane no longer reaches, is swept every
+// step. A tolerance of 0 turns the cache off.
+template <int Capacity>
+class BasicContactCache {
+    GroundHit contact[Capacity];
+    Vector3f swept_center[Capacity];
+    float age[Capacity];
+    bool valid[Capacity];
+    float tolerance;
+    float max_age;
+
+   public:
+    BasicContactCache() : tolerance(0.f), max_age(0.f) { clear(); }
+
+    void configure(float tolerance_, float max_age_) {
+        tolerance = tolerance_;
+        max_age = max_age_;
+        clear();
+    }
+
+    bool enabled() const { return tolerance > 0.f; }
+    float get_tolerance() const { return tolerance; }
+    float get_max_age() const { return max_age; }
+
+    // forgets every contact, e.g. after the vehicle was moved
+    void clear() {
+        for (int i = 0; i < Capacity; i++) {
+            valid[i] = false;
+            age[i] = 0.f;
+        }
+    }
+
+    // start of a step delta_time after the last one
+    void advance(int count, float delta_time) {
+        for (int i = 0; i < count; i++)
+            age[i] += delta_time;
+    }
+
+    // The sweep of wheel i's sphere at center moved down by distance, from
+    // the cached plane; false when the wheel must be swept instead.
+    bool predict(int i,
+                 const Vector3f& center,
+                 float radius,
+                 float distance,
+                 GroundHit* hit) const {
+        if (!enabled() || !valid[i] || age[i] > max_age)
+            return false;
+        float dx = center(0) - swept_center[i](0);
+        float dy = center(1) - swept_center[i](1);
+        if (dx * dx + dy * dy > tolerance * tolerance)
+            return false;
+        const Vector3f& n = contact[i].normal;
+        float s = n.dot(center - contact[i].point);
+        if (s <= radius) {
+            // touching already, as SphereSweep reports it
+            hit->point = center - s * n;
+        } else {
+            if (n(2) < 1e-6f)
+                return false;
+            float t = (s - radius) / n(2);
+            if (t > distance)
+                return false;
+            hit->point = center - t * Vector3f(0.f, 0.f, 1.f) - radius * n;
+        }
+        hit->normal = n;
+        hit->surface = contact[i].surface;
+        return true;
+    }
+
+    // wheel i's contact and its age; the tolerance and maximum age are
+    // settings and stay out
+    void save(int i, ContactSnapshot* snapshot) const {
+        memcpy(snapshot->point, contact[i].point.data(),
+               sizeof(snapshot->point));
+        memcpy(snapshot->normal, contact[i].normal.data(),
+               sizeof(snapshot->normal));
+        snapshot->surface = contact[i].surface;
+        memcpy(snapshot->swept_center, swept_center[i].data(),
+               sizeof(snapshot->swept_center));
+        snapshot->age = age[i];
+        snapshot->valid = valid[i];
+    }
+
+    void restore(int i, const ContactSnapshot& snapshot) {
+        memcpy(contact[i].point.data(), snapshot.point,
+               sizeof(snapshot.point));
+        memcpy(contact[i].normal.data(), snapshot.normal,
+               sizeof(snapshot.normal));
+        contact[i].surface = snapshot.surface;
+        memcpy(swept_center[i].data(), snapshot.swept_center,
+               sizeof(snapshot.swept_center));
+        age[i] = snapshot.age;
+        valid[i] = snapshot.valid != 0;
+    }
+
+    // the sweep of wheel i from center; hit is null for a miss
+    void store(int i, const Vector3f& center, const GroundHit* hit) {
+        valid[i] = hit != nullptr;
+        if (!hit)
+            return;
+        contact[i] = *hit;
+        // the plane's normal points at the wheel's side of it
+        if (contact[i].normal(2) < 0.f)
+            contact[i].normal = -contact[i].normal;
+        swept_center[i] = center;
+        age[i] = 0.f;
+    }
+
+    // GroundQuery::sweep_spheres through the cache, a step delta_time
+    // after the last one; returns the number of sweeps made
+    int sweep_spheres(const GroundQuery& ground,
+                      const Vector3f* centers,
+                      const float* radii,
+                      int count,
+                      float distance,
+                      float delta_time,
+                      GroundHit* hits,
+                      uint8_t* hit_flags) {
+        advance(count, delta_time);
+        int swept[Capacity];
+        Vector3f swept_centers[Capacity];
+        float swept_radii[Capacity];
+        GroundHit swept_hits[Capacity];
+        uint8_t swept_flags[Capacity];
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            hit_flags[i] = predict(i, centers[i], radii[i], distance, hits + i);
+            if (hit_flags[i])
+                continue;
+            swept[n] = i;
+            swept_centers[n] = centers[i];
+            swept_radii[n] = radii[i];
+            n++;
+        }
+        if (n == 0)
+            return 0;
+        ground.sweep_spheres(swept_centers, swept_radii, n, distance,
+                             swept_hits, swept_flags);
+        for (int k = 0; k < n; k++) {
+            int i = swept[k];
+            hit_flags[i] = swept_flags[k];
+            if (swept_flags[k])
+                hits[i] = swept_hits[k];
+            store(i, centers[i], swept_flags[k] ? &swept_hits[k] : nullptr);
+        }
+        return n;
+    }
+};
+
+// Earliest t <= max_t at which a sphere at center - t * Z touches the
+// triangle (a, b, c). A sphere that already overlaps it gets t = -depth.
+class SphereSweep {
+    static bool ray_sphere(const Vector3f& origin,
+                           const Vector3f& center,
+                           float radius,
+                           float* t) {
+        Vector3f m = origin - center;
+        float b = -m(2);  // m . (-Z)
+        float c = m.squaredNorm() - radius * radius;
+        if (c > 0.f && b > 0.f)
+            return false;
+        float disc = b * b - c;
+        if (disc < 0.f)
+            return false;
+        *t = max(-b - sqrt(disc), 0.f);
+        return true;
+    }
+
+    // ray against the side of the capsule around segment ab; works on the
+    // components perpendicular to ab to stay accurate on long edges
+    static bool ray_cylinder(const Vector3f& origin,
+                             const Vector3f& a,
+                             const Vector3f& b,
+                             float radius,
+                             float* t) {
+        Vector3f ab = b - a;
+        float length = ab.norm();
+        if (length < 1e-6f)
+            return false;
+        Vector3f u = ab / length;
+        Vector3f ao = origin - a;
+        Vector3f dir(0.f, 0.f, -1.f);
+        Vector3f ao_perp = ao - u.dot(ao) * u;
+        Vector3f dir_perp = dir - u.dot(dir) * u;
+        float qa = dir_perp.squaredNorm();
+        float qb = dir_perp.dot(ao_perp);
+        float qc = ao_perp.squaredNorm() - radius * radius;
+        if (qa < 1e-8f)
+            return false;
+        float hit_t;
+        if (qc < 0.f) {
+            hit_t = 0.f;
+        } else {
+            float disc = qb * qb - qa * qc;
+            if (disc < 0.f || qb > 0.f)
+                return false;
+            hit_t = (-qb - sqrt(disc)) / qa;
+        }
+        float s = u.dot(ao + hit_t * dir) / length;
+        if (s < 0.f || s > 1.f)
+            return false;
+        *t = hit_t;
+        return true;
+    }
+
+    static Vector3f closest_on_segment(const Vector3f& p,
+                                       const Vector3f& a,
+                                       const Vector3f& b) {
+        Vector3f ab = b - a;
+        float s = (p - a).dot(ab) / ab.squaredNorm();
+        s = min(max(s, 0.f), 1.f);
+        return a + s * ab;
+    }
+
+    // Real-Time Collision Detection, 5.1.5
+    static Vector3f closest_on_triangle(const Vector3f& p,
+                                        const Vector3f& a,
+                                        const Vector3f& b,
+                                        const Vector3f& c) {
+        Vector3f ab = b - a, ac = c - a, ap = p - a;
+        float d1 = ab.dot(ap), d2 = ac.dot(ap);
+        if (d1 <= 0.f && d2 <= 0.f)
+            return a;
+        Vector3f bp = p - b;
+        float d3 = ab.dot(bp), d4 = ac.dot(bp);
+        if (d3 >= 0.f && d4 <= d3)
+            return b;
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+            return a + d1 / (d1 - d3) * ab;
+        Vector3f cp = p - c;
+        float d5 = ab.dot(cp), d6 = ac.dot(cp);
+        if (d6 >= 0.f && d5 <= d6)
+            return c;
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+            return a + d2 / (d2 - d6) * ac;
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+            return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+        float denom = 1.f / (va + vb + vc);
+        return a + ab * (vb * denom) + ac * (vc * denom);
+    }
+
+    static bool inside(const Vector3f& p,
+                       const Vector3f& a,
+                       const Vector3f& b,
+                       const Vector3f& c,
+                       const Vector3f& n) {
+        return (b - a).cross(p - a).dot(n) >= 0.f &&
+               (c - b).cross(p - b).dot(n) >= 0.f &&
+               (a - c).cross(p - c).dot(n) >= 0.f;
+    }
+
+   public:
+    static bool sweep(const Vector3f& center,
+                      float radius,
+                      float max_t,
+                      const Vector3f& a,
+                      const Vector3f& b,
+                      const Vector3f& c,
+                      float* t,
+                      Vector3f* point,
+                      Vector3f* normal) {
+        Vector3f n = (b - a).cross(c - a);
+        float n_len = n.norm();
+        if (n_len < 1e-12f)
+            return false;
+        n /= n_len;
+        // face the normal up; flipping it reverses the winding
+        bool flipped = n(2) < 0.f;
+        if (flipped)
+            n = -n;
+
+        // already touching: report the deepest point with t = -depth, so
+        // overlapping features order by penetration
+        Vector3f closest = closest_on_triangle(center, a, b, c);
+        float dist = (center - closest).norm();
+        if (dist <= radius) {
+            if (dist - radius > max_t)
+                return false;
+            *t = dist - radius;
+            *point = closest;
+            *normal = dist > 1e-6f ? Vector3f((center - closest) / dist) : n;
+            return true;
+        }
+
+        float best = max_t;
+        bool found = false;
+
+        // face
+        float s0 = n.dot(center - a);
+        if (s0 >= -radius && n(2) > 1e-6f) {
+            float face_t = max((s0 - radius) / n(2), 0.f);
+            Vector3f touch = center - face_t * Vector3f(0.f, 0.f, 1.f) -
+                             radius * n;
+            if (face_t <= best &&
+                inside(touch, a, flipped ? c : b, flipped ? b : c, n)) {
+                best = face_t, found = true;
+                *point = touch;
+            }
+        }
+
+        // edges and vertices
+        const Vector3f* v[3] = {&a, &b, &c};
+        for (int i = 0; i < 3; i++) {
+            const Vector3f& p0 = *v[i];
+            const Vector3f& p1 = *v[(i + 1) % 3];
+            float edge_t;
+            if (ray_cylinder(center, p0, p1, radius, &edge_t) &&
+                edge_t <= best) {
+                best = edge_t, found = true;
+                *point = closest_on_segment(
+                    center - edge_t * Vector3f(0.f, 0.f, 1.f), p0, p1);
+            }
+            if (ray_sphere(center, p0, radius, &edge_t) && edge_t <= best) {
+                best = edge_t, found = true;
+                *point = p0;
+            }
+        }
+
+        if (!found)
+            return false;
+        *t = best;
+        Vector3f to_center = center - best * Vector3f(0.f, 0.f, 1.f) - *point;
+        float len = to_center.norm();
+        *normal = len > 1e-6f ? Vector3f(to_center / len) : n;
+        return true;
+    }
+};
+
+// Regular grid of heights: vertex (i, j) sits at
+// origin + (i * cell_size, j * cell_size, heights[j * size_x + i]); each cell
+// is split into two triangles along its (i, j)-(i + 1, j + 1) diagonal.
+class HeightfieldGround : public GroundQuery {
+    Vector2f origin;
+    float cell_size;
+    int size_x;
+    int size_y;
+    vector<float> heights;
+    int surface;
+
+    Vector3f vertex(int i, int j) const {
+        return Vector3f(origin(0) + i * cell_size, origin(1) + j * cell_size,
+                        heights[(size_t)j * size_x + i]);
+    }
+
+   public:
+    HeightfieldGround(Vector2f origin_,
+                      float cell_size_,
+                      int size_x_,
+                      int size_y_,
+                      const vector<float>& heights_,
+                      int surface_ = 0)
+        : origin(origin_),
+          cell_size(cell_size_),
+          size_x(size_x_),
+          size_y(size_y_),
+          heights(heights_),
+          surface(surface_) {}
+
+    float get_height(int i, int j) const {
+        return heights[(size_t)j * size_x + i];
+    }
+
+    virtual bool sweep_sphere(const Vector3f& center,
+                              float radius,
+                              float distance,
+                              GroundHit* hit) const {
+        int i0 = (int)floor((center(0) - radius - origin(0)) / cell_size);
+        int i1 = (int)floor((center(0) + radius - origin(0)) / cell_size);
+        int j0 = (int)floor((center(1) - radius - origin(1)) / cell_size);
+        int j1 = (int)floor((center(1) + radius - origin(1)) / cell_size);
+        i0 = max(i0, 0), j0 = max(j0, 0);
+        i1 = min(i1, size_x - 2), j1 = min(j1, size_y - 2);
+
+        float best = distance;
+        bool found = false;
+        float t;
+        Vector3f point, normal;
+        for (int j = j0; j <= j1; j++) {
+            for (int i = i0; i <= i1; i++) {
+                Vector3f p00 = vertex(i, j), p10 = vertex(i + 1, j);
+                Vector3f p01 = vertex(i, j + 1), p11 = vertex(i + 1, j + 1);
+                const Vector3f* corner[2] = {&p10, &p01};
+                for (int k = 0; k < 2; k++) {
+                    if (SphereSweep::sweep(center, radius, best, p00,
+                                           *corner[k], p11, &t, &point,
+                                           &normal)) {
+                        best = t, found = true;
+                        hit->point = point;
+                        hit->normal = normal;
+                    }
+                }
+            }
+        }
+        if (found)
+            hit->surface = surface;
+        return found;
+    }
+};
+
+// Static triangle soup binned into a uniform XY grid.
+class TriangleMeshGround : public GroundQuery {
+    struct Triangle {
+        Vector3f a, b, c;
+        float min_z, max_z;
+        int surface;
+    };
+
+    vector<Triangle> triangles;
+    Vector2f grid_min;
+    float cell_size;
+    int cells_x;
+    int cells_y;
+    // triangles of cell k are cell_triangles[cell_start[k] .. cell_start[k+1])
+    vector<int> cell_start;
+    vector<int> cell_triangles;
+
+    void cell_range(float lo, float hi, int axis, int* c0, int* c1) const {
+        int cells = axis ? cells_y : cells_x;
+        *c0 = max((int)floor((lo - grid_min(axis)) / cell_size), 0);
+        *c1 = min((int)floor((hi - grid_min(axis)) / cell_size), cells - 1);
+    }
+
+   public:
+    // vertices are indexed three at a time by indices; surfaces, if given,
+    // holds one surface id per triangle
+    TriangleMeshGround(const vector<Vector3f>& vertices,
+                       const vector<int>& indices,
+                       float cell_size_,
+                       const vector<int>& surfaces = vector<int>())
+        : cell_size(cell_size_) {
+        Vector2f lo(INFINITY, INFINITY), hi(-INFINITY, -INFINITY);
+        for (size_t k = 0; k + 2 < indices.size(); k += 3) {
+            Triangle tri;
+            tri.a = vertices[indices[k]];
+            tri.b = vertices[indices[k + 1]];
+            tri.c = vertices[indices[k + 2]];
+            tri.min_z = min(tri.a(2), min(tri.b(2), tri.c(2)));
+            tri.max_z = max(tri.a(2), max(tri.b(2), tri.c(2)));
+            tri.surface = surfaces.empty() ? 0 : surfaces[k / 3];
+            triangles.push_back(tri);
+            for (const Vector3f* p : {&tri.a, &tri.b, &tri.c}) {
+                lo = lo.cwiseMin(p->head<2>());
+                hi = hi.cwiseMax(p->head<2>());
+            }
+        }
+        if (triangles.empty())
+            lo = hi = Vector2f::Zero();
+        grid_min = lo;
+        cells_x = max((int)ceil((hi(0) - lo(0)) / cell_size), 1);
+        cells_y = max((int)ceil((hi(1) - lo(1)) / cell_size), 1);
+
+        // counting sort of triangle references into cells
+        cell_start.assign((size_t)cells_x * cells_y + 1, 0);
+        for (int pass = 0; pass < 2; pass++) {
+            vector<int> cursor;
+            if (pass == 1) {
+                for (size_t k = 1; k < cell_start.size(); k++)
+                    cell_start[k] += cell_start[k - 1];
+                cell_triangles.resize(cell_start.back());
+                cursor.assign(cell_start.begin(), cell_start.end() - 1);
+            }
+            for (size_t t = 0; t < triangles.size(); t++) {
+                const Triangle& tri = triangles[t];
+                int i0, i1, j0, j1;
+                cell_range(min(tri.a(0), min(tri.b(0), tri.c(0))),
+                           max(tri.a(0), max(tri.b(0), tri.c(0))), 0, &i0,
+                           &i1);
+                cell_range(min(tri.a(1), min(tri.b(1), tri.c(1))),
+                           max(tri.a(1), max(tri.b(1), tri.c(1))), 1, &j0,
+                           &j1);
+                for (int j = j0; j <= j1; j++) {
+                    for (int i = i0; i <= i1; i++) {
+                        int cell = j * cells_x + i;
+                        if (pass == 0)
+                            cell_start[cell + 1]++;
+                        else
+                            cell_triangles[cursor[cell]++] = (int)t;
+                    }
+                }
+            }
+        }
+    }
+
+    size_t size() const { return triangles.size(); }
+
+    virtual bool sweep_sphere(const Vector3f& center,
+                              float radius,
+                              float distance,
+                              GroundHit* hit) const {
+        int i0, i1, j0, j1;
+        cell_range(center(0) - radius, center(0) + radius, 0, &i0, &i1);
+        cell_range(center(1) - radius, center(1) + radius, 1, &j0, &j1);
+
+        float best = distance;
+        bool found = false;
+        float t;
+        Vector3f point, normal;
+        for (int j = j0; j <= j1; j++) {
+            for (int i = i0; i <= i1; i++) {
+                int cell = j * cells_x + i;
+                for (int k = cell_start[cell]; k < cell_start[cell + 1]; k++) {
+                    const Triangle& tri = triangles[cell_triangles[k]];
+                    // entirely above the sphere or below the sweep
+                    if (tri.min_z > center(2) + radius ||
+                        tri.max_z < center(2) - radius - best)
+                        continue;
+                    if (SphereSweep::sweep(center, radius, best, tri.a, tri.b,
+                                           tri.c, &t, &point, &normal)) {
+                        best = t, found = true;
+                        hit->point = point;
+                        hit->normal = normal;
+                        hit->surface = tri.surface;
+                    }
+                }
+            }
+        }
+        return found;
+    }
+};
+
+#endif
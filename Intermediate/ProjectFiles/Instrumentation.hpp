@@ -0,0 +1,351 @@
+#ifndef _INSTRUMENTATION_HPP_
+#define _INSTRUMENTATION_HPP_
+
+#include <cstdint>
+#include <cstdio>
+
+// Compile-time instrumentation of the simulator hot paths.
+//
+//   VEHICLE4W_INSTRUMENTATION 0  compiled out, the macros expand to nothing
+//                             1  stage timers and counters
+//                             2  plus one timer per force generator type
+//
+// INSTRUMENT_SCOPE(stage) times the rest of the enclosing block,
+// INSTRUMENT_SCOPE_DETAIL(stage) does so only at level 2, and
+// INSTRUMENT_COUNT(counter, n) adds n to a counter.
+//
+// The default backend keeps lock-free per-thread histograms and counters
+// (see InstrumentRegistry below) for headless runs. Defining
+// VEHICLE4W_INSTRUMENTATION_BACKEND as a header file name, unquoted,
+// replaces it: that header provides InstrumentScope and instrument_count,
+// e.g. on top of the Unreal stats system.
+#ifndef VEHICLE4W_INSTRUMENTATION
+#define VEHICLE4W_INSTRUMENTATION 0
+#endif
+
+enum InstrumentStage {
+    // one vehicle step, or one fleet chunk step
+    INSTRUMENT_STEP,
+    // wheel ground sweeps
+    INSTRUMENT_SWEEP,
+    // permanent and temporary force generators
+    INSTRUMENT_FORCES,
+    // integration of the accumulated forces
+    INSTRUMENT_INTEGRATE,
+    // simulated transforms written back to components
+    INSTRUMENT_WRITE_BACK,
+    // per force generator type, level 2
+    INSTRUMENT_GRAVITY,
+    INSTRUMENT_SPRING,
+    INSTRUMENT_CONTACT,
+    INSTRUMENT_FRICTION,
+    INSTRUMENT_FRAME_CONSTRAINT,
+    INSTRUMENT_OTHER_GENERATOR,
+    INSTRUMENT_TEMPORARY_FORCES,
+    // the tire model's suspension and tire stage, level 2
+    INSTRUMENT_TIRES
+};
+
+#define INSTRUMENT_STAGE_COUNT 13
+
+enum InstrumentCounter {
+    INSTRUMENT_VEHICLE_STEPS,
+    INSTRUMENT_WHEEL_SWEEPS,
+    INSTRUMENT_WHEEL_HITS,
+    INSTRUMENT_GENERATOR_CALLS,
+    // fleet vehicles asleep and awake, counted once per step
+    INSTRUMENT_ASLEEP_VEHICLES,
+    INSTRUMENT_AWAKE_VEHICLES,
+    // wheel contacts taken from the contact cache instead of a sweep
+    INSTRUMENT_CACHED_CONTACTS
+};
+
+#define INSTRUMENT_COUNTER_COUNT 7
+
+inline const char* instrument_stage_name(InstrumentStage stage) {
+    static const char* names[INSTRUMENT_STAGE_COUNT] = {
+        "step",          "sweep",           "forces",
+        "integrate",     "write_back",      "gravity",
+        "spring",        "contact",         "friction",
+        "frame_constraint", "other_generator", "temporary_forces",
+        "tires"};
+    return names[stage];
+}
+
+inline const char* instrument_counter_name(InstrumentCounter counter) {
+    static const char* names[INSTRUMENT_COUNTER_COUNT] = {
+        "vehicle_steps",   "wheel_sweeps",   "wheel_hits",
+        "generator_calls", "asleep_vehicles", "awake_vehicles",
+        "cached_contacts"};
+    return names[counter];
+}
+
+// stage timing one generator type in a force pipeline, level 2
+class Gravity;
+template <int Size>
+class BasicSpring;
+class Contact;
+class Friction;
+template <int Size>
+class BasicFrameConstraint;
+
+template <typename G>
+struct InstrumentGenerator {
+    static const InstrumentStage stage = INSTRUMENT_OTHER_GENERATOR;
+};
+
+template <>
+struct InstrumentGenerator<Gravity> {
+    static const InstrumentStage stage = INSTRUMENT_GRAVITY;
+};
+
+template <int Size>
+struct InstrumentGenerator<BasicSpring<Size>> {
+    static const InstrumentStage stage = INSTRUMENT_SPRING;
+};
+
+template <>
+struct InstrumentGenerator<Contact> {
+    static const InstrumentStage stage = INSTRUMENT_CONTACT;
+};
+
+template <>
+struct InstrumentGenerator<Friction> {
+    static const InstrumentStage stage = INSTRUMENT_FRICTION;
+};
+
+template <int Size>
+struct InstrumentGenerator<BasicFrameConstraint<Size>> {
+    static const InstrumentStage stage = INSTRUMENT_FRAME_CONSTRAINT;
+};
+
+#if VEHICLE4W_INSTRUMENTATION
+
+#ifdef VEHICLE4W_INSTRUMENTATION_BACKEND
+#define INSTRUMENT_STRING_(x) #x
+#define INSTRUMENT_STRING(x) INSTRUMENT_STRING_(x)
+#include INSTRUMENT_STRING(VEHICLE4W_INSTRUMENTATION_BACKEND)
+#else
+
+#include <atomic>
+#include <chrono>
+
+// Log-linear histogram of nanoseconds: values below 8 get a bucket each,
+// then every power of two is split into 8, so a bucket is at most 12.5%
+// wide. Each thread owns its histograms and is their only writer, so an
+// update is a relaxed load and store; readers may see a sample or two
+// late, never a torn count.
+#define INSTRUMENT_SUB_BUCKETS 8
+#define INSTRUMENT_BUCKETS (INSTRUMENT_SUB_BUCKETS * 62)
+
+struct InstrumentHistogram {
+    std::atomic<uint64_t> bucket[INSTRUMENT_BUCKETS];
+    std::atomic<uint64_t> total_ns;
+
+    static int bucket_of(uint64_t ns) {
+        if (ns < INSTRUMENT_SUB_BUCKETS)
+            return (int)ns;
+        int e = 63;
+        while (!(ns >> e))
+            e--;
+        // e >= 3; the top three bits below the leading one pick the bucket
+        int sub = (int)(ns >> (e - 3)) & (INSTRUMENT_SUB_BUCKETS - 1);
+        return (e - 2) * INSTRUMENT_SUB_BUCKETS + sub;
+    }
+
+    // middle of bucket b
+    static double value_of(int b) {
+        if (b < INSTRUMENT_SUB_BUCKETS)
+            return b;
+        int e = b / INSTRUMENT_SUB_BUCKETS + 2;
+        int sub = b % INSTRUMENT_SUB_BUCKETS;
+        double width = (double)(1ull << (e - 3));
+        return (INSTRUMENT_SUB_BUCKETS + sub + 0.5) * width;
+    }
+
+    void add(uint64_t ns) {
+        std::atomic<uint64_t>& b = bucket[bucket_of(ns)];
+        b.store(b.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+        total_ns.store(total_ns.load(std::memory_order_relaxed) + ns,
+                       std::memory_order_relaxed);
+    }
+};
+
+struct InstrumentThreadData {
+    InstrumentHistogram stage[INSTRUMENT_STAGE_COUNT];
+    std::atomic<uint64_t> counter[INSTRUMENT_COUNTER_COUNT];
+    InstrumentThreadData* next;
+};
+
+// Merged view of every thread's histograms for one stage
+struct InstrumentSummary {
+    uint64_t count;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double max_ns;
+};
+
+// Per-thread data hangs off a lock-free list: a thread pushes its block
+// with one compare-and-swap the first time it records anything and never
+// touches shared state again. Blocks live until the process exits, so a
+// report can walk the list at any time.
+class InstrumentRegistry {
+    std::atomic<InstrumentThreadData*> head;
+
+    InstrumentRegistry() : head(nullptr) {}
+
+    InstrumentThreadData* add_thread() {
+        InstrumentThreadData* data = new InstrumentThreadData();
+        InstrumentThreadData* first = head.load(std::memory_order_relaxed);
+        do {
+            data->next = first;
+        } while (!head.compare_exchange_weak(first, data,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+        return data;
+    }
+
+   public:
+    static InstrumentRegistry& get() {
+        static InstrumentRegistry registry;
+        return registry;
+    }
+
+    InstrumentThreadData& local() {
+        static thread_local InstrumentThreadData* data = add_thread();
+        return *data;
+    }
+
+    InstrumentSummary summary(InstrumentStage stage) const {
+        uint64_t merged[INSTRUMENT_BUCKETS];
+        InstrumentSummary s = {0, 0.0, 0.0, 0.0, 0.0};
+        double total_ns = 0.0;
+        for (int b = 0; b < INSTRUMENT_BUCKETS; b++)
+            merged[b] = 0;
+        for (InstrumentThreadData* data =
+                 head.load(std::memory_order_acquire);
+             data; data = data->next) {
+            const InstrumentHistogram& h = data->stage[stage];
+            for (int b = 0; b < INSTRUMENT_BUCKETS; b++) {
+                uint64_t n = h.bucket[b].load(std::memory_order_relaxed);
+                merged[b] += n;
+                s.count += n;
+            }
+            total_ns += (double)h.total_ns.load(std::memory_order_relaxed);
+        }
+        if (!s.count)
+            return s;
+
+        s.mean_ns = total_ns / s.count;
+        uint64_t p50 = (s.count + 1) / 2, p99 = (s.count * 99 + 99) / 100;
+        uint64_t seen = 0;
+        for (int b = 0; b < INSTRUMENT_BUCKETS; b++) {
+            if (!merged[b])
+                continue;
+            if (seen < p50 && seen + merged[b] >= p50)
+                s.p50_ns = InstrumentHistogram::value_of(b);
+            if (seen < p99 && seen + merged[b] >= p99)
+                s.p99_ns = InstrumentHistogram::value_of(b);
+            seen += merged[b];
+            s.max_ns = InstrumentHistogram::value_of(b);
+        }
+        return s;
+    }
+
+    uint64_t counter(InstrumentCounter counter) const {
+        uint64_t total = 0;
+        for (InstrumentThreadData* data =
+                 head.load(std::memory_order_acquire);
+             data; data = data->next)
+            total += data->counter[counter].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // zeroes every thread's data; samples racing with it may survive
+    void reset() {
+        for (InstrumentThreadData* data =
+                 head.load(std::memory_order_acquire);
+             data; data = data->next) {
+            for (int k = 0; k < INSTRUMENT_STAGE_COUNT; k++) {
+                InstrumentHistogram& h = data->stage[k];
+                for (int b = 0; b < INSTRUMENT_BUCKETS; b++)
+                    h.bucket[b].store(0, std::memory_order_relaxed);
+                h.total_ns.store(0, std::memory_order_relaxed);
+            }
+            for (int k = 0; k < INSTRUMENT_COUNTER_COUNT; k++)
+                data->counter[k].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // count, mean, p50, p99 and max per stage that saw samples, then the
+    // counters
+    void report(FILE* out) const {
+        fprintf(out, "%-18s %12s %10s %10s %10s %10s\n", "stage", "count",
+                "mean ns", "p50 ns", "p99 ns", "max ns");
+        for (int k = 0; k < INSTRUMENT_STAGE_COUNT; k++) {
+            InstrumentSummary s = summary((InstrumentStage)k);
+            if (!s.count)
+                continue;
+            fprintf(out, "%-18s %12llu %10.0f %10.0f %10.0f %10.0f\n",
+                    instrument_stage_name((InstrumentStage)k),
+                    (unsigned long long)s.count, s.mean_ns, s.p50_ns,
+                    s.p99_ns, s.max_ns);
+        }
+        for (int k = 0; k < INSTRUMENT_COUNTER_COUNT; k++) {
+            fprintf(out, "%-18s %12llu\n",
+                    instrument_counter_name((InstrumentCounter)k),
+                    (unsigned long long)counter((InstrumentCounter)k));
+        }
+    }
+};
+
+class InstrumentScope {
+    InstrumentStage stage;
+    std::chrono::steady_clock::time_point start;
+
+   public:
+    explicit InstrumentScope(InstrumentStage stage_)
+        : stage(stage_), start(std::chrono::steady_clock::now()) {}
+
+    ~InstrumentScope() {
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<
+                          std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+        InstrumentRegistry::get().local().stage[stage].add(ns);
+    }
+
+    InstrumentScope(const InstrumentScope&) = delete;
+    InstrumentScope& operator=(const InstrumentScope&) = delete;
+};
+
+inline void instrument_count(InstrumentCounter counter, uint64_t n) {
+    std::atomic<uint64_t>& c =
+        InstrumentRegistry::get().local().counter[counter];
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+#endif  // VEHICLE4W_INSTRUMENTATION_BACKEND
+
+#define INSTRUMENT_CONCAT_(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT_(a, b)
+#define INSTRUMENT_SCOPE(stage) \
+    InstrumentScope INSTRUMENT_CONCAT(instrument_scope_, __LINE__)(stage)
+#define INSTRUMENT_COUNT(counter, n) instrument_count(counter, n)
+
+#else
+
+#define INSTRUMENT_SCOPE(stage) ((void)0)
+#define INSTRUMENT_COUNT(counter, n) ((void)0)
+
+#endif  // VEHICLE4W_INSTRUMENTATION
+
+#if VEHICLE4W_INSTRUMENTATION >= 2
+#define INSTRUMENT_SCOPE_DETAIL(stage) INSTRUMENT_SCOPE(stage)
+#else
+#define INSTRUMENT_SCOPE_DETAIL(stage) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef _INTEGRATOR_HPP_
+#define _INTEGRATOR_HPP_
+
+#include <cmath>
+#include <cstring>
+
+#include "Eigen/Eigen/Dense"
+using namespace Eigen;
+
+// Time integration schemes, chosen per Vehicle4WSimulator.
+//
+//   symplectic Euler  v += dt * a(x, v); x += dt * v. One force evaluation;
+//                     what Particle::apply_force has always done.
+//   velocity Verlet   half kick, drift, half kick with forces re-evaluated at
+//                     the new position. Two evaluations.
+//   RK4               classic fourth order Runge-Kutta. Four evaluations.
+//   implicit spring   symplectic Euler, except that the suspension springs
+//                     are solved backward-Euler along z, which stays stable
+//                     at any step. One evaluation plus an arrowhead solve
+//                     over the body and wheels (1 + wheels unknowns),
+//                     linear in the wheel count.
+enum Integrator {
+    INTEGRATOR_SYMPLECTIC_EULER,
+    INTEGRATOR_VERLET,
+    INTEGRATOR_RK4,
+    INTEGRATOR_IMPLICIT_SPRING
+};
+
+#define INTEGRATOR_COUNT 4
+
+inline const char* integrator_name(Integrator integrator) {
+    static const char* names[INTEGRATOR_COUNT] = {"symplectic_euler", "verlet",
+                                                  "rk4", "implicit_spring"};
+    return names[integrator];
+}
+
+// INTEGRATOR_COUNT when name is unknown
+inline Integrator integrator_from_name(const char* name) {
+    int k = 0;
+    while (k < INTEGRATOR_COUNT && strcmp(name, integrator_name((Integrator)k)))
+        k++;
+    return (Integrator)k;
+}
+
+// quat turned by angular_velocity held for delta_time
+inline Quaternionf rotate_quat(const Quaternionf& quat,
+                               const Vector3f& angular_velocity,
+                               float delta_time) {
+    if (angular_velocity.isZero())
+        return quat;
+    float angular_vel_norm = angular_velocity.norm();
+    float a = angular_vel_norm * delta_time * 0.5f;
+    Vector3f axis = angular_velocity / angular_vel_norm;
+    float s = (float)sin(a);
+    Quaternionf delta_quat((float)cos(a), axis.x() * s, axis.y() * s,
+                           axis.z() * s);
+    return delta_quat * quat;
+}
+
+// dq/dt = 1/2 (0, w) q
+inline Quaternionf quat_derivative(const Quaternionf& quat,
+                                   const Vector3f& angular_velocity) {
+    Quaternionf w(0.f, angular_velocity.x(), angular_velocity.y(),
+                  angular_velocity.z());
+    Quaternionf dq = w * quat;
+    dq.coeffs() *= 0.5f;
+    return dq;
+}
+
+// Advances angular_velocity by delta_vel, a constant angular acceleration
+// applied over delta_time, and quat along with it. The implicit spring
+// scheme has no angular springs and integrates like symplectic Euler.
+inline void integrate_angular(Integrator integrator,
+                              const Vector3f& delta_vel,
+                              float delta_time,
+                              Vector3f* angular_velocity,
+                              Quaternionf* quat) {
+    Vector3f w0 = *angular_velocity;
+    *angular_velocity += delta_vel;
+
+    switch (integrator) {
+        case INTEGRATOR_VERLET:
+            // midpoint angular velocity
+            *quat = rotate_quat(*quat, w0 + 0.5f * delta_vel, delta_time);
+            break;
+        case INTEGRATOR_RK4: {
+            float h = delta_time;
+            Vector3f w_mid = w0 + 0.5f * delta_vel;
+            Quaternionf q = *quat, k1, k2, k3, k4, t;
+            k1 = quat_derivative(q, w0);
+            t.coeffs() = q.coeffs() + 0.5f * h * k1.coeffs();
+            k2 = quat_derivative(t, w_mid);
+            t.coeffs() = q.coeffs() + 0.5f * h * k2.coeffs();
+            k3 = quat_derivative(t, w_mid);
+            t.coeffs() = q.coeffs() + h * k3.coeffs();
+            k4 = quat_derivative(t, *angular_velocity);
+            q.coeffs() += h / 6 *
+                          (k1.coeffs() + 2 * k2.coeffs() + 2 * k3.coeffs() +
+                           k4.coeffs());
+            *quat = q.normalized();
+            break;
+        }
+        default:
+            *quat = rotate_quat(*quat, *angular_velocity, delta_time);
+            break;
+    }
+}
+
+#endif
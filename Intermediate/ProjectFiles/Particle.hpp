@@ -1,9 +1,11 @@
 #ifndef _PARTICLE_H_
 #define _PARTICLE_H_
 
-#include <iostream>
+#include <cstring>
 
 #include "Eigen/Eigen/Dense"
+#include "Integrator.hpp"
+#include "Snapshot.hpp"
 #define normalized_Z Vector3f(0, 0, 1)
 #define MIN_DELTA_ANGLE 0.001f
 
@@ -24,17 +26,16 @@ class Particle {
 
     Vector3f force_accum;
 
-    Vector3f* hit_point;
+    // force_accum as the last step integrated it
+    Vector3f applied_force;
 
-    void set_quat(float angle, Vector3f axis, Quaternionf* quat_) {
-        const float a = angle * 0.5f;
-        const float s = (float)sin(a);
-        const float c = (float)cos(a);
-        quat_->w() = c;
-        quat_->x() = axis.x() * s;
-        quat_->y() = axis.y() * s;
-        quat_->z() = axis.z() * s;
-    }
+    Vector3f torque_accum;
+
+    // body-frame tensors, set once by the owner from the particle's shape
+    Matrix3f inertia;
+    Matrix3f inverse_inertia;
+
+    Vector3f* hit_point;
 
    public:
     Particle(float mass_,
@@ -49,18 +50,28 @@ class Particle {
           angular_velocity(angular_velocity_),
           hit_point(nullptr) {
         force_accum.setZero();
+        applied_force.setZero();
+        torque_accum.setZero();
+        inertia.setIdentity();
+        inverse_inertia.setIdentity();
     }
 
-    void set_linear_velocity(float idx, float vel) {
+    void set_linear_velocity(int idx, float vel) {
         linear_velocity(idx) = vel;
     }
 
+    void set_linear_velocity(const Vector3f& vel) { linear_velocity = vel; }
+
+    void set_location(const Vector3f& location_) { location = location_; }
+
     Vector3f get_location() { return location; }
 
     Quaternionf get_quat() { return quat; }
 
     float get_mass() { return mass; }
 
+    void set_mass(float mass_) { mass = mass_; }
+
     void update_hit_point(Vector3f* hit_point_) { hit_point = hit_point_; }
 
     Vector3f* get_hit_point() { return hit_point; }
@@ -71,13 +82,90 @@ class Particle {
 
     void update_force(const Vector3f& force) { force_accum += force; }
 
+    Vector3f get_force() { return force_accum; }
+
+    void clear_force() { force_accum.setZero(); }
+
+    // ends a step: remembers the accumulated force and clears it
+    void retire_force() {
+        applied_force = force_accum;
+        force_accum.setZero();
+    }
+
+    Vector3f get_applied_force() { return applied_force; }
+
+    // the inverse is taken here, not per step
+    void set_inertia(const Matrix3f& inertia_) {
+        inertia = inertia_;
+        inverse_inertia = inertia_.inverse();
+    }
+
+    // principal axes along the particle's axes
+    void set_inertia(const Vector3f& moments) {
+        inertia = moments.asDiagonal();
+        inverse_inertia = moments.cwiseInverse().asDiagonal();
+    }
+
+    Matrix3f get_inertia() { return inertia; }
+
+    Matrix3f get_inverse_inertia() { return inverse_inertia; }
+
+    void update_torque(const Vector3f& torque) { torque_accum += torque; }
+
+    Vector3f get_torque() { return torque_accum; }
+
+    // Integrates and clears the accumulated torque. The orientation only
+    // follows the angular velocity in steps a torque acts in: nothing damps
+    // the spin yet, and steering has always been one impulse per input.
+    void apply_torque(float delta_time,
+                      Integrator integrator = INTEGRATOR_SYMPLECTIC_EULER) {
+        if (torque_accum.isZero())
+            return;
+        Vector3f angular_acc = inverse_inertia * torque_accum;
+        integrate_angular(integrator, delta_time * angular_acc, delta_time,
+                          &angular_velocity, &quat);
+        torque_accum.setZero();
+    }
+
+    // everything but the hit point, which is per-step input
+    void save(ParticleSnapshot* snapshot) const {
+        snapshot->mass = mass;
+        memcpy(snapshot->location, location.data(), sizeof(snapshot->location));
+        memcpy(snapshot->quat, quat.coeffs().data(), sizeof(snapshot->quat));
+        memcpy(snapshot->linear_velocity, linear_velocity.data(),
+               sizeof(snapshot->linear_velocity));
+        memcpy(snapshot->angular_velocity, angular_velocity.data(),
+               sizeof(snapshot->angular_velocity));
+        memcpy(snapshot->force_accum, force_accum.data(),
+               sizeof(snapshot->force_accum));
+        memcpy(snapshot->torque_accum, torque_accum.data(),
+               sizeof(snapshot->torque_accum));
+    }
+
+    void restore(const ParticleSnapshot& snapshot) {
+        mass = snapshot.mass;
+        memcpy(location.data(), snapshot.location, sizeof(snapshot.location));
+        memcpy(quat.coeffs().data(), snapshot.quat, sizeof(snapshot.quat));
+        memcpy(linear_velocity.data(), snapshot.linear_velocity,
+               sizeof(snapshot.linear_velocity));
+        memcpy(angular_velocity.data(), snapshot.angular_velocity,
+               sizeof(snapshot.angular_velocity));
+        memcpy(force_accum.data(), snapshot.force_accum,
+               sizeof(snapshot.force_accum));
+        memcpy(torque_accum.data(), snapshot.torque_accum,
+               sizeof(snapshot.torque_accum));
+    }
+
     void apply_force(float delta_time) {
         // linear
         linear_velocity += delta_time * force_accum / mass;
         location += delta_time * linear_velocity;
 
+        // angular
+        apply_torque(delta_time);
+
         // reset
-        force_accum.setZero();
+        retire_force();
     }
 
     void move(bool forward) {
@@ -85,25 +173,6 @@ class Particle {
         linear_velocity(0) += flag[forward] * 20.f;
         linear_velocity(1) += flag[forward] * 20.f;
     }
-
-    void turn(bool left, Vector3f torque, float delta_time, Matrix3f inertia) {
-        static char flag[2] = {-1, 1};
-        angular_velocity += delta_time * inertia.inverse() * torque;
-
-        float angular_vel_norm, angular_delta_angle;
-        angular_vel_norm = angular_delta_angle = 0.f;
-        Vector3f angular_vel_axis;
-        angular_vel_axis.setZero();
-        if (!angular_velocity.isZero()) {
-            angular_vel_norm = angular_velocity.norm();
-            angular_delta_angle = angular_vel_norm * delta_time;
-            angular_vel_axis = angular_velocity / angular_vel_norm;
-        }
-
-        Quaternionf delta_quat;
-        set_quat(angular_delta_angle, angular_vel_axis, &delta_quat);
-        quat = delta_quat * quat;
-    }
 };
 
 #endif
@@ -15,6 +15,8 @@ using namespace Eigen;
 
 class ForceGenerator {
    public:
+    virtual ~ForceGenerator() {}
+
     virtual void update_force(Particle* particle, float delta_time) = 0;
 };
 
@@ -29,17 +31,23 @@ class Gravity : public ForceGenerator {
     }
 };
 
-class Spring : public ForceGenerator {
+// Generators over a fixed number of other particles take it as Size, so
+// their loops have a constant trip count the compiler unrolls; Size 0 reads
+// the count from the constructor.
+template <int Size>
+class BasicSpring : public ForceGenerator {
     Particle** other;
     int size;
     float spring_constant;
     float const* normal_length;
 
+    int count() const { return Size ? Size : size; }
+
    public:
-    Spring(Particle** other_,
-           int size_,
-           float spring_constant_,
-           const float* normal_length_)
+    BasicSpring(Particle** other_,
+                int size_,
+                float spring_constant_,
+                const float* normal_length_)
         : other(other_),
           size(size_),
           spring_constant(spring_constant_),
@@ -49,7 +57,7 @@ class Spring : public ForceGenerator {
         Vector3f force_sum;
         force_sum.setZero();
 
-        for (int i = 0; i < size; i++) {
+        for (int i = 0; i < count(); i++) {
             float val =
                 particle->get_location()(2) - other[i]->get_location()(2);
             val = val - normal_length[i];
@@ -61,6 +69,8 @@ class Spring : public ForceGenerator {
     }
 };
 
+typedef BasicSpring<0> Spring;
+
 class Friction : public ForceGenerator {
     float damping;
     float gravity_acc;
@@ -87,26 +97,31 @@ class Friction : public ForceGenerator {
     }
 };
 
-class FrameConstraint : public ForceGenerator {
+template <int Size>
+class BasicFrameConstraint : public ForceGenerator {
     Particle** other;
     int size;
 
+    int count() const { return Size ? Size : size; }
+
    public:
-    FrameConstraint(Particle** other_, int size_)
+    BasicFrameConstraint(Particle** other_, int size_)
         : other(other_), size(size_) {}
 
     virtual void update_force(Particle* particle, float delta_time) {
         for (int i = 0; i < 2; i++) {
             float vel_proj = 0.f;
-            for (int j = 0; j < size; j++) {
+            for (int j = 0; j < count(); j++) {
                 vel_proj += other[j]->get_linear_velocity()(i);
             }
-            vel_proj /= size;
+            vel_proj /= count();
             particle->set_linear_velocity(i, vel_proj);
         }
     }
 };
 
+typedef BasicFrameConstraint<0> FrameConstraint;
+
 class Contact : public ForceGenerator {
     float balance;
     float loss_coeff;
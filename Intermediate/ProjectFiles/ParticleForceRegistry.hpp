@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "Eigen/Eigen/Dense"
+#include "Instrumentation.hpp"
 #include "Particle.hpp"
 #include "ParticleForce.hpp"
 
@@ -28,8 +29,20 @@ class ParticleForceRegistry {
         registrations.push_back(registration);
     }
 
+    void remove(Particle* particle, ForceGenerator* fg) {
+        for (auto it = registrations.begin(); it != registrations.end(); ++it) {
+            if (it->particle == particle && it->fg == fg) {
+                registrations.erase(it);
+                return;
+            }
+        }
+    }
+
+    void clear() { registrations.clear(); }
+
     void update_forces(float delta_time) {
-        for (auto registry : registrations) {
+        INSTRUMENT_COUNT(INSTRUMENT_GENERATOR_CALLS, registrations.size());
+        for (const auto& registry : registrations) {
             registry.fg->update_force(registry.particle, delta_time);
         }
     }
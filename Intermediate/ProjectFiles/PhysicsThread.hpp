@@ -0,0 +1,334 @@
+#ifndef _PHYSICS_THREAD_HPP_
+#define _PHYSICS_THREAD_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "Eigen/Eigen/Dense"
+#include "FixedStep.hpp"
+#include "Vehicle4WSimulator.hpp"
+#include "VehicleCommand.hpp"
+using namespace std;
+using namespace Eigen;
+
+#define PHYSICS_CACHE_LINE 64
+#define PHYSICS_INPUT_CAPACITY 256
+#define PHYSICS_GROUND_CAPACITY 16
+
+// Bounded single-producer single-consumer ring. The producer only writes
+// tail and the consumer only head, each on its own cache line; a full
+// queue rejects the push instead of waiting.
+template <typename T>
+class SpscQueue {
+    vector<T> slots;
+    size_t mask;
+    char pad0[PHYSICS_CACHE_LINE];
+    atomic<size_t> head;
+    char pad1[PHYSICS_CACHE_LINE - sizeof(atomic<size_t>)];
+    atomic<size_t> tail;
+    char pad2[PHYSICS_CACHE_LINE - sizeof(atomic<size_t>)];
+
+   public:
+    // capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity_) : head(0), tail(0) {
+        size_t capacity = 1;
+        while (capacity < capacity_)
+            capacity *= 2;
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool push(const T& value) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == slots.size())
+            return false;
+        slots[t & mask] = value;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire))
+            return false;
+        value = slots[h & mask];
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    size_t get_capacity() const { return slots.size(); }
+};
+
+// Latest-value hand-over between one writer and one reader. The writer
+// fills its back buffer and swaps it into the middle; the reader swaps the
+// middle out when it holds something newer. Neither side ever waits, and
+// the reader's buffer stays intact until its next update().
+template <typename T>
+class TripleBuffer {
+    static const uint8_t FRESH = 4;
+    static const uint8_t INDEX = 3;
+
+    T buffers[3];
+    atomic<uint8_t> middle;
+    uint8_t back;
+    uint8_t front;
+
+   public:
+    explicit TripleBuffer(const T& initial) : middle(1), back(0), front(2) {
+        buffers[0] = buffers[1] = buffers[2] = initial;
+    }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // writer
+    T& write_buffer() { return buffers[back]; }
+
+    void publish() {
+        back = middle.exchange(back | FRESH, memory_order_acq_rel) & INDEX;
+    }
+
+    // reader: true when a newer publication was taken
+    bool update() {
+        if (!(middle.load(memory_order_relaxed) & FRESH))
+            return false;
+        front = middle.exchange(front, memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T& read_buffer() const { return buffers[front]; }
+};
+
+enum PhysicsInputKind {
+    PHYSICS_INPUT_COMMAND,
+    PHYSICS_INPUT_MOVE,
+    PHYSICS_INPUT_TURN
+};
+
+// one input for the physics thread; flag is move()'s forward or turn()'s
+// left
+struct PhysicsInput {
+    PhysicsInputKind kind;
+    bool flag;
+    VehicleCommand command;
+};
+
+// wheel sweep results in world space, as Vehicle4WSimulator::apply takes
+// them; normal is the ground normal at each point, which the tire model's
+// suspension pushes along
+struct WheelGroundHits {
+    uint8_t hit[4];
+    Vector3f point[4];
+    Vector3f normal[4];
+};
+
+// what the physics thread hands the game thread after every step
+struct VehiclePublication {
+    VehicleRenderState previous;
+    VehicleRenderState current;
+    // world space, where the next wheel sweeps start
+    Vector3f wheel_location[4];
+    float wheel_radius;
+    // simulator clock after the step, i.e. when a new command takes effect
+    double time;
+    // steady clock time the step was due at
+    chrono::steady_clock::time_point due;
+    uint64_t steps;
+};
+
+// Runs a Vehicle4WSimulator on its own thread at a fixed real-time rate.
+// The game thread never touches the simulator once start() is called:
+// inputs and ground hits go in through SPSC queues, and every step
+// publishes the render state through a triple buffer, so neither side
+// blocks the other. Ground hits are whatever the game thread last swept
+// from a published state, so they trail the simulation by a frame or so.
+//
+// Only one thread may feed inputs and hits and call acquire().
+class PhysicsThread {
+   public:
+    // runs on the physics thread after each step, e.g. to record it
+    typedef function<void(Vehicle4WSimulator&, Vector3f**)> StepCallback;
+
+   private:
+    Vehicle4WSimulator* simulator;
+    float step;
+    int max_steps;
+
+    SpscQueue<PhysicsInput> inputs;
+    SpscQueue<WheelGroundHits> ground;
+    TripleBuffer<VehiclePublication> publications;
+    StepCallback on_step;
+
+    thread worker;
+    atomic<bool> running;
+    atomic<uint64_t> dropped_steps;
+
+    static VehiclePublication publication(Vehicle4WSimulator* simulator) {
+        VehiclePublication p;
+        p.previous = p.current = simulator->get_render_state();
+        for (int i = 0; i < 4; i++) {
+            p.wheel_location[i] = simulator->get_wheel_location(i);
+        }
+        p.wheel_radius = simulator->get_wheel_radius();
+        p.time = simulator->get_time();
+        p.due = chrono::steady_clock::now();
+        p.steps = 0;
+        return p;
+    }
+
+    void apply_input(const PhysicsInput& input) {
+        switch (input.kind) {
+            case PHYSICS_INPUT_COMMAND:
+                simulator->submit(input.command);
+                break;
+            case PHYSICS_INPUT_MOVE:
+                simulator->move(input.flag);
+                break;
+            case PHYSICS_INPUT_TURN:
+                simulator->turn(input.flag);
+                break;
+        }
+    }
+
+    void run() {
+        typedef chrono::steady_clock clock;
+        clock::duration period =
+            chrono::duration_cast<clock::duration>(
+                chrono::duration<float>(step));
+        clock::time_point due = clock::now();
+        VehicleRenderState current = simulator->get_render_state();
+        WheelGroundHits hits = WheelGroundHits();
+        uint64_t steps = 0;
+
+        while (running.load(memory_order_acquire)) {
+            PhysicsInput input;
+            while (inputs.pop(input))
+                apply_input(input);
+            WheelGroundHits latest;
+            while (ground.pop(latest))
+                hits = latest;
+
+            Vector3f* hit_point_arr[4];
+            for (int i = 0; i < 4; i++) {
+                hit_point_arr[i] = hits.hit[i] ? &hits.point[i] : nullptr;
+            }
+            simulator->apply(hit_point_arr, hits.normal, step);
+            if (on_step)
+                on_step(*simulator, hit_point_arr);
+
+            VehiclePublication& p = publications.write_buffer();
+            p.previous = current;
+            p.current = current = simulator->get_render_state();
+            for (int i = 0; i < 4; i++) {
+                p.wheel_location[i] = simulator->get_wheel_location(i);
+            }
+            p.wheel_radius = simulator->get_wheel_radius();
+            p.time = simulator->get_time();
+            p.due = due;
+            p.steps = ++steps;
+            publications.publish();
+
+            // as FixedStepper: beyond max_steps behind, drop the backlog
+            due += period;
+            clock::time_point now = clock::now();
+            if (now - due > max_steps * period) {
+                dropped_steps.fetch_add((uint64_t)((now - due) / period),
+                                        memory_order_relaxed);
+                due = now;
+            }
+            this_thread::sleep_until(due);
+        }
+    }
+
+   public:
+    PhysicsThread(Vehicle4WSimulator* simulator_,
+                  float step_ = FIXED_STEP_DELTA_TIME,
+                  int max_steps_ = FIXED_STEP_MAX_STEPS)
+        : simulator(simulator_),
+          step(step_),
+          max_steps(max_steps_ < 1 ? 1 : max_steps_),
+          inputs(PHYSICS_INPUT_CAPACITY),
+          ground(PHYSICS_GROUND_CAPACITY),
+          publications(publication(simulator_)),
+          running(false),
+          dropped_steps(0) {}
+
+    ~PhysicsThread() { stop(); }
+
+    PhysicsThread(const PhysicsThread&) = delete;
+    PhysicsThread& operator=(const PhysicsThread&) = delete;
+
+    // before start()
+    void set_step_callback(const StepCallback& on_step_) {
+        on_step = on_step_;
+    }
+
+    void start() {
+        if (running.exchange(true))
+            return;
+        worker = thread([this] { run(); });
+    }
+
+    // joins after the step in flight; the simulator is the caller's again
+    void stop() {
+        if (!running.exchange(false))
+            return;
+        worker.join();
+    }
+
+    bool is_running() const { return running.load(memory_order_relaxed); }
+
+    // Inputs, applied before the next step. False when the queue is full,
+    // i.e. the physics thread has stalled.
+    bool submit(const VehicleCommand& command) {
+        PhysicsInput input = {PHYSICS_INPUT_COMMAND, false, command};
+        return inputs.push(input);
+    }
+
+    bool move(bool forward) {
+        PhysicsInput input = {PHYSICS_INPUT_MOVE, forward, VehicleCommand()};
+        return inputs.push(input);
+    }
+
+    bool turn(bool left) {
+        PhysicsInput input = {PHYSICS_INPUT_TURN, left, VehicleCommand()};
+        return inputs.push(input);
+    }
+
+    // replaces the hits the following steps use
+    bool submit_ground(const WheelGroundHits& hits) {
+        return ground.push(hits);
+    }
+
+    // newest publication, valid until the next acquire()
+    const VehiclePublication& acquire() {
+        publications.update();
+        return publications.read_buffer();
+    }
+
+    // how far the clock is past p.due, in steps, for blending previous and
+    // current
+    float get_alpha(const VehiclePublication& p) const {
+        float elapsed = chrono::duration<float>(chrono::steady_clock::now() -
+                                                p.due)
+                            .count();
+        float alpha = elapsed / step;
+        return alpha < 0.f ? 0.f : alpha > 1.f ? 1.f : alpha;
+    }
+
+    float get_step() const { return step; }
+
+    // steps skipped because the thread fell more than max_steps behind
+    uint64_t get_dropped_steps() const {
+        return dropped_steps.load(memory_order_relaxed);
+    }
+};
+
+#endif
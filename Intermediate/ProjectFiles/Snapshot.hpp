@@ -0,0 +1,145 @@
+#ifndef _SNAPSHOT_HPP_
+#define _SNAPSHOT_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#define VEHICLE_SNAPSHOT_MAGIC 0x53573456u  // "V4WS"
+#define VEHICLE_SNAPSHOT_VERSION 7
+
+// Plain float blocks, so a snapshot can be copied, hashed or sent as bytes.
+// Quaternions are stored in Eigen's coefficient order, x, y, z, w.
+struct ParticleSnapshot {
+    float mass;
+    float location[3];
+    float quat[4];
+    float linear_velocity[3];
+    float angular_velocity[3];
+    float force_accum[3];
+    float torque_accum[3];
+};
+
+// One wheel of a contact cache: the contact it holds, where the wheel was
+// swept from and how long ago. valid is 0 when it holds none.
+struct ContactSnapshot {
+    float point[3];
+    float normal[3];
+    int32_t surface;
+    float swept_center[3];
+    float age;
+    int32_t valid;
+};
+
+// Everything VehicleSimulator::apply reads besides the hit points, the
+// temporary registry, queued commands and the contact cache's tolerance and
+// maximum age, for a simulator with room for
+// Wheels wheels. Buffers holding one need 8-byte alignment.
+template <int Wheels>
+struct BasicVehicleSnapshot {
+    uint32_t magic;
+    uint32_t version;
+    // Wheels and sizeof of the writer's snapshot, which fix the layout of
+    // the rest
+    uint32_t capacity;
+    uint32_t size;
+
+    // clock and held input axes
+    double time;
+    float throttle;
+    float brake;
+    float steer;
+
+    float location[3];
+    float body_box_extent[3];
+    float wheel_radius;
+    int32_t integrator;
+    // wheels in use, at most Wheels; the arrays' tails are unused
+    int32_t wheel_count;
+
+    // force generator parameters
+    float gravity_acc;
+    float spring_constant;
+    float balance;
+    float loss_coeff;
+    float damping;
+    float normal_length_body[Wheels];
+    float normal_length_wheel[Wheels];
+    // the tire model's wheel slip speeds, 0 without it
+    float wheel_slip[Wheels];
+    // the contact cache, so re-simulated steps reuse the contacts the first
+    // run did
+    ContactSnapshot contact[Wheels];
+
+    // body, then the wheels
+    ParticleSnapshot particle[1 + Wheels];
+};
+
+typedef BasicVehicleSnapshot<4> VehicleSnapshot;
+
+// The last `frames` snapshots of block_size bytes each, in one allocation
+// made up front. push() hands out the slot of the oldest frame to write the
+// new one into, so recording and rolling back never allocate.
+class SnapshotRing {
+    std::vector<unsigned char> storage;
+    std::vector<int64_t> frame_ids;
+    size_t block_size;
+    size_t capacity;
+    size_t head;
+    size_t count;
+
+    size_t slot(size_t age) const {
+        return (head + capacity - 1 - age) % capacity;
+    }
+
+   public:
+    SnapshotRing(size_t block_size_, size_t frames_)
+        : storage(block_size_ * (frames_ ? frames_ : 1)),
+          frame_ids(frames_ ? frames_ : 1, -1),
+          block_size(block_size_),
+          capacity(frames_ ? frames_ : 1),
+          head(0),
+          count(0) {}
+
+    // slot to save frame into; frames must be pushed in increasing order
+    void* push(int64_t frame) {
+        void* block = &storage[head * block_size];
+        frame_ids[head] = frame;
+        head = (head + 1) % capacity;
+        if (count < capacity)
+            count++;
+        return block;
+    }
+
+    // snapshot of frame, nullptr when it is not (or no longer) buffered
+    const void* find(int64_t frame) const {
+        for (size_t age = 0; age < count; age++) {
+            size_t k = slot(age);
+            if (frame_ids[k] == frame)
+                return &storage[k * block_size];
+            if (frame_ids[k] < frame)
+                break;
+        }
+        return nullptr;
+    }
+
+    // forgets every frame after frame, e.g. after rolling back to it
+    void truncate(int64_t frame) {
+        while (count > 0 && frame_ids[slot(0)] > frame) {
+            head = (head + capacity - 1) % capacity;
+            frame_ids[head] = -1;
+            count--;
+        }
+    }
+
+    // most recent frame, -1 when empty
+    int64_t latest() const { return count ? frame_ids[slot(0)] : -1; }
+
+    size_t size() const { return count; }
+
+    size_t get_capacity() const { return capacity; }
+
+    size_t get_block_size() const { return block_size; }
+};
+
+#endif
@@ -0,0 +1,428 @@
+#ifndef _TIREMODEL_HPP_
+#define _TIREMODEL_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "FleetForceKernels.hpp"
+using namespace std;
+
+// Raycast-style suspension and slip tires for VehicleSimulator, the
+// archetype's tire_model. One call evaluates every wheel of a vehicle:
+//
+//   suspension  k * compression + c * compression rate, along the hit normal
+//   load        the suspension force plus the wheel's weight, 0 in the air
+//   slip        longitudinal (spin * radius - v) / |v|, lateral v_lat / |v|
+//   tire force  grip * load * sin(shape * atan(stiffness * slip)) per
+//               direction (Pacejka's magic formula without the curvature
+//               term), scaled back into the friction circle
+//   spin        drive torque, brake torque and the tire's reaction, the
+//               latter linearized and taken implicitly
+//
+// atan and sin are rational and parabolic fits (about 1e-3 off), so the
+// stage has no library calls and no branches; as in FleetForceKernels.hpp,
+// the SSE2 and AVX2 variants perform the scalar path's operations in its
+// order and give bit-identical results (Tests/KernelParityTest.cpp).
+//
+// |v| is clamped to min_speed: below it the slip stiffness no longer grows,
+// which keeps a step from overshooting the tire force at a standstill (see
+// tire_min_speed()).
+#define TIRE_MIN_SPEED 1.f
+// smallest tire force the friction circle divides by
+#define TIRE_MIN_FORCE 1e-3f
+#define TIRE_HALF_PI 1.57079633f
+#define TIRE_QUARTER_PI 0.785398163f
+// atan(t) ~ t * (pi / 4 + (1 - t) * (A + B * t)) on [0, 1]
+#define TIRE_ATAN_A 0.2447f
+#define TIRE_ATAN_B 0.0663f
+// sin(y) ~ y * (4 / pi - 4 / pi^2 * |y|) on [-pi, pi], then refined
+#define TIRE_SIN_A 1.27323954f
+#define TIRE_SIN_B 0.405284735f
+#define TIRE_SIN_REFINE 0.225f
+
+// Per-wheel columns of one vehicle, count entries each, plus its constants.
+struct TireKernelArgs {
+    // per wheel
+    // rest length minus the current body-wheel height, and its rate
+    const float* compression;
+    const float* compression_rate;
+    // 1 on the ground, 0 in the air
+    const float* grounded;
+    // contact point velocity and rolling direction, in the ground plane
+    const float* vx;
+    const float* vy;
+    const float* hx;
+    const float* hy;
+    const float* drive_torque;
+    const float* spin;
+
+    // outputs: the suspension force along the hit normal, the tire force
+    // and the spin at the end of the step
+    float* suspension;
+    float* fx;
+    float* fy;
+    float* next_spin;
+
+    // per vehicle
+    float spring_constant;
+    float suspension_damping;
+    float wheel_weight;
+    float wheel_radius;
+    float spin_inertia;
+    float brake_torque;
+    float tire_stiffness;
+    float tire_shape;
+    float tire_grip;
+    float min_speed;
+};
+
+// Speed below which the slip denominator stops shrinking. Over one step a
+// vehicle on its tires changes speed by about dt * g * grip * stiffness *
+// shape times its slip speed; clamping |v| to that keeps the factor at or
+// below one, so the tires settle instead of oscillating at low speed.
+inline float tire_min_speed(float gravity_acc,
+                            float tire_grip,
+                            float tire_stiffness,
+                            float tire_shape,
+                            float delta_time) {
+    return max(TIRE_MIN_SPEED, delta_time * gravity_acc * tire_grip *
+                                   tire_stiffness * tire_shape);
+}
+
+inline float tire_atan(float x) {
+    float ax = abs(x);
+    float t = min(ax, 1.f) / max(ax, 1.f);
+    float p = t * (TIRE_QUARTER_PI +
+                   (1.f - t) * (TIRE_ATAN_A + TIRE_ATAN_B * t));
+    p = ax > 1.f ? TIRE_HALF_PI - p : p;
+    return copysign(p, x);
+}
+
+inline float tire_sin(float y) {
+    float s = y * (TIRE_SIN_A - TIRE_SIN_B * abs(y));
+    return s + TIRE_SIN_REFINE * (s * abs(s) - s);
+}
+
+// share of the peak force at slip, for shape in (0, 2]
+inline float tire_curve(float slip, float stiffness, float shape) {
+    return tire_sin(shape * tire_atan(stiffness * slip));
+}
+
+// suspension, tire force and spin of the wheels [begin, end)
+inline void tire_forces_scalar(const TireKernelArgs& a,
+                               size_t begin,
+                               size_t end,
+                               float delta_time) {
+    for (size_t i = begin; i < end; i++) {
+        // suspension
+        float suspension = a.spring_constant * a.compression[i] +
+                           a.suspension_damping * a.compression_rate[i];
+        a.suspension[i] = suspension;
+        float load = a.grounded[i] * max(suspension + a.wheel_weight, 0.f);
+
+        // slip
+        float v_long = a.vx[i] * a.hx[i] + a.vy[i] * a.hy[i];
+        float v_lat = a.vy[i] * a.hx[i] - a.vx[i] * a.hy[i];
+        float speed = max(abs(v_long), a.min_speed);
+        float spin = a.spin[i];
+        float slip_long = (spin * a.wheel_radius - v_long) / speed;
+        float slip_lat = v_lat / speed;
+
+        // tire force, in the friction circle
+        float peak = a.tire_grip * load;
+        float f_long =
+            peak * tire_curve(slip_long, a.tire_stiffness, a.tire_shape);
+        float f_lat =
+            -(peak * tire_curve(slip_lat, a.tire_stiffness, a.tire_shape));
+        float total = sqrt(f_long * f_long + f_lat * f_lat);
+        float scale = min(peak / max(total, TIRE_MIN_FORCE), 1.f);
+        f_long = f_long * scale;
+        f_lat = f_lat * scale;
+        a.fx[i] = f_long * a.hx[i] - f_lat * a.hy[i];
+        a.fy[i] = f_long * a.hy[i] + f_lat * a.hx[i];
+
+        // spin; the brake stops the wheel at most
+        float brake =
+            min(a.brake_torque, abs(spin) * a.spin_inertia / delta_time);
+        brake = copysign(brake, spin);
+        float slope = peak * a.tire_stiffness * a.tire_shape *
+                      a.wheel_radius / speed;
+        float torque = a.drive_torque[i] - brake - a.wheel_radius * f_long;
+        a.next_spin[i] =
+            spin + delta_time * torque /
+                       (a.spin_inertia + delta_time * a.wheel_radius * slope);
+    }
+}
+
+#if FLEET_KERNELS_X86
+
+inline __m128 tire_atan_sse2(__m128 x) {
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    __m128 ax = _mm_and_ps(x, abs_mask);
+    __m128 t = _mm_div_ps(_mm_min_ps(ax, one), _mm_max_ps(ax, one));
+    __m128 inner = _mm_add_ps(_mm_set1_ps(TIRE_ATAN_A),
+                              _mm_mul_ps(_mm_set1_ps(TIRE_ATAN_B), t));
+    __m128 p = _mm_mul_ps(
+        t, _mm_add_ps(_mm_set1_ps(TIRE_QUARTER_PI),
+                      _mm_mul_ps(_mm_sub_ps(one, t), inner)));
+    __m128 big = _mm_cmpgt_ps(ax, one);
+    p = _mm_or_ps(_mm_and_ps(big, _mm_sub_ps(_mm_set1_ps(TIRE_HALF_PI), p)),
+                  _mm_andnot_ps(big, p));
+    return _mm_or_ps(p, _mm_and_ps(x, sign_mask));
+}
+
+inline __m128 tire_sin_sse2(__m128 y) {
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 s = _mm_mul_ps(
+        y, _mm_sub_ps(_mm_set1_ps(TIRE_SIN_A),
+                      _mm_mul_ps(_mm_set1_ps(TIRE_SIN_B),
+                                 _mm_and_ps(y, abs_mask))));
+    __m128 refine = _mm_sub_ps(_mm_mul_ps(s, _mm_and_ps(s, abs_mask)), s);
+    return _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(TIRE_SIN_REFINE), refine));
+}
+
+inline __m128 tire_curve_sse2(__m128 slip, __m128 stiffness, __m128 shape) {
+    return tire_sin_sse2(
+        _mm_mul_ps(shape, tire_atan_sse2(_mm_mul_ps(stiffness, slip))));
+}
+
+// four wheels per instruction
+inline void tire_forces_sse2(const TireKernelArgs& a,
+                             size_t begin,
+                             size_t end,
+                             float delta_time) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    const __m128 dt = _mm_set1_ps(delta_time);
+    const __m128 k = _mm_set1_ps(a.spring_constant);
+    const __m128 c = _mm_set1_ps(a.suspension_damping);
+    const __m128 wheel_weight = _mm_set1_ps(a.wheel_weight);
+    const __m128 radius = _mm_set1_ps(a.wheel_radius);
+    const __m128 spin_inertia = _mm_set1_ps(a.spin_inertia);
+    const __m128 brake_torque = _mm_set1_ps(a.brake_torque);
+    const __m128 stiffness = _mm_set1_ps(a.tire_stiffness);
+    const __m128 shape = _mm_set1_ps(a.tire_shape);
+    const __m128 grip = _mm_set1_ps(a.tire_grip);
+    const __m128 min_speed = _mm_set1_ps(a.min_speed);
+    const __m128 min_force = _mm_set1_ps(TIRE_MIN_FORCE);
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        // suspension
+        __m128 suspension =
+            _mm_add_ps(_mm_mul_ps(k, _mm_loadu_ps(a.compression + i)),
+                       _mm_mul_ps(c, _mm_loadu_ps(a.compression_rate + i)));
+        _mm_storeu_ps(a.suspension + i, suspension);
+        __m128 load = _mm_mul_ps(
+            _mm_loadu_ps(a.grounded + i),
+            _mm_max_ps(_mm_add_ps(suspension, wheel_weight), zero));
+
+        // slip
+        __m128 vx = _mm_loadu_ps(a.vx + i);
+        __m128 vy = _mm_loadu_ps(a.vy + i);
+        __m128 hx = _mm_loadu_ps(a.hx + i);
+        __m128 hy = _mm_loadu_ps(a.hy + i);
+        __m128 v_long = _mm_add_ps(_mm_mul_ps(vx, hx), _mm_mul_ps(vy, hy));
+        __m128 v_lat = _mm_sub_ps(_mm_mul_ps(vy, hx), _mm_mul_ps(vx, hy));
+        __m128 speed = _mm_max_ps(_mm_and_ps(v_long, abs_mask), min_speed);
+        __m128 spin = _mm_loadu_ps(a.spin + i);
+        __m128 slip_long = _mm_div_ps(
+            _mm_sub_ps(_mm_mul_ps(spin, radius), v_long), speed);
+        __m128 slip_lat = _mm_div_ps(v_lat, speed);
+
+        // tire force, in the friction circle
+        __m128 peak = _mm_mul_ps(grip, load);
+        __m128 f_long =
+            _mm_mul_ps(peak, tire_curve_sse2(slip_long, stiffness, shape));
+        __m128 f_lat = _mm_xor_ps(
+            _mm_mul_ps(peak, tire_curve_sse2(slip_lat, stiffness, shape)),
+            sign_mask);
+        __m128 total = _mm_sqrt_ps(
+            _mm_add_ps(_mm_mul_ps(f_long, f_long), _mm_mul_ps(f_lat, f_lat)));
+        __m128 scale =
+            _mm_min_ps(_mm_div_ps(peak, _mm_max_ps(total, min_force)), one);
+        f_long = _mm_mul_ps(f_long, scale);
+        f_lat = _mm_mul_ps(f_lat, scale);
+        _mm_storeu_ps(a.fx + i, _mm_sub_ps(_mm_mul_ps(f_long, hx),
+                                           _mm_mul_ps(f_lat, hy)));
+        _mm_storeu_ps(a.fy + i, _mm_add_ps(_mm_mul_ps(f_long, hy),
+                                           _mm_mul_ps(f_lat, hx)));
+
+        // spin; the brake stops the wheel at most
+        __m128 brake = _mm_min_ps(
+            brake_torque,
+            _mm_div_ps(_mm_mul_ps(_mm_and_ps(spin, abs_mask), spin_inertia),
+                       dt));
+        brake = _mm_or_ps(brake, _mm_and_ps(spin, sign_mask));
+        __m128 slope = _mm_div_ps(
+            _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(peak, stiffness), shape),
+                       radius),
+            speed);
+        __m128 torque =
+            _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(a.drive_torque + i), brake),
+                       _mm_mul_ps(radius, f_long));
+        __m128 inertia = _mm_add_ps(
+            spin_inertia, _mm_mul_ps(_mm_mul_ps(dt, radius), slope));
+        _mm_storeu_ps(a.next_spin + i,
+                      _mm_add_ps(spin, _mm_div_ps(_mm_mul_ps(dt, torque),
+                                                  inertia)));
+    }
+    tire_forces_scalar(a, i, end, delta_time);
+}
+
+FLEET_TARGET_AVX2 inline __m256 tire_atan_avx2(__m256 x) {
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 abs_mask =
+        _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 sign_mask =
+        _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+    __m256 ax = _mm256_and_ps(x, abs_mask);
+    __m256 t = _mm256_div_ps(_mm256_min_ps(ax, one), _mm256_max_ps(ax, one));
+    __m256 inner =
+        _mm256_add_ps(_mm256_set1_ps(TIRE_ATAN_A),
+                      _mm256_mul_ps(_mm256_set1_ps(TIRE_ATAN_B), t));
+    __m256 p = _mm256_mul_ps(
+        t, _mm256_add_ps(_mm256_set1_ps(TIRE_QUARTER_PI),
+                         _mm256_mul_ps(_mm256_sub_ps(one, t), inner)));
+    p = _mm256_blendv_ps(p, _mm256_sub_ps(_mm256_set1_ps(TIRE_HALF_PI), p),
+                         _mm256_cmp_ps(ax, one, _CMP_GT_OQ));
+    return _mm256_or_ps(p, _mm256_and_ps(x, sign_mask));
+}
+
+FLEET_TARGET_AVX2 inline __m256 tire_sin_avx2(__m256 y) {
+    const __m256 abs_mask =
+        _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 s = _mm256_mul_ps(
+        y, _mm256_sub_ps(_mm256_set1_ps(TIRE_SIN_A),
+                         _mm256_mul_ps(_mm256_set1_ps(TIRE_SIN_B),
+                                       _mm256_and_ps(y, abs_mask))));
+    __m256 refine =
+        _mm256_sub_ps(_mm256_mul_ps(s, _mm256_and_ps(s, abs_mask)), s);
+    return _mm256_add_ps(
+        s, _mm256_mul_ps(_mm256_set1_ps(TIRE_SIN_REFINE), refine));
+}
+
+FLEET_TARGET_AVX2 inline __m256 tire_curve_avx2(__m256 slip,
+                                                __m256 stiffness,
+                                                __m256 shape) {
+    return tire_sin_avx2(_mm256_mul_ps(
+        shape, tire_atan_avx2(_mm256_mul_ps(stiffness, slip))));
+}
+
+// eight wheels per instruction
+FLEET_TARGET_AVX2
+inline void tire_forces_avx2(const TireKernelArgs& a,
+                             size_t begin,
+                             size_t end,
+                             float delta_time) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 abs_mask =
+        _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 sign_mask =
+        _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+    const __m256 dt = _mm256_set1_ps(delta_time);
+    const __m256 k = _mm256_set1_ps(a.spring_constant);
+    const __m256 c = _mm256_set1_ps(a.suspension_damping);
+    const __m256 wheel_weight = _mm256_set1_ps(a.wheel_weight);
+    const __m256 radius = _mm256_set1_ps(a.wheel_radius);
+    const __m256 spin_inertia = _mm256_set1_ps(a.spin_inertia);
+    const __m256 brake_torque = _mm256_set1_ps(a.brake_torque);
+    const __m256 stiffness = _mm256_set1_ps(a.tire_stiffness);
+    const __m256 shape = _mm256_set1_ps(a.tire_shape);
+    const __m256 grip = _mm256_set1_ps(a.tire_grip);
+    const __m256 min_speed = _mm256_set1_ps(a.min_speed);
+    const __m256 min_force = _mm256_set1_ps(TIRE_MIN_FORCE);
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        // suspension
+        __m256 suspension = _mm256_add_ps(
+            _mm256_mul_ps(k, _mm256_loadu_ps(a.compression + i)),
+            _mm256_mul_ps(c, _mm256_loadu_ps(a.compression_rate + i)));
+        _mm256_storeu_ps(a.suspension + i, suspension);
+        __m256 load = _mm256_mul_ps(
+            _mm256_loadu_ps(a.grounded + i),
+            _mm256_max_ps(_mm256_add_ps(suspension, wheel_weight), zero));
+
+        // slip
+        __m256 vx = _mm256_loadu_ps(a.vx + i);
+        __m256 vy = _mm256_loadu_ps(a.vy + i);
+        __m256 hx = _mm256_loadu_ps(a.hx + i);
+        __m256 hy = _mm256_loadu_ps(a.hy + i);
+        __m256 v_long =
+            _mm256_add_ps(_mm256_mul_ps(vx, hx), _mm256_mul_ps(vy, hy));
+        __m256 v_lat =
+            _mm256_sub_ps(_mm256_mul_ps(vy, hx), _mm256_mul_ps(vx, hy));
+        __m256 speed =
+            _mm256_max_ps(_mm256_and_ps(v_long, abs_mask), min_speed);
+        __m256 spin = _mm256_loadu_ps(a.spin + i);
+        __m256 slip_long = _mm256_div_ps(
+            _mm256_sub_ps(_mm256_mul_ps(spin, radius), v_long), speed);
+        __m256 slip_lat = _mm256_div_ps(v_lat, speed);
+
+        // tire force, in the friction circle
+        __m256 peak = _mm256_mul_ps(grip, load);
+        __m256 f_long = _mm256_mul_ps(
+            peak, tire_curve_avx2(slip_long, stiffness, shape));
+        __m256 f_lat = _mm256_xor_ps(
+            _mm256_mul_ps(peak, tire_curve_avx2(slip_lat, stiffness, shape)),
+            sign_mask);
+        __m256 total = _mm256_sqrt_ps(_mm256_add_ps(
+            _mm256_mul_ps(f_long, f_long), _mm256_mul_ps(f_lat, f_lat)));
+        __m256 scale = _mm256_min_ps(
+            _mm256_div_ps(peak, _mm256_max_ps(total, min_force)), one);
+        f_long = _mm256_mul_ps(f_long, scale);
+        f_lat = _mm256_mul_ps(f_lat, scale);
+        _mm256_storeu_ps(a.fx + i, _mm256_sub_ps(_mm256_mul_ps(f_long, hx),
+                                                 _mm256_mul_ps(f_lat, hy)));
+        _mm256_storeu_ps(a.fy + i, _mm256_add_ps(_mm256_mul_ps(f_long, hy),
+                                                 _mm256_mul_ps(f_lat, hx)));
+
+        // spin; the brake stops the wheel at most
+        __m256 brake = _mm256_min_ps(
+            brake_torque,
+            _mm256_div_ps(
+                _mm256_mul_ps(_mm256_and_ps(spin, abs_mask), spin_inertia),
+                dt));
+        brake = _mm256_or_ps(brake, _mm256_and_ps(spin, sign_mask));
+        __m256 slope = _mm256_div_ps(
+            _mm256_mul_ps(
+                _mm256_mul_ps(_mm256_mul_ps(peak, stiffness), shape), radius),
+            speed);
+        __m256 torque = _mm256_sub_ps(
+            _mm256_sub_ps(_mm256_loadu_ps(a.drive_torque + i), brake),
+            _mm256_mul_ps(radius, f_long));
+        __m256 inertia = _mm256_add_ps(
+            spin_inertia, _mm256_mul_ps(_mm256_mul_ps(dt, radius), slope));
+        _mm256_storeu_ps(
+            a.next_spin + i,
+            _mm256_add_ps(spin,
+                          _mm256_div_ps(_mm256_mul_ps(dt, torque), inertia)));
+    }
+    // a four-wheel vehicle fills no eight-wide batch
+    tire_forces_sse2(a, i, end, delta_time);
+}
+
+#endif
+
+inline void tire_forces(FleetKernelLevel level,
+                        const TireKernelArgs& a,
+                        size_t begin,
+                        size_t end,
+                        float delta_time) {
+#if FLEET_KERNELS_X86
+    if (level == FLEET_KERNEL_AVX2)
+        return tire_forces_avx2(a, begin, end, delta_time);
+    if (level == FLEET_KERNEL_SSE2)
+        return tire_forces_sse2(a, begin, end, delta_time);
+#endif
+    tire_forces_scalar(a, begin, end, delta_time);
+}
+
+#endif
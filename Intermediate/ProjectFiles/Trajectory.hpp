@@ -0,0 +1,623 @@
+#ifndef _TRAJECTORY_HPP_
+#define _TRAJECTORY_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Eigen/Eigen/Dense"
+#include "FixedStep.hpp"
+#include "FleetSimulator.hpp"
+#include "Vehicle4WSimulator.hpp"
+using namespace Eigen;
+
+// Trajectory files: an append-only, memory-mapped columnar log of vehicle
+// state, one record per simulation step.
+//
+//   [header, TRAJECTORY_PAGE bytes][segment 0][segment 1]...
+//
+// A segment holds frames_per_segment frames. Inside it every column is one
+// contiguous block of frames_per_segment * vehicles * width floats, frame
+// major; wheel columns are 4 wide, wheel i of vehicle v at v * 4 + i, like
+// the FleetSimulator columns. Segments have a fixed size, so the header's
+// column offsets are the whole index: any frame of any column is one
+// multiplication away, and the reader can scrub without scanning.
+//
+// Locations, rotations and hit points are relative to the vehicle origin;
+// hit points are NaN while a wheel is airborne. Forces are what the step
+// integrated. Vehicles a frame did not record read as zero.
+
+#define TRAJECTORY_MAGIC "V4WTRAJ"
+#define TRAJECTORY_VERSION 1
+// mmap offsets have to be multiples of the allocation granularity, which
+// is 64 KiB on Windows
+#define TRAJECTORY_PAGE 65536
+// segments are sized to about this many bytes unless open() is given a
+// frame count; large enough to make remapping rare, small enough to keep
+// the mapped window modest
+#define TRAJECTORY_SEGMENT_BYTES (16 << 20)
+
+enum TrajectoryColumn {
+    // per vehicle
+    TRAJECTORY_ORIGIN_X,
+    TRAJECTORY_ORIGIN_Y,
+    TRAJECTORY_ORIGIN_Z,
+    TRAJECTORY_BODY_X,
+    TRAJECTORY_BODY_Y,
+    TRAJECTORY_BODY_Z,
+    TRAJECTORY_BODY_VX,
+    TRAJECTORY_BODY_VY,
+    TRAJECTORY_BODY_VZ,
+    TRAJECTORY_BODY_FX,
+    TRAJECTORY_BODY_FY,
+    TRAJECTORY_BODY_FZ,
+    TRAJECTORY_BODY_QW,
+    TRAJECTORY_BODY_QX,
+    TRAJECTORY_BODY_QY,
+    TRAJECTORY_BODY_QZ,
+    // per wheel
+    TRAJECTORY_WHEEL_X,
+    TRAJECTORY_WHEEL_Y,
+    TRAJECTORY_WHEEL_Z,
+    TRAJECTORY_WHEEL_VX,
+    TRAJECTORY_WHEEL_VY,
+    TRAJECTORY_WHEEL_VZ,
+    TRAJECTORY_WHEEL_FX,
+    TRAJECTORY_WHEEL_FY,
+    TRAJECTORY_WHEEL_FZ,
+    TRAJECTORY_WHEEL_QW,
+    TRAJECTORY_WHEEL_QX,
+    TRAJECTORY_WHEEL_QY,
+    TRAJECTORY_WHEEL_QZ,
+    TRAJECTORY_WHEEL_HIT_X,
+    TRAJECTORY_WHEEL_HIT_Y,
+    TRAJECTORY_WHEEL_HIT_Z
+};
+
+#define TRAJECTORY_COLUMN_COUNT 32
+
+#define TRAJECTORY_ALL_COLUMNS 0xffffffffull
+// what replay needs: origin, body and wheel locations, wheel rotation
+#define TRAJECTORY_RENDER_COLUMNS 0x1e07003full
+
+inline uint64_t trajectory_bit(TrajectoryColumn column) {
+    return 1ull << column;
+}
+
+// floats per vehicle
+inline int trajectory_width(TrajectoryColumn column) {
+    return column >= TRAJECTORY_WHEEL_X ? FLEET_WHEEL_COUNT : 1;
+}
+
+struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vehicles;
+    uint32_t frames_per_segment;
+    float delta_time;
+    uint64_t column_mask;
+    uint64_t segment_bytes;
+    // frames fully written, updated as each one ends
+    uint64_t frame_count;
+    // byte offset of each column inside a segment, unused when masked out
+    uint64_t column_offset[TRAJECTORY_COLUMN_COUNT];
+};
+
+// The little of the OS file mapping API the recorder and reader need.
+class MappedFile {
+#ifdef _WIN32
+    HANDLE file;
+#else
+    int fd;
+#endif
+    bool writable;
+
+   public:
+#ifdef _WIN32
+    MappedFile() : file(INVALID_HANDLE_VALUE), writable(false) {}
+#else
+    MappedFile() : fd(-1), writable(false) {}
+#endif
+
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // writable truncates or creates the file
+    bool open(const char* path, bool writable_) {
+        close();
+        writable = writable_;
+#ifdef _WIN32
+        file = CreateFileA(path,
+                           writable ? GENERIC_READ | GENERIC_WRITE
+                                    : GENERIC_READ,
+                           FILE_SHARE_READ, nullptr,
+                           writable ? CREATE_ALWAYS : OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        return file != INVALID_HANDLE_VALUE;
+#else
+        fd = writable ? ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)
+                      : ::open(path, O_RDONLY);
+        return fd >= 0;
+#endif
+    }
+
+    bool is_open() const {
+#ifdef _WIN32
+        return file != INVALID_HANDLE_VALUE;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+    }
+
+    uint64_t size() const {
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        return GetFileSizeEx(file, &size) ? (uint64_t)size.QuadPart : 0;
+#else
+        struct stat st;
+        return fstat(fd, &st) ? 0 : (uint64_t)st.st_size;
+#endif
+    }
+
+    // grows the file; new bytes read as zero
+    bool resize(uint64_t bytes) {
+#ifdef _WIN32
+        LARGE_INTEGER end;
+        end.QuadPart = (LONGLONG)bytes;
+        return SetFilePointerEx(file, end, nullptr, FILE_BEGIN) &&
+               SetEndOfFile(file);
+#else
+        return ftruncate(fd, (off_t)bytes) == 0;
+#endif
+    }
+
+    // offset must be a multiple of TRAJECTORY_PAGE; nullptr on failure
+    void* map(uint64_t offset, size_t bytes) {
+#ifdef _WIN32
+        HANDLE mapping = CreateFileMappingA(
+            file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0,
+            nullptr);
+        if (!mapping)
+            return nullptr;
+        void* view = MapViewOfFile(
+            mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+            (DWORD)(offset >> 32), (DWORD)offset, bytes);
+        // the view keeps the mapping alive
+        CloseHandle(mapping);
+        return view;
+#else
+        void* view =
+            mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                 MAP_SHARED, fd, (off_t)offset);
+        return view == MAP_FAILED ? nullptr : view;
+#endif
+    }
+
+    static void unmap(void* view, size_t bytes) {
+        if (!view)
+            return;
+#ifdef _WIN32
+        (void)bytes;
+        UnmapViewOfFile(view);
+#else
+        munmap(view, bytes);
+#endif
+    }
+};
+
+// Appends frames to a trajectory file. Only the header and the segment
+// being filled are mapped; the file grows one segment at a time, so the
+// per-frame cost is the stores into the mapping. Not thread-safe: record
+// from one thread, after the step has finished.
+class TrajectoryRecorder {
+    MappedFile file;
+    TrajectoryHeader* header;
+    char* segment;
+    uint64_t segment_index;
+    // frame inside the mapped segment
+    uint32_t segment_frame;
+    bool failed;
+
+    void close_segment() {
+        MappedFile::unmap(segment, (size_t)header->segment_bytes);
+        segment = nullptr;
+    }
+
+   public:
+    TrajectoryRecorder()
+        : header(nullptr),
+          segment(nullptr),
+          segment_index(0),
+          segment_frame(0),
+          failed(false) {}
+
+    ~TrajectoryRecorder() { close(); }
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    // Creates path for vehicles vehicles stepped at delta_time, recording the
+    // columns in column_mask. frames_per_segment 0 picks it from
+    // TRAJECTORY_SEGMENT_BYTES. Returns false when the file cannot be
+    // created or mapped.
+    bool open(const char* path,
+              uint32_t vehicles,
+              float delta_time,
+              uint64_t column_mask = TRAJECTORY_ALL_COLUMNS,
+              uint32_t frames_per_segment = 0) {
+        close();
+        uint64_t frame_bytes = 0;
+        for (int c = 0; c < TRAJECTORY_COLUMN_COUNT; c++) {
+            TrajectoryColumn column = (TrajectoryColumn)c;
+            if (column_mask & trajectory_bit(column))
+                frame_bytes += trajectory_width(column) * sizeof(float);
+        }
+        frame_bytes *= vehicles;
+        if (frame_bytes == 0 || !file.open(path, true) ||
+            !file.resize(TRAJECTORY_PAGE))
+            return false;
+        if (frames_per_segment == 0) {
+            uint64_t frames = TRAJECTORY_SEGMENT_BYTES / frame_bytes;
+            frames_per_segment = frames ? (uint32_t)frames : 1;
+        }
+        header = (TrajectoryHeader*)file.map(0, TRAJECTORY_PAGE);
+        if (!header) {
+            file.close();
+            return false;
+        }
+
+        memcpy(header->magic, TRAJECTORY_MAGIC, sizeof(header->magic));
+        header->version = TRAJECTORY_VERSION;
+        header->vehicles = vehicles;
+        header->frames_per_segment = frames_per_segment;
+        header->delta_time = delta_time;
+        header->column_mask = column_mask & TRAJECTORY_ALL_COLUMNS;
+        header->frame_count = 0;
+        uint64_t offset = 0;
+        for (int c = 0; c < TRAJECTORY_COLUMN_COUNT; c++) {
+            TrajectoryColumn column = (TrajectoryColumn)c;
+            header->column_offset[c] = offset;
+            if (header->column_mask & trajectory_bit(column)) {
+                offset += (uint64_t)frames_per_segment * vehicles *
+                          trajectory_width(column) * sizeof(float);
+            }
+        }
+        header->segment_bytes =
+            (offset + TRAJECTORY_PAGE - 1) / TRAJECTORY_PAGE * TRAJECTORY_PAGE;
+        segment_index = 0;
+        segment_frame = 0;
+        failed = false;
+        return true;
+    }
+
+    void close() {
+        if (header)
+            close_segment();
+        MappedFile::unmap(header, TRAJECTORY_PAGE);
+        header = nullptr;
+        file.close();
+    }
+
+    bool is_open() const { return header != nullptr; }
+
+    // set when growing or mapping the file failed; frames are dropped
+    bool has_failed() const { return failed; }
+
+    uint64_t get_frame_count() const {
+        return header ? header->frame_count : 0;
+    }
+
+    uint32_t get_vehicle_count() const {
+        return header ? header->vehicles : 0;
+    }
+
+    // Starts a frame, mapping the next segment when needed. Columns of the
+    // frame are written through column(), then end_frame() commits it.
+    bool begin_frame() {
+        if (!header || failed)
+            return false;
+        if (segment)
+            return true;
+        uint64_t bytes = header->segment_bytes;
+        uint64_t offset = TRAJECTORY_PAGE + segment_index * bytes;
+        if (!file.resize(offset + bytes) ||
+            !(segment = (char*)file.map(offset, (size_t)bytes))) {
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    // vehicles * width floats of column in the current frame, nullptr when
+    // the column is not recorded
+    float* column(TrajectoryColumn column) {
+        if (!segment || !(header->column_mask & trajectory_bit(column)))
+            return nullptr;
+        size_t stride = header->vehicles * trajectory_width(column);
+        return (float*)(segment + header->column_offset[column]) +
+               segment_frame * stride;
+    }
+
+    void end_frame() {
+        if (!segment)
+            return;
+        header->frame_count++;
+        if (++segment_frame == header->frames_per_segment) {
+            close_segment();
+            segment_index++;
+            segment_frame = 0;
+        }
+    }
+
+    // Writes one vehicle of the current frame. hit_point_arr is what the
+    // step was given: world-space hit points, nullptr when airborne; without
+    // it every hit point is NaN.
+    void record(uint32_t vehicle,
+                Vehicle4WSimulator& simulator,
+                Vector3f* const* hit_point_arr = nullptr) {
+        if (!segment || vehicle >= header->vehicles)
+            return;
+        Vector3f origin = simulator.get_location();
+        Vector3f body = simulator.get_body_relative_location();
+        Vector3f body_vel = simulator.get_body_linear_velocity();
+        Vector3f body_force = simulator.get_body_applied_force();
+        Quaternionf body_quat = simulator.get_body_relative_quat();
+        put(TRAJECTORY_ORIGIN_X, vehicle, origin);
+        put(TRAJECTORY_BODY_X, vehicle, body);
+        put(TRAJECTORY_BODY_VX, vehicle, body_vel);
+        put(TRAJECTORY_BODY_FX, vehicle, body_force);
+        put(TRAJECTORY_BODY_QW, vehicle, body_quat);
+
+        float nan = numeric_limits<float>::quiet_NaN();
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            size_t w = vehicle * FLEET_WHEEL_COUNT + i;
+            put(TRAJECTORY_WHEEL_X, w,
+                simulator.get_wheel_relative_location(i));
+            put(TRAJECTORY_WHEEL_VX, w, simulator.get_wheel_linear_velocity(i));
+            put(TRAJECTORY_WHEEL_FX, w, simulator.get_wheel_applied_force(i));
+            put(TRAJECTORY_WHEEL_QW, w, simulator.get_wheel_relative_quat(i));
+            put(TRAJECTORY_WHEEL_HIT_X, w,
+                hit_point_arr && hit_point_arr[i]
+                    ? Vector3f(*hit_point_arr[i] - origin)
+                    : Vector3f(nan, nan, nan));
+        }
+    }
+
+    // Writes the first vehicles of fleet, by dense index, with one copy per
+    // column.
+    void record(FleetSimulator& fleet) {
+        if (!segment)
+            return;
+        size_t n = fleet.size() < header->vehicles ? fleet.size()
+                                                    : header->vehicles;
+        ParticleColumns& bodies = fleet.get_bodies();
+        ParticleColumns& wheels = fleet.get_wheels();
+        VehicleColumns& vehicles = fleet.get_vehicles();
+        WheelColumns& wheel_state = fleet.get_wheel_state();
+        const FloatColumn* source[TRAJECTORY_COLUMN_COUNT] = {
+            &vehicles.origin_x, &vehicles.origin_y, &vehicles.origin_z,
+            &bodies.x,          &bodies.y,          &bodies.z,
+            &bodies.vx,         &bodies.vy,         &bodies.vz,
+            &bodies.fx,         &bodies.fy,         &bodies.fz,
+            &bodies.qw,         &bodies.qx,         &bodies.qy,
+            &bodies.qz,         &wheels.x,          &wheels.y,
+            &wheels.z,          &wheels.vx,         &wheels.vy,
+            &wheels.vz,         &wheels.fx,         &wheels.fy,
+            &wheels.fz,         &wheels.qw,         &wheels.qx,
+            &wheels.qy,         &wheels.qz,         &wheel_state.hit_x,
+            &wheel_state.hit_y, &wheel_state.hit_z};
+        for (int c = 0; c < TRAJECTORY_WHEEL_HIT_X; c++) {
+            TrajectoryColumn col = (TrajectoryColumn)c;
+            float* dest = column(col);
+            if (dest) {
+                memcpy(dest, source[c]->data(),
+                       n * trajectory_width(col) * sizeof(float));
+            }
+        }
+
+        // hit points only mean something on grounded wheels
+        float nan = numeric_limits<float>::quiet_NaN();
+        for (int c = TRAJECTORY_WHEEL_HIT_X; c <= TRAJECTORY_WHEEL_HIT_Z; c++) {
+            float* dest = column((TrajectoryColumn)c);
+            for (size_t w = 0; dest && w < n * FLEET_WHEEL_COUNT; w++) {
+                dest[w] = wheel_state.grounded[w] ? (*source[c])[w] : nan;
+            }
+        }
+    }
+
+   private:
+    // writes value to three consecutive columns starting at first
+    void put(TrajectoryColumn first, size_t slot, const Vector3f& value) {
+        for (int k = 0; k < 3; k++) {
+            float* dest = column((TrajectoryColumn)(first + k));
+            if (dest)
+                dest[slot] = value(k);
+        }
+    }
+
+    // w, x, y, z into four consecutive columns
+    void put(TrajectoryColumn first, size_t slot, const Quaternionf& value) {
+        float coeffs[4] = {value.w(), value.x(), value.y(), value.z()};
+        for (int k = 0; k < 4; k++) {
+            float* dest = column((TrajectoryColumn)(first + k));
+            if (dest)
+                dest[slot] = coeffs[k];
+        }
+    }
+};
+
+// Read-only view of a trajectory file. The whole file is mapped once, so
+// seeking to any frame costs nothing; a file still being recorded shows
+// the frames committed when it was opened.
+class TrajectoryReader {
+    MappedFile file;
+    const char* data;
+    size_t bytes;
+    TrajectoryHeader header;
+
+    // every recorded column lies inside a segment, so column() stays in
+    // the mapping whatever the header says
+    bool columns_fit() const {
+        if (header.column_mask & ~TRAJECTORY_ALL_COLUMNS ||
+            header.segment_bytes == 0)
+            return false;
+        for (int c = 0; c < TRAJECTORY_COLUMN_COUNT; c++) {
+            TrajectoryColumn column = (TrajectoryColumn)c;
+            if (!has_column(column))
+                continue;
+            uint64_t offset = header.column_offset[c];
+            uint64_t frame_bytes = (uint64_t)header.vehicles *
+                                   trajectory_width(column) * sizeof(float);
+            if (offset % sizeof(float) || offset > header.segment_bytes ||
+                (header.segment_bytes - offset) / frame_bytes <
+                    header.frames_per_segment)
+                return false;
+        }
+        return true;
+    }
+
+   public:
+    TrajectoryReader() : data(nullptr), bytes(0) {
+        memset(&header, 0, sizeof(header));
+    }
+
+    ~TrajectoryReader() { close(); }
+
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+    // false when path is missing, not a trajectory or truncated
+    bool open(const char* path) {
+        close();
+        if (!file.open(path, false))
+            return false;
+        uint64_t size = file.size();
+        if (size < TRAJECTORY_PAGE ||
+            !(data = (const char*)file.map(0, (size_t)size))) {
+            close();
+            return false;
+        }
+        bytes = (size_t)size;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic)) ||
+            header.version != TRAJECTORY_VERSION || header.vehicles == 0 ||
+            header.frames_per_segment == 0) {
+            close();
+            return false;
+        }
+        uint64_t segments =
+            (header.frame_count + header.frames_per_segment - 1) /
+            header.frames_per_segment;
+        if (!columns_fit() ||
+            segments > (size - TRAJECTORY_PAGE) / header.segment_bytes) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        MappedFile::unmap((void*)data, bytes);
+        data = nullptr;
+        bytes = 0;
+        file.close();
+        memset(&header, 0, sizeof(header));
+    }
+
+    bool is_open() const { return data != nullptr; }
+
+    uint64_t get_frame_count() const { return header.frame_count; }
+
+    uint32_t get_vehicle_count() const { return header.vehicles; }
+
+    float get_delta_time() const { return header.delta_time; }
+
+    bool has_column(TrajectoryColumn column) const {
+        return (header.column_mask & trajectory_bit(column)) != 0;
+    }
+
+    // vehicles * width floats of column at frame, nullptr when the column
+    // was not recorded or frame is out of range
+    const float* column(TrajectoryColumn column, uint64_t frame) const {
+        if (!data || frame >= header.frame_count || !has_column(column))
+            return nullptr;
+        uint64_t segment = frame / header.frames_per_segment;
+        uint64_t segment_frame = frame % header.frames_per_segment;
+        size_t stride = header.vehicles * trajectory_width(column);
+        return (const float*)(data + TRAJECTORY_PAGE +
+                              segment * header.segment_bytes +
+                              header.column_offset[column]) +
+               segment_frame * stride;
+    }
+
+    // one value, NaN when it is not in the file
+    float get(TrajectoryColumn column, uint64_t frame, size_t slot) const {
+        const float* values = this->column(column, frame);
+        return values ? values[slot]
+                      : numeric_limits<float>::quiet_NaN();
+    }
+
+    Vector3f get_vector(TrajectoryColumn first,
+                        uint64_t frame,
+                        size_t slot) const {
+        return Vector3f(get(first, frame, slot),
+                        get((TrajectoryColumn)(first + 1), frame, slot),
+                        get((TrajectoryColumn)(first + 2), frame, slot));
+    }
+
+    Quaternionf get_quat(TrajectoryColumn first,
+                         uint64_t frame,
+                         size_t slot) const {
+        return Quaternionf(get(first, frame, slot),
+                           get((TrajectoryColumn)(first + 1), frame, slot),
+                           get((TrajectoryColumn)(first + 2), frame, slot),
+                           get((TrajectoryColumn)(first + 3), frame, slot));
+    }
+
+    // what the vehicle's components showed after frame, as
+    // get_render_state() would have returned it
+    VehicleRenderState get_render_state(uint64_t frame,
+                                        uint32_t vehicle) const {
+        VehicleRenderState state;
+        state.body_location = get_vector(TRAJECTORY_BODY_X, frame, vehicle);
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            state.wheel_location[i] = get_vector(
+                TRAJECTORY_WHEEL_X, frame, vehicle * FLEET_WHEEL_COUNT + i);
+        }
+        state.quat = get_quat(TRAJECTORY_WHEEL_QW, frame,
+                              vehicle * FLEET_WHEEL_COUNT);
+        return state;
+    }
+};
+
+#endif
@@ -1,152 +1,828 @@
 #ifndef _VEHICLE4WSIMULATOR_HPP_
 #define _VEHICLE4WSIMULATOR_HPP_
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "Arena.hpp"
 #include "Eigen/Eigen/Dense"
+#include "FixedStep.hpp"
+#include "ForcePipeline.hpp"
+#include "GroundQuery.hpp"
+#include "Instrumentation.hpp"
+#include "Integrator.hpp"
 #include "Particle.hpp"
 #include "ParticleForce.hpp"
 #include "ParticleForceRegistry.hpp"
+#include "Snapshot.hpp"
+#include "TireModel.hpp"
+#include "VehicleArchetype.hpp"
+#include "VehicleCommand.hpp"
 using namespace Eigen;
 
-class Vehicle4WSimulator {
+// wheels a VehicleSimulator<Wheels> has room for; 0 is the runtime-sized
+// simulator
+constexpr int vehicle_wheel_capacity(int wheels) {
+    return wheels ? wheels : VEHICLE_MAX_WHEELS;
+}
+
+// Registration order of the original registry. The body's spring over the
+// wheels and the wheels' springs over the body are separate groups, so both
+// loops have a constant trip count when Wheels is fixed.
+template <int Wheels>
+using BasicVehicleForcePipeline =
+    BasicForcePipeline<ArenaAllocator, Gravity, BasicSpring<Wheels>,
+                       BasicSpring<1>, Contact, Friction,
+                       BasicFrameConstraint<Wheels>>;
+
+template <int Wheels, typename G>
+constexpr size_t vehicle_group_bytes(size_t n) {
+    typedef BasicVehicleForcePipeline<Wheels> Pipeline;
+    return n * Pipeline::template registration_size<G>() +
+           Pipeline::template registration_align<G>();
+}
+
+// the particles plus the pipeline groups of one vehicle, each padded for
+// alignment
+template <int Wheels>
+constexpr size_t vehicle_arena_bytes() {
+    return (1 + vehicle_wheel_capacity(Wheels)) *
+               (sizeof(Particle) + alignof(Particle)) +
+           vehicle_group_bytes<Wheels, Gravity>(
+               1 + vehicle_wheel_capacity(Wheels)) +
+           vehicle_group_bytes<Wheels, BasicSpring<Wheels>>(1) +
+           vehicle_group_bytes<Wheels, BasicSpring<1>>(
+               vehicle_wheel_capacity(Wheels)) +
+           vehicle_group_bytes<Wheels, Contact>(
+               vehicle_wheel_capacity(Wheels)) +
+           vehicle_group_bytes<Wheels, Friction>(
+               vehicle_wheel_capacity(Wheels)) +
+           vehicle_group_bytes<Wheels, BasicFrameConstraint<Wheels>>(1);
+}
+
+// One vehicle: a body on Wheels wheels, or on the archetype's wheel count
+// when Wheels is 0. The fixed counts keep every per-wheel loop at a
+// constant trip count; the archetype of a fixed-count simulator must have
+// that many wheels.
+template <int Wheels>
+class VehicleSimulator {
+    static_assert(Wheels == 0 || (Wheels >= VEHICLE_MIN_WHEELS &&
+                                  Wheels <= VEHICLE_MAX_WHEELS),
+                  "unsupported wheel count");
+
+   public:
+    static const int CAPACITY = vehicle_wheel_capacity(Wheels);
+    typedef BasicVehicleRenderState<CAPACITY> RenderState;
+    typedef BasicVehicleSnapshot<CAPACITY> Snapshot;
+    typedef BasicContactCache<CAPACITY> ContactCache;
+
+   private:
+    typedef BasicVehicleForcePipeline<Wheels> ForcePipeline;
+
     Vector3f location;
-    Vector3f body_box_extent;
-    float wheel_radius;
+    // masses, shape and force constants, shared with the archetype's other
+    // vehicles; the springs point into it
+    shared_ptr<const VehicleArchetype> archetype;
 
+    // Particles and registrations live in arena_block, inside the object, so
+    // a vehicle is one allocation and tearing it down frees nothing else.
+    alignas(16) char arena_block[vehicle_arena_bytes<Wheels>()];
+    Arena arena;
+
+    // wheels in use when Wheels is 0
+    int wheel_count;
     Particle* body;
-    Particle* wheel[4];
-    ParticleForceRegistry* permanent_registry;
-    ParticleForceRegistry* temporary_registry;
+    Particle* wheel[CAPACITY];
+    // this step's contact of each grounded wheel, relative to location;
+    // the wheels' contact generators point here
+    Vector3f wheel_hit_point[CAPACITY];
+    ContactCache contact_cache;
+    ForcePipeline permanent_registry;
+    // scripted or temporary forces, evaluated after the permanent ones
+    ParticleForceRegistry temporary_registry;
+    Integrator integrator;
 
-    float sphere_inertia(float mass, float radius) {
-        return 2.f / 5 * mass * radius * radius;
-    }
+    // commands in time order, consumed from next_command by the steps;
+    // time is the start of the next step
+    vector<VehicleCommand> commands;
+    size_t next_command;
+    double time;
+    VehicleInput held_input;
+    // held_input averaged over the running step
+    VehicleInput step_input;
 
-   public:
-    Vehicle4WSimulator(float body_mass_,
-                       float wheel_mass_,
-                       Vector3f location_,
-                       Quaternionf quat_,
-                       Vector3f body_box_extent_,
-                       float wheel_radius_,
-                       Vector3f linear_velocity_,
-                       Vector3f angular_velocity_,
-                       Vector3f body_relative_location_,
-                       Vector3f* wheel_relative_location_arr_)
-        : location(location_),
-          body_box_extent(body_box_extent_),
-          wheel_radius(wheel_radius_) {
-        body = new Particle(body_mass_, body_relative_location_, quat_,
-                            linear_velocity_, angular_velocity_);
+    // Tire model state. Each wheel's slip speed, spin times radius minus
+    // its ground speed along the wheel, is what carries over between steps:
+    // a wheel keeps rolling with the speed the step gave the vehicle, rather
+    // than braking it by a step's change of speed. Then the spin of the
+    // last step, the ground normal under each wheel (z in the air) and
+    // whether the running step has yet to spin the wheels and yaw the
+    // vehicle.
+    float wheel_slip[CAPACITY];
+    float wheel_spin[CAPACITY];
+    Vector3f hit_normal[CAPACITY];
+    bool tire_step_pending;
+    FleetKernelLevel kernel_level;
+
+    // constant when Wheels is fixed
+    int wheels() const { return Wheels ? Wheels : wheel_count; }
 
-        for (int i = 0; i < 4; i++) {
-            wheel[i] =
-                new Particle(wheel_mass_, wheel_relative_location_arr_[i],
-                             quat_, linear_velocity_, angular_velocity_);
+    void update_inertia() {
+        body->set_inertia(archetype->body_inertia);
+        float inertia_1d = archetype->wheel_inertia;
+        for (int i = 0; i < wheels(); i++) {
+            wheel[i]->set_inertia(Vector3f(inertia_1d, inertia_1d, inertia_1d));
         }
+    }
+
+    // 0 is the body, 1..wheels() the wheels
+    Particle* particle(int k) { return k ? wheel[k - 1] : body; }
 
-        permanent_registry = new ParticleForceRegistry();
-        temporary_registry = new ParticleForceRegistry();
+    // (re)builds the permanent forces from the archetype; the groups keep
+    // their reserved storage, so this never allocates. The tire model's
+    // stage replaces the springs and friction.
+    void register_forces() {
+        permanent_registry.clear();
+        const VehicleArchetype& a = *archetype;
+        float gravity_acc = a.desc.gravity_acc;
+        float spring_constant = a.desc.spring_constant;
 
-        // // gravity
-        float gravity_acc = 10.f;
+        // gravity
         Vector3f gravity_acc_vec = -gravity_acc * normalized_Z;
-        Gravity* fg_gravity_body = new Gravity(gravity_acc_vec);
-        permanent_registry->add(body, fg_gravity_body);
-        for (int i = 0; i < 4; i++) {
-            Gravity* fg_gravity_wheel = new Gravity(gravity_acc_vec);
-            permanent_registry->add(wheel[i], fg_gravity_wheel);
+        permanent_registry.template emplace<Gravity>(body, gravity_acc_vec);
+        for (int i = 0; i < wheels(); i++) {
+            permanent_registry.template emplace<Gravity>(wheel[i],
+                                                         gravity_acc_vec);
         }
 
         // spring
-        float spring_constant = 100.f;
-        float* normal_length_body = new float[4]();
-        float* normal_length_wheel = new float[4]();
-        for (int i = 0; i < 4; i++) {
-            normal_length_body[i] =
-                (body_relative_location_(2) -
-                 (wheel_relative_location_arr_[i](2))) +
-                ((body_mass_ / 4 * gravity_acc) / spring_constant);
-            normal_length_wheel[i] = -normal_length_body[i];
+        if (!a.desc.tire_model) {
+            permanent_registry.template emplace<BasicSpring<Wheels>>(
+                body, wheel, wheels(), spring_constant,
+                a.normal_length_body);
         }
-
-        Spring* fg_spring_body =
-            new Spring(wheel, 4, spring_constant, normal_length_body);
-        permanent_registry->add(body, fg_spring_body);
-
-        for (int i = 0; i < 4; i++) {
-            Spring* fg_spring_wheel =
-                new Spring(&body, 1, spring_constant, normal_length_wheel + i);
-            permanent_registry->add(wheel[i], fg_spring_wheel);
+        for (int i = 0; !a.desc.tire_model && i < wheels(); i++) {
+            permanent_registry.template emplace<BasicSpring<1>>(
+                wheel[i], &body, 1, spring_constant,
+                a.normal_length_wheel + i);
         }
 
         // contact
-        float balance = (body_mass_ + 4 * wheel_mass_) * gravity_acc / 4;
-        float loss_coeff = 0.2f;
-        for (int i = 0; i < 4; i++) {
-            Contact* fg_contact = new Contact(balance, loss_coeff);
-            permanent_registry->add(wheel[i], fg_contact);
+        for (int i = 0; i < wheels(); i++) {
+            permanent_registry.template emplace<Contact>(wheel[i], a.balance,
+                                                         a.desc.loss_coeff);
         }
 
         // friction
-        float damping = 1.f;
-        for (int i = 0; i < 4; i++) {
-            Friction* fg_friction = new Friction(damping, gravity_acc);
-            permanent_registry->add(wheel[i], fg_friction);
+        for (int i = 0; !a.desc.tire_model && i < wheels(); i++) {
+            permanent_registry.template emplace<Friction>(
+                wheel[i], a.desc.damping, gravity_acc);
         }
 
         // constraint
-        FrameConstraint* fg_frameconstraint = new FrameConstraint(wheel, 4);
-        permanent_registry->add(body, fg_frameconstraint);
+        permanent_registry.template emplace<BasicFrameConstraint<Wheels>>(
+            body, wheel, wheels());
+    }
+
+    // clears the accumulators and evaluates every force at the current state
+    void evaluate_forces(float delta_time) {
+        INSTRUMENT_SCOPE(INSTRUMENT_FORCES);
+        for (int k = 0; k < 1 + wheels(); k++) {
+            particle(k)->clear_force();
+        }
+        permanent_registry.update_forces(delta_time);
+        update_temporary_forces(delta_time);
+        update_input_forces(delta_time);
+    }
+
+    void update_temporary_forces(float delta_time) {
+        INSTRUMENT_SCOPE_DETAIL(INSTRUMENT_TEMPORARY_FORCES);
+        temporary_registry.update_forces(delta_time);
+    }
+
+    // Consumes the commands due in this step and queues its steering torque;
+    // with the tire model, the steer angle turns the vehicle instead.
+    void begin_input(float delta_time) {
+        step_input =
+            consume_commands(commands.data(), &next_command, commands.size(),
+                             time, time + delta_time, &held_input);
+        time += delta_time;
+        if (next_command == commands.size()) {
+            commands.clear();
+            next_command = 0;
+        }
+        tire_step_pending = true;
+        if (step_input.steer != 0.f && !archetype->desc.tire_model) {
+            Vector3f torque(0.f, 0.f, step_input.steer * VEHICLE_STEER_TORQUE);
+            for (int i = 0; i < wheels(); i++) {
+                wheel[i]->update_torque(torque);
+            }
+        }
+    }
+
+    // throttle and brake, after the generators that set velocities
+    void update_input_forces(float delta_time) {
+        if (archetype->desc.tire_model) {
+            update_tire_forces(delta_time);
+            return;
+        }
+        if (step_input.throttle == 0.f && step_input.brake == 0.f)
+            return;
+        for (int k = 0; k < 1 + wheels(); k++) {
+            Particle* p = particle(k);
+            Vector3f vel = p->get_linear_velocity();
+            float mass = p->get_mass();
+            p->update_force(Vector3f(
+                mass * input_acceleration(step_input, vel(0), delta_time),
+                mass * input_acceleration(step_input, vel(1), delta_time),
+                0.f));
+        }
+    }
+
+    // The tire model's stage (see TireModel.hpp). The suspension acts
+    // between body and wheel in z; what the hit normal tilts sideways is the
+    // ground pushing the vehicle, and goes with the tire forces. Those are
+    // summed into one force spread over the particles by mass, which keeps
+    // the wheels' layout in the ground plane, and a yaw torque about the
+    // body, both set in the vehicle's heading. Spin and yaw are taken from
+    // the first evaluation of a step.
+    void update_tire_forces(float delta_time) {
+        INSTRUMENT_SCOPE_DETAIL(INSTRUMENT_TIRES);
+        const VehicleArchetype& a = *archetype;
+        const VehicleArchetypeDesc& d = a.desc;
+        float compression[CAPACITY], compression_rate[CAPACITY],
+            grounded[CAPACITY], vx[CAPACITY], vy[CAPACITY], hx[CAPACITY],
+            hy[CAPACITY], drive_torque[CAPACITY], lever_x[CAPACITY],
+            lever_y[CAPACITY], v_long[CAPACITY], spin[CAPACITY],
+            suspension[CAPACITY], fx[CAPACITY], fy[CAPACITY],
+            next_spin[CAPACITY];
+
+        Vector3f forward = wheel[0]->get_quat() * normalized_X;
+        float heading = atan2(forward(1), forward(0));
+        float steered = heading + step_input.steer * d.max_steer_angle;
+        float cos_h = cos(heading), sin_h = sin(heading);
+        float cos_s = cos(steered), sin_s = sin(steered);
+        float yaw_rate = wheel[0]->get_angular_velocity()(2);
+        Vector3f body_vel = body->get_linear_velocity();
+        float body_z = body->get_location()(2);
+        float torque = step_input.throttle * d.engine_torque;
+        for (int i = 0; i < wheels(); i++) {
+            compression[i] = a.normal_length_body[i] -
+                             (body_z - wheel[i]->get_location()(2));
+            compression_rate[i] =
+                wheel[i]->get_linear_velocity()(2) - body_vel(2);
+            grounded[i] = wheel[i]->get_hit_point() ? 1.f : 0.f;
+            float x = a.wheel_lever_x[i], y = a.wheel_lever_y[i];
+            lever_x[i] = cos_h * x - sin_h * y;
+            lever_y[i] = sin_h * x + cos_h * y;
+            vx[i] = body_vel(0) - yaw_rate * lever_y[i];
+            vy[i] = body_vel(1) + yaw_rate * lever_x[i];
+            float steer = a.wheel_steer[i];
+            hx[i] = steer * cos_s + (1.f - steer) * cos_h;
+            hy[i] = steer * sin_s + (1.f - steer) * sin_h;
+            drive_torque[i] = torque * a.wheel_drive_share[i];
+            v_long[i] = vx[i] * hx[i] + vy[i] * hy[i];
+            spin[i] = (wheel_slip[i] + v_long[i]) / d.wheel_radius;
+        }
+
+        TireKernelArgs args = {
+            compression, compression_rate, grounded, vx, vy, hx, hy,
+            drive_torque, spin, suspension, fx, fy, next_spin,
+            d.spring_constant, d.suspension_damping,
+            d.wheel_mass * d.gravity_acc, d.wheel_radius, a.wheel_inertia,
+            step_input.brake * d.brake_torque, d.tire_stiffness, d.tire_shape,
+            d.tire_grip,
+            tire_min_speed(d.gravity_acc, d.tire_grip, d.tire_stiffness,
+                           d.tire_shape, delta_time)};
+        tire_forces(kernel_level, args, 0, wheels(), delta_time);
+
+        float push_x = 0.f, push_y = 0.f, yaw_torque = 0.f;
+        for (int i = 0; i < wheels(); i++) {
+            Vector3f force = suspension[i] * hit_normal[i];
+            body->update_force(Vector3f(0.f, 0.f, force(2)));
+            wheel[i]->update_force(Vector3f(0.f, 0.f, -force(2)));
+            float tire_x = fx[i] + force(0), tire_y = fy[i] + force(1);
+            push_x += tire_x;
+            push_y += tire_y;
+            yaw_torque += lever_x[i] * tire_y - lever_y[i] * tire_x;
+        }
+        float mass = d.body_mass + wheels() * d.wheel_mass;
+        for (int k = 0; k < 1 + wheels(); k++) {
+            float share = particle(k)->get_mass() / mass;
+            particle(k)->update_force(
+                Vector3f(share * push_x, share * push_y, 0.f));
+        }
+
+        if (!tire_step_pending)
+            return;
+        tire_step_pending = false;
+        for (int i = 0; i < wheels(); i++) {
+            wheel_spin[i] = next_spin[i];
+            wheel_slip[i] = next_spin[i] * d.wheel_radius - v_long[i];
+        }
+        float yaw_acc = yaw_torque / a.yaw_inertia;
+        body->update_torque(Vector3f(0.f, 0.f, yaw_acc * a.body_inertia(2)));
+        for (int i = 0; i < wheels(); i++) {
+            wheel[i]->update_torque(
+                Vector3f(0.f, 0.f, yaw_acc * a.wheel_inertia));
+        }
+    }
+
+    // Forces are re-evaluated at the start of the step rather than reused
+    // from the end of the last one, which saw the previous contact state.
+    void step_verlet(float delta_time) {
+        float h = delta_time;
+        evaluate_forces(h);
+        for (int k = 0; k < 1 + wheels(); k++) {
+            Particle* p = particle(k);
+            Vector3f vel = p->get_linear_velocity() +
+                           0.5f * h * p->get_force() / p->get_mass();
+            p->set_linear_velocity(vel);
+            p->set_location(p->get_location() + h * vel);
+        }
+
+        evaluate_forces(h);
+        for (int k = 0; k < 1 + wheels(); k++) {
+            Particle* p = particle(k);
+            p->set_linear_velocity(p->get_linear_velocity() +
+                                   0.5f * h * p->get_force() / p->get_mass());
+            p->apply_torque(h, integrator);
+            p->retire_force();
+        }
+    }
+
+    // Generators that set velocities (friction, frame constraint) act at
+    // every stage; the velocity they leave behind is the stage's dx/dt.
+    void step_rk4(float delta_time) {
+        static const float offset[4] = {0.f, 0.5f, 0.5f, 1.f};
+        static const float weight[4] = {1.f, 2.f, 2.f, 1.f};
+        float h = delta_time;
+        Vector3f x0[1 + CAPACITY], v0[1 + CAPACITY], kx[1 + CAPACITY],
+            kv[1 + CAPACITY], dx[1 + CAPACITY], dv[1 + CAPACITY];
+        for (int k = 0; k < 1 + wheels(); k++) {
+            x0[k] = particle(k)->get_location();
+            v0[k] = particle(k)->get_linear_velocity();
+            dx[k].setZero();
+            dv[k].setZero();
+        }
+
+        for (int stage = 0; stage < 4; stage++) {
+            for (int k = 0; stage > 0 && k < 1 + wheels(); k++) {
+                particle(k)->set_location(x0[k] + offset[stage] * h * kx[k]);
+                particle(k)->set_linear_velocity(v0[k] +
+                                                 offset[stage] * h * kv[k]);
+            }
+            evaluate_forces(h);
+            for (int k = 0; k < 1 + wheels(); k++) {
+                Particle* p = particle(k);
+                kx[k] = p->get_linear_velocity();
+                kv[k] = p->get_force() / p->get_mass();
+                dx[k] += weight[stage] * kx[k];
+                dv[k] += weight[stage] * kv[k];
+                if (stage == 0)
+                    v0[k] = kx[k];
+            }
+        }
+
+        for (int k = 0; k < 1 + wheels(); k++) {
+            particle(k)->set_location(x0[k] + h / 6 * dx[k]);
+            particle(k)->set_linear_velocity(v0[k] + h / 6 * dv[k]);
+            particle(k)->apply_torque(h, integrator);
+            particle(k)->retire_force();
+        }
+    }
+
+    // Backward Euler on the suspension: (M + h^2 K) v' = M v + h F along z,
+    // K being the body-wheel spring stiffness. The system is an arrowhead
+    // (body row and column plus a diagonal), solved by eliminating the
+    // wheels. x and y integrate as symplectic Euler.
+    void step_implicit_spring(float delta_time) {
+        float h = delta_time;
+        evaluate_forces(h);
+
+        float c = h * h * archetype->desc.spring_constant;
+        float mass[1 + CAPACITY], rhs[1 + CAPACITY], vel_z[1 + CAPACITY];
+        for (int k = 0; k < 1 + wheels(); k++) {
+            mass[k] = particle(k)->get_mass();
+            rhs[k] = mass[k] * particle(k)->get_linear_velocity()(2) +
+                     h * particle(k)->get_force()(2);
+        }
+        float body_lhs = mass[0] + wheels() * c, body_rhs = rhs[0];
+        for (int k = 1; k < 1 + wheels(); k++) {
+            body_lhs -= c * c / (mass[k] + c);
+            body_rhs += c * rhs[k] / (mass[k] + c);
+        }
+        vel_z[0] = body_rhs / body_lhs;
+        for (int k = 1; k < 1 + wheels(); k++) {
+            vel_z[k] = (rhs[k] + c * vel_z[0]) / (mass[k] + c);
+        }
+
+        for (int k = 0; k < 1 + wheels(); k++) {
+            Particle* p = particle(k);
+            Vector3f vel =
+                p->get_linear_velocity() + h * p->get_force() / mass[k];
+            vel(2) = vel_z[k];
+            p->set_linear_velocity(vel);
+            p->set_location(p->get_location() + h * vel);
+            p->apply_torque(h, integrator);
+            p->retire_force();
+        }
+    }
+
+   public:
+    // the archetype's locations are relative to location_; throws
+    // invalid_argument when a fixed-count simulator gets an archetype with
+    // another wheel count
+    VehicleSimulator(shared_ptr<const VehicleArchetype> archetype_,
+                     Vector3f location_,
+                     Quaternionf quat_,
+                     Vector3f linear_velocity_,
+                     Vector3f angular_velocity_)
+        : location(location_),
+          archetype(archetype_),
+          arena(arena_block, sizeof(arena_block)),
+          wheel_count(archetype_->desc.wheel_count),
+          permanent_registry(ArenaAllocator<char>(&arena)),
+          integrator(INTEGRATOR_SYMPLECTIC_EULER),
+          next_command(0),
+          time(0.),
+          tire_step_pending(false),
+          kernel_level(detect_fleet_kernel_level()) {
+        const VehicleArchetypeDesc& desc = archetype->desc;
+        if (Wheels && desc.wheel_count != Wheels)
+            throw std::invalid_argument("archetype has the wrong wheel count");
+        held_input = step_input = VehicleInput();
+        // rolling at the initial speed
+        float rolling = (quat_ * normalized_X).dot(linear_velocity_) /
+                        desc.wheel_radius;
+        for (int i = 0; i < CAPACITY; i++) {
+            wheel_slip[i] = 0.f;
+            wheel_spin[i] = rolling;
+            hit_normal[i] = normalized_Z;
+        }
+        body = arena.create<Particle>(desc.body_mass,
+                                      desc.body_relative_location, quat_,
+                                      linear_velocity_, angular_velocity_);
+
+        for (int i = 0; i < wheels(); i++) {
+            wheel[i] = arena.create<Particle>(
+                desc.wheel_mass, desc.wheel_relative_location[i], quat_,
+                linear_velocity_, angular_velocity_);
+        }
+        for (int i = wheels(); i < CAPACITY; i++) {
+            wheel[i] = nullptr;
+        }
+
+        permanent_registry.template reserve<Gravity>(1 + wheels());
+        permanent_registry.template reserve<BasicSpring<Wheels>>(1);
+        permanent_registry.template reserve<BasicSpring<1>>(wheels());
+        permanent_registry.template reserve<Contact>(wheels());
+        permanent_registry.template reserve<Friction>(wheels());
+        permanent_registry.template reserve<BasicFrameConstraint<Wheels>>(1);
+
+        update_inertia();
+        register_forces();
+    }
+
+    // An archetype with the default force constants, shared with the
+    // vehicles built from the same parameters on this thread.
+    // wheel_relative_location_arr_ holds Wheels wheels, four for the
+    // runtime-sized simulator.
+    VehicleSimulator(float body_mass_,
+                     float wheel_mass_,
+                     Vector3f location_,
+                     Quaternionf quat_,
+                     Vector3f body_box_extent_,
+                     float wheel_radius_,
+                     Vector3f linear_velocity_,
+                     Vector3f angular_velocity_,
+                     Vector3f body_relative_location_,
+                     Vector3f* wheel_relative_location_arr_)
+        : VehicleSimulator(
+              shared_vehicle_archetype(vehicle_archetype_desc(
+                  body_mass_, wheel_mass_, body_box_extent_, wheel_radius_,
+                  body_relative_location_, wheel_relative_location_arr_,
+                  Wheels ? Wheels : 4)),
+              location_, quat_, linear_velocity_, angular_velocity_) {}
+
+    // generators point into the object
+    VehicleSimulator(const VehicleSimulator&) = delete;
+    VehicleSimulator& operator=(const VehicleSimulator&) = delete;
+
+    // Rebinds the vehicle to another archetype, e.g. a reloaded one. Masses,
+    // shape and force constants follow it; positions and velocities stay.
+    // Archetypes with another wheel count are ignored. Call between steps.
+    void set_archetype(shared_ptr<const VehicleArchetype> archetype_) {
+        if (!archetype_ || archetype_ == archetype ||
+            archetype_->desc.wheel_count != wheels())
+            return;
+        archetype = archetype_;
+        body->set_mass(archetype->desc.body_mass);
+        for (int i = 0; i < wheels(); i++) {
+            wheel[i]->set_mass(archetype->desc.wheel_mass);
+        }
+        update_inertia();
+        register_forces();
+        // the wheel radius may have changed
+        contact_cache.clear();
+    }
+
+    const shared_ptr<const VehicleArchetype>& get_archetype() const {
+        return archetype;
+    }
+
+    void set_integrator(Integrator integrator_) { integrator = integrator_; }
+
+    // Lets apply(ground) take wheel contacts from the contact cache: a
+    // wheel is swept again once it moved tolerance from its last sweep, in
+    // x and y, or max_age seconds after it. tolerance 0 sweeps every step.
+    // Snapshots hold the cached contacts, so steps re-simulated from one
+    // reuse what the first run did; the settings here stay as they are.
+    void set_contact_cache(float tolerance, float max_age) {
+        contact_cache.configure(tolerance, max_age);
+    }
+
+    // for callers sweeping the wheels themselves; clear it when the
+    // vehicle is moved
+    ContactCache& get_contact_cache() { return contact_cache; }
+
+    // of the tire model's stage; defaults to the widest instruction set the
+    // CPU supports
+    void set_kernel_level(FleetKernelLevel level) { kernel_level = level; }
+
+    FleetKernelLevel get_kernel_level() { return kernel_level; }
+
+    Integrator get_integrator() { return integrator; }
+
+    // heap chunks taken beyond the inline arena, 0 unless it was undersized
+    size_t get_arena_overflow_count() const {
+        return arena.get_overflow_count();
+    }
+
+    int get_wheel_count() const { return wheels(); }
+
+    static constexpr size_t snapshot_size() { return sizeof(Snapshot); }
+
+    // writes snapshot_size() bytes of state into buffer
+    void save_snapshot(void* buffer) const {
+        Snapshot* snapshot = static_cast<Snapshot*>(buffer);
+        snapshot->magic = VEHICLE_SNAPSHOT_MAGIC;
+        snapshot->version = VEHICLE_SNAPSHOT_VERSION;
+        snapshot->capacity = CAPACITY;
+        snapshot->size = sizeof(Snapshot);
+        memcpy(snapshot->location, location.data(), sizeof(snapshot->location));
+        const VehicleArchetype& a = *archetype;
+        memcpy(snapshot->body_box_extent, a.desc.body_box_extent.data(),
+               sizeof(snapshot->body_box_extent));
+        snapshot->wheel_radius = a.desc.wheel_radius;
+        snapshot->integrator = integrator;
+        snapshot->wheel_count = wheels();
+        snapshot->time = time;
+        snapshot->throttle = held_input.throttle;
+        snapshot->brake = held_input.brake;
+        snapshot->steer = held_input.steer;
+
+        snapshot->gravity_acc = a.desc.gravity_acc;
+        snapshot->spring_constant = a.desc.spring_constant;
+        snapshot->balance = a.balance;
+        snapshot->loss_coeff = a.desc.loss_coeff;
+        snapshot->damping = a.desc.damping;
+        memcpy(snapshot->normal_length_body, a.normal_length_body,
+               sizeof(snapshot->normal_length_body));
+        memcpy(snapshot->normal_length_wheel, a.normal_length_wheel,
+               sizeof(snapshot->normal_length_wheel));
+        memset(snapshot->wheel_slip, 0, sizeof(snapshot->wheel_slip));
+        memcpy(snapshot->wheel_slip, wheel_slip, wheels() * sizeof(float));
+        memset(snapshot->contact, 0, sizeof(snapshot->contact));
+        for (int i = 0; i < wheels(); i++) {
+            contact_cache.save(i, &snapshot->contact[i]);
+        }
+
+        body->save(&snapshot->particle[0]);
+        for (int i = 0; i < wheels(); i++) {
+            wheel[i]->save(&snapshot->particle[i + 1]);
+        }
+    }
+
+    // Puts the vehicle back in the state save_snapshot wrote, which may come
+    // from another vehicle of the same archetype. Copies only, so rollback
+    // can restore every tick without allocating. Queued commands are
+    // dropped: submit the inputs of the frames to re-simulate again.
+    // Returns false, changing nothing, when buffer does not hold a snapshot
+    // of this version, wheel count and capacity (one from a simulator of
+    // another Wheels has another layout), or when its masses, shape or force
+    // constants differ from the archetype's, e.g. one taken before a hot
+    // reload: set_archetype() the block it was taken with first.
+    bool restore_snapshot(const void* buffer) {
+        const Snapshot* snapshot = static_cast<const Snapshot*>(buffer);
+        if (snapshot->magic != VEHICLE_SNAPSHOT_MAGIC ||
+            snapshot->version != VEHICLE_SNAPSHOT_VERSION ||
+            snapshot->capacity != CAPACITY ||
+            snapshot->size != sizeof(Snapshot) ||
+            snapshot->wheel_count != wheels())
+            return false;
+
+        const VehicleArchetype& a = *archetype;
+        bool other_archetype =
+            a.desc.wheel_radius != snapshot->wheel_radius ||
+            memcmp(a.desc.body_box_extent.data(), snapshot->body_box_extent,
+                   sizeof(snapshot->body_box_extent)) ||
+            a.desc.body_mass != snapshot->particle[0].mass ||
+            a.desc.gravity_acc != snapshot->gravity_acc ||
+            a.desc.spring_constant != snapshot->spring_constant ||
+            a.balance != snapshot->balance ||
+            a.desc.loss_coeff != snapshot->loss_coeff ||
+            a.desc.damping != snapshot->damping ||
+            memcmp(a.normal_length_body, snapshot->normal_length_body,
+                   wheels() * sizeof(float)) ||
+            memcmp(a.normal_length_wheel, snapshot->normal_length_wheel,
+                   wheels() * sizeof(float));
+        for (int i = 0; i < wheels(); i++) {
+            other_archetype =
+                other_archetype ||
+                a.desc.wheel_mass != snapshot->particle[i + 1].mass;
+        }
+        if (other_archetype)
+            return false;
+
+        memcpy(location.data(), snapshot->location, sizeof(snapshot->location));
+        integrator = (Integrator)snapshot->integrator;
+        time = snapshot->time;
+        held_input.throttle = snapshot->throttle;
+        held_input.brake = snapshot->brake;
+        held_input.steer = snapshot->steer;
+        memcpy(wheel_slip, snapshot->wheel_slip, wheels() * sizeof(float));
+        clear_commands();
+        contact_cache.clear();
+        for (int i = 0; i < wheels(); i++) {
+            contact_cache.restore(i, snapshot->contact[i]);
+        }
+
+        body->restore(snapshot->particle[0]);
+        for (int i = 0; i < wheels(); i++) {
+            wheel[i]->restore(snapshot->particle[i + 1]);
+        }
+        return true;
     }
 
     void apply(Vector3f** hit_point_arr, float delta_time) {
+        apply(hit_point_arr, nullptr, delta_time);
+    }
+
+    // hit_normal_arr, when given, holds the ground normal at each hit
+    // point; the tire model's suspension pushes along it, and along z
+    // without it
+    void apply(Vector3f** hit_point_arr,
+               const Vector3f* hit_normal_arr,
+               float delta_time) {
+        INSTRUMENT_SCOPE(INSTRUMENT_STEP);
+        INSTRUMENT_COUNT(INSTRUMENT_VEHICLE_STEPS, 1);
         // pre-set
-        for (int i = 0; i < 4; i++) {
+        for (int i = 0; i < wheels(); i++) {
+            // the contact normal points at the wheel's center, down when
+            // the center has sunk below the surface
+            hit_normal[i] = hit_point_arr[i] && hit_normal_arr
+                                ? hit_normal_arr[i]
+                                : normalized_Z;
+            if (hit_normal[i](2) < 0.f)
+                hit_normal[i] = -hit_normal[i];
             if (!hit_point_arr[i]) {
                 wheel[i]->update_hit_point(nullptr);
             } else {
-                Vector3f hit_point = *(hit_point_arr[i]) - location;
-                wheel[i]->update_hit_point(&hit_point);
+                wheel_hit_point[i] = *(hit_point_arr[i]) - location;
+                wheel[i]->update_hit_point(&wheel_hit_point[i]);
             }
         }
+        begin_input(delta_time);
+
+        switch (integrator) {
+            case INTEGRATOR_VERLET:
+                step_verlet(delta_time);
+                return;
+            case INTEGRATOR_RK4:
+                step_rk4(delta_time);
+                return;
+            case INTEGRATOR_IMPLICIT_SPRING:
+                step_implicit_spring(delta_time);
+                return;
+            default:
+                break;
+        }
 
         // update
-        permanent_registry->update_forces(delta_time);
+        {
+            INSTRUMENT_SCOPE(INSTRUMENT_FORCES);
+            permanent_registry.update_forces(delta_time);
+            update_temporary_forces(delta_time);
+            update_input_forces(delta_time);
+        }
 
         // apply
+        INSTRUMENT_SCOPE(INSTRUMENT_INTEGRATE);
         body->apply_force(delta_time);
-        for (int i = 0; i < 4; i++) {
+        for (int i = 0; i < wheels(); i++) {
             wheel[i]->apply_force(delta_time);
         }
     }
 
+    // sweeps the wheels against ground itself, for runs without UE
+    void apply(const GroundQuery& ground, float delta_time) {
+        Vector3f centers[CAPACITY];
+        float radii[CAPACITY];
+        GroundHit hits[CAPACITY];
+        uint8_t hit_flags[CAPACITY];
+        for (int i = 0; i < wheels(); i++) {
+            centers[i] = get_wheel_location(i);
+            radii[i] = archetype->desc.wheel_radius;
+        }
+        {
+            INSTRUMENT_SCOPE(INSTRUMENT_SWEEP);
+            int sweeps = wheels();
+            if (contact_cache.enabled()) {
+                sweeps = contact_cache.sweep_spheres(
+                    ground, centers, radii, wheels(), GROUND_SWEEP_DISTANCE,
+                    delta_time, hits, hit_flags);
+            } else {
+                ground.sweep_spheres(centers, radii, wheels(),
+                                     GROUND_SWEEP_DISTANCE, hits, hit_flags);
+            }
+            int hit_count = 0;
+            for (int i = 0; i < wheels(); i++) {
+                hit_count += hit_flags[i];
+            }
+            INSTRUMENT_COUNT(INSTRUMENT_WHEEL_SWEEPS, sweeps);
+            INSTRUMENT_COUNT(INSTRUMENT_WHEEL_HITS, hit_count);
+            INSTRUMENT_COUNT(INSTRUMENT_CACHED_CONTACTS, wheels() - sweeps);
+            // only the counters read these
+            (void)sweeps;
+            (void)hit_count;
+        }
+
+        Vector3f* hit_point_arr[CAPACITY];
+        Vector3f hit_normal_arr[CAPACITY];
+        for (int i = 0; i < wheels(); i++) {
+            hit_point_arr[i] = hit_flags[i] ? &hits[i].point : nullptr;
+            hit_normal_arr[i] = hit_flags[i] ? hits[i].normal : normalized_Z;
+        }
+        apply(hit_point_arr, hit_normal_arr, delta_time);
+    }
+
+    // i < 0 selects the body, 0..get_wheel_count() - 1 a wheel
+    void add_temporary_force(int i, ForceGenerator* fg) {
+        temporary_registry.add(i < 0 ? body : wheel[i], fg);
+    }
+
+    void remove_temporary_force(int i, ForceGenerator* fg) {
+        temporary_registry.remove(i < 0 ? body : wheel[i], fg);
+    }
+
+    void clear_temporary_forces() { temporary_registry.clear(); }
+
+    // Queues command for the step whose span holds its time; commands may
+    // arrive out of order. Steps apply them as time-weighted axis values.
+    void submit(const VehicleCommand& command) {
+        vector<VehicleCommand>::iterator it = upper_bound(
+            commands.begin() + next_command, commands.end(), command.time,
+            [](double t, const VehicleCommand& c) { return t < c.time; });
+        commands.insert(it, command);
+    }
+
+    void clear_commands() {
+        commands.clear();
+        next_command = 0;
+    }
+
+    // start of the next step on the clock command times refer to
+    double get_time() { return time; }
+
+    void set_time(double time_) { time = time_; }
+
+    // input held after the last step
+    VehicleInput get_input() { return held_input; }
+
     void move(bool forward) {
         body->move(forward);
-        for (int i = 0; i < 4; i++) {
+        for (int i = 0; i < wheels(); i++) {
             wheel[i]->move(forward);
         }
     }
 
+    // queues the steering torque on the wheels; the next step integrates it
     void turn(bool left) {
         float turn_radius = 10.f;
         float force = 1000.f;
-        bool direction = true;
-        for (int i = 0; i < 4; i++) {
-            Matrix3f inertia;
-            float mass = wheel[i]->get_mass();
-            float inertia_1d = sphere_inertia(mass, wheel_radius);
-            cout << "inertia_1d: " << inertia_1d << endl;
-            inertia << inertia_1d, 0, 0, 0, inertia_1d, 0, 0, 0, inertia_1d;
-            Vector3f torque;
-            torque.setZero();
-            torque(2) = force * turn_radius;
-            wheel[i]->turn(left, torque, 0.02f, inertia);
+        for (int i = 0; i < wheels(); i++) {
+            wheel[i]->update_torque(Vector3f(0.f, 0.f, force * turn_radius));
         }
     }
 
     Vector3f get_location() { return location; }
 
-    Vector3f get_body_box_extent() { return body_box_extent; }
+    Vector3f get_body_box_extent() { return archetype->desc.body_box_extent; }
 
     Vector3f get_body_relative_location() { return body->get_location(); }
 
@@ -154,6 +830,11 @@ class Vehicle4WSimulator {
 
     Quaternionf get_body_relative_quat() { return body->get_quat(); }
 
+    Vector3f get_body_linear_velocity() { return body->get_linear_velocity(); }
+
+    // force integrated by the last step
+    Vector3f get_body_applied_force() { return body->get_applied_force(); }
+
     Vector3f get_wheel_relative_location(int i) {
         return wheel[i]->get_location();
     }
@@ -168,7 +849,37 @@ class Vehicle4WSimulator {
         return wheel[i]->get_linear_velocity();
     }
 
-    float get_wheel_radius() { return wheel_radius; }
+    Vector3f get_wheel_applied_force(int i) {
+        return wheel[i]->get_applied_force();
+    }
+
+    float get_wheel_radius() { return archetype->desc.wheel_radius; }
+
+    // about the axle, in radians per second, as of the last step; only the
+    // tire model spins the wheels
+    float get_wheel_spin(int i) { return wheel_spin[i]; }
+
+    // wheels past get_wheel_count() are left at zero
+    RenderState get_render_state() {
+        RenderState state;
+        state.body_location = body->get_location();
+        for (int i = 0; i < wheels(); i++) {
+            state.wheel_location[i] = wheel[i]->get_location();
+        }
+        for (int i = wheels(); i < CAPACITY; i++) {
+            state.wheel_location[i].setZero();
+        }
+        state.quat = wheel[0]->get_quat();
+        return state;
+    }
 };
 
+template <int Wheels>
+const int VehicleSimulator<Wheels>::CAPACITY;
+
+typedef VehicleSimulator<4> Vehicle4WSimulator;
+typedef VehicleSimulator<6> Vehicle6WSimulator;
+// any wheel count up to VEHICLE_MAX_WHEELS, chosen by the archetype
+typedef VehicleSimulator<0> VehicleNWSimulator;
+
 #endif
@@ -0,0 +1,554 @@
+#ifndef _VEHICLE_ARCHETYPE_HPP_
+#define _VEHICLE_ARCHETYPE_HPP_
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Eigen/Eigen/Dense"
+using namespace std;
+using namespace Eigen;
+
+#define VEHICLE_ARCHETYPE_ALIGNMENT 64
+// wheels of the largest vehicle, e.g. the trailer of an 18-wheeler with
+// its own axles
+#define VEHICLE_MAX_WHEELS 18
+#define VEHICLE_MIN_WHEELS 2
+
+// What a vehicle type is made of, as archetype files and data assets hold
+// it. Defaults are the values the simulators always hardcoded. Locations
+// are relative to the vehicle origin; only the first wheel_count wheels
+// exist.
+struct VehicleArchetypeDesc {
+    float body_mass;
+    float wheel_mass;
+    float wheel_radius;
+    Vector3f body_box_extent;
+    Vector3f body_relative_location;
+    int wheel_count;
+    Vector3f wheel_relative_location[VEHICLE_MAX_WHEELS];
+
+    // force generator parameters
+    float gravity_acc;
+    float spring_constant;
+    float loss_coeff;
+    float damping;
+
+    // Suspension and tires (see TireModel.hpp) in place of the z springs,
+    // Coulomb friction and scripted acceleration above. Wheels ahead of the
+    // body steer; those behind it share the engine torque, or all of them
+    // when none is. Torques are force times length, angles in radians.
+    bool tire_model;
+    float suspension_damping;
+    float engine_torque;
+    float brake_torque;
+    float max_steer_angle;
+    // Pacejka B, C and D
+    float tire_stiffness;
+    float tire_shape;
+    float tire_grip;
+
+    VehicleArchetypeDesc()
+        : body_mass(100.f),
+          wheel_mass(20.f),
+          wheel_radius(20.f),
+          body_box_extent(150.f, 150.f, 50.f),
+          body_relative_location(Vector3f::Zero()),
+          wheel_count(4),
+          gravity_acc(10.f),
+          spring_constant(100.f),
+          loss_coeff(0.2f),
+          damping(1.f),
+          tire_model(false),
+          suspension_damping(30.f),
+          engine_torque(20000.f),
+          brake_torque(40000.f),
+          max_steer_angle(0.5f),
+          tire_stiffness(10.f),
+          tire_shape(1.5f),
+          tire_grip(1.f) {
+        wheel_relative_location[0] = Vector3f(100.f, 100.f, -50.f);
+        wheel_relative_location[1] = Vector3f(100.f, -100.f, -50.f);
+        wheel_relative_location[2] = Vector3f(-100.f, 100.f, -50.f);
+        wheel_relative_location[3] = Vector3f(-100.f, -100.f, -50.f);
+        for (int i = 4; i < VEHICLE_MAX_WHEELS; i++) {
+            wheel_relative_location[i].setZero();
+        }
+    }
+
+    // Two wheels per axle, left (+y) then right (-y); axle k is
+    // (x, half track, z) and gives wheels 2k and 2k + 1. Duals are a second
+    // axle at the same x with a wider track.
+    void set_axles(const Vector3f* axles, int axle_count) {
+        wheel_count = 2 * axle_count;
+        for (int k = 0; k < axle_count; k++) {
+            wheel_relative_location[2 * k] =
+                Vector3f(axles[k](0), axles[k](1), axles[k](2));
+            wheel_relative_location[2 * k + 1] =
+                Vector3f(axles[k](0), -axles[k](1), axles[k](2));
+        }
+    }
+
+    // bitwise, so a reload of an unchanged file shares the old block
+    bool operator==(const VehicleArchetypeDesc& other) const {
+        bool same = body_mass == other.body_mass &&
+                    wheel_mass == other.wheel_mass &&
+                    wheel_radius == other.wheel_radius &&
+                    body_box_extent == other.body_box_extent &&
+                    body_relative_location == other.body_relative_location &&
+                    wheel_count == other.wheel_count &&
+                    gravity_acc == other.gravity_acc &&
+                    spring_constant == other.spring_constant &&
+                    loss_coeff == other.loss_coeff &&
+                    damping == other.damping &&
+                    tire_model == other.tire_model &&
+                    suspension_damping == other.suspension_damping &&
+                    engine_torque == other.engine_torque &&
+                    brake_torque == other.brake_torque &&
+                    max_steer_angle == other.max_steer_angle &&
+                    tire_stiffness == other.tire_stiffness &&
+                    tire_shape == other.tire_shape &&
+                    tire_grip == other.tire_grip;
+        for (int i = 0; same && i < wheel_count; i++) {
+            same = wheel_relative_location[i] ==
+                   other.wheel_relative_location[i];
+        }
+        return same;
+    }
+
+    bool operator!=(const VehicleArchetypeDesc& other) const {
+        return !(*this == other);
+    }
+};
+
+// the loose parameters the simulators' constructors have always taken
+inline VehicleArchetypeDesc vehicle_archetype_desc(
+    float body_mass,
+    float wheel_mass,
+    const Vector3f& body_box_extent,
+    float wheel_radius,
+    const Vector3f& body_relative_location,
+    const Vector3f* wheel_relative_location_arr,
+    int wheel_count = 4) {
+    VehicleArchetypeDesc desc;
+    desc.body_mass = body_mass;
+    desc.wheel_mass = wheel_mass;
+    desc.body_box_extent = body_box_extent;
+    desc.wheel_radius = wheel_radius;
+    desc.body_relative_location = body_relative_location;
+    desc.wheel_count = wheel_count;
+    for (int i = 0; i < wheel_count; i++) {
+        desc.wheel_relative_location[i] = wheel_relative_location_arr[i];
+    }
+    return desc;
+}
+
+// Everything a vehicle of one archetype derives from its desc, computed
+// once. Vehicles share the block through shared_ptr<const VehicleArchetype>
+// instead of each keeping copies; a reload builds a new block, and vehicles
+// still bound to the old one keep it alive until they rebind.
+//
+// Allocate with new (or make_vehicle_archetype), not make_shared, which
+// would bypass the aligned operator new.
+struct alignas(VEHICLE_ARCHETYPE_ALIGNMENT) VehicleArchetype {
+    VehicleArchetypeDesc desc;
+    // the vehicle's weight over its wheels, each wheel's contact force at
+    // rest
+    float balance;
+    // spring rest lengths, body to wheel i and wheel i to body
+    float normal_length_body[VEHICLE_MAX_WHEELS];
+    float normal_length_wheel[VEHICLE_MAX_WHEELS];
+    // principal moments of a solid box body and solid sphere wheels
+    Vector3f body_inertia;
+    float wheel_inertia;
+    // for the tire model: each wheel's offset from the body in the ground
+    // plane, its steering (0 or 1) and share of the engine torque, and the
+    // whole vehicle's moment about z
+    float wheel_lever_x[VEHICLE_MAX_WHEELS];
+    float wheel_lever_y[VEHICLE_MAX_WHEELS];
+    float wheel_steer[VEHICLE_MAX_WHEELS];
+    float wheel_drive_share[VEHICLE_MAX_WHEELS];
+    float yaw_inertia;
+
+    explicit VehicleArchetype(const VehicleArchetypeDesc& desc_)
+        : desc(desc_) {
+        const VehicleArchetypeDesc& d = desc;
+        int n = d.wheel_count;
+        for (int i = 0; i < VEHICLE_MAX_WHEELS; i++) {
+            normal_length_body[i] =
+                (d.body_relative_location(2) -
+                 (d.wheel_relative_location[i](2))) +
+                ((d.body_mass / n * d.gravity_acc) / d.spring_constant);
+            normal_length_wheel[i] = -normal_length_body[i];
+        }
+        balance = (d.body_mass + n * d.wheel_mass) * d.gravity_acc / n;
+
+        Vector3f e2 = d.body_box_extent.cwiseProduct(d.body_box_extent);
+        Vector3f box(e2(1) + e2(2), e2(0) + e2(2), e2(0) + e2(1));
+        body_inertia = d.body_mass / 3 * box;
+        wheel_inertia =
+            2.f / 5 * d.wheel_mass * d.wheel_radius * d.wheel_radius;
+
+        int driven = 0;
+        for (int i = 0; i < n; i++) {
+            driven += d.wheel_relative_location[i](0) <
+                      d.body_relative_location(0);
+        }
+        yaw_inertia = body_inertia(2);
+        for (int i = 0; i < VEHICLE_MAX_WHEELS; i++) {
+            Vector3f lever =
+                d.wheel_relative_location[i] - d.body_relative_location;
+            bool used = i < n;
+            wheel_lever_x[i] = lever(0);
+            wheel_lever_y[i] = lever(1);
+            wheel_steer[i] = used && lever(0) > 0.f;
+            wheel_drive_share[i] =
+                !used ? 0.f
+                      : !driven ? 1.f / n
+                                : lever(0) < 0.f ? 1.f / driven : 0.f;
+            if (used)
+                yaw_inertia += d.wheel_mass * (lever(0) * lever(0) +
+                                               lever(1) * lever(1)) +
+                               wheel_inertia;
+        }
+    }
+
+    // C++14 new ignores alignas beyond the default alignment; over-allocate
+    // through the global operator new, so replacements of it see the block
+    static void* operator new(size_t size) {
+        void* raw = ::operator new(size + VEHICLE_ARCHETYPE_ALIGNMENT +
+                                   sizeof(void*));
+        uintptr_t addr = (uintptr_t)raw + sizeof(void*);
+        addr = (addr + VEHICLE_ARCHETYPE_ALIGNMENT - 1) &
+               ~(uintptr_t)(VEHICLE_ARCHETYPE_ALIGNMENT - 1);
+        ((void**)addr)[-1] = raw;
+        return (void*)addr;
+    }
+
+    static void operator delete(void* ptr) {
+        if (ptr)
+            ::operator delete(((void**)ptr)[-1]);
+    }
+};
+
+inline shared_ptr<const VehicleArchetype> make_vehicle_archetype(
+    const VehicleArchetypeDesc& desc) {
+    return shared_ptr<const VehicleArchetype>(new VehicleArchetype(desc));
+}
+
+// Hands out one block per distinct desc for as long as some vehicle holds
+// it, so spawning many vehicles of a type builds its constants once and a
+// reload that changed nothing keeps them shared. Not thread safe: use it
+// from the thread that spawns and reloads.
+class VehicleArchetypeCache {
+    vector<weak_ptr<const VehicleArchetype>> entries;
+
+   public:
+    shared_ptr<const VehicleArchetype> get(const VehicleArchetypeDesc& desc) {
+        for (size_t k = 0; k < entries.size();) {
+            shared_ptr<const VehicleArchetype> archetype = entries[k].lock();
+            if (!archetype) {
+                entries[k] = entries.back();
+                entries.pop_back();
+                continue;
+            }
+            if (archetype->desc == desc)
+                return archetype;
+            k++;
+        }
+        shared_ptr<const VehicleArchetype> archetype =
+            make_vehicle_archetype(desc);
+        entries.push_back(archetype);
+        return archetype;
+    }
+
+    // blocks still held by some vehicle, as of the last get()
+    size_t size() const { return entries.size(); }
+};
+
+// The block for desc from a cache of the calling thread, for callers that
+// hand over loose parameters rather than an archetype: vehicles spawned
+// that way with the same parameters share one block.
+inline shared_ptr<const VehicleArchetype> shared_vehicle_archetype(
+    const VehicleArchetypeDesc& desc) {
+    static thread_local VehicleArchetypeCache cache;
+    return cache.get(desc);
+}
+
+// Reads an archetype file: one JSON object whose keys are the desc's
+// fields, vectors as arrays of three numbers, e.g.
+//
+//   {
+//     "body_mass": 100, "wheel_mass": 20, "wheel_radius": 20,
+//     "body_extent": [150, 150, 50], "body_location": [0, 0, 0],
+//     "wheel_locations": [[100, 100, -50], [100, -100, -50],
+//                         [-100, 100, -50], [-100, -100, -50]],
+//     "gravity_acc": 10, "spring_constant": 100,
+//     "loss_coeff": 0.2, "damping": 1
+//   }
+//
+// "tire_model": true switches to suspension and tires, read from
+// suspension_damping, engine_torque, brake_torque, max_steer_angle,
+// tire_stiffness, tire_shape (at most 2) and tire_grip.
+// wheel_locations takes VEHICLE_MIN_WHEELS to VEHICLE_MAX_WHEELS wheels;
+// instead of it, "axles": [[x, half_track, z], ...] lays out two wheels per
+// axle (see VehicleArchetypeDesc::set_axles). Missing keys keep the desc's
+// values. Returns false with a message in *error, leaving *desc untouched,
+// on malformed input or unknown keys.
+class VehicleArchetypeParser {
+    const char* text;
+    size_t length;
+    size_t pos;
+    string message;
+
+    bool fail(const string& what) {
+        if (message.empty()) {
+            int line = 1;
+            for (size_t k = 0; k < pos && k < length; k++) {
+                line += text[k] == '\n';
+            }
+            ostringstream out;
+            out << "line " << line << ": " << what;
+            message = out.str();
+        }
+        return false;
+    }
+
+    void skip_space() {
+        while (pos < length && (text[pos] == ' ' || text[pos] == '\t' ||
+                                text[pos] == '\n' || text[pos] == '\r'))
+            pos++;
+    }
+
+    bool expect(char c) {
+        skip_space();
+        if (pos == length || text[pos] != c)
+            return fail(string("expected '") + c + "'");
+        pos++;
+        return true;
+    }
+
+    bool peek(char c) {
+        skip_space();
+        return pos < length && text[pos] == c;
+    }
+
+    bool read_string(string* value) {
+        if (!expect('"'))
+            return false;
+        size_t start = pos;
+        while (pos < length && text[pos] != '"') {
+            if (text[pos] == '\\' || text[pos] == '\n')
+                return fail("unsupported character in string");
+            pos++;
+        }
+        if (pos == length)
+            return fail("unterminated string");
+        value->assign(text + start, pos - start);
+        pos++;
+        return true;
+    }
+
+    bool read_number(float* value) {
+        skip_space();
+        // strtof stops at the end of the number; copy it out so an unpadded
+        // buffer is never read past its end
+        size_t start = pos;
+        while (pos < length && strchr("+-.0123456789eE", text[pos]))
+            pos++;
+        string number(text + start, pos - start);
+        char* end = nullptr;
+        *value = strtof(number.c_str(), &end);
+        if (number.empty() || *end)
+            return fail("expected number");
+        return true;
+    }
+
+    bool read_vector(Vector3f* value) {
+        if (!expect('['))
+            return false;
+        for (int k = 0; k < 3; k++) {
+            if (k && !expect(','))
+                return false;
+            if (!read_number(&(*value)(k)))
+                return false;
+        }
+        return expect(']');
+    }
+
+    bool read_value(const string& key, VehicleArchetypeDesc* desc) {
+        float* scalars[] = {&desc->body_mass,
+                            &desc->wheel_mass,
+                            &desc->wheel_radius,
+                            &desc->gravity_acc,
+                            &desc->spring_constant,
+                            &desc->loss_coeff,
+                            &desc->damping,
+                            &desc->suspension_damping,
+                            &desc->engine_torque,
+                            &desc->brake_torque,
+                            &desc->max_steer_angle,
+                            &desc->tire_stiffness,
+                            &desc->tire_shape,
+                            &desc->tire_grip};
+        static const char* scalar_keys[] = {"body_mass",
+                                            "wheel_mass",
+                                            "wheel_radius",
+                                            "gravity_acc",
+                                            "spring_constant",
+                                            "loss_coeff",
+                                            "damping",
+                                            "suspension_damping",
+                                            "engine_torque",
+                                            "brake_torque",
+                                            "max_steer_angle",
+                                            "tire_stiffness",
+                                            "tire_shape",
+                                            "tire_grip"};
+        for (int k = 0; k < 14; k++) {
+            if (key == scalar_keys[k])
+                return read_number(scalars[k]);
+        }
+        if (key == "tire_model")
+            return read_bool(&desc->tire_model);
+        if (key == "body_extent")
+            return read_vector(&desc->body_box_extent);
+        if (key == "body_location")
+            return read_vector(&desc->body_relative_location);
+        if (key == "wheel_locations") {
+            int count;
+            if (!read_vectors(desc->wheel_relative_location,
+                              VEHICLE_MAX_WHEELS, &count))
+                return false;
+            desc->wheel_count = count;
+            return true;
+        }
+        if (key == "axles") {
+            Vector3f axles[VEHICLE_MAX_WHEELS / 2];
+            int count;
+            if (!read_vectors(axles, VEHICLE_MAX_WHEELS / 2, &count))
+                return false;
+            desc->set_axles(axles, count);
+            return true;
+        }
+        return fail("unknown key '" + key + "'");
+    }
+
+    bool read_bool(bool* value) {
+        skip_space();
+        static const char* words[] = {"false", "true"};
+        for (int k = 0; k < 2; k++) {
+            size_t n = strlen(words[k]);
+            if (length - pos >= n && !strncmp(text + pos, words[k], n)) {
+                pos += n;
+                *value = k;
+                return true;
+            }
+        }
+        return fail("expected true or false");
+    }
+
+    // an array of up to capacity vectors
+    bool read_vectors(Vector3f* values, int capacity, int* count) {
+        if (!expect('['))
+            return false;
+        *count = 0;
+        if (peek(']')) {
+            pos++;
+            return true;
+        }
+        while (true) {
+            if (*count == capacity)
+                return fail("too many entries");
+            if (!read_vector(&values[(*count)++]))
+                return false;
+            if (!peek(','))
+                return expect(']');
+            pos++;
+        }
+    }
+
+    // of the whole object, so without a line
+    bool check(const VehicleArchetypeDesc& desc) {
+        if (!(desc.body_mass > 0.f) || !(desc.wheel_mass > 0.f) ||
+            !(desc.wheel_radius > 0.f))
+            message = "masses and wheel radius must be positive";
+        else if (!(desc.spring_constant > 0.f))
+            message = "spring_constant must be positive";
+        else if (desc.wheel_count < VEHICLE_MIN_WHEELS)
+            message = "a vehicle needs at least two wheels";
+        else if (!(desc.suspension_damping >= 0.f) ||
+                 !(desc.brake_torque >= 0.f) || !(desc.tire_grip >= 0.f) ||
+                 !(desc.tire_stiffness > 0.f))
+            message = "suspension_damping, brake_torque and tire_grip must "
+                      "not be negative, tire_stiffness must be positive";
+        else if (!(desc.tire_shape > 0.f && desc.tire_shape <= 2.f))
+            message = "tire_shape must be in (0, 2]";
+        return message.empty();
+    }
+
+   public:
+    bool parse(const string& text_, VehicleArchetypeDesc* desc,
+               string* error) {
+        text = text_.data();
+        length = text_.size();
+        pos = 0;
+        message.clear();
+
+        VehicleArchetypeDesc parsed = *desc;
+        bool ok = expect('{');
+        if (ok && peek('}')) {
+            pos++;
+        } else {
+            while (ok) {
+                string key;
+                ok = read_string(&key) && expect(':') &&
+                     read_value(key, &parsed);
+                if (ok && peek('}')) {
+                    pos++;
+                    break;
+                }
+                ok = ok && expect(',');
+            }
+        }
+        skip_space();
+        if (ok && pos != length)
+            ok = fail("unexpected text after the object");
+        ok = ok && check(parsed);
+
+        if (!ok) {
+            if (error)
+                *error = message;
+            return false;
+        }
+        *desc = parsed;
+        return true;
+    }
+};
+
+inline bool load_vehicle_archetype(const string& path,
+                                   VehicleArchetypeDesc* desc,
+                                   string* error) {
+    ifstream file(path.c_str(), ios::binary);
+    if (!file) {
+        if (error)
+            *error = "cannot open " + path;
+        return false;
+    }
+    ostringstream text;
+    text << file.rdbuf();
+    if (!VehicleArchetypeParser().parse(text.str(), desc, error)) {
+        if (error)
+            *error = path + ": " + *error;
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef _VEHICLE_COMMAND_HPP_
+#define _VEHICLE_COMMAND_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+// per second, on the body and every wheel, along x and y as move() pushes
+#define VEHICLE_DRIVE_ACCELERATION 200.f
+#define VEHICLE_BRAKE_DECELERATION 400.f
+// about z on every wheel at full steer, the torque of one turn() input
+#define VEHICLE_STEER_TORQUE 10000.f
+
+// Axis values a vehicle holds from time on, until its next command. time is
+// on the simulator's clock (get_time()); throttle and steer are in [-1, 1],
+// a negative throttle reverses, brake is in [0, 1].
+struct VehicleCommand {
+    double time;
+    float throttle;
+    float brake;
+    float steer;
+};
+
+struct VehicleInput {
+    float throttle;
+    float brake;
+    float steer;
+};
+
+inline VehicleInput command_input(const VehicleCommand& command) {
+    VehicleInput input = {max(-1.f, min(command.throttle, 1.f)),
+                          max(0.f, min(command.brake, 1.f)),
+                          max(-1.f, min(command.steer, 1.f))};
+    return input;
+}
+
+// Commands for many vehicles, recorded by one producer (AI, replay, player
+// input) without touching the simulator and handed to it in one submit.
+class VehicleCommandBuffer {
+   public:
+    struct Record {
+        int vehicle;
+        VehicleCommand command;
+    };
+
+   private:
+    vector<Record> records;
+
+   public:
+    void reserve(size_t n) { records.reserve(n); }
+
+    void push(int vehicle, const VehicleCommand& command) {
+        Record record = {vehicle, command};
+        records.push_back(record);
+    }
+
+    void push(int vehicle,
+              double time,
+              float throttle,
+              float brake,
+              float steer) {
+        VehicleCommand command = {time, throttle, brake, steer};
+        push(vehicle, command);
+    }
+
+    // keeps the storage for the next batch
+    void clear() { records.clear(); }
+
+    bool empty() const { return records.empty(); }
+
+    size_t size() const { return records.size(); }
+
+    const Record& operator[](size_t i) const { return records[i]; }
+};
+
+// Time-weighted mean of the input over the step [t0, t1). Consumes the
+// commands in [commands + *first, commands + last) due before t1, which must
+// be in time order; commands older than t0 count from t0. held is the input
+// the step starts with and ends as the last consumed command.
+inline VehicleInput consume_commands(const VehicleCommand* commands,
+                                     size_t* first,
+                                     size_t last,
+                                     double t0,
+                                     double t1,
+                                     VehicleInput* held) {
+    size_t k = *first;
+    if (k == last || commands[k].time >= t1)
+        return *held;
+
+    double t = t0;
+    double throttle = 0., brake = 0., steer = 0.;
+    for (; k < last && commands[k].time < t1; k++) {
+        double start = max(commands[k].time, t0);
+        throttle += (start - t) * held->throttle;
+        brake += (start - t) * held->brake;
+        steer += (start - t) * held->steer;
+        t = start;
+        *held = command_input(commands[k]);
+    }
+    throttle += (t1 - t) * held->throttle;
+    brake += (t1 - t) * held->brake;
+    steer += (t1 - t) * held->steer;
+    *first = k;
+
+    double span = t1 - t0;
+    VehicleInput mean = {(float)(throttle / span), (float)(brake / span),
+                         (float)(steer / span)};
+    return mean;
+}
+
+// Horizontal acceleration of one velocity component under input: throttle
+// pushes, the brake opposes the motion but never reverses it within a step.
+inline float input_acceleration(const VehicleInput& input,
+                                float velocity,
+                                float delta_time) {
+    float brake = min(input.brake * VEHICLE_BRAKE_DECELERATION,
+                      fabs(velocity) / delta_time);
+    return input.throttle * VEHICLE_DRIVE_ACCELERATION -
+           (velocity < 0.f ? -brake : brake);
+}
+
+#endif
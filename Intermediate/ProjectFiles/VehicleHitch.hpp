@@ -0,0 +1,120 @@
+#ifndef _VEHICLEHITCH_HPP_
+#define _VEHICLEHITCH_HPP_
+
+#include "Eigen/Eigen/Dense"
+#include "Particle.hpp"
+#include "ParticleForce.hpp"
+using namespace Eigen;
+
+// a force set between steps and applied as is
+class HeldForce : public ForceGenerator {
+    Vector3f force;
+
+   public:
+    HeldForce() : force(Vector3f::Zero()) {}
+
+    void set_force(const Vector3f& force_) { force = force_; }
+
+    virtual void update_force(Particle* particle, float delta_time) {
+        particle->update_force(force);
+    }
+};
+
+// Couples two simulators, e.g. a tractor and its trailer, with a
+// spring-damper between a point on each body. Offsets are in the body
+// frame, relative to the body's location, and turn with the vehicle.
+//
+// update() computes the link force from the state after the last step and
+// holds it through the next one, so call it once per step before stepping
+// either unit. The vertical part acts on the bodies; the horizontal part is
+// spread over the wheels, since the frame constraint sets the body's
+// horizontal velocity from them. Both units must outlive the hitch.
+template <typename Front, typename Back>
+class VehicleHitch {
+    Front* front;
+    Back* back;
+    Vector3f front_offset;
+    Vector3f back_offset;
+    float stiffness;
+    float damping;
+
+    HeldForce front_body_force;
+    HeldForce front_wheel_force;
+    HeldForce back_body_force;
+    HeldForce back_wheel_force;
+
+    template <typename Unit>
+    static Vector3f hitch_location(Unit* unit, const Vector3f& offset) {
+        return unit->get_body_location() +
+               unit->get_wheel_relative_quat(0) * offset;
+    }
+
+    template <typename Unit>
+    static void attach(Unit* unit, HeldForce* body_force,
+                       HeldForce* wheel_force) {
+        unit->add_temporary_force(-1, body_force);
+        for (int i = 0; i < unit->get_wheel_count(); i++) {
+            unit->add_temporary_force(i, wheel_force);
+        }
+    }
+
+    template <typename Unit>
+    static void detach(Unit* unit, HeldForce* body_force,
+                       HeldForce* wheel_force) {
+        unit->remove_temporary_force(-1, body_force);
+        for (int i = 0; i < unit->get_wheel_count(); i++) {
+            unit->remove_temporary_force(i, wheel_force);
+        }
+    }
+
+    template <typename Unit>
+    static void hold(Unit* unit, const Vector3f& force, HeldForce* body_force,
+                     HeldForce* wheel_force) {
+        body_force->set_force(Vector3f(0.f, 0.f, force(2)));
+        wheel_force->set_force(Vector3f(force(0), force(1), 0.f) /
+                               (float)unit->get_wheel_count());
+    }
+
+   public:
+    VehicleHitch(Front* front_,
+                 Vector3f front_offset_,
+                 Back* back_,
+                 Vector3f back_offset_,
+                 float stiffness_,
+                 float damping_)
+        : front(front_),
+          back(back_),
+          front_offset(front_offset_),
+          back_offset(back_offset_),
+          stiffness(stiffness_),
+          damping(damping_) {
+        attach(front, &front_body_force, &front_wheel_force);
+        attach(back, &back_body_force, &back_wheel_force);
+    }
+
+    ~VehicleHitch() {
+        detach(front, &front_body_force, &front_wheel_force);
+        detach(back, &back_body_force, &back_wheel_force);
+    }
+
+    // the units point at the forces
+    VehicleHitch(const VehicleHitch&) = delete;
+    VehicleHitch& operator=(const VehicleHitch&) = delete;
+
+    void update() {
+        Vector3f stretch = get_separation();
+        Vector3f closing = back->get_body_linear_velocity() -
+                           front->get_body_linear_velocity();
+        Vector3f force = stiffness * stretch + damping * closing;
+        hold(front, force, &front_body_force, &front_wheel_force);
+        hold(back, -force, &back_body_force, &back_wheel_force);
+    }
+
+    // back hitch point minus front hitch point, zero when the link is at rest
+    Vector3f get_separation() {
+        return hitch_location(back, back_offset) -
+               hitch_location(front, front_offset);
+    }
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "AsyncWheelSweeps.h"
+
+void FAsyncWheelSweeps::Reset(int32 InWheelCount, int32 InDelayFrames) {
+    WheelCount = InWheelCount;
+    DelayFrames = FMath::Max(InDelayFrames, 1);
+    Pending.Init(FTraceHandle(), WheelCount);
+    bHit.Init(false, WheelCount * DelayFrames);
+    ImpactPoints.Init(FVector::ZeroVector, WheelCount * DelayFrames);
+    ImpactNormals.Init(FVector::UpVector, WheelCount * DelayFrames);
+    Head = 0;
+    Filled = 0;
+}
+
+void FAsyncWheelSweeps::Collect(UWorld* World) {
+    if (WheelCount == 0 || !Pending[0].IsValid()) {
+        return;
+    }
+
+    int32 Slot = (Head + 1) % DelayFrames;
+    for (int32 Wheel = 0; Wheel < WheelCount; Wheel++) {
+        FTraceDatum Datum;
+        int32 Index = Slot * WheelCount + Wheel;
+        bHit[Index] = false;
+        if (World->QueryTraceData(Pending[Wheel], Datum)) {
+            for (const FHitResult& Hit : Datum.OutHits) {
+                if (Hit.bBlockingHit) {
+                    bHit[Index] = true;
+                    ImpactPoints[Index] = Hit.ImpactPoint;
+                    ImpactNormals[Index] = Hit.ImpactNormal;
+                    break;
+                }
+            }
+        }
+        Pending[Wheel].Invalidate();
+    }
+    Head = Slot;
+    Filled = FMath::Min(Filled + 1, DelayFrames);
+}
+
+bool FAsyncWheelSweeps::GetHit(int32 Wheel,
+                               const FVector& Location,
+                               float Radius,
+                               FVector& ImpactPoint,
+                               FVector* ImpactNormal) const {
+    // oldest buffered slot
+    int32 Index = ((Head + 1) % DelayFrames) * WheelCount + Wheel;
+    if (!bHit[Index]) {
+        return false;
+    }
+    if (Location.Z - Radius - ImpactPoints[Index].Z > 1.0f) {
+        return false;
+    }
+    ImpactPoint = ImpactPoints[Index];
+    if (ImpactNormal) {
+        *ImpactNormal = ImpactNormals[Index];
+    }
+    return true;
+}
+
+void FAsyncWheelSweeps::Submit(UWorld* World,
+                               int32 Wheel,
+                               const FVector& Location,
+                               float Radius,
+                               const FQuat& Rotation) {
+    FVector end = Location;
+    end.Z -= 1.0f;
+    Pending[Wheel] = World->AsyncSweepByChannel(
+        EAsyncTraceType::Single, Location, end, Rotation,
+        ECollisionChannel::ECC_WorldDynamic,
+        FCollisionShape::MakeSphere(Radius));
+}
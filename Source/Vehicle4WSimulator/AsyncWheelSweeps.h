@@ -0,0 +1,47 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/World.h"
+
+// Wheel ground sweeps issued as async traces and consumed DelayFrames frames
+// later, so the game thread never waits on the physics scene query.
+//
+// Sweeps are submitted after the simulator step, at the wheel locations the
+// next step starts from; with a delay of one frame the step therefore sees
+// the same query it would have made synchronously, only against last frame's
+// scene. Delayed hits are re-validated against the current wheel location
+// with the same one-unit reach as the blocking sweep.
+class FAsyncWheelSweeps {
+public:
+	void Reset(int32 InWheelCount, int32 InDelayFrames);
+
+	// Start of frame: gathers the results of last frame's submissions
+	void Collect(UWorld* World);
+
+	// Whether DelayFrames frames of results are buffered
+	bool IsReady() const { return Filled == DelayFrames; }
+
+	// Delayed result for Wheel, checked against its current Location; the
+	// surface normal too when ImpactNormal is given
+	bool GetHit(int32 Wheel, const FVector& Location, float Radius, FVector& ImpactPoint,
+		FVector* ImpactNormal = nullptr) const;
+
+	// End of frame: queues the sweep for Wheel at its current Location
+	void Submit(UWorld* World, int32 Wheel, const FVector& Location, float Radius, const FQuat& Rotation);
+
+private:
+	int32 WheelCount = 0;
+	int32 DelayFrames = 1;
+
+	// handles submitted this frame, one per wheel
+	TArray<FTraceHandle> Pending;
+
+	// DelayFrames slots of WheelCount results; Head is the newest slot
+	TArray<bool> bHit;
+	TArray<FVector> ImpactPoints;
+	TArray<FVector> ImpactNormals;
+	int32 Head = 0;
+	int32 Filled = 0;
+};
@@ -1,10 +1,25 @@
 #include "Vehicle4WActor.h"
 
+#include "../../Intermediate/ProjectFiles/PhysicsThread.hpp"
 #include "../../Intermediate/ProjectFiles/Vehicle4WSimulator.hpp"
 #include "Components/BoxComponent.h"
 #include "Components/InputComponent.h"
 #include "Components/SphereComponent.h"
+#include "EngineUtils.h"
+#include "HAL/FileManager.h"
 #include "Kismet/GameplayStatics.h"
+#include "Misc/Paths.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+#include "VehicleArchetypeAsset.h"
+#include "VehicleFleetManager.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "../../Intermediate/ProjectFiles/Trajectory.hpp"
+#if PLATFORM_WINDOWS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
 
 Vector3f FVector2Eigen(FVector vec) {
     return Vector3f(vec.X, vec.Y, vec.Z);
@@ -30,6 +45,24 @@ FQuat Eigen2FQuat(Eigen::Quaternionf quat_) {
     return FQuat(quat_.x(), quat_.y(), quat_.z(), quat_.w());
 }
 
+// one constant block per distinct archetype in play, game thread only
+static VehicleArchetypeCache& ArchetypeCache() {
+    static VehicleArchetypeCache Cache;
+    return Cache;
+}
+
+// trajectory files hold four-wheel vehicles; the others never record
+static void RecordStep(TrajectoryRecorder* Recorder,
+                       Vehicle4WSimulator& Simulator,
+                       Vector3f** HitPoints) {
+    if (Recorder && Recorder->begin_frame()) {
+        Recorder->record(0, Simulator, HitPoints);
+        Recorder->end_frame();
+    }
+}
+
+static void RecordStep(TrajectoryRecorder*, VehicleNWSimulator&, Vector3f**) {}
+
 // Sets default values
 AVehicle4WActor::AVehicle4WActor() {
     // Set this actor to call Tick() every frame.  You can turn this off to
@@ -56,13 +89,25 @@ AVehicle4WActor::AVehicle4WActor() {
     // input
     InputComp = CreateDefaultSubobject<UInputComponent>(TEXT("Input"));
     InputComponent = InputComp;
+
+    simulator = nullptr;
+    MultiSimulator = nullptr;
+    bTrailersAttached = false;
+    bTowed = false;
+    bUseAsyncSweeps = false;
+    Physics = nullptr;
+    Recorder = nullptr;
+    Reader = nullptr;
+    ReplayTime = 0.f;
+    FleetManager = nullptr;
+    FleetHandle = INDEX_NONE;
+    ThrottleInput = BrakeInput = SteerInput = 0.f;
 }
 
 // Called when the game starts or when spawned
 void AVehicle4WActor::BeginPlay() {
     Super::BeginPlay();
 
-    float body_mass = 100.f, wheel_mass = 20.f;
     FVector location = GetActorLocation();
     Quaternionf quat =
         FQuat2Eigen(BodyComp->GetRelativeRotation().Quaternion());
@@ -79,17 +124,136 @@ void AVehicle4WActor::BeginPlay() {
     wheel_transform = (*(WheelComp[0]))->GetComponentToWorld();
     float wheel_radius =
         (*(WheelComp[0]))->CalcBounds(wheel_transform).BoxExtent.X;
-    Vector3f wheel_relative_location[4];
+    Wheels.Reset();
     for (int i = 0; i < 4; i++) {
-        wheel_relative_location[i] =
-            FVector2Eigen((*(WheelComp[i]))->GetRelativeLocation());
+        Wheels.Add(*(WheelComp[i]));
+    }
+    TInlineComponentArray<USphereComponent*> Spheres(this);
+    for (USphereComponent* Sphere : Spheres) {
+        if (!Sphere->ComponentHasTag(TEXT("Wheel")) ||
+            Wheels.Contains(Sphere)) {
+            continue;
+        }
+        if (Wheels.Num() == VEHICLE_MAX_WHEELS) {
+            UE_LOG(LogTemp, Warning,
+                   TEXT("%s: more than %d wheels, ignoring %s"), *GetName(),
+                   VEHICLE_MAX_WHEELS, *Sphere->GetName());
+            continue;
+        }
+        Wheels.Add(Sphere);
+    }
+    ShapeDesc = VehicleArchetypeDesc();
+    ShapeDesc.body_box_extent = FVector2Eigen(body_box_extent);
+    ShapeDesc.body_relative_location = FVector2Eigen(body_relative_location);
+    ShapeDesc.wheel_radius = wheel_radius;
+    ShapeDesc.wheel_count = Wheels.Num();
+    for (int i = 0; i < Wheels.Num(); i++) {
+        ShapeDesc.wheel_relative_location[i] =
+            FVector2Eigen(Wheels[i]->GetRelativeLocation());
+    }
+    ArchetypeBlock = FindArchetype();
+
+    // tractors and trailers step together, on the game thread
+    Trailers.Reset();
+    for (TActorIterator<AVehicle4WActor> It(GetWorld()); It; ++It) {
+        if (It->TowedBy == this) {
+            Trailers.Add(*It);
+        }
+    }
+    bool bMulti = Wheels.Num() != 4 || TowedBy || Trailers.Num() > 0;
+    if (bMulti && (bReplayTrajectory || bRecordTrajectory || bAsyncPhysics)) {
+        UE_LOG(LogTemp, Warning,
+               TEXT("%s: hitched or not on four wheels, simulating on the "
+                    "game thread without trajectories"),
+               *GetName());
+    }
+    if (Archetype) {
+        ArchetypeChangedHandle = Archetype->OnChanged.AddUObject(
+            this, &AVehicle4WActor::OnArchetypeChanged);
+    }
+
+    FString TrajectoryPath = FPaths::ProjectSavedDir() / TrajectoryFile;
+    if (bReplayTrajectory && !bMulti) {
+        Reader = new TrajectoryReader();
+        if (!Reader->open(TCHAR_TO_UTF8(*TrajectoryPath)) ||
+            (uint32)ReplayVehicle >= Reader->get_vehicle_count()) {
+            UE_LOG(LogTemp, Warning,
+                   TEXT("%s: cannot replay vehicle %d of %s, simulating"),
+                   *GetName(), ReplayVehicle, *TrajectoryPath);
+            delete Reader;
+            Reader = nullptr;
+        }
+        ReplayTime = 0.f;
     }
 
-    simulator = new Vehicle4WSimulator(
-        body_mass, wheel_mass, FVector2Eigen(location), quat,
-        FVector2Eigen(body_box_extent), wheel_radius, linear_velocity,
-        angular_velocity, FVector2Eigen(body_relative_location),
-        wheel_relative_location);
+    // a fleet manager in the level steps every vehicle from its own tick,
+    // except the tire model, which it does not run
+    bool bFleet = !Reader && !bMulti && !ArchetypeBlock->desc.tire_model;
+    for (TActorIterator<AVehicleFleetManager> It(GetWorld()); It && bFleet;
+         ++It) {
+        FleetManager = *It;
+        break;
+    }
+
+    if (FleetManager) {
+        FleetHandle = FleetManager->AddVehicle(
+            this, *ArchetypeBlock, FVector2Eigen(location), quat,
+            linear_velocity, angular_velocity);
+        SetActorTickEnabled(false);
+    } else if (bMulti) {
+        MultiSimulator = new VehicleNWSimulator(
+            ArchetypeBlock, FVector2Eigen(location), quat, linear_velocity,
+            angular_velocity);
+        MultiSimulator->set_integrator(
+            static_cast<Integrator>(IntegrationScheme));
+        MultiSimulator->set_contact_cache(ContactCacheTolerance,
+                                          ContactCacheMaxAge);
+        AsyncSweeps.Reset(Wheels.Num(), GroundQueryDelayFrames);
+        Stepper = FixedStepper(FixedDeltaTime, MaxSubsteps);
+        MultiPreviousState = MultiCurrentState =
+            MultiSimulator->get_render_state();
+    } else {
+        simulator =
+            new Vehicle4WSimulator(ArchetypeBlock, FVector2Eigen(location),
+                                   quat, linear_velocity, angular_velocity);
+        simulator->set_integrator(static_cast<Integrator>(IntegrationScheme));
+        simulator->set_contact_cache(ContactCacheTolerance,
+                                     ContactCacheMaxAge);
+        AsyncSweeps.Reset(4, GroundQueryDelayFrames);
+        Stepper = FixedStepper(FixedDeltaTime, MaxSubsteps);
+        PreviousState = CurrentState = simulator->get_render_state();
+
+        if (bRecordTrajectory && !Reader) {
+            IFileManager::Get().MakeDirectory(*FPaths::GetPath(TrajectoryPath),
+                                              true);
+            Recorder = new TrajectoryRecorder();
+            if (!Recorder->open(TCHAR_TO_UTF8(*TrajectoryPath), 1,
+                                Stepper.get_step())) {
+                UE_LOG(LogTemp, Warning, TEXT("%s: cannot record to %s"),
+                       *GetName(), *TrajectoryPath);
+                delete Recorder;
+                Recorder = nullptr;
+            }
+        }
+
+        if (bAsyncPhysics) {
+            Physics =
+                new PhysicsThread(simulator, Stepper.get_step(), MaxSubsteps);
+            if (Recorder) {
+                // only the physics thread touches the recorder from now on
+                TrajectoryRecorder* StepRecorder = Recorder;
+                Physics->set_step_callback(
+                    [StepRecorder](Vehicle4WSimulator& Simulator,
+                                   Vector3f** HitPoints) {
+                        if (StepRecorder->begin_frame()) {
+                            StepRecorder->record(0, Simulator, HitPoints);
+                            StepRecorder->end_frame();
+                        }
+                    });
+            }
+            Physics->start();
+        }
+    }
 
     // input
     UGameplayStatics::GetPlayerController(GetWorld(), 0);
@@ -101,53 +265,127 @@ void AVehicle4WActor::BeginPlay() {
                                &AVehicle4WActor::TurnLeft);
     InputComponent->BindAction("TurnRight", EInputEvent::IE_Released, this,
                                &AVehicle4WActor::TurnRight);
+    InputComponent->BindAxis("Throttle", this, &AVehicle4WActor::OnThrottle);
+    InputComponent->BindAxis("Brake", this, &AVehicle4WActor::OnBrake);
+    InputComponent->BindAxis("Steer", this, &AVehicle4WActor::OnSteer);
 }
 
-// Called every frame
-void AVehicle4WActor::Tick(float DeltaTime) {
-    Super::Tick(DeltaTime);
+void AVehicle4WActor::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+    if (Archetype) {
+        Archetype->OnChanged.Remove(ArchetypeChangedHandle);
+    }
+    // the hitches point into both simulators
+    if (TowedBy && bTowed) {
+        TowedBy->DetachTrailer(this);
+    }
+    while (Trailers.Num() > 0) {
+        DetachTrailer(Trailers.Last());
+    }
+    if (FleetManager) {
+        FleetManager->RemoveVehicle(this, FleetHandle);
+        FleetManager = nullptr;
+        FleetHandle = INDEX_NONE;
+    }
+    // joins the physics thread before the simulator goes
+    delete Physics;
+    Physics = nullptr;
+    delete simulator;
+    simulator = nullptr;
+    delete MultiSimulator;
+    MultiSimulator = nullptr;
+    delete Recorder;
+    Recorder = nullptr;
+    delete Reader;
+    Reader = nullptr;
+    ArchetypeBlock.reset();
 
-    FHitResult Hit;
-    bool bHasHit;
-    FCollisionShape SphereShape =
-        FCollisionShape::MakeSphere(simulator->get_wheel_radius());
-    FVector location, end;
-    Vector3f* hit_point_arr[4];
-    for (int i = 0; i < 4; i++) {
-        location = Eigen2FVector(simulator->get_wheel_location(i));
-        end = location;
-        end.Z -= 1.0f;
-        bHasHit = GetWorld()->SweepSingleByChannel(
-            Hit, location, end, GetActorRotation().Quaternion(),
-            ECollisionChannel::ECC_WorldDynamic, SphereShape);
+    Super::EndPlay(EndPlayReason);
+}
 
-        if (bHasHit) {
-            Vector3f hit_point = FVector2Eigen(Hit.ImpactPoint);
-            hit_point_arr[i] = &hit_point;
-        } else {
-            hit_point_arr[i] = nullptr;
+shared_ptr<const VehicleArchetype> AVehicle4WActor::FindArchetype() const {
+    VehicleArchetypeDesc Desc = ShapeDesc;
+    if (Archetype) {
+        Archetype->ApplyTo(Desc);
+    }
+    return ArchetypeCache().get(Desc);
+}
+
+void AVehicle4WActor::OnArchetypeChanged(UVehicleArchetypeAsset* Asset) {
+    shared_ptr<const VehicleArchetype> Block = FindArchetype();
+    if (Block == ArchetypeBlock) {
+        return;
+    }
+    ArchetypeBlock = Block;
+    if (FleetManager) {
+        FleetManager->SetVehicleArchetype(FleetHandle, *ArchetypeBlock);
+    } else if (simulator) {
+        // the simulator is the physics thread's while it runs
+        bool bRunning = Physics && Physics->is_running();
+        if (bRunning) {
+            Physics->stop();
         }
+        simulator->set_archetype(ArchetypeBlock);
+        if (bRunning) {
+            Physics->start();
+        }
+    } else if (MultiSimulator) {
+        MultiSimulator->set_archetype(ArchetypeBlock);
     }
+}
 
-    simulator->apply(hit_point_arr, DeltaTime);
+// Called every frame
+void AVehicle4WActor::Tick(float DeltaTime) {
+    Super::Tick(DeltaTime);
 
-    // relative
-    FVector relative_location;
+    if (Reader) {
+        TickReplay(DeltaTime);
+        return;
+    }
+    if (Physics) {
+        TickPhysicsThread();
+        return;
+    }
+    if (MultiSimulator) {
+        // else the towing vehicle steps this one
+        if (!bTowed) {
+            TickTrain(DeltaTime);
+        }
+        return;
+    }
 
-    // body
-    relative_location = Eigen2FVector(simulator->get_body_relative_location());
-    BodyComp->SetRelativeLocation(relative_location);
+    bool bAsync = GroundQueryDelayFrames > 0;
+    if (bAsync) {
+        AsyncSweeps.Collect(GetWorld());
+    }
+    bool bUseAsync = bAsync && AsyncSweeps.IsReady();
 
-    // wheel
-    for (int i = 0; i < 4; i++) {
-        relative_location =
-            Eigen2FVector(simulator->get_wheel_relative_location(i));
-        (*(WheelComp[i]))->SetRelativeLocation(relative_location);
+    if (bFixedStep) {
+        // the async results of this frame serve every step in it
+        int32 Steps = Stepper.advance(DeltaTime);
+        for (int32 Step = 0; Step < Steps; Step++) {
+            PreviousState = CurrentState;
+            StepSimulator(*simulator, Stepper.get_step(), bUseAsync);
+            CurrentState = simulator->get_render_state();
+        }
+        UpdateComponents(
+            interpolate(PreviousState, CurrentState, Stepper.get_alpha()));
+    } else {
+        StepSimulator(*simulator, DeltaTime, bUseAsync);
+        PreviousState = CurrentState = simulator->get_render_state();
+        UpdateComponents(CurrentState);
     }
 
-    // angular
-    FQuat quat = Eigen2FQuat(simulator->get_wheel_relative_quat(0));
-    RootComp->SetRelativeRotation(quat.Rotator());
+    // queries for the next step
+    if (bAsync) {
+        float radius = simulator->get_wheel_radius();
+        FQuat rotation = GetActorRotation().Quaternion();
+        for (int i = 0; i < 4; i++) {
+            AsyncSweeps.Submit(
+                GetWorld(), i,
+                Eigen2FVector(simulator->get_wheel_location(i)), radius,
+                rotation);
+        }
+    }
 
     // display
     /*UE_LOG(LogTemp, Display, TEXT("Wheel Location: %s"),
@@ -161,18 +399,391 @@ void AVehicle4WActor::Tick(float DeltaTime) {
                     *relative_location.ToString()));*/
 }
 
+template <typename Simulator>
+void AVehicle4WActor::StepSimulator(Simulator& Sim,
+                                    float StepTime,
+                                    bool bUseAsync) {
+    FVector location, impact_point, impact_normal;
+    float radius = Sim.get_wheel_radius();
+    int wheel_count = Sim.get_wheel_count();
+    Vector3f hit_points[Simulator::CAPACITY];
+    Vector3f* hit_point_arr[Simulator::CAPACITY];
+    // the tire model pushes along them; the spring model ignores them
+    Vector3f hit_normals[Simulator::CAPACITY];
+    // delayed results are already off the game thread
+    typename Simulator::ContactCache& Cache = Sim.get_contact_cache();
+    bool bCache = !bUseAsync && Cache.enabled();
+    {
+        INSTRUMENT_SCOPE(INSTRUMENT_SWEEP);
+        if (bCache) {
+            Cache.advance(wheel_count, StepTime);
+        }
+        for (int i = 0; i < wheel_count; i++) {
+            Vector3f center = Sim.get_wheel_location(i);
+            GroundHit Contact;
+            bool bHasHit;
+            if (bCache && Cache.predict(i, center, radius,
+                                        GROUND_SWEEP_DISTANCE, &Contact)) {
+                INSTRUMENT_COUNT(INSTRUMENT_CACHED_CONTACTS, 1);
+                bHasHit = true;
+            } else if (bCache) {
+                INSTRUMENT_COUNT(INSTRUMENT_WHEEL_SWEEPS, 1);
+                bHasHit = SweepWheel(Eigen2FVector(center), radius, Contact);
+                Cache.store(i, center, bHasHit ? &Contact : nullptr);
+            } else {
+                INSTRUMENT_COUNT(INSTRUMENT_WHEEL_SWEEPS, 1);
+                location = Eigen2FVector(center);
+                bHasHit = bUseAsync
+                              ? AsyncSweeps.GetHit(i, location, radius,
+                                                   impact_point,
+                                                   &impact_normal)
+                              : SweepWheel(location, radius, impact_point,
+                                           &impact_normal);
+                Contact.point = FVector2Eigen(impact_point);
+                Contact.normal = FVector2Eigen(impact_normal);
+            }
+            if (bHasHit) {
+                INSTRUMENT_COUNT(INSTRUMENT_WHEEL_HITS, 1);
+                hit_points[i] = Contact.point;
+                hit_normals[i] = Contact.normal;
+                hit_point_arr[i] = &hit_points[i];
+            } else {
+                hit_point_arr[i] = nullptr;
+            }
+        }
+    }
+
+    Sim.apply(hit_point_arr, hit_normals, StepTime);
+    RecordStep(Recorder, Sim, hit_point_arr);
+}
+
+void AVehicle4WActor::TickTrain(float DeltaTime) {
+    AttachTrailers();
+    BeginTrainFrame();
+    if (bFixedStep) {
+        int32 Steps = Stepper.advance(DeltaTime);
+        for (int32 Step = 0; Step < Steps; Step++) {
+            UpdateHitches();
+            StepTrain(Stepper.get_step());
+        }
+        EndTrainFrame(Stepper.get_alpha());
+    } else {
+        UpdateHitches();
+        StepTrain(DeltaTime);
+        EndTrainFrame(1.f);
+    }
+}
+
+void AVehicle4WActor::BeginTrainFrame() {
+    bool bAsync = GroundQueryDelayFrames > 0;
+    if (bAsync) {
+        AsyncSweeps.Collect(GetWorld());
+    }
+    bUseAsyncSweeps = bAsync && AsyncSweeps.IsReady();
+    for (AVehicle4WActor* Trailer : Trailers) {
+        Trailer->BeginTrainFrame();
+    }
+}
+
+void AVehicle4WActor::UpdateHitches() {
+    for (int32 i = 0; i < Hitches.Num(); i++) {
+        Hitches[i]->update();
+        Trailers[i]->UpdateHitches();
+    }
+}
+
+void AVehicle4WActor::StepTrain(float StepTime) {
+    MultiPreviousState = MultiCurrentState;
+    StepSimulator(*MultiSimulator, StepTime, bUseAsyncSweeps);
+    MultiCurrentState = MultiSimulator->get_render_state();
+    for (AVehicle4WActor* Trailer : Trailers) {
+        Trailer->StepTrain(StepTime);
+    }
+}
+
+void AVehicle4WActor::EndTrainFrame(float Alpha) {
+    UpdateComponents(
+        interpolate(MultiPreviousState, MultiCurrentState, Alpha));
+    if (GroundQueryDelayFrames > 0) {
+        float radius = MultiSimulator->get_wheel_radius();
+        FQuat rotation = GetActorRotation().Quaternion();
+        for (int i = 0; i < MultiSimulator->get_wheel_count(); i++) {
+            AsyncSweeps.Submit(
+                GetWorld(), i,
+                Eigen2FVector(MultiSimulator->get_wheel_location(i)), radius,
+                rotation);
+        }
+    }
+    for (AVehicle4WActor* Trailer : Trailers) {
+        Trailer->EndTrainFrame(Alpha);
+    }
+}
+
+void AVehicle4WActor::AttachTrailers() {
+    if (bTrailersAttached) {
+        return;
+    }
+    bTrailersAttached = true;
+    for (int32 i = Trailers.Num() - 1; i >= 0; i--) {
+        if (!Trailers[i]->MultiSimulator || Trailers[i]->bTowed) {
+            UE_LOG(LogTemp, Warning, TEXT("%s: cannot tow %s"), *GetName(),
+                   *Trailers[i]->GetName());
+            Trailers.RemoveAt(i);
+        }
+    }
+    for (AVehicle4WActor* Trailer : Trailers) {
+        Hitches.Add(new VehicleHitch<VehicleNWSimulator, VehicleNWSimulator>(
+            MultiSimulator, FVector2Eigen(Trailer->TowOffset),
+            Trailer->MultiSimulator, FVector2Eigen(Trailer->HitchOffset),
+            Trailer->HitchStiffness, Trailer->HitchDamping));
+        Trailer->bTowed = true;
+        Trailer->AttachTrailers();
+    }
+}
+
+void AVehicle4WActor::DetachTrailer(AVehicle4WActor* Trailer) {
+    int32 Index = Trailers.Find(Trailer);
+    if (Index == INDEX_NONE) {
+        return;
+    }
+    if (Index < Hitches.Num()) {
+        delete Hitches[Index];
+        Hitches.RemoveAt(Index);
+    }
+    Trailers.RemoveAt(Index);
+    Trailer->bTowed = false;
+}
+
+void AVehicle4WActor::TickPhysicsThread() {
+    const VehiclePublication& State = Physics->acquire();
+
+    // hits for the steps until the next frame
+    WheelGroundHits Hits;
+    FVector impact_point;
+    FVector impact_normal;
+    {
+        INSTRUMENT_SCOPE(INSTRUMENT_SWEEP);
+        INSTRUMENT_COUNT(INSTRUMENT_WHEEL_SWEEPS, 4);
+        for (int i = 0; i < 4; i++) {
+            Hits.hit[i] =
+                SweepWheel(Eigen2FVector(State.wheel_location[i]),
+                           State.wheel_radius, impact_point, &impact_normal);
+            if (Hits.hit[i]) {
+                INSTRUMENT_COUNT(INSTRUMENT_WHEEL_HITS, 1);
+                Hits.point[i] = FVector2Eigen(impact_point);
+                Hits.normal[i] = FVector2Eigen(impact_normal);
+            }
+        }
+    }
+    Physics->submit_ground(Hits);
+
+    UpdateComponents(interpolate(State.previous, State.current,
+                                 Physics->get_alpha(State)));
+}
+
+void AVehicle4WActor::TickReplay(float DeltaTime) {
+    int64 Frames = (int64)Reader->get_frame_count();
+    if (Frames == 0) {
+        return;
+    }
+    float Step = Reader->get_delta_time();
+    ReplayTime = FMath::Clamp(ReplayTime + DeltaTime * ReplayRate, 0.f,
+                              Frames * Step);
+
+    // frame f is the state after step f, at (f + 1) * Step
+    float Position = ReplayTime / Step - 1.f;
+    int64 Frame = FMath::Clamp((int64)FMath::FloorToFloat(Position),
+                               (int64)0, Frames - 1);
+    int64 Next = FMath::Min(Frame + 1, Frames - 1);
+    float Alpha = FMath::Clamp(Position - Frame, 0.f, 1.f);
+    if (Reader->has_column(TRAJECTORY_ORIGIN_X)) {
+        SetActorLocation(Eigen2FVector(
+            Reader->get_vector(TRAJECTORY_ORIGIN_X, Frame, ReplayVehicle)));
+    }
+    UpdateComponents(
+        interpolate(Reader->get_render_state(Frame, ReplayVehicle),
+                    Reader->get_render_state(Next, ReplayVehicle), Alpha));
+}
+
+void AVehicle4WActor::SeekReplay(float Time) {
+    ReplayTime = FMath::Max(Time, 0.f);
+    if (Reader) {
+        TickReplay(0.f);
+    }
+}
+
+bool AVehicle4WActor::SweepWheel(const FVector& Location,
+                                 float Radius,
+                                 FVector& ImpactPoint,
+                                 FVector* ImpactNormal) const {
+    FHitResult Hit;
+    FVector end = Location;
+    end.Z -= 1.0f;
+    bool bHasHit = GetWorld()->SweepSingleByChannel(
+        Hit, Location, end, GetActorRotation().Quaternion(),
+        ECollisionChannel::ECC_WorldDynamic,
+        FCollisionShape::MakeSphere(Radius));
+    if (bHasHit) {
+        ImpactPoint = Hit.ImpactPoint;
+        if (ImpactNormal) {
+            *ImpactNormal = Hit.ImpactNormal;
+        }
+    }
+    return bHasHit;
+}
+
+bool AVehicle4WActor::SweepWheel(const FVector& Location,
+                                 float Radius,
+                                 GroundHit& Hit) const {
+    FHitResult Result;
+    FVector end = Location;
+    end.Z -= GROUND_SWEEP_DISTANCE;
+    FCollisionQueryParams Params;
+    Params.bReturnPhysicalMaterial = true;
+    bool bHasHit = GetWorld()->SweepSingleByChannel(
+        Result, Location, end, GetActorRotation().Quaternion(),
+        ECollisionChannel::ECC_WorldDynamic,
+        FCollisionShape::MakeSphere(Radius), Params);
+    if (bHasHit) {
+        Hit.point = FVector2Eigen(Result.ImpactPoint);
+        Hit.normal = FVector2Eigen(Result.ImpactNormal);
+        Hit.surface = Result.PhysMaterial.IsValid()
+                          ? (int)Result.PhysMaterial->SurfaceType
+                          : 0;
+    }
+    return bHasHit;
+}
+
+void AVehicle4WActor::UpdateComponents(const Vector3f& BodyRelativeLocation,
+                                       const Vector3f* WheelRelativeLocation,
+                                       const Quaternionf& Quat,
+                                       bool bWheels) {
+    INSTRUMENT_SCOPE(INSTRUMENT_WRITE_BACK);
+
+    // Set every relative transform without touching the world transforms,
+    // then propagate once from the root, which the body and wheels hang
+    // below. Each SetRelative* call would otherwise update its subtree,
+    // physics state and overlaps on its own.
+    RootComp->SetRelativeRotation_Direct(Eigen2FQuat(Quat).Rotator());
+    BodyComp->SetRelativeLocation_Direct(Eigen2FVector(BodyRelativeLocation));
+    if (bWheels) {
+        for (int i = 0; i < Wheels.Num(); i++) {
+            Wheels[i]->SetRelativeLocation_Direct(
+                Eigen2FVector(WheelRelativeLocation[i]));
+        }
+    }
+    RootComp->UpdateComponentToWorld(EUpdateTransformFlags::SkipPhysicsUpdate,
+                                     ETeleportType::TeleportPhysics);
+}
+
+void AVehicle4WActor::UpdateComponents(const VehicleRenderState& State,
+                                       bool bWheels) {
+    UpdateComponents(State.body_location, State.wheel_location, State.quat,
+                     bWheels);
+}
+
+void AVehicle4WActor::UpdateComponents(
+    const VehicleNWSimulator::RenderState& State,
+    bool bWheels) {
+    UpdateComponents(State.body_location, State.wheel_location, State.quat,
+                     bWheels);
+}
+
 void AVehicle4WActor::MoveForward() {
-    simulator->move(true);
+    if (Reader) {
+        return;
+    }
+    if (FleetManager) {
+        FleetManager->GetFleet().move(FleetHandle, true);
+    } else if (Physics) {
+        Physics->move(true);
+    } else if (MultiSimulator) {
+        MultiSimulator->move(true);
+    } else {
+        simulator->move(true);
+    }
 }
 
 void AVehicle4WActor::MoveBackward() {
-    simulator->move(false);
+    if (Reader) {
+        return;
+    }
+    if (FleetManager) {
+        FleetManager->GetFleet().move(FleetHandle, false);
+    } else if (Physics) {
+        Physics->move(false);
+    } else if (MultiSimulator) {
+        MultiSimulator->move(false);
+    } else {
+        simulator->move(false);
+    }
 }
 
 void AVehicle4WActor::TurnLeft() {
-    simulator->turn(true);
+    if (Reader) {
+        return;
+    }
+    if (FleetManager) {
+        FleetManager->GetFleet().turn(FleetHandle, true,
+                                      FleetManager->GetStepTime());
+    } else if (Physics) {
+        Physics->turn(true);
+    } else if (MultiSimulator) {
+        MultiSimulator->turn(true);
+    } else {
+        simulator->turn(true);
+    }
 }
 
 void AVehicle4WActor::TurnRight() {
-    simulator->turn(false);
+    if (Reader) {
+        return;
+    }
+    if (FleetManager) {
+        FleetManager->GetFleet().turn(FleetHandle, false,
+                                      FleetManager->GetStepTime());
+    } else if (Physics) {
+        Physics->turn(false);
+    } else if (MultiSimulator) {
+        MultiSimulator->turn(false);
+    } else {
+        simulator->turn(false);
+    }
+}
+
+void AVehicle4WActor::SetDriveInput(float Throttle, float Brake, float Steer) {
+    if (Reader || (Throttle == ThrottleInput && Brake == BrakeInput &&
+                   Steer == SteerInput)) {
+        return;
+    }
+    ThrottleInput = Throttle;
+    BrakeInput = Brake;
+    SteerInput = Steer;
+    if (FleetManager) {
+        FleetManager->QueueCommand(FleetHandle, Throttle, Brake, Steer);
+    } else if (Physics) {
+        VehicleCommand Command = {Physics->acquire().time, Throttle, Brake,
+                                  Steer};
+        Physics->submit(Command);
+    } else if (simulator) {
+        VehicleCommand Command = {simulator->get_time(), Throttle, Brake,
+                                  Steer};
+        simulator->submit(Command);
+    } else if (MultiSimulator) {
+        VehicleCommand Command = {MultiSimulator->get_time(), Throttle, Brake,
+                                  Steer};
+        MultiSimulator->submit(Command);
+    }
+}
+
+void AVehicle4WActor::OnThrottle(float Value) {
+    SetDriveInput(Value, BrakeInput, SteerInput);
+}
+
+void AVehicle4WActor::OnBrake(float Value) {
+    SetDriveInput(ThrottleInput, Value, SteerInput);
+}
+
+void AVehicle4WActor::OnSteer(float Value) {
+    SetDriveInput(ThrottleInput, BrakeInput, Value);
 }
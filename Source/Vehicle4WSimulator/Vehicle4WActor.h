@@ -6,11 +6,35 @@
 #include "GameFramework/Actor.h"
 // #include "../../Intermediate/ProjectFiles/PhysicsSim.hpp"
 #include "../../Intermediate/ProjectFiles/Vehicle4WSimulator.hpp"
+#include "../../Intermediate/ProjectFiles/VehicleHitch.hpp"
 #include "Components/BoxComponent.h"
 #include "Components/SphereComponent.h"
+#include "AsyncWheelSweeps.h"
 // last
 #include "Vehicle4WActor.generated.h"
 
+class AVehicleFleetManager;
+class PhysicsThread;
+class TrajectoryRecorder;
+class TrajectoryReader;
+class UVehicleArchetypeAsset;
+
+// UE <-> Eigen conversions, defined in Vehicle4WActor.cpp
+Vector3f FVector2Eigen(FVector vec);
+Quaternionf FQuat2Eigen(FQuat quat_);
+FVector Eigen2FVector(Eigen::Vector3f vec);
+FQuat Eigen2FQuat(Eigen::Quaternionf quat_);
+
+// Editor-facing mirror of the core Integrator enum, in the same order
+UENUM()
+enum class EVehicleIntegrator : uint8
+{
+	SymplecticEuler,
+	Verlet,
+	RK4,
+	ImplicitSpring
+};
+
 UCLASS()
 class VEHICLE4WSIMULATOR_API AVehicle4WActor : public AActor
 {
@@ -24,6 +48,9 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	// Called when the actor is destroyed or the level ends
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
@@ -33,6 +60,117 @@ public:
 	void TurnLeft();
 	void TurnRight();
 
+	// Analog driving input, queued as a command the next simulation step
+	// applies; throttle and steer in [-1, 1], brake in [0, 1]. AI drivers
+	// call this instead of going through the axis bindings.
+	UFUNCTION(BlueprintCallable, Category = "Input")
+		void SetDriveInput(float Throttle, float Brake, float Steer);
+
+	// Sweeps the wheel sphere one unit down from Location
+	bool SweepWheel(const FVector& Location, float Radius, FVector& ImpactPoint,
+		FVector* ImpactNormal = nullptr) const;
+
+	// the same sweep as a GroundHit, surface from the physical material
+	bool SweepWheel(const FVector& Location, float Radius, GroundHit& Hit) const;
+
+	// Writes simulated relative transforms back to the components in one
+	// batch: teleport, no sweeps or overlap updates, render transforms only
+	// marked dirty. bWheels false leaves the wheel components where they are,
+	// for a fleet manager that draws the wheels itself. WheelRelativeLocation
+	// holds one location per wheel component.
+	void UpdateComponents(const Vector3f& BodyRelativeLocation, const Vector3f* WheelRelativeLocation, const Quaternionf& Quat, bool bWheels = true);
+	void UpdateComponents(const VehicleRenderState& State, bool bWheels = true);
+	void UpdateComponents(const VehicleNWSimulator::RenderState& State, bool bWheels = true);
+
+	// Step the simulation in fixed FixedDeltaTime steps and interpolate the
+	// components between the last two; off passes DeltaTime straight through
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+		bool bFixedStep = true;
+
+	// Length of one simulation step
+	UPROPERTY(EditAnywhere, Category = "Simulation", meta = (ClampMin = "0.001"))
+		float FixedDeltaTime = FIXED_STEP_DELTA_TIME;
+
+	// Steps per frame before time is dropped, so a hitch cannot snowball
+	UPROPERTY(EditAnywhere, Category = "Simulation", meta = (ClampMin = "1"))
+		int32 MaxSubsteps = FIXED_STEP_MAX_STEPS;
+
+	// Masses and force constants, none for the defaults; the shape comes
+	// from the components. Edits to the asset apply while playing.
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+		UVehicleArchetypeAsset* Archetype = nullptr;
+
+	// Time integration of the simulator; higher orders allow larger steps
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+		EVehicleIntegrator IntegrationScheme = EVehicleIntegrator::SymplecticEuler;
+
+	// Step the simulator on its own thread at FixedDeltaTime; the game thread
+	// then only sweeps the wheels and shows the latest published state
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+		bool bAsyncPhysics = false;
+
+	// Frames between submitting a wheel sweep and using its result; 0 sweeps
+	// synchronously inside Tick
+	UPROPERTY(EditAnywhere, Category = "Ground Query", meta = (ClampMin = "0"))
+		int32 GroundQueryDelayFrames = 0;
+
+	// Synchronous sweeps only: a grounded wheel reuses the plane of its last
+	// hit until it moved this far sideways from where it was swept; 0 sweeps
+	// every step (see BasicContactCache)
+	UPROPERTY(EditAnywhere, Category = "Ground Query", meta = (ClampMin = "0"))
+		float ContactCacheTolerance = 0.f;
+
+	// Seconds after which a cached contact is swept again regardless
+	UPROPERTY(EditAnywhere, Category = "Ground Query", meta = (ClampMin = "0.001"))
+		float ContactCacheMaxAge = 0.25f;
+
+	// Append every simulation step to TrajectoryFile
+	UPROPERTY(EditAnywhere, Category = "Trajectory")
+		bool bRecordTrajectory = false;
+
+	// Drive the components from TrajectoryFile instead of simulating; the
+	// vehicle then stays out of any fleet manager
+	UPROPERTY(EditAnywhere, Category = "Trajectory")
+		bool bReplayTrajectory = false;
+
+	// Relative to the project's Saved directory
+	UPROPERTY(EditAnywhere, Category = "Trajectory")
+		FString TrajectoryFile = TEXT("Trajectories/Vehicle.traj");
+
+	// Vehicle of the file to replay; fleet recordings hold one per fleet slot
+	UPROPERTY(EditAnywhere, Category = "Trajectory", meta = (ClampMin = "0"))
+		int32 ReplayVehicle = 0;
+
+	// Playback speed, negative plays backwards
+	UPROPERTY(EditAnywhere, Category = "Trajectory")
+		float ReplayRate = 1.f;
+
+	// Jumps the replay to Time seconds into the recording
+	UFUNCTION(BlueprintCallable, Category = "Trajectory")
+		void SeekReplay(float Time);
+
+	// Vehicle towing this one, e.g. the tractor of a trailer. The towing
+	// vehicle steps its trailers along with itself; hitched vehicles stay
+	// out of fleet managers, physics threads and trajectory files.
+	UPROPERTY(EditAnywhere, Category = "Hitch")
+		AVehicle4WActor* TowedBy = nullptr;
+
+	// Hitch point on TowedBy's body, in its body frame
+	UPROPERTY(EditAnywhere, Category = "Hitch")
+		FVector TowOffset = FVector(-200.f, 0.f, 0.f);
+
+	// Hitch point on this vehicle's body, in its body frame
+	UPROPERTY(EditAnywhere, Category = "Hitch")
+		FVector HitchOffset = FVector(200.f, 0.f, 0.f);
+
+	// Force per unit of distance between the two hitch points
+	UPROPERTY(EditAnywhere, Category = "Hitch", meta = (ClampMin = "0"))
+		float HitchStiffness = 2000.f;
+
+	// Force per unit of closing speed between the two bodies
+	UPROPERTY(EditAnywhere, Category = "Hitch", meta = (ClampMin = "0"))
+		float HitchDamping = 1000.f;
+
 private:
 	UPROPERTY(VisibleAnywhere)
 		USceneComponent * RootComp;
@@ -57,5 +195,102 @@ private:
 
 	USphereComponent ** WheelComp[4] = { &WheelComp0, &WheelComp1, &WheelComp2, &WheelComp3 };
 
+	// WheelComp0..3, then the sphere components tagged "Wheel" in the order
+	// BeginPlay found them, e.g. the extra axles of a truck
+	UPROPERTY(Transient)
+		TArray<USphereComponent*> Wheels;
+
+	// sweeps the wheels and advances Sim, simulator or MultiSimulator, by
+	// one step
+	template <typename Simulator>
+	void StepSimulator(Simulator& Sim, float StepTime, bool bUseAsync);
+
+	// fixed steps of MultiSimulator and of the trailers hitched to it
+	void TickTrain(float DeltaTime);
+
+	// The Train functions recurse into the trailers. Collects the async
+	// sweeps of the frame.
+	void BeginTrainFrame();
+
+	// one step of every unit, all hitch forces taken before any unit moves
+	void UpdateHitches();
+	void StepTrain(float StepTime);
+
+	// shows the units Alpha between their last two steps and queues the
+	// next frame's sweeps
+	void EndTrainFrame(float Alpha);
+
+	// hitches the vehicles whose TowedBy is this one, once
+	void AttachTrailers();
+	void DetachTrailer(AVehicle4WActor* Trailer);
+
+	// sweeps from the latest published state and shows it
+	void TickPhysicsThread();
+
+	// advances the replay clock and shows the recorded state at it
+	void TickReplay(float DeltaTime);
+
+	// Archetype's values over ShapeDesc, shared with every vehicle of the
+	// same values
+	shared_ptr<const VehicleArchetype> FindArchetype() const;
+
+	// rebinds the simulator or the fleet slot to the asset's new values
+	void OnArchetypeChanged(UVehicleArchetypeAsset* Asset);
+
+	// "Throttle", "Brake" and "Steer" axis bindings
+	void OnThrottle(float Value);
+	void OnBrake(float Value);
+	void OnSteer(float Value);
+
 	Vehicle4WSimulator* simulator;
+
+	// set instead of simulator for what the four-wheel paths cannot take:
+	// other than four wheels, or a hitch
+	VehicleNWSimulator* MultiSimulator;
+	VehicleNWSimulator::RenderState MultiPreviousState;
+	VehicleNWSimulator::RenderState MultiCurrentState;
+
+	// vehicles whose TowedBy is this one, and their hitches once attached
+	TArray<AVehicle4WActor*> Trailers;
+	TArray<VehicleHitch<VehicleNWSimulator, VehicleNWSimulator>*> Hitches;
+	bool bTrailersAttached;
+
+	// set while the towing vehicle steps this one
+	bool bTowed;
+
+	// this frame's sweeps come from AsyncSweeps
+	bool bUseAsyncSweeps;
+
+	// the components' shape as BeginPlay found it, default force constants
+	VehicleArchetypeDesc ShapeDesc;
+
+	// keeps the block alive for the next vehicle of the archetype
+	shared_ptr<const VehicleArchetype> ArchetypeBlock;
+
+	FDelegateHandle ArchetypeChangedHandle;
+
+	FAsyncWheelSweeps AsyncSweeps;
+
+	FixedStepper Stepper;
+
+	// simulated state before and after the last step
+	VehicleRenderState PreviousState;
+	VehicleRenderState CurrentState;
+
+	// set with bAsyncPhysics; owns the simulator while it runs
+	PhysicsThread* Physics;
+
+	// open while recording or replaying
+	TrajectoryRecorder* Recorder;
+	TrajectoryReader* Reader;
+	float ReplayTime;
+
+	// set when a fleet manager in the level drives this vehicle
+	AVehicleFleetManager* FleetManager;
+	int32 FleetHandle;
+
+	// axis values of the last queued command
+	float ThrottleInput;
+	float BrakeInput;
+	float SteerInput;
 };
@@ -0,0 +1,48 @@
+// Instrumentation.hpp includes Vehicle4WInstrumentation.h itself when the
+// build selects it as the backend; Shipping builds compile this file empty.
+#include "../../Intermediate/ProjectFiles/Instrumentation.hpp"
+
+#if VEHICLE4W_INSTRUMENTATION && defined(VEHICLE4W_INSTRUMENTATION_BACKEND)
+
+DEFINE_STAT(STAT_Vehicle4WStep);
+DEFINE_STAT(STAT_Vehicle4WSweep);
+DEFINE_STAT(STAT_Vehicle4WForces);
+DEFINE_STAT(STAT_Vehicle4WIntegrate);
+DEFINE_STAT(STAT_Vehicle4WWriteBack);
+DEFINE_STAT(STAT_Vehicle4WGravity);
+DEFINE_STAT(STAT_Vehicle4WSpring);
+DEFINE_STAT(STAT_Vehicle4WContact);
+DEFINE_STAT(STAT_Vehicle4WFriction);
+DEFINE_STAT(STAT_Vehicle4WFrameConstraint);
+DEFINE_STAT(STAT_Vehicle4WOtherGenerator);
+DEFINE_STAT(STAT_Vehicle4WTemporaryForces);
+DEFINE_STAT(STAT_Vehicle4WTires);
+
+DEFINE_STAT(STAT_Vehicle4WVehicleSteps);
+DEFINE_STAT(STAT_Vehicle4WWheelSweeps);
+DEFINE_STAT(STAT_Vehicle4WWheelHits);
+DEFINE_STAT(STAT_Vehicle4WGeneratorCalls);
+DEFINE_STAT(STAT_Vehicle4WAsleepVehicles);
+DEFINE_STAT(STAT_Vehicle4WAwakeVehicles);
+DEFINE_STAT(STAT_Vehicle4WCachedContacts);
+
+TStatId InstrumentStatId(InstrumentStage Stage) {
+    static const TStatId StatIds[INSTRUMENT_STAGE_COUNT] = {
+        GET_STATID(STAT_Vehicle4WStep),
+        GET_STATID(STAT_Vehicle4WSweep),
+        GET_STATID(STAT_Vehicle4WForces),
+        GET_STATID(STAT_Vehicle4WIntegrate),
+        GET_STATID(STAT_Vehicle4WWriteBack),
+        GET_STATID(STAT_Vehicle4WGravity),
+        GET_STATID(STAT_Vehicle4WSpring),
+        GET_STATID(STAT_Vehicle4WContact),
+        GET_STATID(STAT_Vehicle4WFriction),
+        GET_STATID(STAT_Vehicle4WFrameConstraint),
+        GET_STATID(STAT_Vehicle4WOtherGenerator),
+        GET_STATID(STAT_Vehicle4WTemporaryForces),
+        GET_STATID(STAT_Vehicle4WTires),
+    };
+    return StatIds[Stage];
+}
+
+#endif
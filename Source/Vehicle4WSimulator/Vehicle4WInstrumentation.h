@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+// Instrumentation backend for the simulator core, selected in
+// Vehicle4WSimulator.Build.cs through VEHICLE4W_INSTRUMENTATION_BACKEND and
+// included by Instrumentation.hpp after its stage and counter enums.
+//
+// Stages become cycle stats of STATGROUP_Vehicle4W ("stat Vehicle4W"), which
+// Unreal Insights also shows as CPU timing events; counters become DWORD
+// accumulators that reset every frame.
+
+DECLARE_STATS_GROUP(TEXT("Vehicle4W"), STATGROUP_Vehicle4W, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step"), STAT_Vehicle4WStep, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Sweep"), STAT_Vehicle4WSweep, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Forces"), STAT_Vehicle4WForces, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Integrate"), STAT_Vehicle4WIntegrate, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Write back"), STAT_Vehicle4WWriteBack, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Gravity"), STAT_Vehicle4WGravity, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Spring"), STAT_Vehicle4WSpring, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Contact"), STAT_Vehicle4WContact, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Friction"), STAT_Vehicle4WFriction, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Frame constraint"), STAT_Vehicle4WFrameConstraint, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Other generators"), STAT_Vehicle4WOtherGenerator, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Temporary forces"), STAT_Vehicle4WTemporaryForces, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Tires"), STAT_Vehicle4WTires, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Vehicle steps"), STAT_Vehicle4WVehicleSteps, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Wheel sweeps"), STAT_Vehicle4WWheelSweeps, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Wheel hits"), STAT_Vehicle4WWheelHits, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Generator calls"), STAT_Vehicle4WGeneratorCalls, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Asleep vehicles"), STAT_Vehicle4WAsleepVehicles, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Awake vehicles"), STAT_Vehicle4WAwakeVehicles, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Cached contacts"), STAT_Vehicle4WCachedContacts, STATGROUP_Vehicle4W, VEHICLE4WSIMULATOR_API);
+
+// Stat of each InstrumentStage, in enum order
+VEHICLE4WSIMULATOR_API TStatId InstrumentStatId(InstrumentStage Stage);
+
+class InstrumentScope {
+public:
+	explicit InstrumentScope(InstrumentStage Stage)
+		: Counter(InstrumentStatId(Stage)) {}
+
+	InstrumentScope(const InstrumentScope&) = delete;
+	InstrumentScope& operator=(const InstrumentScope&) = delete;
+
+private:
+	FScopeCycleCounter Counter;
+};
+
+inline void instrument_count(InstrumentCounter Counter, uint64 N) {
+	switch (Counter) {
+	case INSTRUMENT_VEHICLE_STEPS:
+		INC_DWORD_STAT_BY(STAT_Vehicle4WVehicleSteps, (uint32)N);
+		break;
+	case INSTRUMENT_WHEEL_SWEEPS:
+		INC_DWORD_STAT_BY(STAT_Vehicle4WWheelSweeps, (uint32)N);
+		break;
+	case INSTRUMENT_WHEEL_HITS:
+		INC_DWORD_STAT_BY(STAT_Vehicle4WWheelHits, (uint32)N);
+		break;
+	case INSTRUMENT_GENERATOR_CALLS:
+		INC_DWORD_STAT_BY(STAT_Vehicle4WGeneratorCalls, (uint32)N);
+		break;
+	case INSTRUMENT_ASLEEP_VEHICLES:
+		INC_DWORD_STAT_BY(STAT_Vehicle4WAsleepVehicles, (uint32)N);
+		break;
+	case INSTRUMENT_AWAKE_VEHICLES:
+		INC_DWORD_STAT_BY(STAT_Vehicle4WAwakeVehicles, (uint32)N);
+		break;
+	case INSTRUMENT_CACHED_CONTACTS:
+		INC_DWORD_STAT_BY(STAT_Vehicle4WCachedContacts, (uint32)N);
+		break;
+	}
+}
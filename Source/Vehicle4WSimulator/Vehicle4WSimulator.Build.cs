@@ -12,6 +12,15 @@ public class Vehicle4WSimulator : ModuleRules
 
 		PrivateDependencyModuleNames.AddRange(new string[] {  });
 
+		// Simulator stage timers and counters as "stat Vehicle4W", see
+		// Intermediate/ProjectFiles/Instrumentation.hpp. Set the level to 2
+		// for one timer per force generator type.
+		if (Target.Configuration != UnrealTargetConfiguration.Shipping)
+		{
+			PublicDefinitions.Add("VEHICLE4W_INSTRUMENTATION=1");
+			PublicDefinitions.Add("VEHICLE4W_INSTRUMENTATION_BACKEND=Vehicle4WInstrumentation.h");
+		}
+
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
 		
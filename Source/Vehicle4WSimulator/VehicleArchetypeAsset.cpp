@@ -0,0 +1,120 @@
+#include "VehicleArchetypeAsset.h"
+
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+void UVehicleArchetypeAsset::ApplyTo(VehicleArchetypeDesc& Desc) const {
+    Desc.body_mass = BodyMass;
+    Desc.wheel_mass = WheelMass;
+    Desc.gravity_acc = GravityAcc;
+    Desc.spring_constant = SpringConstant;
+    Desc.loss_coeff = LossCoeff;
+    Desc.damping = Damping;
+    Desc.tire_model = bTireModel;
+    Desc.suspension_damping = SuspensionDamping;
+    Desc.engine_torque = EngineTorque;
+    Desc.brake_torque = BrakeTorque;
+    Desc.max_steer_angle = MaxSteerAngle;
+    Desc.tire_stiffness = TireStiffness;
+    Desc.tire_shape = TireShape;
+    Desc.tire_grip = TireGrip;
+}
+
+bool UVehicleArchetypeAsset::ReloadSourceFile() {
+    if (SourceFile.FilePath.IsEmpty()) {
+        return false;
+    }
+    FString Path = FPaths::ProjectDir() / SourceFile.FilePath;
+    SourceTimeStamp = IFileManager::Get().GetTimeStamp(*Path);
+    FString Text;
+    if (!FFileHelper::LoadFileToString(Text, *Path)) {
+        UE_LOG(LogTemp, Warning, TEXT("%s: cannot read %s"), *GetName(),
+               *Path);
+        return false;
+    }
+
+    VehicleArchetypeDesc Desc;
+    ApplyTo(Desc);
+    std::string Error;
+    if (!VehicleArchetypeParser().parse(TCHAR_TO_UTF8(*Text), &Desc,
+                                        &Error)) {
+        UE_LOG(LogTemp, Warning, TEXT("%s: %s: %s"), *GetName(), *Path,
+               UTF8_TO_TCHAR(Error.c_str()));
+        return false;
+    }
+    BodyMass = Desc.body_mass;
+    WheelMass = Desc.wheel_mass;
+    GravityAcc = Desc.gravity_acc;
+    SpringConstant = Desc.spring_constant;
+    LossCoeff = Desc.loss_coeff;
+    Damping = Desc.damping;
+    bTireModel = Desc.tire_model;
+    SuspensionDamping = Desc.suspension_damping;
+    EngineTorque = Desc.engine_torque;
+    BrakeTorque = Desc.brake_torque;
+    MaxSteerAngle = Desc.max_steer_angle;
+    TireStiffness = Desc.tire_stiffness;
+    TireShape = Desc.tire_shape;
+    TireGrip = Desc.tire_grip;
+    OnChanged.Broadcast(this);
+    return true;
+}
+
+void UVehicleArchetypeAsset::PostLoad() {
+    Super::PostLoad();
+    if (!SourceFile.FilePath.IsEmpty()) {
+        ReloadSourceFile();
+    }
+    UpdateSourceWatch();
+}
+
+void UVehicleArchetypeAsset::BeginDestroy() {
+    if (SourceWatch.IsValid()) {
+        FTicker::GetCoreTicker().RemoveTicker(SourceWatch);
+        SourceWatch.Reset();
+    }
+    Super::BeginDestroy();
+}
+
+#if WITH_EDITOR
+void UVehicleArchetypeAsset::PostEditChangeProperty(
+    FPropertyChangedEvent& PropertyChangedEvent) {
+    Super::PostEditChangeProperty(PropertyChangedEvent);
+
+    FName Name = PropertyChangedEvent.GetPropertyName();
+    if (Name == GET_MEMBER_NAME_CHECKED(FFilePath, FilePath) ||
+        Name == GET_MEMBER_NAME_CHECKED(UVehicleArchetypeAsset, SourceFile) ||
+        Name == GET_MEMBER_NAME_CHECKED(UVehicleArchetypeAsset,
+                                        SourceCheckInterval)) {
+        // a file that does not parse keeps the current values
+        ReloadSourceFile();
+        UpdateSourceWatch();
+        return;
+    }
+    OnChanged.Broadcast(this);
+}
+#endif
+
+void UVehicleArchetypeAsset::UpdateSourceWatch() {
+    if (SourceWatch.IsValid()) {
+        FTicker::GetCoreTicker().RemoveTicker(SourceWatch);
+        SourceWatch.Reset();
+    }
+    // the class default object never drives a vehicle
+    if (SourceFile.FilePath.IsEmpty() || HasAnyFlags(RF_ClassDefaultObject)) {
+        return;
+    }
+    SourceWatch = FTicker::GetCoreTicker().AddTicker(
+        FTickerDelegate::CreateUObject(
+            this, &UVehicleArchetypeAsset::CheckSourceFile),
+        SourceCheckInterval);
+}
+
+bool UVehicleArchetypeAsset::CheckSourceFile(float DeltaTime) {
+    FString Path = FPaths::ProjectDir() / SourceFile.FilePath;
+    if (IFileManager::Get().GetTimeStamp(*Path) != SourceTimeStamp) {
+        ReloadSourceFile();
+    }
+    return true;
+}
@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Engine/DataAsset.h"
+#include "Engine/EngineTypes.h"
+#include "../../Intermediate/ProjectFiles/VehicleArchetype.hpp"
+// last
+#include "VehicleArchetypeAsset.generated.h"
+
+class UVehicleArchetypeAsset;
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnVehicleArchetypeChanged, UVehicleArchetypeAsset*);
+
+// Masses and force constants of a vehicle type, shared by every
+// AVehicle4WActor that points at it. The shape stays with each actor's
+// components. Editing the asset, or the archetype file it reads from, while
+// playing rebinds the vehicles using it on their next frame.
+UCLASS(BlueprintType)
+class VEHICLE4WSIMULATOR_API UVehicleArchetypeAsset : public UPrimaryDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditAnywhere, Category = "Mass", meta = (ClampMin = "0.001"))
+		float BodyMass = 100.f;
+
+	UPROPERTY(EditAnywhere, Category = "Mass", meta = (ClampMin = "0.001"))
+		float WheelMass = 20.f;
+
+	UPROPERTY(EditAnywhere, Category = "Forces")
+		float GravityAcc = 10.f;
+
+	// Stiffness of the body-wheel springs
+	UPROPERTY(EditAnywhere, Category = "Forces", meta = (ClampMin = "0.001"))
+		float SpringConstant = 100.f;
+
+	// Share of the wheels' downward speed lost on contact
+	UPROPERTY(EditAnywhere, Category = "Forces", meta = (ClampMin = "0"))
+		float LossCoeff = 0.2f;
+
+	// Friction coefficient of the wheels on the ground
+	UPROPERTY(EditAnywhere, Category = "Forces", meta = (ClampMin = "0"))
+		float Damping = 1.f;
+
+	// Replaces the springs and friction with suspension dampers and slip
+	// driven tire forces; see TireModel.hpp
+	UPROPERTY(EditAnywhere, Category = "Tires")
+		bool bTireModel = false;
+
+	UPROPERTY(EditAnywhere, Category = "Tires", meta = (ClampMin = "0"))
+		float SuspensionDamping = 30.f;
+
+	// Engine torque at full throttle, shared by the driven wheels
+	UPROPERTY(EditAnywhere, Category = "Tires")
+		float EngineTorque = 20000.f;
+
+	UPROPERTY(EditAnywhere, Category = "Tires", meta = (ClampMin = "0"))
+		float BrakeTorque = 40000.f;
+
+	// Radians the front wheels turn at full steer
+	UPROPERTY(EditAnywhere, Category = "Tires")
+		float MaxSteerAngle = 0.5f;
+
+	UPROPERTY(EditAnywhere, Category = "Tires", meta = (ClampMin = "0.001"))
+		float TireStiffness = 10.f;
+
+	UPROPERTY(EditAnywhere, Category = "Tires", meta = (ClampMin = "0.001", ClampMax = "2"))
+		float TireShape = 1.5f;
+
+	// Peak tire force over wheel load
+	UPROPERTY(EditAnywhere, Category = "Tires", meta = (ClampMin = "0"))
+		float TireGrip = 1.f;
+
+	// Optional archetype JSON (see VehicleArchetype.hpp) relative to the
+	// project directory, the one the headless runner reads. Its masses and
+	// force constants replace the values above whenever the file changes;
+	// its geometry keys are ignored.
+	UPROPERTY(EditAnywhere, Category = "Source")
+		FFilePath SourceFile;
+
+	// Seconds between checks of SourceFile for changes
+	UPROPERTY(EditAnywhere, Category = "Source", meta = (ClampMin = "0.1"))
+		float SourceCheckInterval = 1.f;
+
+	// Broadcast on the game thread after any value changed
+	FOnVehicleArchetypeChanged OnChanged;
+
+	// The asset's values over Desc, whose geometry is kept
+	void ApplyTo(VehicleArchetypeDesc& Desc) const;
+
+	// Reads SourceFile now; false, changing nothing, when it cannot
+	UFUNCTION(CallInEditor, BlueprintCallable, Category = "Source")
+		bool ReloadSourceFile();
+
+	virtual void PostLoad() override;
+	virtual void BeginDestroy() override;
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+private:
+	// polls SourceFile's time stamp while it is set
+	void UpdateSourceWatch();
+	bool CheckSourceFile(float DeltaTime);
+
+	FDelegateHandle SourceWatch;
+	FDateTime SourceTimeStamp;
+};
@@ -0,0 +1,322 @@
+#include "VehicleFleetManager.h"
+
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Vehicle4WActor.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "../../Intermediate/ProjectFiles/Trajectory.hpp"
+#if PLATFORM_WINDOWS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+// Sets default values
+AVehicleFleetManager::AVehicleFleetManager() {
+    PrimaryActorTick.bCanEverTick = true;
+
+    WheelInstances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(
+        TEXT("WheelInstances"));
+    WheelInstances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+    WheelInstances->SetMobility(EComponentMobility::Movable);
+    RootComponent = WheelInstances;
+}
+
+void AVehicleFleetManager::BeginPlay() {
+    Super::BeginPlay();
+
+    Stepper = FixedStepper(FixedDeltaTime, MaxSubsteps);
+
+    Lod = FleetLod(LodFullDistance, LodRigidDistance);
+    fleet.set_far_interval(LodFarInterval);
+    fleet.set_sleep(SleepSteps, SleepVelocity);
+
+    if (WheelMesh) {
+        WheelInstances->SetStaticMesh(WheelMesh);
+        WheelMeshRadius =
+            FMath::Max(WheelMesh->GetBounds().SphereRadius, KINDA_SMALL_NUMBER);
+    }
+
+    if (bRecordTrajectory) {
+        FString Path = FPaths::ProjectSavedDir() / TrajectoryFile;
+        IFileManager::Get().MakeDirectory(*FPaths::GetPath(Path), true);
+        Recorder = new TrajectoryRecorder();
+        if (!Recorder->open(TCHAR_TO_UTF8(*Path), (uint32)MaxRecordedVehicles,
+                            Stepper.get_step(),
+                            bRecordRenderStateOnly ? TRAJECTORY_RENDER_COLUMNS
+                                                   : TRAJECTORY_ALL_COLUMNS)) {
+            UE_LOG(LogTemp, Warning, TEXT("%s: cannot record to %s"),
+                   *GetName(), *Path);
+            delete Recorder;
+            Recorder = nullptr;
+        }
+    }
+}
+
+void AVehicleFleetManager::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+    delete Recorder;
+    Recorder = nullptr;
+
+    Super::EndPlay(EndPlayReason);
+}
+
+int32 AVehicleFleetManager::AddVehicle(AVehicle4WActor* Vehicle,
+                                       const VehicleArchetype& archetype,
+                                       Vector3f location,
+                                       Quaternionf quat,
+                                       Vector3f linear_velocity,
+                                       Vector3f angular_velocity) {
+    int32 Handle = fleet.add_vehicle(archetype, location, quat,
+                                     linear_velocity, angular_velocity);
+    Vehicles.Add(Vehicle);
+    Handles.Add(Handle);
+    PreviousStates.Add(fleet.get_render_state(Handle));
+    CurrentStates.Add(fleet.get_render_state(Handle));
+    SubmittedSweeps.Add(FLEET_WHEEL_COUNT);
+    bSettled.Add(false);
+    if (WheelMesh) {
+        // every transform is rewritten each frame, so instances need not
+        // follow their vehicle around
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            WheelInstances->AddInstance(FTransform::Identity);
+        }
+    }
+    AsyncSweeps.Reset(Vehicles.Num() * FLEET_WHEEL_COUNT,
+                      GroundQueryDelayFrames);
+    return Handle;
+}
+
+void AVehicleFleetManager::RemoveVehicle(AVehicle4WActor* Vehicle,
+                                         int32 Handle) {
+    int32 Index = Vehicles.Find(Vehicle);
+    if (Index == INDEX_NONE) {
+        return;
+    }
+    Vehicles.RemoveAtSwap(Index);
+    Handles.RemoveAtSwap(Index);
+    PreviousStates.RemoveAtSwap(Index);
+    CurrentStates.RemoveAtSwap(Index);
+    SubmittedSweeps.RemoveAtSwap(Index);
+    bSettled.RemoveAtSwap(Index);
+    if (Index < bSettled.Num()) {
+        // its wheel instances still show the removed vehicle
+        bSettled[Index] = false;
+    }
+    if (WheelMesh) {
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            WheelInstances->RemoveInstance(
+                WheelInstances->GetInstanceCount() - 1);
+        }
+    }
+    fleet.remove_vehicle(Handle);
+    AsyncSweeps.Reset(Vehicles.Num() * FLEET_WHEEL_COUNT,
+                      GroundQueryDelayFrames);
+}
+
+void AVehicleFleetManager::QueueCommand(int32 Handle,
+                                        float Throttle,
+                                        float Brake,
+                                        float Steer) {
+    Commands.push(Handle, fleet.get_time(), Throttle, Brake, Steer);
+}
+
+void AVehicleFleetManager::WakeVehiclesNear(FVector Location, float Radius) {
+    fleet.wake_near(FVector2Eigen(Location), Radius);
+}
+
+static bool IsSameState(const VehicleRenderState& A,
+                        const VehicleRenderState& B) {
+    bool bSame = A.body_location == B.body_location &&
+                 A.quat.coeffs() == B.quat.coeffs();
+    for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+        bSame = bSame && A.wheel_location[i] == B.wheel_location[i];
+    }
+    return bSame;
+}
+
+// Called every frame
+void AVehicleFleetManager::Tick(float DeltaTime) {
+    Super::Tick(DeltaTime);
+
+    // sweep; async results are only used once the whole fleet has them, and
+    // then serve every step of this frame
+    bool bAsync = GroundQueryDelayFrames > 0;
+    if (bAsync) {
+        AsyncSweeps.Collect(GetWorld());
+    }
+    bool bUseAsync = bAsync && AsyncSweeps.IsReady();
+
+    // this frame's input, all vehicles in one batch
+    fleet.submit(Commands);
+
+    if (bSimulationLod) {
+        UpdateLod();
+    }
+
+    int32 Steps = bFixedStep ? Stepper.advance(DeltaTime) : 1;
+    float StepTime = bFixedStep ? Stepper.get_step() : DeltaTime;
+    for (int32 Step = 0; Step < Steps; Step++) {
+        for (int32 v = 0; v < Vehicles.Num(); v++) {
+            PreviousStates[v] = CurrentStates[v];
+        }
+        SweepWheels(bUseAsync);
+        StepFleet(StepTime);
+        if (Recorder && Recorder->begin_frame()) {
+            Recorder->record(fleet);
+            Recorder->end_frame();
+        }
+        for (int32 v = 0; v < Vehicles.Num(); v++) {
+            CurrentStates[v] = fleet.get_render_state(Handles[v]);
+        }
+    }
+
+    UpdateTransforms();
+
+    // queries for the next step, all vehicles in one batch; vehicles below
+    // full detail use their first slot for the probe
+    if (bAsync) {
+        for (int32 v = 0; v < Vehicles.Num(); v++) {
+            int32 Handle = Handles[v];
+            float radius = fleet.get_wheel_radius(Handle);
+            FQuat rotation = Vehicles[v]->GetActorRotation().Quaternion();
+            bool bProbe = fleet.get_lod(Handle) != VEHICLE_LOD_FULL;
+            SubmittedSweeps[v] = bProbe ? 1 : FLEET_WHEEL_COUNT;
+            if (bProbe) {
+                AsyncSweeps.Submit(
+                    GetWorld(), v * FLEET_WHEEL_COUNT,
+                    Eigen2FVector(fleet.get_ground_probe(Handle)), radius,
+                    rotation);
+                continue;
+            }
+            for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+                AsyncSweeps.Submit(
+                    GetWorld(), v * FLEET_WHEEL_COUNT + i,
+                    Eigen2FVector(fleet.get_wheel_location(Handle, i)),
+                    radius, rotation);
+            }
+        }
+    }
+}
+
+void AVehicleFleetManager::UpdateTransforms() {
+    bool bInstanced = WheelMesh != nullptr;
+    WheelTransforms.SetNum(bInstanced ? Vehicles.Num() * FLEET_WHEEL_COUNT : 0,
+                           false);
+    for (int32 v = 0; v < Vehicles.Num(); v++) {
+        // a sleeping vehicle is written back once more after its last step
+        // has been blended in, then left alone
+        bool bAsleep = fleet.is_asleep(Handles[v]);
+        if (bAsleep && bSettled[v]) {
+            continue;
+        }
+        bSettled[v] =
+            bAsleep && IsSameState(PreviousStates[v], CurrentStates[v]);
+
+        VehicleRenderState State =
+            bFixedStep ? interpolate(PreviousStates[v], CurrentStates[v],
+                                     Stepper.get_alpha())
+                       : CurrentStates[v];
+        Vehicles[v]->UpdateComponents(State, !bInstanced);
+        if (bInstanced) {
+            // the vehicle's root carries the rotation just written
+            FTransform Root = Vehicles[v]->GetActorTransform();
+            FVector Scale(fleet.get_wheel_radius(Handles[v]) /
+                          WheelMeshRadius);
+            for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+                WheelTransforms[v * FLEET_WHEEL_COUNT + i] = FTransform(
+                    Root.GetRotation(),
+                    Root.TransformPosition(
+                        Eigen2FVector(State.wheel_location[i])),
+                    Scale);
+            }
+        }
+    }
+
+    if (bInstanced && WheelTransforms.Num() > 0) {
+        INSTRUMENT_SCOPE(INSTRUMENT_WRITE_BACK);
+        WheelInstances->BatchUpdateInstancesTransforms(
+            0, WheelTransforms, true, true, true);
+    }
+}
+
+void AVehicleFleetManager::UpdateLod() {
+    Viewers.Reset();
+    for (FConstPlayerControllerIterator It =
+             GetWorld()->GetPlayerControllerIterator();
+         It; ++It) {
+        APlayerController* Controller = It->Get();
+        if (Controller && Controller->PlayerCameraManager) {
+            Viewers.Add(FVector2Eigen(
+                Controller->PlayerCameraManager->GetCameraLocation()));
+        }
+    }
+    // rendering lags a frame behind, so allow a little slack
+    for (int32 v = 0; v < Vehicles.Num(); v++) {
+        Lod.set_hidden(Handles[v], !Vehicles[v]->WasRecentlyRendered(0.2f));
+    }
+    Lod.update(fleet, Viewers.GetData(), (size_t)Viewers.Num());
+}
+
+void AVehicleFleetManager::SweepWheels(bool bUseAsync) {
+    INSTRUMENT_SCOPE(INSTRUMENT_SWEEP);
+    FVector location, impact_point;
+    for (int32 v = 0; v < Vehicles.Num(); v++) {
+        int32 Handle = Handles[v];
+        float radius = fleet.get_wheel_radius(Handle);
+        int Queries = fleet.ground_queries(Handle);
+        INSTRUMENT_COUNT(INSTRUMENT_WHEEL_SWEEPS, Queries);
+        if (Queries == 0) {
+            continue;
+        }
+        // promoted since the submission: its other slots hold nothing
+        bool bAsyncHits = bUseAsync && SubmittedSweeps[v] >= Queries;
+        if (Queries == 1) {
+            // one probe from the centre of the wheels grounds all four
+            location = Eigen2FVector(fleet.get_ground_probe(Handle));
+            bool bHasHit =
+                bAsyncHits
+                    ? AsyncSweeps.GetHit(v * FLEET_WHEEL_COUNT, location,
+                                         radius, impact_point)
+                    : Vehicles[v]->SweepWheel(location, radius, impact_point);
+            Vector3f hit_point = FVector2Eigen(impact_point);
+            for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+                fleet.set_hit_point(Handle, i, bHasHit ? &hit_point : nullptr);
+            }
+            continue;
+        }
+        for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+            location = Eigen2FVector(fleet.get_wheel_location(Handle, i));
+            bool bHasHit =
+                bAsyncHits
+                    ? AsyncSweeps.GetHit(v * FLEET_WHEEL_COUNT + i, location,
+                                         radius, impact_point)
+                    : Vehicles[v]->SweepWheel(location, radius, impact_point);
+            if (bHasHit) {
+                INSTRUMENT_COUNT(INSTRUMENT_WHEEL_HITS, 1);
+                Vector3f hit_point = FVector2Eigen(impact_point);
+                fleet.set_hit_point(Handle, i, &hit_point);
+            } else {
+                fleet.set_hit_point(Handle, i, nullptr);
+            }
+        }
+    }
+}
+
+void AVehicleFleetManager::StepFleet(float StepTime) {
+    if (bParallelStep) {
+        size_t chunk_size = (size_t)ChunkSize;
+        ParallelFor((int32)fleet.chunk_count(chunk_size),
+                    [this, chunk_size, StepTime](int32 Chunk) {
+                        fleet.apply_chunk((size_t)Chunk, chunk_size,
+                                          StepTime);
+                    });
+        fleet.advance_time(StepTime);
+    } else {
+        fleet.apply(StepTime);
+    }
+}
@@ -0,0 +1,204 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "../../Intermediate/ProjectFiles/FleetLod.hpp"
+#include "AsyncWheelSweeps.h"
+// last
+#include "VehicleFleetManager.generated.h"
+
+class AVehicle4WActor;
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+class TrajectoryRecorder;
+
+// Steps every registered AVehicle4WActor from a single tick. Vehicles find
+// the manager in BeginPlay, register their initial state and disable their
+// own tick; the manager then sweeps all wheels, advances the whole fleet in
+// fixed steps and writes the interpolated transforms back.
+UCLASS()
+class VEHICLE4WSIMULATOR_API AVehicleFleetManager : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	AVehicleFleetManager();
+
+	// Called every frame
+	virtual void Tick(float DeltaTime) override;
+
+protected:
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+	// Called when the manager is destroyed or the level ends
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+
+	int32 AddVehicle(AVehicle4WActor* Vehicle,
+					 const VehicleArchetype& archetype,
+					 Vector3f location,
+					 Quaternionf quat,
+					 Vector3f linear_velocity,
+					 Vector3f angular_velocity);
+
+	// Rebinds the vehicle of Handle, e.g. after its archetype was edited
+	void SetVehicleArchetype(int32 Handle, const VehicleArchetype& archetype) { fleet.set_archetype(Handle, archetype); }
+
+	void RemoveVehicle(AVehicle4WActor* Vehicle, int32 Handle);
+
+	FleetSimulator& GetFleet() { return fleet; }
+
+	// Length of the steps the fleet advances by
+	float GetStepTime() const { return Stepper.get_step(); }
+
+	// Queues an analog command for the vehicle of Handle, effective from the
+	// next step; everything queued in a frame reaches the fleet in one batch
+	void QueueCommand(int32 Handle, float Throttle, float Brake, float Steer);
+
+	// Wakes the sleeping vehicle of Handle, e.g. after something outside the
+	// simulation pushed it
+	void WakeVehicle(int32 Handle) { fleet.wake(Handle); }
+
+	// Wakes the sleeping vehicles within Radius of Location; call when the
+	// ground there changes
+	UFUNCTION(BlueprintCallable, Category = "Sleep")
+		void WakeVehiclesNear(FVector Location, float Radius);
+
+	// Step chunks of the fleet on the task graph
+	UPROPERTY(EditAnywhere, Category = "Fleet")
+		bool bParallelStep = true;
+
+	// Vehicles per parallel chunk
+	UPROPERTY(EditAnywhere, Category = "Fleet", meta = (ClampMin = "16"))
+		int32 ChunkSize = FLEET_DEFAULT_CHUNK;
+
+	// Frames between submitting the fleet's wheel sweeps and using their
+	// results; 0 sweeps synchronously inside Tick
+	UPROPERTY(EditAnywhere, Category = "Fleet", meta = (ClampMin = "0"))
+		int32 GroundQueryDelayFrames = 1;
+
+	// Step the fleet in fixed FixedDeltaTime steps and interpolate the
+	// components between the last two; off passes DeltaTime straight through
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+		bool bFixedStep = true;
+
+	// Length of one simulation step
+	UPROPERTY(EditAnywhere, Category = "Simulation", meta = (ClampMin = "0.001"))
+		float FixedDeltaTime = FIXED_STEP_DELTA_TIME;
+
+	// Steps per frame before time is dropped, so a hitch cannot snowball
+	UPROPERTY(EditAnywhere, Category = "Simulation", meta = (ClampMin = "1"))
+		int32 MaxSubsteps = FIXED_STEP_MAX_STEPS;
+
+	// Simulate vehicles by distance to the nearest player camera: full
+	// detail up close, one rigid body with a single ground sweep further
+	// out, and only every LodFarInterval steps beyond that or when not
+	// rendered
+	UPROPERTY(EditAnywhere, Category = "LOD")
+		bool bSimulationLod = false;
+
+	UPROPERTY(EditAnywhere, Category = "LOD", meta = (ClampMin = "0"))
+		float LodFullDistance = FLEET_LOD_FULL_DISTANCE;
+
+	UPROPERTY(EditAnywhere, Category = "LOD", meta = (ClampMin = "0"))
+		float LodRigidDistance = FLEET_LOD_RIGID_DISTANCE;
+
+	// Steps between two steps of a far vehicle; 0 leaves far vehicles
+	// dormant until a camera comes close
+	UPROPERTY(EditAnywhere, Category = "LOD", meta = (ClampMin = "0"))
+		int32 LodFarInterval = FLEET_FAR_INTERVAL;
+
+	// Steps a vehicle must rest for before it falls asleep and is neither
+	// stepped, swept nor written back until input or a wake call; 0 keeps
+	// every vehicle awake
+	UPROPERTY(EditAnywhere, Category = "Sleep", meta = (ClampMin = "0"))
+		int32 SleepSteps = FLEET_SLEEP_STEPS;
+
+	// Speed of the wheels below which a vehicle counts as resting
+	UPROPERTY(EditAnywhere, Category = "Sleep", meta = (ClampMin = "0"))
+		float SleepVelocity = FLEET_SLEEP_VELOCITY;
+
+	// Append every fleet step to TrajectoryFile, one slot per fleet index
+	UPROPERTY(EditAnywhere, Category = "Trajectory")
+		bool bRecordTrajectory = false;
+
+	// Relative to the project's Saved directory
+	UPROPERTY(EditAnywhere, Category = "Trajectory")
+		FString TrajectoryFile = TEXT("Trajectories/Fleet.traj");
+
+	// Slots in the file; vehicles past them are not recorded
+	UPROPERTY(EditAnywhere, Category = "Trajectory", meta = (ClampMin = "1"))
+		int32 MaxRecordedVehicles = 1024;
+
+	// Record only what replay needs (locations and wheel rotation) instead
+	// of velocities, forces and hit points too, at less than half the size
+	UPROPERTY(EditAnywhere, Category = "Trajectory")
+		bool bRecordRenderStateOnly = false;
+
+	// Draws every wheel of the fleet as an instance of this mesh, scaled to
+	// the wheel radius, and updates them all in one batch per frame; the
+	// vehicles' wheel components are then no longer moved
+	UPROPERTY(EditAnywhere, Category = "Rendering")
+		UStaticMesh* WheelMesh = nullptr;
+
+private:
+	// writes the interpolated states of this frame to the vehicles
+	void UpdateTransforms();
+
+	// re-tiers the fleet for this frame's cameras
+	void UpdateLod();
+
+	// sweeps every wheel and advances the fleet by one step
+	void SweepWheels(bool bUseAsync);
+	void StepFleet(float StepTime);
+
+	UPROPERTY(VisibleAnywhere)
+		TArray<AVehicle4WActor*> Vehicles;
+
+	// instance Vehicles index * FLEET_WHEEL_COUNT + wheel, with WheelMesh
+	UPROPERTY(VisibleAnywhere)
+		UInstancedStaticMeshComponent* WheelInstances;
+
+	// world transforms of the wheel instances, kept between frames
+	TArray<FTransform> WheelTransforms;
+
+	// sphere radius of WheelMesh's bounds
+	float WheelMeshRadius = 1.f;
+
+	// fleet handle of Vehicles[i]
+	TArray<int32> Handles;
+
+	FleetSimulator fleet;
+
+	FleetLod Lod;
+
+	// player camera locations, gathered every frame
+	TArray<Vector3f> Viewers;
+
+	// commands queued since the last submission, by fleet handle
+	VehicleCommandBuffer Commands;
+
+	// indexed by Vehicles index * FLEET_WHEEL_COUNT + wheel; reset whenever
+	// the vehicle set changes
+	FAsyncWheelSweeps AsyncSweeps;
+
+	// sweeps submitted for Vehicles[i] last frame, 1 below full detail
+	TArray<uint8> SubmittedSweeps;
+
+	FixedStepper Stepper;
+
+	// open while recording
+	TrajectoryRecorder* Recorder = nullptr;
+
+	// state of Vehicles[i] before and after the last step
+	TArray<VehicleRenderState> PreviousStates;
+	TArray<VehicleRenderState> CurrentStates;
+
+	// Vehicles[i] is asleep and its components show where it stopped
+	TArray<bool> bSettled;
+};
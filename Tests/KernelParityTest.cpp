@@ -0,0 +1,335 @@
+// Checks the SIMD kernels against the scalar path, run by ctest (see
+// Headless/CMakeLists.txt).
+//
+//   kernel_parity_test fleet <scenario>
+//   kernel_parity_test tire
+//
+// fleet steps one FleetSimulator per kernel level through the scenario in
+// lockstep and compares every body, wheel and wheel state column after each
+// frame. tire runs tire_forces() at each level over batches of random
+// wheels, many of them on the edges of its clamps: speeds at min_speed,
+// wheels in the air or with a load whose force is about TIRE_MIN_FORCE, and
+// brakes that stop the wheel. Levels the CPU cannot run are skipped. A value
+// matches when it is within FLEET_KERNEL_TOLERANCE of the scalar one,
+// relative to its magnitude or to 1 for smaller values.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../Headless/Runner.hpp"
+#include "TireModel.hpp"
+
+// mismatches printed before giving up on the rest
+#define PARITY_REPORTED 10
+#define TIRE_PARITY_BATCHES 200
+// not a multiple of eight or four, so every variant runs its tail
+#define TIRE_PARITY_WHEELS 1003
+#define TIRE_PARITY_DELTA_TIME 0.016f
+
+static const char* level_name(FleetKernelLevel level) {
+    static const char* names[] = {"scalar", "sse2", "avx2"};
+    return names[level];
+}
+
+static bool within_tolerance(float expected, float actual) {
+    float error = fabs(actual - expected);
+    return error <= FLEET_KERNEL_TOLERANCE * max(fabs(expected), 1.f);
+}
+
+// the columns of fleet that the kernels feed, named for the report
+static void fleet_columns(FleetSimulator& fleet,
+                          vector<FloatColumn*>* columns,
+                          vector<string>* names) {
+    static const char* particle[] = {"mass", "x",  "y",  "z",  "vx", "vy",
+                                     "vz",   "fx", "fy", "fz", "wx", "wy",
+                                     "wz",   "qw", "qx", "qy", "qz"};
+    size_t c = 0;
+    fleet.get_bodies().for_each_column([&](FloatColumn& column) {
+        columns->push_back(&column);
+        names->push_back(string("body ") + particle[c++]);
+    });
+    c = 0;
+    fleet.get_wheels().for_each_column([&](FloatColumn& column) {
+        columns->push_back(&column);
+        names->push_back(string("wheel ") + particle[c++]);
+    });
+    WheelColumns& state = fleet.get_wheel_state();
+    FloatColumn* wheel_state[] = {&state.normal_length, &state.hit_x,
+                                  &state.hit_y, &state.hit_z};
+    const char* wheel_state_names[] = {"normal_length", "hit_x", "hit_y",
+                                       "hit_z"};
+    for (int k = 0; k < 4; k++) {
+        columns->push_back(wheel_state[k]);
+        names->push_back(string("wheel ") + wheel_state_names[k]);
+    }
+}
+
+// number of values of fleet off the scalar one
+static long compare_fleets(FleetSimulator& scalar,
+                           FleetSimulator& fleet,
+                           int frame,
+                           long reported) {
+    vector<FloatColumn*> expected, actual;
+    vector<string> names, unused;
+    fleet_columns(scalar, &expected, &names);
+    fleet_columns(fleet, &actual, &unused);
+    long mismatches = 0;
+    for (size_t c = 0; c < expected.size(); c++) {
+        const FloatColumn& want = *expected[c];
+        const FloatColumn& got = *actual[c];
+        for (size_t i = 0; i < want.size(); i++) {
+            if (within_tolerance(want[i], got[i]))
+                continue;
+            if (reported + mismatches++ < PARITY_REPORTED) {
+                printf("%s, frame %d, %s[%zu]: %.9g, scalar %.9g\n",
+                       level_name(fleet.get_kernel_level()), frame,
+                       names[c].c_str(), i, got[i], want[i]);
+            }
+        }
+    }
+    return mismatches;
+}
+
+static int check_fleet(const Scenario& scenario, const GroundQuery& ground) {
+    FleetKernelLevel detected = detect_fleet_kernel_level();
+    VehicleArchetype archetype(scenario.vehicle);
+    vector<unique_ptr<FleetSimulator>> fleets;
+    for (int level = FLEET_KERNEL_SCALAR; level <= FLEET_KERNEL_AVX2;
+         level++) {
+        if (level > detected) {
+            printf("%s: not supported on this CPU, skipped\n",
+                   level_name((FleetKernelLevel)level));
+            continue;
+        }
+        fleets.emplace_back(new FleetSimulator());
+        FleetSimulator& fleet = *fleets.back();
+        fleet.set_kernel_level((FleetKernelLevel)level);
+        for (int v = 0; v < scenario.vehicles; v++) {
+            fleet.add_vehicle(archetype, scenario.vehicle_location(v),
+                              Quaternionf::Identity(),
+                              scenario.linear_velocity, Vector3f::Zero());
+        }
+        VehicleCommandBuffer batch;
+        submit_drives(scenario, [&](int v, const VehicleCommand& command) {
+            batch.push(v, command);
+        });
+        fleet.submit(batch);
+    }
+
+    vector<size_t> next(fleets.size(), 0);
+    long mismatches = 0;
+    for (int frame = 0; frame < scenario.frames; frame++) {
+        for (size_t f = 0; f < fleets.size(); f++) {
+            FleetSimulator& fleet = *fleets[f];
+            dispatch_inputs(
+                scenario, frame, &next[f],
+                [&](int v, bool forward) { fleet.move(v, forward); },
+                [&](int v, bool left) { fleet.turn(v, left); });
+            fleet.query_ground(ground);
+            fleet.apply(scenario.delta_time);
+        }
+        for (size_t f = 1; f < fleets.size(); f++) {
+            mismatches +=
+                compare_fleets(*fleets[0], *fleets[f], frame, mismatches);
+        }
+    }
+    printf("%zu levels, %d frames of %d vehicles, %ld values off\n",
+           fleets.size(), scenario.frames, scenario.vehicles, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// the inputs of one tire_forces() call; outputs are per level
+struct TireBatch {
+    vector<float> compression, compression_rate, grounded;
+    vector<float> vx, vy, hx, hy, drive_torque, spin;
+    TireKernelArgs constants;
+
+    explicit TireBatch(size_t n)
+        : compression(n),
+          compression_rate(n),
+          grounded(n),
+          vx(n),
+          vy(n),
+          hx(n),
+          hy(n),
+          drive_torque(n),
+          spin(n) {}
+};
+
+struct TireOutputs {
+    vector<float> suspension, fx, fy, next_spin;
+
+    explicit TireOutputs(size_t n)
+        : suspension(n), fx(n), fy(n), next_spin(n) {}
+};
+
+static void random_tire_batch(mt19937& random, TireBatch* batch) {
+    uniform_real_distribution<float> unit(0.f, 1.f);
+    auto between = [&](float low, float high) {
+        return low + (high - low) * unit(random);
+    };
+    TireKernelArgs& c = batch->constants;
+    memset(&c, 0, sizeof(c));
+    c.spring_constant = between(1e3f, 5e4f);
+    c.suspension_damping = between(0.f, 2e3f);
+    c.wheel_weight = between(1e3f, 5e4f);
+    c.wheel_radius = between(10.f, 60.f);
+    c.spin_inertia = between(1e3f, 1e5f);
+    c.brake_torque = unit(random) < 0.5f ? 0.f : between(0.f, 3e7f);
+    c.tire_stiffness = between(1.f, 20.f);
+    c.tire_shape = between(0.5f, 2.f);
+    c.tire_grip = between(0.5f, 1.5f);
+    c.min_speed = tire_min_speed(980.f, c.tire_grip, c.tire_stiffness,
+                                 c.tire_shape, TIRE_PARITY_DELTA_TIME);
+
+    for (size_t i = 0; i < batch->vx.size(); i++) {
+        float heading = between(-3.1416f, 3.1416f);
+        batch->hx[i] = cos(heading);
+        batch->hy[i] = sin(heading);
+        batch->compression[i] = between(-5.f, 10.f);
+        batch->compression_rate[i] = between(-100.f, 100.f);
+        batch->grounded[i] = 1.f;
+        batch->vx[i] = between(-3000.f, 3000.f);
+        batch->vy[i] = between(-3000.f, 3000.f);
+        batch->drive_torque[i] = between(-1e7f, 1e7f);
+        batch->spin[i] = between(-100.f, 100.f);
+
+        float speed = c.min_speed;
+        switch (i % 8) {
+            case 1:
+                // rolling at exactly min_speed, or either side of it
+                speed = i % 3 == 0   ? c.min_speed
+                        : i % 3 == 1 ? nextafter(c.min_speed, 0.f)
+                                     : nextafter(c.min_speed, 1e9f);
+                batch->hx[i] = 1.f;
+                batch->hy[i] = 0.f;
+                batch->vx[i] = i % 2 ? speed : -speed;
+                batch->vy[i] = between(-speed, speed);
+                break;
+            case 2:
+                // standing
+                batch->vx[i] = batch->vy[i] = batch->spin[i] = 0.f;
+                batch->compression_rate[i] = 0.f;
+                break;
+            case 3:
+                batch->grounded[i] = 0.f;
+                break;
+            case 4:
+                // a peak force about TIRE_MIN_FORCE
+                batch->compression_rate[i] = 0.f;
+                batch->compression[i] =
+                    (between(0.5f, 2.f) * TIRE_MIN_FORCE / c.tire_grip -
+                     c.wheel_weight) /
+                    c.spring_constant;
+                break;
+            case 5:
+                // pulled off the ground by the suspension
+                batch->compression[i] = -2.f * c.wheel_weight /
+                                        c.spring_constant;
+                break;
+            case 6:
+                // slow spin the brake can stop within the step
+                batch->spin[i] = between(-1e-3f, 1e-3f);
+                break;
+            case 7:
+                // slip at the edge of tire_atan's two ranges
+                batch->hx[i] = 1.f;
+                batch->hy[i] = 0.f;
+                batch->vy[i] = 0.f;
+                speed = max(abs(batch->vx[i]), c.min_speed);
+                batch->spin[i] = (batch->vx[i] + speed / c.tire_stiffness) /
+                                 c.wheel_radius;
+                break;
+        }
+    }
+}
+
+static TireKernelArgs tire_args(TireBatch& batch, TireOutputs& outputs) {
+    TireKernelArgs a = batch.constants;
+    a.compression = batch.compression.data();
+    a.compression_rate = batch.compression_rate.data();
+    a.grounded = batch.grounded.data();
+    a.vx = batch.vx.data();
+    a.vy = batch.vy.data();
+    a.hx = batch.hx.data();
+    a.hy = batch.hy.data();
+    a.drive_torque = batch.drive_torque.data();
+    a.spin = batch.spin.data();
+    a.suspension = outputs.suspension.data();
+    a.fx = outputs.fx.data();
+    a.fy = outputs.fy.data();
+    a.next_spin = outputs.next_spin.data();
+    return a;
+}
+
+static int check_tires() {
+    FleetKernelLevel detected = detect_fleet_kernel_level();
+    for (int level = FLEET_KERNEL_SSE2; level <= FLEET_KERNEL_AVX2; level++) {
+        if (level > detected) {
+            printf("%s: not supported on this CPU, skipped\n",
+                   level_name((FleetKernelLevel)level));
+        }
+    }
+
+    mt19937 random(1);
+    TireBatch batch(TIRE_PARITY_WHEELS);
+    TireOutputs expected(TIRE_PARITY_WHEELS), actual(TIRE_PARITY_WHEELS);
+    long mismatches = 0;
+    for (int b = 0; b < TIRE_PARITY_BATCHES; b++) {
+        random_tire_batch(random, &batch);
+        tire_forces_scalar(tire_args(batch, expected), 0, TIRE_PARITY_WHEELS,
+                           TIRE_PARITY_DELTA_TIME);
+        for (int level = FLEET_KERNEL_SSE2; level <= detected; level++) {
+            tire_forces((FleetKernelLevel)level, tire_args(batch, actual), 0,
+                        TIRE_PARITY_WHEELS, TIRE_PARITY_DELTA_TIME);
+            const vector<float>* want[] = {&expected.suspension, &expected.fx,
+                                           &expected.fy, &expected.next_spin};
+            const vector<float>* got[] = {&actual.suspension, &actual.fx,
+                                          &actual.fy, &actual.next_spin};
+            const char* names[] = {"suspension", "fx", "fy", "next_spin"};
+            for (int c = 0; c < 4; c++) {
+                for (size_t i = 0; i < TIRE_PARITY_WHEELS; i++) {
+                    if (within_tolerance((*want[c])[i], (*got[c])[i]))
+                        continue;
+                    if (mismatches++ < PARITY_REPORTED) {
+                        printf("%s, batch %d, %s[%zu]: %.9g, scalar %.9g\n",
+                               level_name((FleetKernelLevel)level), b,
+                               names[c], i, (*got[c])[i], (*want[c])[i]);
+                    }
+                }
+            }
+        }
+    }
+    printf("%d levels, %d batches of %d wheels, %ld values off\n",
+           detected + 1, TIRE_PARITY_BATCHES, TIRE_PARITY_WHEELS, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && !strcmp(argv[1], "tire"))
+        return check_tires();
+    if (argc != 3 || strcmp(argv[1], "fleet")) {
+        fprintf(stderr,
+                "usage: kernel_parity_test fleet <scenario>\n"
+                "       kernel_parity_test tire\n");
+        return 1;
+    }
+
+    try {
+        Scenario scenario = ScenarioParser().parse(argv[2]);
+        if (scenario.vehicle.wheel_count != FLEET_WHEEL_COUNT ||
+            scenario.trailer || scenario.vehicle.tire_model)
+            throw runtime_error("fleet mode runs four-wheel vehicles "
+                                "without trailers or the tire model");
+        unique_ptr<GroundQuery> ground = make_ground(scenario);
+        return check_fleet(scenario, *ground);
+    } catch (const exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,449 @@
+// Regression harness for the simulator core, run by ctest (see
+// Headless/CMakeLists.txt) on the canonical scenarios in Tests/scenarios.
+//
+//   regression_test <scenario> --golden FILE [--mode fleet|vehicle]
+//                   [--update]
+//   regression_test <scenario> --timing FILE [--mode fleet|vehicle]
+//                   [--slack S] [--record-baseline]
+//
+// --golden records the run to <scenario name>.traj in the working directory
+// (readable with vehicle4w_trajectory), samples it and compares the samples
+// with FILE: body location and velocity, rotation and wheel locations of up
+// to GOLDEN_VEHICLES vehicles at GOLDEN_SAMPLES frames. A value matches when
+// it is within the file's tolerance, absolute plus relative. --update rewrites
+// FILE from the run, keeping its tolerance; do so only for changes meant to
+// alter behavior, and say why in the commit.
+//
+// --timing reruns the scenario unrecorded and compares the best steps/s of
+// TIMING_SAMPLES samples with the scenario's line in FILE, failing below
+// (1 - slack) of it, or when FILE has no line for the scenario.
+// --record-baseline writes the line instead. Baselines belong to one
+// machine and build: record them on a quiet machine, and keep FILE with the
+// build or check it in per machine.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../Headless/Runner.hpp"
+
+#define GOLDEN_VERSION 1
+#define GOLDEN_SAMPLES 30
+#define GOLDEN_VEHICLES 16
+// per sample: body location, body velocity, rotation, four wheel locations
+#define GOLDEN_VALUES 22
+#define GOLDEN_ABS_TOLERANCE 1e-2f
+#define GOLDEN_REL_TOLERANCE 1e-4f
+// mismatches printed before giving up on the rest
+#define GOLDEN_REPORTED 10
+
+#define TIMING_SAMPLES 3
+// each sample repeats the scenario for at least this long
+#define TIMING_SAMPLE_SECONDS 0.25
+#define TIMING_SLACK 0.3
+
+struct Options {
+    string scenario;
+    string mode;
+    string golden;
+    string timing;
+    float slack;
+    bool update;
+    bool record_baseline;
+
+    Options()
+        : mode("vehicle"),
+          slack(TIMING_SLACK),
+          update(false),
+          record_baseline(false) {}
+};
+
+struct GoldenSample {
+    long frame;
+    long vehicle;
+    float values[GOLDEN_VALUES];
+};
+
+struct Golden {
+    float abs_tolerance;
+    float rel_tolerance;
+    vector<GoldenSample> samples;
+
+    Golden()
+        : abs_tolerance(GOLDEN_ABS_TOLERANCE),
+          rel_tolerance(GOLDEN_REL_TOLERANCE) {}
+};
+
+static void usage() {
+    fprintf(stderr,
+            "usage: regression_test <scenario> --golden FILE [--update]\n"
+            "       regression_test <scenario> --timing FILE [--slack S] "
+            "[--record-baseline]\n"
+            "       [--mode fleet|vehicle]\n");
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    for (int k = 1; k < argc; k++) {
+        const char* arg = argv[k];
+        if (arg[0] != '-') {
+            if (!options->scenario.empty())
+                return false;
+            options->scenario = arg;
+            continue;
+        }
+        if (!strcmp(arg, "--update")) {
+            options->update = true;
+            continue;
+        }
+        if (!strcmp(arg, "--record-baseline")) {
+            options->record_baseline = true;
+            continue;
+        }
+        if (k + 1 >= argc)
+            return false;
+        const char* value = argv[++k];
+        if (!strcmp(arg, "--mode")) {
+            options->mode = value;
+            if (options->mode != "fleet" && options->mode != "vehicle")
+                return false;
+        } else if (!strcmp(arg, "--golden")) {
+            options->golden = value;
+        } else if (!strcmp(arg, "--timing")) {
+            options->timing = value;
+        } else if (!strcmp(arg, "--slack")) {
+            options->slack = (float)atof(value);
+        } else {
+            return false;
+        }
+    }
+    return !options->scenario.empty() &&
+           options->golden.empty() != options->timing.empty() &&
+           !(options->update && options->golden.empty()) &&
+           !(options->record_baseline && options->timing.empty()) &&
+           options->slack >= 0.f && options->slack < 1.f;
+}
+
+// file name without directory and extension
+static string scenario_name(const string& path) {
+    size_t slash = path.find_last_of("/\\");
+    string name = slash == string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == string::npos ? name : name.substr(0, dot);
+}
+
+static Vector3f run(const Scenario& scenario,
+                    const GroundQuery& ground,
+                    const string& mode,
+                    TrajectoryRecorder* recorder) {
+    if (mode == "fleet") {
+        size_t lod_sizes[VEHICLE_LOD_COUNT];
+        size_t asleep;
+        return run_fleet(scenario, ground, 1, FLEET_DEFAULT_CHUNK, recorder,
+                         lod_sizes, &asleep);
+    }
+    Vector3f trailer;
+    return run_vehicles(scenario, ground, recorder, &trailer);
+}
+
+// the columns the samples read
+static uint64_t golden_columns() {
+    uint64_t mask = 0;
+    for (int c = TRAJECTORY_ORIGIN_X; c <= TRAJECTORY_BODY_VZ; c++)
+        mask |= trajectory_bit((TrajectoryColumn)c);
+    for (int c = TRAJECTORY_WHEEL_X; c <= TRAJECTORY_WHEEL_Z; c++)
+        mask |= trajectory_bit((TrajectoryColumn)c);
+    for (int c = TRAJECTORY_WHEEL_QW; c <= TRAJECTORY_WHEEL_QZ; c++)
+        mask |= trajectory_bit((TrajectoryColumn)c);
+    return mask;
+}
+
+// GOLDEN_SAMPLES frames spread over the run, the last one included, of
+// every vehicle or GOLDEN_VEHICLES spread over the fleet; locations are in
+// world space, whatever origin the simulator keeps them relative to
+static vector<GoldenSample> sample(const TrajectoryReader& reader) {
+    vector<GoldenSample> samples;
+    long frames = (long)reader.get_frame_count();
+    long vehicles = (long)reader.get_vehicle_count();
+    long sampled = min(vehicles, (long)GOLDEN_VEHICLES);
+    for (long s = 1; s <= GOLDEN_SAMPLES && frames > 0; s++) {
+        long frame = s * frames / GOLDEN_SAMPLES - 1;
+        if (frame < 0)
+            continue;
+        for (long k = 0; k < sampled; k++) {
+            GoldenSample sample;
+            sample.frame = frame;
+            sample.vehicle =
+                sampled > 1 ? k * (vehicles - 1) / (sampled - 1) : 0;
+            Vector3f origin = reader.get_vector(TRAJECTORY_ORIGIN_X, frame,
+                                                sample.vehicle);
+            Vector3f body = origin + reader.get_vector(TRAJECTORY_BODY_X,
+                                                       frame, sample.vehicle);
+            Vector3f body_vel =
+                reader.get_vector(TRAJECTORY_BODY_VX, frame, sample.vehicle);
+            // every wheel carries the vehicle's rotation
+            size_t w0 = sample.vehicle * FLEET_WHEEL_COUNT;
+            Quaternionf quat = reader.get_quat(TRAJECTORY_WHEEL_QW, frame, w0);
+            float* values = sample.values;
+            for (int k = 0; k < 3; k++) {
+                values[k] = body(k);
+                values[3 + k] = body_vel(k);
+            }
+            values[6] = quat.w(), values[7] = quat.x();
+            values[8] = quat.y(), values[9] = quat.z();
+            for (int i = 0; i < FLEET_WHEEL_COUNT; i++) {
+                Vector3f wheel =
+                    origin +
+                    reader.get_vector(TRAJECTORY_WHEEL_X, frame, w0 + i);
+                for (int k = 0; k < 3; k++)
+                    values[10 + 3 * i + k] = wheel(k);
+            }
+            samples.push_back(sample);
+        }
+    }
+    return samples;
+}
+
+static bool read_golden(const string& path, Golden* golden) {
+    ifstream file(path.c_str());
+    if (!file)
+        return false;
+    string line, key;
+    int version = 0;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        istringstream in(line);
+        if (!version) {
+            if (!(in >> key >> version) || key != "vehicle4w-golden" ||
+                version != GOLDEN_VERSION)
+                throw runtime_error(path + " is not a version " +
+                                    to_string(GOLDEN_VERSION) +
+                                    " golden file");
+            continue;
+        }
+        if (line.compare(0, 9, "tolerance") == 0) {
+            in >> key >> golden->abs_tolerance >> golden->rel_tolerance;
+            continue;
+        }
+        GoldenSample sample;
+        in >> sample.frame >> sample.vehicle;
+        for (int v = 0; v < GOLDEN_VALUES; v++)
+            in >> sample.values[v];
+        if (!in)
+            throw runtime_error("bad sample in " + path + ": " + line);
+        golden->samples.push_back(sample);
+    }
+    return true;
+}
+
+static void write_golden(const string& path,
+                         const string& scenario,
+                         const string& mode,
+                         const Golden& golden) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file)
+        throw runtime_error("cannot write " + path);
+    fprintf(file,
+            "# %s, %s mode; written by regression_test --update\n"
+            "# frame vehicle body xyz, body velocity xyz, rotation wxyz, "
+            "wheel 0-3 xyz\n"
+            "vehicle4w-golden %d\n"
+            "tolerance %g %g\n",
+            scenario.c_str(), mode.c_str(), GOLDEN_VERSION,
+            golden.abs_tolerance, golden.rel_tolerance);
+    for (const GoldenSample& sample : golden.samples) {
+        fprintf(file, "%ld %ld", sample.frame, sample.vehicle);
+        for (int v = 0; v < GOLDEN_VALUES; v++)
+            fprintf(file, " %.9g", sample.values[v]);
+        fprintf(file, "\n");
+    }
+    fclose(file);
+}
+
+// number of values outside the tolerance, the first few printed
+static long compare(const Golden& golden, const vector<GoldenSample>& run) {
+    static const char* names[GOLDEN_VALUES] = {
+        "body x",     "body y",     "body z",     "body vx",    "body vy",
+        "body vz",    "rotation w", "rotation x", "rotation y", "rotation z",
+        "wheel 0 x",  "wheel 0 y",  "wheel 0 z",  "wheel 1 x",  "wheel 1 y",
+        "wheel 1 z",  "wheel 2 x",  "wheel 2 y",  "wheel 2 z",  "wheel 3 x",
+        "wheel 3 y",  "wheel 3 z"};
+    if (run.size() != golden.samples.size()) {
+        printf("%zu samples, the golden file has %zu\n", run.size(),
+               golden.samples.size());
+        return 1;
+    }
+    long mismatches = 0;
+    float worst = 0.f;
+    for (size_t s = 0; s < run.size(); s++) {
+        const GoldenSample& expected = golden.samples[s];
+        const GoldenSample& actual = run[s];
+        if (actual.frame != expected.frame ||
+            actual.vehicle != expected.vehicle) {
+            printf("sample %zu is frame %ld vehicle %ld, the golden file "
+                   "has frame %ld vehicle %ld\n",
+                   s, actual.frame, actual.vehicle, expected.frame,
+                   expected.vehicle);
+            return mismatches + 1;
+        }
+        for (int v = 0; v < GOLDEN_VALUES; v++) {
+            float want = expected.values[v];
+            float error = fabs(actual.values[v] - want);
+            float allowed =
+                golden.abs_tolerance + golden.rel_tolerance * fabs(want);
+            if (!(error <= allowed)) {
+                if (mismatches++ < GOLDEN_REPORTED) {
+                    printf("frame %ld vehicle %ld %s: %.6g, expected %.6g\n",
+                           actual.frame, actual.vehicle, names[v],
+                           actual.values[v], want);
+                }
+            }
+            if (error > worst || error != error)
+                worst = error;
+        }
+    }
+    printf("%zu samples, largest difference %g\n", run.size(), worst);
+    return mismatches;
+}
+
+static int check_golden(const Options& options,
+                        const Scenario& scenario,
+                        const GroundQuery& ground) {
+    string traj = scenario_name(options.scenario) + ".traj";
+    TrajectoryRecorder recorder;
+    if (!recorder.open(traj.c_str(), scenario.vehicles, scenario.delta_time,
+                       golden_columns()))
+        throw runtime_error("cannot create " + traj);
+    run(scenario, ground, options.mode, &recorder);
+    if (recorder.has_failed())
+        throw runtime_error("cannot record to " + traj);
+    recorder.close();
+
+    TrajectoryReader reader;
+    if (!reader.open(traj.c_str()))
+        throw runtime_error("cannot read back " + traj);
+    vector<GoldenSample> samples = sample(reader);
+
+    Golden golden;
+    bool found = read_golden(options.golden, &golden);
+    if (options.update) {
+        golden.samples = samples;
+        write_golden(options.golden, scenario_name(options.scenario),
+                     options.mode, golden);
+        printf("wrote %zu samples to %s\n", samples.size(),
+               options.golden.c_str());
+        return 0;
+    }
+    if (!found)
+        throw runtime_error("cannot open " + options.golden +
+                            ", write it with --update");
+    long mismatches = compare(golden, samples);
+    if (mismatches) {
+        printf("FAILED: %ld values differ from %s; %s holds the run\n",
+               mismatches, options.golden.c_str(), traj.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// best steps/s of TIMING_SAMPLES samples
+static double measure(const Options& options,
+                      const Scenario& scenario,
+                      const GroundQuery& ground) {
+    TrajectoryRecorder closed;
+    double best = 0.0;
+    for (int s = 0; s < TIMING_SAMPLES; s++) {
+        long steps = 0;
+        double seconds = 0.0;
+        auto start = chrono::steady_clock::now();
+        while (seconds < TIMING_SAMPLE_SECONDS) {
+            run(scenario, ground, options.mode, &closed);
+            steps += scenario.frames;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() -
+                                               start)
+                          .count();
+        }
+        best = max(best, steps / seconds);
+    }
+    return best;
+}
+
+static int check_timing(const Options& options,
+                        const Scenario& scenario,
+                        const GroundQuery& ground) {
+    // scenario name and mode, then steps/s
+    map<string, double> baselines;
+    ifstream in(options.timing.c_str());
+    string key;
+    double value;
+    while (in >> key >> value)
+        baselines[key] = value;
+    in.close();
+
+    key = scenario_name(options.scenario) + "/" + options.mode;
+    map<string, double>::iterator it = baselines.find(key);
+    if (it == baselines.end() && !options.record_baseline) {
+        printf("FAILED: %s has no baseline for %s; record one on this "
+               "machine with --record-baseline\n",
+               options.timing.c_str(), key.c_str());
+        return 1;
+    }
+    double steps = measure(options, scenario, ground);
+    printf("%-24s %12.1f steps/s\n", key.c_str(), steps);
+    if (!options.record_baseline) {
+        double floor = it->second * (1.0 - options.slack);
+        printf("%-24s %12.1f steps/s, failing below %.1f\n", "baseline",
+               it->second, floor);
+        if (steps < floor) {
+            printf("FAILED: %.0f%% slower than the baseline\n",
+                   100.0 * (1.0 - steps / it->second));
+            return 1;
+        }
+        return 0;
+    }
+
+    baselines[key] = steps;
+    FILE* file = fopen(options.timing.c_str(), "w");
+    if (!file)
+        throw runtime_error("cannot write " + options.timing);
+    for (it = baselines.begin(); it != baselines.end(); ++it)
+        fprintf(file, "%s %.1f\n", it->first.c_str(), it->second);
+    fclose(file);
+    printf("recorded the baseline in %s\n", options.timing.c_str());
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 1;
+    }
+
+    try {
+        Scenario scenario = ScenarioParser().parse(options.scenario);
+        if (scenario.vehicle.wheel_count != FLEET_WHEEL_COUNT ||
+            scenario.trailer)
+            throw runtime_error("trajectories hold four-wheel vehicles "
+                                "without trailers");
+        if (options.mode == "fleet" &&
+            (scenario.integrator != INTEGRATOR_SYMPLECTIC_EULER ||
+             scenario.vehicle.tire_model || scenario.contact_tolerance > 0.f))
+            throw runtime_error("the scenario needs vehicle mode");
+        unique_ptr<GroundQuery> ground = make_ground(scenario);
+        return options.golden.empty()
+                   ? check_timing(options, scenario, *ground)
+                   : check_golden(options, scenario, *ground);
+    } catch (const exception& e) {
+        fprintf(stderr, "regression_test: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,221 @@
+// Checks vehicle snapshots, run by ctest (see Headless/CMakeLists.txt).
+//
+//   snapshot_test capacity
+//   snapshot_test rollback
+//
+// capacity saves a vehicle of each simulator type, four-wheel ones in the
+// fixed and the runtime-sized simulator alike, and restores every snapshot
+// into every vehicle. Only the vehicle that wrote a snapshot may take it
+// back, since the others differ in wheel count or in the Wheels that fixes
+// the layout; those must refuse it and keep their state. Each snapshot
+// sits in a buffer of exactly its writer's snapshot_size(), so a restore
+// that reads past it shows up under ASan.
+//
+// rollback records a falling vehicle in a SnapshotRing and rolls it back
+// again and again, counting heap allocations: restoring must not make any.
+// A snapshot of a vehicle of another archetype must be refused until the
+// vehicle is bound to that archetype.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../Headless/Runner.hpp"
+
+#define SNAPSHOT_TEST_DELTA_TIME 0.016f
+#define SNAPSHOT_TEST_FRAMES 10
+#define ROLLBACK_TEST_FRAMES 8
+#define ROLLBACK_TEST_ROUNDS 100
+
+static size_t allocation_count = 0;
+
+void* operator new(size_t size) {
+    allocation_count++;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// GCC pairs the inlined free() with the operator new above and takes the
+// replacements for a mismatch
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+// a simulator of any Wheels, behind the calls the checks make
+struct Subject {
+    string name;
+    size_t snapshot_size;
+    function<void(void*)> save;
+    function<bool(const void*)> restore;
+    function<void()> step;
+    function<Vector3f()> body_location;
+};
+
+template <typename Simulator>
+static Subject make_subject(const string& name,
+                            const VehicleArchetypeDesc& desc,
+                            const Vector3f& location) {
+    shared_ptr<Simulator> vehicle = make_shared<Simulator>(
+        make_vehicle_archetype(desc), location, Quaternionf::Identity(),
+        Vector3f::Zero(), Vector3f::Zero());
+    Subject subject;
+    subject.name = name;
+    subject.snapshot_size = Simulator::snapshot_size();
+    subject.save = [vehicle](void* buffer) { vehicle->save_snapshot(buffer); };
+    subject.restore = [vehicle](const void* buffer) {
+        return vehicle->restore_snapshot(buffer);
+    };
+    subject.step = [vehicle]() {
+        // in the air
+        Vector3f* hits[VEHICLE_MAX_WHEELS] = {};
+        vehicle->apply(hits, SNAPSHOT_TEST_DELTA_TIME);
+    };
+    subject.body_location = [vehicle]() {
+        return vehicle->get_body_location();
+    };
+    return subject;
+}
+
+static int check_capacity() {
+    VehicleArchetypeDesc four;
+    VehicleArchetypeDesc six;
+    const Vector3f axles[] = {Vector3f(150.f, 100.f, -50.f),
+                              Vector3f(0.f, 100.f, -50.f),
+                              Vector3f(-150.f, 100.f, -50.f)};
+    six.set_axles(axles, 3);
+
+    vector<Subject> subjects;
+    subjects.push_back(make_subject<Vehicle4WSimulator>(
+        "4w", four, Vector3f(0.f, 0.f, 100.f)));
+    subjects.push_back(make_subject<Vehicle6WSimulator>(
+        "6w", six, Vector3f(0.f, 0.f, 200.f)));
+    subjects.push_back(make_subject<VehicleNWSimulator>(
+        "nw with 4 wheels", four, Vector3f(0.f, 0.f, 300.f)));
+    subjects.push_back(make_subject<VehicleNWSimulator>(
+        "nw with 6 wheels", six, Vector3f(0.f, 0.f, 400.f)));
+
+    vector<vector<unsigned char>> snapshots;
+    vector<Vector3f> saved;
+    for (size_t k = 0; k < subjects.size(); k++) {
+        snapshots.push_back(vector<unsigned char>(subjects[k].snapshot_size));
+        subjects[k].save(snapshots[k].data());
+        saved.push_back(subjects[k].body_location());
+    }
+
+    int failures = 0;
+    for (size_t j = 0; j < subjects.size(); j++) {
+        for (size_t k = 0; k < subjects.size(); k++) {
+            Subject& reader = subjects[j];
+            for (int f = 0; f < SNAPSHOT_TEST_FRAMES; f++) {
+                reader.step();
+            }
+            Vector3f before = reader.body_location();
+            bool restored = reader.restore(snapshots[k].data());
+            Vector3f expected = j == k ? saved[k] : before;
+            if (restored != (j == k) ||
+                reader.body_location() != expected) {
+                printf("%s %s the snapshot of %s\n", reader.name.c_str(),
+                       restored ? "took" : "refused",
+                       subjects[k].name.c_str());
+                failures++;
+            }
+        }
+    }
+    if (failures)
+        return 1;
+    printf("%zu restores across %zu simulators ok\n",
+           subjects.size() * subjects.size(), subjects.size());
+    return 0;
+}
+
+static void step_in_air(Vehicle4WSimulator& vehicle) {
+    Vector3f* hits[4] = {};
+    vehicle.apply(hits, SNAPSHOT_TEST_DELTA_TIME);
+}
+
+static int check_rollback() {
+    VehicleArchetypeDesc desc;
+    shared_ptr<const VehicleArchetype> archetype =
+        make_vehicle_archetype(desc);
+    desc.body_mass *= 2.f;
+    shared_ptr<const VehicleArchetype> heavy = make_vehicle_archetype(desc);
+    Vehicle4WSimulator vehicle(archetype, Vector3f(0.f, 0.f, 100.f),
+                               Quaternionf::Identity(), Vector3f::Zero(),
+                               Vector3f::Zero());
+    Vehicle4WSimulator other(heavy, Vector3f(0.f, 0.f, 200.f),
+                             Quaternionf::Identity(), Vector3f::Zero(),
+                             Vector3f::Zero());
+
+    int failures = 0;
+    SnapshotRing ring(Vehicle4WSimulator::snapshot_size(),
+                      ROLLBACK_TEST_FRAMES);
+    for (int f = 0; f < ROLLBACK_TEST_FRAMES; f++) {
+        vehicle.save_snapshot(ring.push(f));
+        step_in_air(vehicle);
+    }
+    Vector3f last = vehicle.get_body_location();
+    size_t allocations = 0;
+    for (int round = 0; round < ROLLBACK_TEST_ROUNDS; round++) {
+        size_t start = allocation_count;
+        bool restored = vehicle.restore_snapshot(ring.find(0));
+        allocations += allocation_count - start;
+        if (!restored) {
+            printf("rollback refused its own snapshot\n");
+            return 1;
+        }
+        for (int f = 0; f < ROLLBACK_TEST_FRAMES; f++) {
+            step_in_air(vehicle);
+        }
+    }
+    if (allocations) {
+        printf("%zu allocations in %d rollbacks\n", allocations,
+               ROLLBACK_TEST_ROUNDS);
+        failures++;
+    }
+    if (vehicle.get_body_location() != last) {
+        printf("re-simulated frames diverged\n");
+        failures++;
+    }
+
+    vector<unsigned char> snapshot(Vehicle4WSimulator::snapshot_size());
+    other.save_snapshot(snapshot.data());
+    if (vehicle.restore_snapshot(snapshot.data()) ||
+        vehicle.get_body_location() != last) {
+        printf("took the snapshot of another archetype\n");
+        failures++;
+    }
+    vehicle.set_archetype(heavy);
+    if (!vehicle.restore_snapshot(snapshot.data()) ||
+        vehicle.get_body_location() != other.get_body_location()) {
+        printf("refused the snapshot after rebinding to its archetype\n");
+        failures++;
+    }
+    if (failures)
+        return 1;
+    printf("%d rollbacks of %d frames ok\n", ROLLBACK_TEST_ROUNDS,
+           ROLLBACK_TEST_FRAMES);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && !strcmp(argv[1], "capacity"))
+        return check_capacity();
+    if (argc == 2 && !strcmp(argv[1], "rollback"))
+        return check_rollback();
+    fprintf(stderr,
+            "usage: snapshot_test capacity\n"
+            "       snapshot_test rollback\n");
+    return 1;
+}